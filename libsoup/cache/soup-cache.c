@@ -43,6 +43,7 @@
 #include "soup.h"
 #include "soup-message-metrics-private.h"
 #include "soup-misc.h"
+#include "soup-profiler.h"
 #include "soup-session-private.h"
 #include "soup-session-feature-private.h"
 
@@ -1122,20 +1123,8 @@ soup_cache_new (const char *cache_dir, SoupCacheType cache_type)
 			     NULL);
 }
 
-/**
- * soup_cache_has_response:
- * @cache: a #SoupCache
- * @msg: a #SoupMessage
- *
- * This function calculates whether the @cache object has a proper
- * response for the request @msg given the flags both in the request
- * and the cached reply and the time ellapsed since it was cached.
- *
- * Returns: whether or not the @cache has a valid response for @msg
- *
- */
-SoupCacheResponse
-soup_cache_has_response (SoupCache *cache, SoupMessage *msg)
+static SoupCacheResponse
+lookup_response (SoupCache *cache, SoupMessage *msg)
 {
 	SoupCachePrivate *priv = soup_cache_get_instance_private (cache);
 	SoupCacheEntry *entry;
@@ -1288,6 +1277,42 @@ soup_cache_has_response (SoupCache *cache, SoupMessage *msg)
 	return SOUP_CACHE_RESPONSE_FRESH;
 }
 
+/**
+ * soup_cache_has_response:
+ * @cache: a #SoupCache
+ * @msg: a #SoupMessage
+ *
+ * This function calculates whether the @cache object has a proper
+ * response for the request @msg given the flags both in the request
+ * and the cached reply and the time ellapsed since it was cached.
+ *
+ * Returns: whether or not the @cache has a valid response for @msg
+ *
+ */
+SoupCacheResponse
+soup_cache_has_response (SoupCache *cache, SoupMessage *msg)
+{
+        SoupCacheResponse response;
+        gint64 begin_time;
+
+        begin_time = soup_profiler_get_time ();
+        response = lookup_response (cache, msg);
+
+        soup_profiler_counter_add (response == SOUP_CACHE_RESPONSE_FRESH ?
+                                   SOUP_PROFILER_COUNTER_CACHE_HITS :
+                                   SOUP_PROFILER_COUNTER_CACHE_MISSES, 1);
+        if (soup_profiler_is_active ()) {
+                static const char *results[] = { "fresh", "needs validation", "stale" };
+                GUri *uri = soup_message_get_uri (msg);
+
+                soup_profiler_mark (begin_time, "Cache lookup", "%s%s: %s",
+                                    g_uri_get_host (uri), g_uri_get_path (uri),
+                                    results[response]);
+        }
+
+        return response;
+}
+
 /**
  * soup_cache_get_cacheability:
  * @cache: a #SoupCache
@@ -0,0 +1,538 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-content-decoder-stream.c
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "soup-content-decoder-stream.h"
+
+/* A single stream running all the content codings of a message body.
+ *
+ * Chaining one GConverterInputStream per coding means one stream object,
+ * one growing buffer and one extra copy per coding. Here every coding is
+ * a stage of the same read loop: the input of the first stage is read
+ * from the base stream into a pooled buffer, every stage decodes into
+ * the input buffer of the next one and the last stage decodes directly
+ * into the caller's buffer. Converters that can't make progress in the
+ * space given (G_IO_ERROR_NO_SPACE) get a bigger buffer instead: the
+ * next stage's input buffer grows, and reads smaller than one decoded
+ * unit are served from an output buffer.
+ */
+
+#define BUFFER_SIZE (32 * 1024)
+#define MAX_POOLED_BUFFERS 16
+
+typedef struct {
+        guint8 *data;
+        gsize size;
+        gsize start;
+        gsize end;
+} SoupDecoderBuffer;
+
+typedef struct {
+        GConverter *converter;
+        SoupDecoderBuffer input;
+        gboolean finished;
+} SoupDecoderStage;
+
+struct _SoupContentDecoderStream {
+        GFilterInputStream parent_instance;
+};
+
+typedef struct {
+        SoupDecoderStage *stages;
+        guint n_stages;
+        SoupDecoderBuffer output;
+        gboolean base_eof;
+        gboolean need_input;
+} SoupContentDecoderStreamPrivate;
+
+static void soup_content_decoder_stream_pollable_init (GPollableInputStreamInterface *pollable_interface, gpointer interface_data);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (SoupContentDecoderStream, soup_content_decoder_stream, G_TYPE_FILTER_INPUT_STREAM,
+                               G_ADD_PRIVATE (SoupContentDecoderStream)
+                               G_IMPLEMENT_INTERFACE (G_TYPE_POLLABLE_INPUT_STREAM,
+                                                      soup_content_decoder_stream_pollable_init))
+
+/* Buffers are recycled across messages (and threads) so that decoding a
+ * response doesn't allocate once the pool is warm.
+ */
+static GMutex buffer_pool_mutex;
+static guint8 *buffer_pool[MAX_POOLED_BUFFERS];
+static guint buffer_pool_length;
+
+static guint8 *
+buffer_pool_acquire (void)
+{
+        guint8 *data = NULL;
+
+        g_mutex_lock (&buffer_pool_mutex);
+        if (buffer_pool_length > 0)
+                data = buffer_pool[--buffer_pool_length];
+        g_mutex_unlock (&buffer_pool_mutex);
+
+        return data ? data : g_malloc (BUFFER_SIZE);
+}
+
+static void
+buffer_pool_release (guint8 *data)
+{
+        g_mutex_lock (&buffer_pool_mutex);
+        if (buffer_pool_length < MAX_POOLED_BUFFERS) {
+                buffer_pool[buffer_pool_length++] = data;
+                data = NULL;
+        }
+        g_mutex_unlock (&buffer_pool_mutex);
+
+        g_free (data);
+}
+
+static void
+decoder_buffer_clear (SoupDecoderBuffer *buffer)
+{
+        if (!buffer->data)
+                return;
+
+        if (buffer->size == BUFFER_SIZE)
+                buffer_pool_release (buffer->data);
+        else
+                g_free (buffer->data);
+        memset (buffer, 0, sizeof (SoupDecoderBuffer));
+}
+
+static inline gsize
+decoder_buffer_get_length (SoupDecoderBuffer *buffer)
+{
+        return buffer->end - buffer->start;
+}
+
+static void
+decoder_buffer_grow (SoupDecoderBuffer *buffer)
+{
+        gsize new_size = buffer->size * 2;
+        guint8 *data = g_malloc (new_size);
+
+        memcpy (data, buffer->data + buffer->start, decoder_buffer_get_length (buffer));
+        buffer->end -= buffer->start;
+        buffer->start = 0;
+        if (buffer->size == BUFFER_SIZE)
+                buffer_pool_release (buffer->data);
+        else
+                g_free (buffer->data);
+        buffer->data = data;
+        buffer->size = new_size;
+}
+
+static guint8 *
+decoder_buffer_prepare (SoupDecoderBuffer *buffer,
+                        gsize             *space)
+{
+        if (!buffer->data) {
+                buffer->data = buffer_pool_acquire ();
+                buffer->size = BUFFER_SIZE;
+                buffer->start = buffer->end = 0;
+        } else if (buffer->start == buffer->end) {
+                buffer->start = buffer->end = 0;
+        } else if (buffer->start > 0) {
+                memmove (buffer->data, buffer->data + buffer->start, buffer->end - buffer->start);
+                buffer->end -= buffer->start;
+                buffer->start = 0;
+        }
+
+        /* The converter needs more than a whole buffer of input
+         * to make progress, so grow it (out of the pool).
+         */
+        if (buffer->end == buffer->size)
+                decoder_buffer_grow (buffer);
+
+        *space = buffer->size - buffer->end;
+        return buffer->data + buffer->end;
+}
+
+static gssize decode_stage (SoupContentDecoderStream *stream,
+                            guint                     index,
+                            guint8                   *outbuf,
+                            gsize                     outbuf_size,
+                            gboolean                  blocking,
+                            GCancellable             *cancellable,
+                            GError                  **error);
+
+static gboolean
+stage_input_at_end (SoupContentDecoderStreamPrivate *priv,
+                    guint                            index)
+{
+        return index == 0 ? priv->base_eof : priv->stages[index - 1].finished;
+}
+
+static gboolean
+fill_stage_input (SoupContentDecoderStream *stream,
+                  guint                     index,
+                  gboolean                  blocking,
+                  GCancellable             *cancellable,
+                  GError                  **error)
+{
+        SoupContentDecoderStreamPrivate *priv = soup_content_decoder_stream_get_instance_private (stream);
+        SoupDecoderBuffer *input = &priv->stages[index].input;
+        guint8 *dest;
+        gsize space;
+        gssize nread;
+
+        dest = decoder_buffer_prepare (input, &space);
+        if (index == 0) {
+                GError *my_error = NULL;
+
+                nread = g_pollable_stream_read (G_FILTER_INPUT_STREAM (stream)->base_stream,
+                                                dest, space, blocking,
+                                                cancellable, &my_error);
+                if (nread == 0)
+                        priv->base_eof = TRUE;
+                else if (nread < 0) {
+                        if (g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+                                priv->need_input = TRUE;
+                        g_propagate_error (error, my_error);
+                }
+        } else {
+                GError *my_error = NULL;
+
+                nread = decode_stage (stream, index - 1, dest, space,
+                                      blocking, cancellable, &my_error);
+                while (nread < 0 && g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+                        g_clear_error (&my_error);
+                        decoder_buffer_grow (input);
+                        dest = decoder_buffer_prepare (input, &space);
+                        nread = decode_stage (stream, index - 1, dest, space,
+                                              blocking, cancellable, &my_error);
+                }
+                if (nread < 0)
+                        g_propagate_error (error, my_error);
+        }
+
+        if (nread < 0)
+                return FALSE;
+
+        input->end += nread;
+        return TRUE;
+}
+
+static gssize
+decode_stage (SoupContentDecoderStream *stream,
+              guint                     index,
+              guint8                   *outbuf,
+              gsize                     outbuf_size,
+              gboolean                  blocking,
+              GCancellable             *cancellable,
+              GError                  **error)
+{
+        SoupContentDecoderStreamPrivate *priv = soup_content_decoder_stream_get_instance_private (stream);
+        SoupDecoderStage *stage = &priv->stages[index];
+        SoupDecoderBuffer *input = &stage->input;
+
+        while (!stage->finished) {
+                GConverterResult result;
+                gsize bytes_read, bytes_written;
+                gboolean at_end = stage_input_at_end (priv, index);
+                GError *my_error = NULL;
+
+                if (!at_end && decoder_buffer_get_length (input) == 0) {
+                        if (!fill_stage_input (stream, index, blocking, cancellable, error))
+                                return -1;
+                        continue;
+                }
+
+                result = g_converter_convert (stage->converter,
+                                              input->data ? input->data + input->start : (const guint8 *)"",
+                                              decoder_buffer_get_length (input),
+                                              outbuf, outbuf_size,
+                                              at_end ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+                                              &bytes_read, &bytes_written, &my_error);
+                if (result == G_CONVERTER_ERROR) {
+                        if (!at_end && g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT)) {
+                                g_error_free (my_error);
+                                if (!fill_stage_input (stream, index, blocking, cancellable, error))
+                                        return -1;
+                                continue;
+                        }
+
+                        g_propagate_error (error, my_error);
+                        return -1;
+                }
+
+                input->start += bytes_read;
+
+                if (result == G_CONVERTER_FINISHED) {
+                        stage->finished = TRUE;
+                        decoder_buffer_clear (input);
+                        return bytes_written;
+                }
+
+                if (bytes_written > 0)
+                        return bytes_written;
+
+                if (bytes_read == 0) {
+                        if (at_end) {
+                                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                                                     "Unexpected end of encoded data");
+                                return -1;
+                        }
+
+                        if (!fill_stage_input (stream, index, blocking, cancellable, error))
+                                return -1;
+                }
+        }
+
+        return 0;
+}
+
+static gssize
+read_internal (GInputStream  *stream,
+               void          *buffer,
+               gsize          count,
+               gboolean       blocking,
+               GCancellable  *cancellable,
+               GError       **error)
+{
+        SoupContentDecoderStream *decoder_stream = SOUP_CONTENT_DECODER_STREAM (stream);
+        SoupContentDecoderStreamPrivate *priv = soup_content_decoder_stream_get_instance_private (decoder_stream);
+        SoupDecoderBuffer *output = &priv->output;
+        GError *my_error = NULL;
+        guint8 *dest;
+        gsize space;
+        gssize nread;
+
+        if (count == 0)
+                return 0;
+
+        if (decoder_buffer_get_length (output) == 0) {
+                priv->need_input = FALSE;
+                nread = decode_stage (decoder_stream, priv->n_stages - 1, buffer, count,
+                                      blocking, cancellable, &my_error);
+                if (nread >= 0 || !g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+                        if (nread < 0)
+                                g_propagate_error (error, my_error);
+                        return nread;
+                }
+
+                /* @buffer is smaller than a decoded unit: decode into the
+                 * output buffer and return it in pieces.
+                 */
+                dest = decoder_buffer_prepare (output, &space);
+                while (TRUE) {
+                        g_clear_error (&my_error);
+                        nread = decode_stage (decoder_stream, priv->n_stages - 1, dest, space,
+                                              blocking, cancellable, &my_error);
+                        if (nread >= 0 || !g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_NO_SPACE))
+                                break;
+
+                        decoder_buffer_grow (output);
+                        dest = decoder_buffer_prepare (output, &space);
+                }
+
+                if (nread <= 0) {
+                        if (nread < 0)
+                                g_propagate_error (error, my_error);
+                        return nread;
+                }
+                output->end += nread;
+        }
+
+        nread = MIN (count, decoder_buffer_get_length (output));
+        memcpy (buffer, output->data + output->start, nread);
+        output->start += nread;
+
+        return nread;
+}
+
+static gssize
+soup_content_decoder_stream_read (GInputStream  *stream,
+                                  void          *buffer,
+                                  gsize          count,
+                                  GCancellable  *cancellable,
+                                  GError       **error)
+{
+        return read_internal (stream, buffer, count, TRUE, cancellable, error);
+}
+
+static gssize
+soup_content_decoder_stream_skip (GInputStream  *stream,
+                                  gsize          count,
+                                  GCancellable  *cancellable,
+                                  GError       **error)
+{
+        guint8 buffer[8192];
+
+        /* GFilterInputStream would skip the encoded data */
+        return read_internal (stream, buffer, MIN (count, sizeof (buffer)), TRUE,
+                              cancellable, error);
+}
+
+static void
+soup_content_decoder_stream_clear_buffers (SoupContentDecoderStream *stream)
+{
+        SoupContentDecoderStreamPrivate *priv = soup_content_decoder_stream_get_instance_private (stream);
+        guint i;
+
+        for (i = 0; i < priv->n_stages; i++)
+                decoder_buffer_clear (&priv->stages[i].input);
+        decoder_buffer_clear (&priv->output);
+}
+
+static gboolean
+soup_content_decoder_stream_close (GInputStream  *stream,
+                                   GCancellable  *cancellable,
+                                   GError       **error)
+{
+        soup_content_decoder_stream_clear_buffers (SOUP_CONTENT_DECODER_STREAM (stream));
+
+        return G_INPUT_STREAM_CLASS (soup_content_decoder_stream_parent_class)->close_fn (stream, cancellable, error);
+}
+
+static gboolean
+soup_content_decoder_stream_can_poll (GPollableInputStream *pollable)
+{
+        GInputStream *base_stream = G_FILTER_INPUT_STREAM (pollable)->base_stream;
+
+        return G_IS_POLLABLE_INPUT_STREAM (base_stream) &&
+                g_pollable_input_stream_can_poll (G_POLLABLE_INPUT_STREAM (base_stream));
+}
+
+static gboolean
+soup_content_decoder_stream_has_pending_data (SoupContentDecoderStream *stream)
+{
+        SoupContentDecoderStreamPrivate *priv = soup_content_decoder_stream_get_instance_private (stream);
+        guint i;
+
+        if (decoder_buffer_get_length (&priv->output) > 0)
+                return TRUE;
+
+        if (priv->need_input)
+                return FALSE;
+
+        if (priv->base_eof)
+                return TRUE;
+
+        for (i = 0; i < priv->n_stages; i++) {
+                if (decoder_buffer_get_length (&priv->stages[i].input) > 0)
+                        return TRUE;
+        }
+
+        return FALSE;
+}
+
+static gboolean
+soup_content_decoder_stream_is_readable (GPollableInputStream *stream)
+{
+        if (soup_content_decoder_stream_has_pending_data (SOUP_CONTENT_DECODER_STREAM (stream)))
+                return TRUE;
+
+        return g_pollable_input_stream_is_readable (G_POLLABLE_INPUT_STREAM (G_FILTER_INPUT_STREAM (stream)->base_stream));
+}
+
+static gssize
+soup_content_decoder_stream_read_nonblocking (GPollableInputStream  *stream,
+                                              void                  *buffer,
+                                              gsize                  count,
+                                              GError               **error)
+{
+        return read_internal (G_INPUT_STREAM (stream), buffer, count,
+                              FALSE, NULL, error);
+}
+
+static GSource *
+soup_content_decoder_stream_create_source (GPollableInputStream *stream,
+                                           GCancellable         *cancellable)
+{
+        GSource *base_source, *pollable_source;
+
+        if (soup_content_decoder_stream_has_pending_data (SOUP_CONTENT_DECODER_STREAM (stream)))
+                base_source = g_timeout_source_new (0);
+        else
+                base_source = g_pollable_input_stream_create_source (G_POLLABLE_INPUT_STREAM (G_FILTER_INPUT_STREAM (stream)->base_stream), cancellable);
+
+        g_source_set_dummy_callback (base_source);
+        pollable_source = g_pollable_source_new (G_OBJECT (stream));
+        g_source_add_child_source (pollable_source, base_source);
+        g_source_unref (base_source);
+
+        return pollable_source;
+}
+
+static void
+soup_content_decoder_stream_finalize (GObject *object)
+{
+        SoupContentDecoderStream *stream = SOUP_CONTENT_DECODER_STREAM (object);
+        SoupContentDecoderStreamPrivate *priv = soup_content_decoder_stream_get_instance_private (stream);
+        guint i;
+
+        soup_content_decoder_stream_clear_buffers (stream);
+        for (i = 0; i < priv->n_stages; i++)
+                g_object_unref (priv->stages[i].converter);
+        g_free (priv->stages);
+
+        G_OBJECT_CLASS (soup_content_decoder_stream_parent_class)->finalize (object);
+}
+
+static void
+soup_content_decoder_stream_init (SoupContentDecoderStream *stream)
+{
+}
+
+static void
+soup_content_decoder_stream_class_init (SoupContentDecoderStreamClass *stream_class)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (stream_class);
+        GInputStreamClass *input_stream_class = G_INPUT_STREAM_CLASS (stream_class);
+
+        object_class->finalize = soup_content_decoder_stream_finalize;
+
+        input_stream_class->read_fn = soup_content_decoder_stream_read;
+        input_stream_class->skip = soup_content_decoder_stream_skip;
+        input_stream_class->close_fn = soup_content_decoder_stream_close;
+}
+
+static void
+soup_content_decoder_stream_pollable_init (GPollableInputStreamInterface *pollable_interface,
+                                           gpointer                       interface_data)
+{
+        pollable_interface->can_poll = soup_content_decoder_stream_can_poll;
+        pollable_interface->is_readable = soup_content_decoder_stream_is_readable;
+        pollable_interface->read_nonblocking = soup_content_decoder_stream_read_nonblocking;
+        pollable_interface->create_source = soup_content_decoder_stream_create_source;
+}
+
+/**
+ * soup_content_decoder_stream_new:
+ * @base_stream: the encoded body stream
+ * @converters: (element-type GConverter): the decoders, in the order they
+ *   must be applied
+ *
+ * Returns: (transfer full): a new #GInputStream returning the decoded body
+ */
+GInputStream *
+soup_content_decoder_stream_new (GInputStream *base_stream,
+                                 GSList       *converters)
+{
+        SoupContentDecoderStream *stream;
+        SoupContentDecoderStreamPrivate *priv;
+        GSList *c;
+        guint i;
+
+        g_return_val_if_fail (converters != NULL, NULL);
+
+        stream = g_object_new (SOUP_TYPE_CONTENT_DECODER_STREAM,
+                               "base-stream", base_stream,
+                               NULL);
+        priv = soup_content_decoder_stream_get_instance_private (stream);
+        priv->n_stages = g_slist_length (converters);
+        priv->stages = g_new0 (SoupDecoderStage, priv->n_stages);
+        for (c = converters, i = 0; c; c = c->next, i++)
+                priv->stages[i].converter = g_object_ref (c->data);
+
+        return G_INPUT_STREAM (stream);
+}
@@ -0,0 +1,18 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-types.h"
+
+G_BEGIN_DECLS
+
+#define SOUP_TYPE_CONTENT_DECODER_STREAM (soup_content_decoder_stream_get_type ())
+G_DECLARE_FINAL_TYPE (SoupContentDecoderStream, soup_content_decoder_stream, SOUP, CONTENT_DECODER_STREAM, GFilterInputStream)
+
+GInputStream *soup_content_decoder_stream_new (GInputStream *base_stream,
+                                               GSList       *converters);
+
+G_END_DECLS
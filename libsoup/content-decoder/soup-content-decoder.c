@@ -10,6 +10,7 @@
 #endif
 
 #include "soup-content-decoder.h"
+#include "soup-content-decoder-stream.h"
 #include "soup-converter-wrapper.h"
 #include "soup-session-feature-private.h"
 #include "soup-message-private.h"
@@ -19,6 +20,9 @@
 #ifdef WITH_BROTLI
 #include "soup-brotli-decompressor.h"
 #endif
+#ifdef WITH_ZSTD
+#include "soup-zstd-decompressor.h"
+#endif
 
 /**
  * SoupContentDecoder:
@@ -27,8 +31,10 @@
  *
  * #SoupContentDecoder handles adding the "Accept-Encoding" header on
  * outgoing messages, and processing the "Content-Encoding" header on
- * incoming ones. Currently it supports the "gzip", "deflate", and "br"
- * content codings.
+ * incoming ones. Currently it supports the "gzip", "deflate", "br" and
+ * "zstd" content codings. Frames of "zstd" encoded responses compressed
+ * with a custom dictionary can be decoded after setting it with
+ * [method@ContentDecoder.set_zstd_dictionary].
  *
  * A #SoupContentDecoder will automatically be
  * added to the session by default. (You can use
@@ -55,9 +61,10 @@ struct _SoupContentDecoder {
 
 typedef struct {
 	GHashTable *decoders;
+	GBytes *zstd_dictionary;
 } SoupContentDecoderPrivate;
 
-typedef GConverter * (*SoupContentDecoderCreator) (void);
+typedef GConverter * (*SoupContentDecoderCreator) (SoupContentDecoder *decoder);
 
 static void soup_content_decoder_session_feature_init (SoupSessionFeatureInterface *feature_interface, gpointer interface_data);
 
@@ -113,7 +120,7 @@ soup_content_decoder_get_decoders_for_msg (SoupContentDecoder *decoder, SoupMess
 
 	for (e = encodings; e; e = e->next) {
 		converter_creator = g_hash_table_lookup (priv->decoders, e->data);
-		converter = converter_creator ();
+		converter = converter_creator (decoder);
 
 		/* Content-Encoding lists the codings in the order
 		 * they were applied in, so we put decoders in reverse
@@ -140,22 +147,15 @@ soup_content_decoder_content_processor_wrap_input (SoupContentProcessor *process
 	if (!decoders)
 		return NULL;
 
-	istream = g_object_ref (base_stream);
+	/* All the codings are decoded by a single stream */
 	for (d = decoders; d; d = d->next) {
-		GConverter *decoder, *wrapper;
-		GInputStream *filter;
-
-		decoder = d->data;
-		wrapper = soup_converter_wrapper_new (decoder, msg);
-		filter = g_object_new (G_TYPE_CONVERTER_INPUT_STREAM,
-				       "base-stream", istream,
-				       "converter", wrapper,
-				       NULL);
-		g_object_unref (istream);
-		g_object_unref (wrapper);
-		istream = filter;
+		GConverter *decoder = d->data;
+
+		d->data = soup_converter_wrapper_new (decoder, msg);
+		g_object_unref (decoder);
 	}
 
+	istream = soup_content_decoder_stream_new (base_stream, decoders);
 	g_slist_free_full (decoders, g_object_unref);
 
 	return istream;
@@ -173,25 +173,35 @@ soup_content_decoder_content_processor_init (SoupContentProcessorInterface *proc
 }
 
 static GConverter *
-gzip_decoder_creator (void)
+gzip_decoder_creator (SoupContentDecoder *decoder)
 {
 	return (GConverter *)g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
 }
 
 static GConverter *
-zlib_decoder_creator (void)
+zlib_decoder_creator (SoupContentDecoder *decoder)
 {
 	return (GConverter *)g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_ZLIB);
 }
 
 #ifdef WITH_BROTLI
 static GConverter *
-brotli_decoder_creator (void)
+brotli_decoder_creator (SoupContentDecoder *decoder)
 {
 	return (GConverter *)soup_brotli_decompressor_new ();
 }
 #endif
 
+#ifdef WITH_ZSTD
+static GConverter *
+zstd_decoder_creator (SoupContentDecoder *decoder)
+{
+        SoupContentDecoderPrivate *priv = soup_content_decoder_get_instance_private (decoder);
+
+	return (GConverter *)soup_zstd_decompressor_new (priv->zstd_dictionary);
+}
+#endif
+
 static void
 soup_content_decoder_init (SoupContentDecoder *decoder)
 {
@@ -209,6 +219,10 @@ soup_content_decoder_init (SoupContentDecoder *decoder)
 	g_hash_table_insert (priv->decoders, "br",
 			     brotli_decoder_creator);
 #endif
+#ifdef WITH_ZSTD
+	g_hash_table_insert (priv->decoders, "zstd",
+			     zstd_decoder_creator);
+#endif
 }
 
 static void
@@ -218,6 +232,7 @@ soup_content_decoder_finalize (GObject *object)
         SoupContentDecoderPrivate *priv = soup_content_decoder_get_instance_private (decoder);
 
 	g_hash_table_destroy (priv->decoders);
+	g_clear_pointer (&priv->zstd_dictionary, g_bytes_unref);
 
 	G_OBJECT_CLASS (soup_content_decoder_parent_class)->finalize (object);
 }
@@ -238,21 +253,57 @@ soup_content_decoder_request_queued (SoupSessionFeature *feature,
                                                   SOUP_HEADER_ACCEPT_ENCODING)) {
                 const char *header = "gzip, deflate";
 
-#ifdef WITH_BROTLI
-                /* brotli is only enabled over TLS connections
+                /* brotli and zstd are only enabled over TLS connections
                  * as other browsers have found that some networks have expectations
                  * regarding the encoding of HTTP messages and this may break those
                  * expectations. Firefox and Chromium behave similarly.
                  */
-                if (soup_uri_is_https (soup_message_get_uri (msg)))
+                if (soup_uri_is_https (soup_message_get_uri (msg))) {
+#if defined(WITH_BROTLI) && defined(WITH_ZSTD)
+                        header = "gzip, deflate, br, zstd";
+#elif defined(WITH_BROTLI)
                         header = "gzip, deflate, br";
+#elif defined(WITH_ZSTD)
+                        header = "gzip, deflate, zstd";
 #endif
+                }
 
 		soup_message_headers_append_common (soup_message_get_request_headers (msg),
                                                     SOUP_HEADER_ACCEPT_ENCODING, header);
 	}
 }
 
+/**
+ * soup_content_decoder_set_zstd_dictionary:
+ * @decoder: a #SoupContentDecoder
+ * @dictionary: (nullable): a Zstandard dictionary, or %NULL
+ *
+ * Sets the dictionary used to decode responses with a "zstd"
+ * Content-Encoding. Responses compressed without a dictionary are still
+ * decoded normally. The dictionary can either be one produced by `zstd
+ * --train` or raw content.
+ *
+ * This has no effect if libsoup was built without Zstandard support.
+ *
+ * Since: 3.4
+ */
+void
+soup_content_decoder_set_zstd_dictionary (SoupContentDecoder *decoder,
+                                          GBytes             *dictionary)
+{
+        SoupContentDecoderPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_CONTENT_DECODER (decoder));
+
+        priv = soup_content_decoder_get_instance_private (decoder);
+        if (priv->zstd_dictionary == dictionary)
+                return;
+
+        g_clear_pointer (&priv->zstd_dictionary, g_bytes_unref);
+        if (dictionary)
+                priv->zstd_dictionary = g_bytes_ref (dictionary);
+}
+
 static void
 soup_content_decoder_session_feature_init (SoupSessionFeatureInterface *feature_interface,
 					   gpointer interface_data)
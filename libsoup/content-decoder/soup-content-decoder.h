@@ -14,4 +14,8 @@ G_BEGIN_DECLS
 SOUP_AVAILABLE_IN_ALL
 G_DECLARE_FINAL_TYPE (SoupContentDecoder, soup_content_decoder, SOUP, CONTENT_DECODER, GObject)
 
+SOUP_AVAILABLE_IN_3_4
+void soup_content_decoder_set_zstd_dictionary (SoupContentDecoder *decoder,
+                                               GBytes             *dictionary);
+
 G_END_DECLS
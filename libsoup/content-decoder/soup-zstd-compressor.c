@@ -0,0 +1,147 @@
+/* soup-zstd-compressor.c
+ *
+ * Copyright 2026 The libsoup authors
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <zstd.h>
+#include <gio/gio.h>
+
+#include "soup-zstd-compressor.h"
+
+struct _SoupZstdCompressor
+{
+	GObject parent_instance;
+	ZSTD_CCtx *cctx;
+	int level;
+};
+
+static void soup_zstd_compressor_iface_init (GConverterIface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (SoupZstdCompressor, soup_zstd_compressor, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER, soup_zstd_compressor_iface_init))
+
+/* Levels up to 19 keep the window within the 8 MB that RFC 8878
+ * requires "zstd" content coding decoders to support.
+ */
+SoupZstdCompressor *
+soup_zstd_compressor_new (int level)
+{
+	SoupZstdCompressor *self = g_object_new (SOUP_TYPE_ZSTD_COMPRESSOR, NULL);
+
+	self->level = CLAMP (level, 1, 19);
+
+	return self;
+}
+
+static GConverterResult
+soup_zstd_compressor_convert (GConverter      *converter,
+			      const void      *inbuf,
+			      gsize            inbuf_size,
+			      void            *outbuf,
+			      gsize            outbuf_size,
+			      GConverterFlags  flags,
+			      gsize           *bytes_read,
+			      gsize           *bytes_written,
+			      GError         **error)
+{
+	SoupZstdCompressor *self = SOUP_ZSTD_COMPRESSOR (converter);
+	ZSTD_inBuffer input = { inbuf, inbuf_size, 0 };
+	ZSTD_outBuffer output = { outbuf, outbuf_size, 0 };
+	ZSTD_EndDirective mode;
+	size_t remaining;
+
+	if (self->cctx == NULL) {
+		self->cctx = ZSTD_createCCtx ();
+		if (self->cctx == NULL) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "SoupZstdCompressorError: Failed to initialize state");
+			return G_CONVERTER_ERROR;
+		}
+		ZSTD_CCtx_setParameter (self->cctx, ZSTD_c_compressionLevel, self->level);
+	}
+
+	if (flags & G_CONVERTER_INPUT_AT_END)
+		mode = ZSTD_e_end;
+	else if (flags & G_CONVERTER_FLUSH)
+		mode = ZSTD_e_flush;
+	else
+		mode = ZSTD_e_continue;
+
+	remaining = ZSTD_compressStream2 (self->cctx, &output, &input, mode);
+	if (ZSTD_isError (remaining)) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "SoupZstdCompressorError: %s", ZSTD_getErrorName (remaining));
+		return G_CONVERTER_ERROR;
+	}
+
+	*bytes_read = input.pos;
+	*bytes_written = output.pos;
+
+	/* Once flushing or ending, zstd reports how much is still buffered */
+	if (mode != ZSTD_e_continue && remaining == 0 && input.pos == input.size)
+		return mode == ZSTD_e_end ? G_CONVERTER_FINISHED : G_CONVERTER_FLUSHED;
+
+	if (*bytes_read == 0 && *bytes_written == 0) {
+		if (inbuf_size == 0) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "SoupZstdCompressorError: Need more input");
+			return G_CONVERTER_ERROR;
+		}
+
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "SoupZstdCompressorError: Larger output buffer required");
+		return G_CONVERTER_ERROR;
+	}
+
+	return G_CONVERTER_CONVERTED;
+}
+
+static void
+soup_zstd_compressor_reset (GConverter *converter)
+{
+	SoupZstdCompressor *self = SOUP_ZSTD_COMPRESSOR (converter);
+
+	if (self->cctx)
+		ZSTD_CCtx_reset (self->cctx, ZSTD_reset_session_only);
+}
+
+static void
+soup_zstd_compressor_finalize (GObject *object)
+{
+	SoupZstdCompressor *self = (SoupZstdCompressor *)object;
+	g_clear_pointer (&self->cctx, ZSTD_freeCCtx);
+	G_OBJECT_CLASS (soup_zstd_compressor_parent_class)->finalize (object);
+}
+
+static void soup_zstd_compressor_iface_init (GConverterIface *iface)
+{
+	iface->convert = soup_zstd_compressor_convert;
+	iface->reset = soup_zstd_compressor_reset;
+}
+
+static void
+soup_zstd_compressor_class_init (SoupZstdCompressorClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = soup_zstd_compressor_finalize;
+}
+
+static void
+soup_zstd_compressor_init (SoupZstdCompressor *self)
+{
+}
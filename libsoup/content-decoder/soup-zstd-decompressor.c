@@ -0,0 +1,233 @@
+/* soup-zstd-decompressor.c
+ *
+ * Copyright 2026 The libsoup authors
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <zstd.h>
+#include <zstd_errors.h>
+#include <gio/gio.h>
+
+#include "soup-zstd-decompressor.h"
+
+/* RFC 8878 section 3.1.1.1.2: decoders of the "zstd" content coding
+ * must support a window of at least 8 MB and should refuse larger ones.
+ */
+#define ZSTD_HTTP_WINDOW_LOG_MAX 23
+
+struct _SoupZstdDecompressor
+{
+	GObject parent_instance;
+	ZSTD_DCtx *dctx;
+	GBytes *dictionary;
+	gboolean frame_done;
+	GError *last_error;
+};
+
+static void soup_zstd_decompressor_iface_init (GConverterIface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (SoupZstdDecompressor, soup_zstd_decompressor, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER, soup_zstd_decompressor_iface_init))
+
+/**
+ * soup_zstd_decompressor_new:
+ * @dictionary: (nullable): a Zstandard dictionary, or %NULL
+ *
+ * Creates a converter decoding the "zstd" content coding. If @dictionary
+ * is given, frames that were compressed with it can be decoded; frames
+ * compressed without a dictionary are decoded as usual.
+ *
+ * Returns: a new #SoupZstdDecompressor
+ */
+SoupZstdDecompressor *
+soup_zstd_decompressor_new (GBytes *dictionary)
+{
+	SoupZstdDecompressor *self = g_object_new (SOUP_TYPE_ZSTD_DECOMPRESSOR, NULL);
+
+	if (dictionary)
+		self->dictionary = g_bytes_ref (dictionary);
+
+	return self;
+}
+
+static GError *
+soup_zstd_decompressor_create_error (size_t code)
+{
+	/* NOTE: all error domains/codes must match GZlibDecompressor,
+	 * in particular data that is not zstd at all must fail with
+	 * G_IO_ERROR_INVALID_DATA so that SoupConverterWrapper can
+	 * fall back to passing it through.
+	 */
+	switch (ZSTD_getErrorCode (code)) {
+	case ZSTD_error_prefix_unknown:
+		return g_error_new (G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "SoupZstdDecompressorError: %s", ZSTD_getErrorName (code));
+	default:
+		return g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED, "SoupZstdDecompressorError: %s", ZSTD_getErrorName (code));
+	}
+}
+
+static gboolean
+soup_zstd_decompressor_ensure_context (SoupZstdDecompressor  *self,
+                                       GError               **error)
+{
+	size_t ret;
+
+	if (self->dctx)
+		return TRUE;
+
+	self->dctx = ZSTD_createDCtx ();
+	if (self->dctx == NULL) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "SoupZstdDecompressorError: Failed to initialize state");
+		return FALSE;
+	}
+
+	ret = ZSTD_DCtx_setParameter (self->dctx, ZSTD_d_windowLogMax, ZSTD_HTTP_WINDOW_LOG_MAX);
+	if (!ZSTD_isError (ret) && self->dictionary) {
+		gsize size;
+		gconstpointer data = g_bytes_get_data (self->dictionary, &size);
+
+		ret = ZSTD_DCtx_loadDictionary (self->dctx, data, size);
+	}
+
+	if (ZSTD_isError (ret)) {
+		if (error)
+			*error = soup_zstd_decompressor_create_error (ret);
+		g_clear_pointer (&self->dctx, ZSTD_freeDCtx);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static GConverterResult
+soup_zstd_decompressor_convert (GConverter      *converter,
+				const void      *inbuf,
+				gsize            inbuf_size,
+				void            *outbuf,
+				gsize            outbuf_size,
+				GConverterFlags  flags,
+				gsize           *bytes_read,
+				gsize           *bytes_written,
+				GError         **error)
+{
+	SoupZstdDecompressor *self = SOUP_ZSTD_DECOMPRESSOR (converter);
+	ZSTD_inBuffer input = { inbuf, inbuf_size, 0 };
+	ZSTD_outBuffer output = { outbuf, outbuf_size, 0 };
+	size_t ret;
+
+	if (self->last_error) {
+		if (error)
+			*error = g_steal_pointer (&self->last_error);
+		g_clear_error (&self->last_error);
+		return G_CONVERTER_ERROR;
+	}
+
+	if (!soup_zstd_decompressor_ensure_context (self, error))
+		return G_CONVERTER_ERROR;
+
+	/* A zstd stream may be made of several frames, so reaching the end
+	 * of one only means we are done if there is no more input.
+	 */
+	if (inbuf_size == 0 && self->frame_done) {
+		if (flags & G_CONVERTER_INPUT_AT_END) {
+			*bytes_read = *bytes_written = 0;
+			return G_CONVERTER_FINISHED;
+		}
+
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "SoupZstdDecompressorError: Need more input");
+		return G_CONVERTER_ERROR;
+	}
+
+	ret = ZSTD_decompressStream (self->dctx, &output, &input);
+
+	*bytes_read = input.pos;
+	*bytes_written = output.pos;
+
+	if (ZSTD_isError (ret)) {
+		/* As per API docs: If any data was either produced or consumed, and then an error happens, then only
+		 * the successful conversion is reported and the error is returned on the next call. */
+		if (*bytes_read || *bytes_written) {
+			self->last_error = soup_zstd_decompressor_create_error (ret);
+			return G_CONVERTER_CONVERTED;
+		}
+
+		if (error)
+			*error = soup_zstd_decompressor_create_error (ret);
+		return G_CONVERTER_ERROR;
+	}
+
+	/* ret is 0 once a frame has been completely decoded and flushed */
+	self->frame_done = ret == 0;
+
+	if (*bytes_read || *bytes_written)
+		return G_CONVERTER_CONVERTED;
+
+	if (self->frame_done && (flags & G_CONVERTER_INPUT_AT_END))
+		return G_CONVERTER_FINISHED;
+
+	if (inbuf_size == 0 || (flags & G_CONVERTER_INPUT_AT_END)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "SoupZstdDecompressorError: More input required (corrupt input)");
+		return G_CONVERTER_ERROR;
+	}
+
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "SoupZstdDecompressorError: Larger output buffer required");
+	return G_CONVERTER_ERROR;
+}
+
+static void
+soup_zstd_decompressor_reset (GConverter *converter)
+{
+	SoupZstdDecompressor *self = SOUP_ZSTD_DECOMPRESSOR (converter);
+
+	/* Keeps the loaded dictionary */
+	if (self->dctx)
+		ZSTD_DCtx_reset (self->dctx, ZSTD_reset_session_only);
+	self->frame_done = FALSE;
+	g_clear_error (&self->last_error);
+}
+
+static void
+soup_zstd_decompressor_finalize (GObject *object)
+{
+	SoupZstdDecompressor *self = (SoupZstdDecompressor *)object;
+	g_clear_pointer (&self->dctx, ZSTD_freeDCtx);
+	g_clear_pointer (&self->dictionary, g_bytes_unref);
+	g_clear_error (&self->last_error);
+	G_OBJECT_CLASS (soup_zstd_decompressor_parent_class)->finalize (object);
+}
+
+static void soup_zstd_decompressor_iface_init (GConverterIface *iface)
+{
+	iface->convert = soup_zstd_decompressor_convert;
+	iface->reset = soup_zstd_decompressor_reset;
+}
+
+static void
+soup_zstd_decompressor_class_init (SoupZstdDecompressorClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = soup_zstd_decompressor_finalize;
+}
+
+static void
+soup_zstd_decompressor_init (SoupZstdDecompressor *self)
+{
+}
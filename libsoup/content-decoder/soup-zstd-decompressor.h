@@ -0,0 +1,34 @@
+/* soup-zstd-decompressor.h
+ *
+ * Copyright 2026 The libsoup authors
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include "soup-version.h"
+
+G_BEGIN_DECLS
+
+#define SOUP_TYPE_ZSTD_DECOMPRESSOR (soup_zstd_decompressor_get_type())
+SOUP_AVAILABLE_IN_ALL
+G_DECLARE_FINAL_TYPE (SoupZstdDecompressor, soup_zstd_decompressor, SOUP, ZSTD_DECOMPRESSOR, GObject)
+
+SoupZstdDecompressor *soup_zstd_decompressor_new (GBytes *dictionary);
+
+G_END_DECLS
@@ -58,6 +58,10 @@ soup_content_sniffer_content_processor_wrap_input (SoupContentProcessor *process
 						   SoupMessage *msg,
 						   GError **error)
 {
+	/* Nothing to sniff, don't add a stream layer for nothing */
+	if (!soup_message_has_content_sniffer (msg))
+		return NULL;
+
 	return g_object_new (SOUP_TYPE_CONTENT_SNIFFER_STREAM,
 			     "base-stream", base_stream,
 			     "message", msg,
@@ -88,38 +92,6 @@ typedef struct {
 	const char   *sniffed_type;
 } SoupContentSnifferMediaPattern;
 
-static char*
-sniff_media (SoupContentSniffer *sniffer,
-	     GBytes *buffer,
-	     SoupContentSnifferMediaPattern table[],
-	     int table_length)
-{
-
-        gsize resource_length;
-        const guchar *resource = g_bytes_get_data (buffer, &resource_length);
-        resource_length = MIN (512, resource_length);
-	int i;
-
-	for (i = 0; i < table_length; i++) {
-		SoupContentSnifferMediaPattern *type_row = &(table[i]);
-		guint j;
-
-		if (resource_length < type_row->pattern_length)
-			continue;
-
-		for (j = 0; j < type_row->pattern_length; j++) {
-			if ((type_row->mask[j] & resource[j]) != type_row->pattern[j])
-				break;
-		}
-
-		/* This means our comparison above matched completely */
-		if (j == type_row->pattern_length)
-			return g_strdup (type_row->sniffed_type);
-	}
-
-	return NULL;
-}
-
 /* This table is based on the MIMESNIFF spec;
  * See 6.1 Matching an image type pattern
  */
@@ -173,14 +145,6 @@ static SoupContentSnifferMediaPattern image_types_table[] = {
 	  "image/jpeg" },
 };
 
-static char*
-sniff_images (SoupContentSniffer *sniffer, GBytes *buffer)
-{
-	return sniff_media (sniffer,
-			    buffer,
-			    image_types_table,
-			    G_N_ELEMENTS (image_types_table));
-}
 
 /* This table is based on the MIMESNIFF spec;
  * See 6.2 Matching an audio or video type pattern
@@ -261,24 +225,6 @@ sniff_mp4 (SoupContentSniffer *sniffer, GBytes *buffer)
 	return FALSE;
 }
 
-static char*
-sniff_audio_video (SoupContentSniffer *sniffer, GBytes *buffer)
-{
-	char *sniffed_type;
-
-	sniffed_type = sniff_media (sniffer,
-				    buffer,
-				    audio_video_types_table,
-				    G_N_ELEMENTS (audio_video_types_table));
-
-	if (sniffed_type != NULL)
-		return sniffed_type;
-
-	if (sniff_mp4 (sniffer, buffer))
-		return g_strdup ("video/mp4");
-
-	return NULL;
-}
 
 /* This table is based on the MIMESNIFF spec;
  * See 7.1 Identifying a resource with an unknown MIME type
@@ -467,6 +413,225 @@ static SoupContentSnifferPattern types_table[] = {
 	  FALSE },
 };
 
+/* The fixed-position signatures of the tables above are compiled into a
+ * single bit-parallel matcher. Each signature gets a bit, and for every
+ * offset a 256-entry table gives the signatures accepting a byte there,
+ * so matching is one pass over the first bytes of the resource instead
+ * of one pass per pattern. Signatures are numbered in table order, so
+ * the lowest matching bit is the one the spec would have picked.
+ *
+ * The "unknown" patterns that allow leading white space all start with
+ * a tag; they are indexed by the first byte after the '<' instead.
+ */
+#define MAX_SIGNATURES 32
+#define MAX_SIGNATURE_LENGTH 16
+
+typedef struct {
+	guint32     accept[MAX_SIGNATURE_LENGTH][256];
+	guint32     last_byte[MAX_SIGNATURE_LENGTH];
+	const char *sniffed_type[MAX_SIGNATURES];
+	guint       n_signatures;
+	guint       max_length;
+
+	guint32     unknown_signatures;
+	guint32     scriptable_signatures;
+	guint32     image_signatures;
+	guint32     audio_video_signatures;
+
+	/* Rows of types_table, by the first byte after the '<' */
+	guint32     tag_candidates[256];
+} SoupContentSnifferSignatures;
+
+static SoupContentSnifferSignatures signatures;
+
+static guint32
+add_signature (const guchar *mask,
+	       const guchar *pattern,
+	       guint         pattern_length,
+	       const char   *sniffed_type)
+{
+	guint bit = signatures.n_signatures++;
+	guint i, b;
+
+	g_assert (bit < MAX_SIGNATURES);
+	g_assert (pattern_length > 0 && pattern_length <= MAX_SIGNATURE_LENGTH);
+
+	for (i = 0; i < pattern_length; i++) {
+		for (b = 0; b < 256; b++) {
+			if ((mask[i] & b) == pattern[i])
+				signatures.accept[i][b] |= 1u << bit;
+		}
+	}
+	signatures.last_byte[pattern_length - 1] |= 1u << bit;
+	signatures.sniffed_type[bit] = sniffed_type;
+	signatures.max_length = MAX (signatures.max_length, pattern_length);
+
+	return 1u << bit;
+}
+
+static void
+compile_signatures (void)
+{
+	guint i, b;
+
+	G_STATIC_ASSERT (G_N_ELEMENTS (types_table) <= MAX_SIGNATURES);
+
+	for (i = 0; i < G_N_ELEMENTS (types_table); i++) {
+		SoupContentSnifferPattern *type_row = &(types_table[i]);
+		guint32 bit;
+
+		if (type_row->has_ws) {
+			/* " <" followed by at least one significant byte */
+			g_assert (type_row->pattern[0] == ' ' && type_row->pattern[1] == '<');
+			g_assert (type_row->pattern_length >= 2 && type_row->pattern[2] != ' ');
+
+			for (b = 0; b < 256; b++) {
+				if ((type_row->mask[2] & b) == type_row->pattern[2])
+					signatures.tag_candidates[b] |= 1u << i;
+			}
+			continue;
+		}
+
+		bit = add_signature (type_row->mask, type_row->pattern,
+				     type_row->pattern_length, type_row->sniffed_type);
+		signatures.unknown_signatures |= bit;
+		if (type_row->scriptable)
+			signatures.scriptable_signatures |= bit;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (image_types_table); i++) {
+		SoupContentSnifferMediaPattern *type_row = &(image_types_table[i]);
+
+		signatures.image_signatures |=
+			add_signature (type_row->mask, type_row->pattern,
+				       type_row->pattern_length, type_row->sniffed_type);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (audio_video_types_table); i++) {
+		SoupContentSnifferMediaPattern *type_row = &(audio_video_types_table[i]);
+
+		signatures.audio_video_signatures |=
+			add_signature (type_row->mask, type_row->pattern,
+				       type_row->pattern_length, type_row->sniffed_type);
+	}
+}
+
+static const char *
+match_signatures (GBytes  *buffer,
+		  guint32  candidates)
+{
+	gsize resource_length;
+	const guchar *resource = g_bytes_get_data (buffer, &resource_length);
+	guint32 matched = 0;
+	guint i;
+
+	resource_length = MIN (512, resource_length);
+	for (i = 0; i < signatures.max_length && i < resource_length && candidates; i++) {
+		candidates &= signatures.accept[i][resource[i]];
+		matched |= candidates & signatures.last_byte[i];
+		candidates &= ~signatures.last_byte[i];
+	}
+
+	if (!matched)
+		return NULL;
+
+	return signatures.sniffed_type[g_bit_nth_lsf (matched, -1)];
+}
+
+static char*
+sniff_images (SoupContentSniffer *sniffer, GBytes *buffer)
+{
+	const char *sniffed_type;
+
+	sniffed_type = match_signatures (buffer, signatures.image_signatures);
+
+	return g_strdup (sniffed_type);
+}
+
+static char*
+sniff_audio_video (SoupContentSniffer *sniffer, GBytes *buffer)
+{
+	const char *sniffed_type;
+
+	sniffed_type = match_signatures (buffer, signatures.audio_video_signatures);
+	if (sniffed_type != NULL)
+		return g_strdup (sniffed_type);
+
+	if (sniff_mp4 (sniffer, buffer))
+		return g_strdup ("video/mp4");
+
+	return NULL;
+}
+
+static inline gboolean
+is_insignificant_space (guchar c)
+{
+	return c == '\x09' || c == '\x0a' || c == '\x0c' || c == '\x0d' || c == '\x20';
+}
+
+static gboolean
+match_tag (SoupContentSnifferPattern *type_row,
+	   const guchar              *resource,
+	   gsize                      index_stream,
+	   gsize                      resource_length,
+	   gsize                      buffer_length)
+{
+	guint index_pattern = 2;
+
+	while (index_pattern <= type_row->pattern_length) {
+		if (index_stream >= resource_length)
+			return FALSE;
+
+		/* Skip insignificant white space ("WS" in the spec) */
+		if (type_row->pattern[index_pattern] == ' ') {
+			if (is_insignificant_space (resource[index_stream]))
+				index_stream++;
+			else
+				index_pattern++;
+		} else {
+			if ((type_row->mask[index_pattern] & resource[index_stream]) != type_row->pattern[index_pattern])
+				return FALSE;
+			index_pattern++;
+			index_stream++;
+		}
+	}
+
+	if (!type_row->has_tag_termination)
+		return TRUE;
+
+	return index_stream < buffer_length &&
+		(resource[index_stream] == '\x20' || resource[index_stream] == '\x3E');
+}
+
+static const char *
+sniff_tags (GBytes *buffer)
+{
+	gsize buffer_length, resource_length;
+	const guchar *resource = g_bytes_get_data (buffer, &buffer_length);
+	gsize index_stream = 0;
+	guint32 candidates;
+
+	resource_length = MIN (512, buffer_length);
+
+	/* All the tag patterns start with WS and '<', skip them only once */
+	while (index_stream < resource_length && is_insignificant_space (resource[index_stream]))
+		index_stream++;
+	if (index_stream + 1 >= resource_length || resource[index_stream] != '<')
+		return NULL;
+	index_stream++;
+
+	candidates = signatures.tag_candidates[resource[index_stream]];
+	while (candidates) {
+		guint i = g_bit_nth_lsf (candidates, -1);
+
+		candidates &= ~(1u << i);
+		if (match_tag (&types_table[i], resource, index_stream, resource_length, buffer_length))
+			return types_table[i].sniffed_type;
+	}
+
+	return NULL;
+}
+
 /* Whether a given byte looks like it might be part of binary content.
  * Source: HTML5 spec; borrowed from the Chromium mime sniffer code,
  * which is BSD-licensed
@@ -495,7 +660,8 @@ static char*
 sniff_unknown (SoupContentSniffer *sniffer, GBytes *buffer,
 	       gboolean sniff_scriptable)
 {
-	char *sniffed_type = NULL;
+	const char *sniffed_type;
+	guint32 candidates;
 	gsize resource_length;
 	const guchar *resource = g_bytes_get_data (buffer, &resource_length);
 	resource_length = MIN (512, resource_length);
@@ -504,76 +670,26 @@ sniff_unknown (SoupContentSniffer *sniffer, GBytes *buffer,
         if (resource_length == 0)
                 return g_strdup ("text/plain");
 
-	for (i = 0; i < G_N_ELEMENTS (types_table); i++) {
-		SoupContentSnifferPattern *type_row = &(types_table[i]);
-
-		if (!sniff_scriptable && type_row->scriptable)
-			continue;
-
-		if (type_row->has_ws) {
-			guint index_stream = 0;
-			guint index_pattern = 0;
-			gboolean skip_row = FALSE;
-
-			while ((index_stream < resource_length) &&
-			       (index_pattern <= type_row->pattern_length)) {
-				/* Skip insignificant white space ("WS" in the spec) */
-				if (type_row->pattern[index_pattern] == ' ') {
-					if (resource[index_stream] == '\x09' ||
-					    resource[index_stream] == '\x0a' ||
-					    resource[index_stream] == '\x0c' ||
-					    resource[index_stream] == '\x0d' ||
-					    resource[index_stream] == '\x20')
-						index_stream++;
-					else
-						index_pattern++;
-				} else {
-					if ((type_row->mask[index_pattern] & resource[index_stream]) != type_row->pattern[index_pattern]) {
-						skip_row = TRUE;
-						break;
-					}
-					index_pattern++;
-					index_stream++;
-				}
-			}
-
-			if (skip_row)
-				continue;
-
-			if (index_pattern > type_row->pattern_length) {
-				if (type_row->has_tag_termination &&
-				    resource[index_stream] != '\x20' &&
-				    resource[index_stream] != '\x3E')
-					continue;
-
-				return g_strdup (type_row->sniffed_type);
-			}
-		} else {
-			guint j;
-
-			if (resource_length < type_row->pattern_length)
-				continue;
-
-			for (j = 0; j < type_row->pattern_length; j++) {
-				if ((type_row->mask[j] & resource[j]) != type_row->pattern[j])
-					break;
-			}
-
-			/* This means our comparison above matched completely */
-			if (j == type_row->pattern_length)
-				return g_strdup (type_row->sniffed_type);
-		}
+	/* All the tag patterns are scriptable */
+	if (sniff_scriptable) {
+		sniffed_type = sniff_tags (buffer);
+		if (sniffed_type != NULL)
+			return g_strdup (sniffed_type);
 	}
 
-	sniffed_type = sniff_images (sniffer, buffer);
+	/* The unknown types table, then images, then audio and video */
+	candidates = signatures.unknown_signatures |
+		signatures.image_signatures |
+		signatures.audio_video_signatures;
+	if (!sniff_scriptable)
+		candidates &= ~signatures.scriptable_signatures;
 
+	sniffed_type = match_signatures (buffer, candidates);
 	if (sniffed_type != NULL)
-		return sniffed_type;
+		return g_strdup (sniffed_type);
 
-	sniffed_type = sniff_audio_video (sniffer, buffer);
-
-	if (sniffed_type != NULL)
-		return sniffed_type;
+	if (sniff_mp4 (sniffer, buffer))
+		return g_strdup ("video/mp4");
 
 	for (i = 0; i < resource_length; i++) {
 		if (byte_looks_binary[resource[i]])
@@ -879,6 +995,7 @@ soup_content_sniffer_request_unqueued (SoupSessionFeature *feature,
 static void
 soup_content_sniffer_class_init (SoupContentSnifferClass *content_sniffer_class)
 {
+	compile_signatures ();
 }
 
 static void
@@ -11,10 +11,6 @@
 
 #include <glib/gi18n-lib.h>
 
-#ifdef HAVE_SYSPROF
-#include <sysprof-capture.h>
-#endif
-
 #include "soup-client-message-io-http1.h"
 #include "soup.h"
 #include "soup-body-input-stream.h"
@@ -29,6 +25,7 @@
 #include "soup-message-metrics-private.h"
 #include "soup-message-queue-item.h"
 #include "soup-misc.h"
+#include "soup-profiler.h"
 #include "soup-uri-utils-private.h"
 
 typedef struct {
@@ -42,9 +39,7 @@ typedef struct {
         /* Request body logger */
         SoupLogger *logger;
 
-#ifdef HAVE_SYSPROF
-        gint64 begin_time_nsec;
-#endif
+        gint64 begin_time;
 } SoupMessageIOHTTP1;
 
 typedef struct {
@@ -144,6 +139,7 @@ request_body_stream_wrote_data_cb (SoupMessage *msg,
 {
         SoupClientMessageIOHTTP1 *client_io = (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg);
 
+        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_BYTES_SENT, count);
         if (client_io->msg_io->metrics) {
                 client_io->msg_io->metrics->request_body_bytes_sent += count;
                 if (!is_metadata)
@@ -337,6 +333,7 @@ io_write (SoupClientMessageIOHTTP1 *client_io,
                         if (nwrote == -1)
                                 return FALSE;
                         io->written += nwrote;
+                        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_BYTES_SENT, nwrote);
                         if (client_io->msg_io->metrics)
                                 client_io->msg_io->metrics->request_header_bytes_sent += nwrote;
                 }
@@ -496,6 +493,7 @@ response_network_stream_read_data_cb (SoupMessage *msg,
 {
         SoupClientMessageIOHTTP1 *client_io = (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg);
 
+        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_BYTES_RECEIVED, count);
         if (client_io->msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY_START) {
                 client_io->msg_io->response_header_bytes_received += count;
                 if (client_io->msg_io->metrics)
@@ -777,38 +775,33 @@ io_run_until (SoupClientMessageIOHTTP1 *client_io,
                 return FALSE;
         }
 
-#ifdef HAVE_SYSPROF
         /* Allow profiling of network requests. */
         if (io->read_state == SOUP_MESSAGE_IO_STATE_DONE &&
-            io->write_state == SOUP_MESSAGE_IO_STATE_DONE) {
+            io->write_state == SOUP_MESSAGE_IO_STATE_DONE &&
+            soup_profiler_is_active ()) {
                 GUri *uri = soup_message_get_uri (msg);
-                char *uri_str = g_uri_to_string_partial (uri, G_URI_HIDE_PASSWORD);
                 const gchar *last_modified = soup_message_headers_get_one_common (soup_message_get_response_headers (msg), SOUP_HEADER_LAST_MODIFIED);
                 const gchar *etag = soup_message_headers_get_one_common (soup_message_get_response_headers (msg), SOUP_HEADER_ETAG);
                 const gchar *if_modified_since = soup_message_headers_get_one_common (soup_message_get_request_headers (msg), SOUP_HEADER_IF_MODIFIED_SINCE);
                 const gchar *if_none_match = soup_message_headers_get_one_common (soup_message_get_request_headers (msg), SOUP_HEADER_IF_NONE_MATCH);
 
-                /* FIXME: Expand and generalise sysprof support:
-                 * https://gitlab.gnome.org/GNOME/sysprof/-/issues/43 */
-                sysprof_collector_mark_printf (client_io->msg_io->begin_time_nsec,
-                                               SYSPROF_CAPTURE_CURRENT_TIME - client_io->msg_io->begin_time_nsec,
-                                               "libsoup", "message",
-                                               "%s request/response to %s: "
-                                               "read %" G_GOFFSET_FORMAT "B, "
-                                               "wrote %" G_GOFFSET_FORMAT "B, "
-                                               "If-Modified-Since: %s, "
-                                               "If-None-Match: %s, "
-                                               "Last-Modified: %s, "
-                                               "ETag: %s",
-                                               soup_message_get_tls_peer_certificate (msg) ? "HTTPS" : "HTTP",
-                                               uri_str, io->read_length, io->write_length,
-                                               (if_modified_since != NULL) ? if_modified_since : "(unset)",
-                                               (if_none_match != NULL) ? if_none_match : "(unset)",
-                                               (last_modified != NULL) ? last_modified : "(unset)",
-                                               (etag != NULL) ? etag : "(unset)");
-                g_free (uri_str);
+                soup_profiler_mark (client_io->msg_io->begin_time, "message",
+                                    "%s %s request/response to %s%s: "
+                                    "read %" G_GOFFSET_FORMAT "B, "
+                                    "wrote %" G_GOFFSET_FORMAT "B, "
+                                    "If-Modified-Since: %s, "
+                                    "If-None-Match: %s, "
+                                    "Last-Modified: %s, "
+                                    "ETag: %s",
+                                    soup_message_get_tls_peer_certificate (msg) ? "HTTPS" : "HTTP",
+                                    soup_message_get_method (msg),
+                                    g_uri_get_host (uri), g_uri_get_path (uri),
+                                    io->read_length, io->write_length,
+                                    (if_modified_since != NULL) ? if_modified_since : "(unset)",
+                                    (if_none_match != NULL) ? if_none_match : "(unset)",
+                                    (last_modified != NULL) ? last_modified : "(unset)",
+                                    (etag != NULL) ? etag : "(unset)");
         }
-#endif  /* HAVE_SYSPROF */
 
         g_object_unref (msg);
         return done;
@@ -1060,9 +1053,7 @@ soup_client_message_io_http1_send_item (SoupClientMessageIO       *iface,
                                  G_CALLBACK (response_network_stream_read_data_cb),
                                  msg_io->item->msg, G_CONNECT_SWAPPED);
 
-#ifdef HAVE_SYSPROF
-        msg_io->begin_time_nsec = SYSPROF_CAPTURE_CURRENT_TIME;
-#endif
+        msg_io->begin_time = soup_profiler_get_time ();
         if (io->msg_io)
                 g_warn_if_reached ();
 
@@ -0,0 +1,314 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-body-output-stream-http2.c
+ *
+ * Copyright (C) 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "soup-body-output-stream-http2.h"
+#include <string.h>
+#include <glib/gi18n-lib.h>
+
+/*
+ * SoupBodyOutputStreamHttp2:
+ *
+ * The outgoing half of an HTTP/2 stream that has been turned into a
+ * tunnel (RFC 8441 extended CONNECT). Data written to the stream is
+ * queued until the HTTP/2 IO pulls it with
+ * soup_body_output_stream_http2_read_data() from its DATA frame
+ * provider. The #SoupBodyOutputStreamHttp2::data-available signal is
+ * emitted whenever new data is queued or the stream is closed, so that
+ * the IO can resume the deferred stream.
+ *
+ * Writes are non blocking: once %SOUP_BODY_OUTPUT_STREAM_HTTP2_MAX_BUFFERED
+ * bytes are queued, g_pollable_output_stream_write_nonblocking() fails
+ * with %G_IO_ERROR_WOULD_BLOCK until the peer's flow control window
+ * lets the IO consume some of it.
+ */
+
+#define SOUP_BODY_OUTPUT_STREAM_HTTP2_MAX_BUFFERED (64 * 1024)
+
+struct _SoupBodyOutputStreamHttp2 {
+        GOutputStream parent_instance;
+};
+
+typedef struct {
+        GByteArray *buffer;
+        gsize pos;
+        gboolean eof;
+        GError *error;
+        GCancellable *can_write_cancellable;
+} SoupBodyOutputStreamHttp2Private;
+
+static void soup_body_output_stream_http2_pollable_iface_init (GPollableOutputStreamInterface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (SoupBodyOutputStreamHttp2, soup_body_output_stream_http2, G_TYPE_OUTPUT_STREAM,
+                               G_ADD_PRIVATE (SoupBodyOutputStreamHttp2)
+                               G_IMPLEMENT_INTERFACE (G_TYPE_POLLABLE_OUTPUT_STREAM,
+                                                      soup_body_output_stream_http2_pollable_iface_init);)
+
+enum {
+        DATA_AVAILABLE,
+        LAST_SIGNAL
+};
+
+static guint signals [LAST_SIGNAL] = { 0 };
+
+GOutputStream *
+soup_body_output_stream_http2_new (void)
+{
+        return G_OUTPUT_STREAM (g_object_new (SOUP_TYPE_BODY_OUTPUT_STREAM_HTTP2, NULL));
+}
+
+static gsize
+soup_body_output_stream_http2_get_buffered (SoupBodyOutputStreamHttp2Private *priv)
+{
+        return priv->buffer->len - priv->pos;
+}
+
+static void
+soup_body_output_stream_http2_wake_writers (SoupBodyOutputStreamHttp2Private *priv)
+{
+        if (priv->can_write_cancellable) {
+                g_cancellable_cancel (priv->can_write_cancellable);
+                g_clear_object (&priv->can_write_cancellable);
+        }
+}
+
+gsize
+soup_body_output_stream_http2_read_data (SoupBodyOutputStreamHttp2 *stream,
+                                         guint8                    *buffer,
+                                         gsize                      length)
+{
+        SoupBodyOutputStreamHttp2Private *priv;
+        gsize count;
+
+        g_return_val_if_fail (SOUP_IS_BODY_OUTPUT_STREAM_HTTP2 (stream), 0);
+
+        priv = soup_body_output_stream_http2_get_instance_private (stream);
+
+        count = MIN (length, soup_body_output_stream_http2_get_buffered (priv));
+        if (count == 0)
+                return 0;
+
+        memcpy (buffer, priv->buffer->data + priv->pos, count);
+        priv->pos += count;
+
+        /* Compact once everything queued has been consumed, or when the
+         * consumed prefix dominates the buffer, so that it doesn't grow
+         * without bounds on long lived tunnels.
+         */
+        if (priv->pos == priv->buffer->len) {
+                g_byte_array_set_size (priv->buffer, 0);
+                priv->pos = 0;
+        } else if (priv->pos > SOUP_BODY_OUTPUT_STREAM_HTTP2_MAX_BUFFERED) {
+                g_byte_array_remove_range (priv->buffer, 0, priv->pos);
+                priv->pos = 0;
+        }
+
+        if (soup_body_output_stream_http2_get_buffered (priv) < SOUP_BODY_OUTPUT_STREAM_HTTP2_MAX_BUFFERED)
+                soup_body_output_stream_http2_wake_writers (priv);
+
+        return count;
+}
+
+gboolean
+soup_body_output_stream_http2_is_eof (SoupBodyOutputStreamHttp2 *stream)
+{
+        SoupBodyOutputStreamHttp2Private *priv;
+
+        g_return_val_if_fail (SOUP_IS_BODY_OUTPUT_STREAM_HTTP2 (stream), TRUE);
+
+        priv = soup_body_output_stream_http2_get_instance_private (stream);
+
+        return (priv->eof || priv->error) && soup_body_output_stream_http2_get_buffered (priv) == 0;
+}
+
+void
+soup_body_output_stream_http2_set_error (SoupBodyOutputStreamHttp2 *stream,
+                                         GError                    *error)
+{
+        SoupBodyOutputStreamHttp2Private *priv;
+
+        g_return_if_fail (SOUP_IS_BODY_OUTPUT_STREAM_HTTP2 (stream));
+
+        priv = soup_body_output_stream_http2_get_instance_private (stream);
+
+        if (priv->error) {
+                g_error_free (error);
+                return;
+        }
+
+        priv->error = error;
+        g_byte_array_set_size (priv->buffer, 0);
+        priv->pos = 0;
+        soup_body_output_stream_http2_wake_writers (priv);
+}
+
+static gssize
+soup_body_output_stream_http2_write_real (GOutputStream  *stream,
+                                          gboolean        blocking,
+                                          const void     *buffer,
+                                          gsize           count,
+                                          GError        **error)
+{
+        SoupBodyOutputStreamHttp2 *body_stream = SOUP_BODY_OUTPUT_STREAM_HTTP2 (stream);
+        SoupBodyOutputStreamHttp2Private *priv = soup_body_output_stream_http2_get_instance_private (body_stream);
+        gsize buffered;
+
+        if (priv->error) {
+                g_propagate_error (error, g_error_copy (priv->error));
+                return -1;
+        }
+
+        buffered = soup_body_output_stream_http2_get_buffered (priv);
+        if (!blocking) {
+                if (buffered >= SOUP_BODY_OUTPUT_STREAM_HTTP2_MAX_BUFFERED) {
+                        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                                             _("Operation would block"));
+                        return -1;
+                }
+
+                count = MIN (count, SOUP_BODY_OUTPUT_STREAM_HTTP2_MAX_BUFFERED - buffered);
+        }
+
+        if (count == 0)
+                return 0;
+
+        g_byte_array_append (priv->buffer, buffer, count);
+        g_signal_emit (body_stream, signals[DATA_AVAILABLE], 0);
+
+        return count;
+}
+
+static gssize
+soup_body_output_stream_http2_write (GOutputStream  *stream,
+                                     const void     *buffer,
+                                     gsize           count,
+                                     GCancellable   *cancellable,
+                                     GError        **error)
+{
+        return soup_body_output_stream_http2_write_real (stream, TRUE, buffer, count, error);
+}
+
+static gboolean
+soup_body_output_stream_http2_close (GOutputStream  *stream,
+                                     GCancellable   *cancellable,
+                                     GError        **error)
+{
+        SoupBodyOutputStreamHttp2 *body_stream = SOUP_BODY_OUTPUT_STREAM_HTTP2 (stream);
+        SoupBodyOutputStreamHttp2Private *priv = soup_body_output_stream_http2_get_instance_private (body_stream);
+
+        if (priv->eof)
+                return TRUE;
+
+        priv->eof = TRUE;
+        soup_body_output_stream_http2_wake_writers (priv);
+        g_signal_emit (body_stream, signals[DATA_AVAILABLE], 0);
+
+        return TRUE;
+}
+
+static gboolean
+soup_body_output_stream_http2_is_writable (GPollableOutputStream *stream)
+{
+        SoupBodyOutputStreamHttp2Private *priv = soup_body_output_stream_http2_get_instance_private (SOUP_BODY_OUTPUT_STREAM_HTTP2 (stream));
+
+        return priv->error || soup_body_output_stream_http2_get_buffered (priv) < SOUP_BODY_OUTPUT_STREAM_HTTP2_MAX_BUFFERED;
+}
+
+static gssize
+soup_body_output_stream_http2_write_nonblocking (GPollableOutputStream  *stream,
+                                                 const void             *buffer,
+                                                 gsize                   count,
+                                                 GError                **error)
+{
+        return soup_body_output_stream_http2_write_real (G_OUTPUT_STREAM (stream), FALSE, buffer, count, error);
+}
+
+static GSource *
+soup_body_output_stream_http2_create_source (GPollableOutputStream *stream,
+                                             GCancellable          *cancellable)
+{
+        SoupBodyOutputStreamHttp2Private *priv = soup_body_output_stream_http2_get_instance_private (SOUP_BODY_OUTPUT_STREAM_HTTP2 (stream));
+        GSource *base_source, *pollable_source;
+
+        if (soup_body_output_stream_http2_is_writable (stream))
+                base_source = g_timeout_source_new (0);
+        else {
+                if (!priv->can_write_cancellable)
+                        priv->can_write_cancellable = g_cancellable_new ();
+                base_source = g_cancellable_source_new (priv->can_write_cancellable);
+        }
+
+        pollable_source = g_pollable_source_new_full (stream, base_source, cancellable);
+        g_source_set_name (pollable_source, "SoupBodyOutputStreamHttp2Source");
+        g_source_unref (base_source);
+
+        return pollable_source;
+}
+
+static void
+soup_body_output_stream_http2_dispose (GObject *object)
+{
+        SoupBodyOutputStreamHttp2 *stream = SOUP_BODY_OUTPUT_STREAM_HTTP2 (object);
+        SoupBodyOutputStreamHttp2Private *priv = soup_body_output_stream_http2_get_instance_private (stream);
+
+        soup_body_output_stream_http2_wake_writers (priv);
+
+        G_OBJECT_CLASS (soup_body_output_stream_http2_parent_class)->dispose (object);
+}
+
+static void
+soup_body_output_stream_http2_finalize (GObject *object)
+{
+        SoupBodyOutputStreamHttp2 *stream = SOUP_BODY_OUTPUT_STREAM_HTTP2 (object);
+        SoupBodyOutputStreamHttp2Private *priv = soup_body_output_stream_http2_get_instance_private (stream);
+
+        g_byte_array_unref (priv->buffer);
+        g_clear_error (&priv->error);
+
+        G_OBJECT_CLASS (soup_body_output_stream_http2_parent_class)->finalize (object);
+}
+
+static void
+soup_body_output_stream_http2_pollable_iface_init (GPollableOutputStreamInterface *iface)
+{
+        iface->is_writable = soup_body_output_stream_http2_is_writable;
+        iface->create_source = soup_body_output_stream_http2_create_source;
+        iface->write_nonblocking = soup_body_output_stream_http2_write_nonblocking;
+}
+
+static void
+soup_body_output_stream_http2_init (SoupBodyOutputStreamHttp2 *stream)
+{
+        SoupBodyOutputStreamHttp2Private *priv = soup_body_output_stream_http2_get_instance_private (stream);
+
+        priv->buffer = g_byte_array_new ();
+}
+
+static void
+soup_body_output_stream_http2_class_init (SoupBodyOutputStreamHttp2Class *klass)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+        GOutputStreamClass *ostream_class = G_OUTPUT_STREAM_CLASS (klass);
+
+        object_class->dispose = soup_body_output_stream_http2_dispose;
+        object_class->finalize = soup_body_output_stream_http2_finalize;
+
+        ostream_class->write_fn = soup_body_output_stream_http2_write;
+        ostream_class->close_fn = soup_body_output_stream_http2_close;
+
+        signals[DATA_AVAILABLE] =
+                g_signal_new ("data-available",
+                              G_OBJECT_CLASS_TYPE (object_class),
+                              G_SIGNAL_RUN_FIRST,
+                              0,
+                              NULL, NULL,
+                              NULL,
+                              G_TYPE_NONE, 0);
+}
@@ -0,0 +1,28 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-body-output-stream-http2.h
+ *
+ * Copyright (C) 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-types.h"
+
+G_BEGIN_DECLS
+
+#define SOUP_TYPE_BODY_OUTPUT_STREAM_HTTP2 (soup_body_output_stream_http2_get_type ())
+G_DECLARE_FINAL_TYPE (SoupBodyOutputStreamHttp2, soup_body_output_stream_http2, SOUP, BODY_OUTPUT_STREAM_HTTP2, GOutputStream)
+
+GOutputStream *soup_body_output_stream_http2_new       (void);
+
+gsize          soup_body_output_stream_http2_read_data (SoupBodyOutputStreamHttp2 *stream,
+                                                        guint8                    *buffer,
+                                                        gsize                      length);
+
+gboolean       soup_body_output_stream_http2_is_eof    (SoupBodyOutputStreamHttp2 *stream);
+
+void           soup_body_output_stream_http2_set_error (SoupBodyOutputStreamHttp2 *stream,
+                                                        GError                    *error);
+
+G_END_DECLS
@@ -39,11 +39,13 @@
 #include "content-sniffer/soup-content-sniffer-stream.h"
 #include "soup-client-input-stream.h"
 #include "soup-logger-private.h"
+#include "soup-profiler.h"
 #include "soup-uri-utils-private.h"
 #include "soup-http2-utils.h"
 
 #include "content-decoder/soup-content-decoder.h"
 #include "soup-body-input-stream-http2.h"
+#include "soup-body-output-stream-http2.h"
 
 #define FRAME_HEADER_SIZE 9
 
@@ -80,8 +82,22 @@ typedef struct {
         gboolean ever_used;
 
         guint in_callback;
+
+        /* Extended CONNECT requests waiting for the server SETTINGS */
+        gboolean remote_settings_received;
+        GList *pending_connect_messages;
+
+        /* Streams stolen for WebSockets, stream id -> SoupHTTP2Tunnel */
+        GHashTable *tunnels;
 } SoupClientMessageIOHTTP2;
 
+typedef struct {
+        SoupClientMessageIOHTTP2 *io; /* Unowned */
+        guint32 stream_id;
+        GInputStream *istream;
+        GOutputStream *ostream;
+} SoupHTTP2Tunnel;
+
 typedef struct {
         SoupMessageQueueItem *item;
         SoupMessage *msg;
@@ -110,12 +126,18 @@ typedef struct {
         uint32_t http2_error;
         gboolean paused;
         guint32 stream_id;
+        gint64 begin_time;
         gboolean can_be_restarted;
         gboolean expect_continue;
+        gboolean io_run;
+
+        /* Outgoing half of an extended CONNECT stream */
+        GOutputStream *tunnel_ostream;
 } SoupHTTP2MessageData;
 
 static void soup_client_message_io_http2_finished (SoupClientMessageIO *iface, SoupMessage *msg);
 static ssize_t on_data_source_read_callback (nghttp2_session *session, int32_t stream_id, uint8_t *buf, size_t length, uint32_t *data_flags, nghttp2_data_source *source, void *user_data);
+static void send_message_request (SoupMessage *msg, SoupClientMessageIOHTTP2 *io, SoupHTTP2MessageData *data);
 
 G_GNUC_PRINTF(3, 0)
 static void
@@ -186,10 +208,35 @@ set_http2_error_for_data (SoupHTTP2MessageData *data,
                                    "HTTP/2 Error: %s", nghttp2_http2_strerror (error_code));
 }
 
+static void
+soup_http2_tunnel_abort (SoupHTTP2Tunnel *tunnel,
+                         GError          *error)
+{
+        soup_body_input_stream_http2_complete (SOUP_BODY_INPUT_STREAM_HTTP2 (tunnel->istream));
+        soup_body_output_stream_http2_set_error (SOUP_BODY_OUTPUT_STREAM_HTTP2 (tunnel->ostream),
+                                                 error ? g_error_copy (error) :
+                                                 g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                                                                      _("Connection terminated unexpectedly")));
+}
+
+static void
+soup_http2_tunnel_free (SoupHTTP2Tunnel *tunnel)
+{
+        g_signal_handlers_disconnect_by_data (tunnel->istream, tunnel);
+        g_signal_handlers_disconnect_by_data (tunnel->ostream, tunnel);
+        soup_http2_tunnel_abort (tunnel, NULL);
+        g_object_unref (tunnel->istream);
+        g_object_unref (tunnel->ostream);
+        g_free (tunnel);
+}
+
 static void
 set_io_error (SoupClientMessageIOHTTP2 *io,
               GError                   *error)
 {
+        GHashTableIter iter;
+        SoupHTTP2Tunnel *tunnel;
+
         h2_debug (io, NULL, "[SESSION] IO error: %s", error->message);
 
         if (!io->error)
@@ -197,6 +244,11 @@ set_io_error (SoupClientMessageIOHTTP2 *io,
         else
                 g_error_free (error);
 
+        /* Tunnels are released once their streams are closed by the user */
+        g_hash_table_iter_init (&iter, io->tunnels);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&tunnel))
+                soup_http2_tunnel_abort (tunnel, io->error);
+
         if (io->close_task && !io->goaway_sent) {
                 g_task_return_boolean (io->close_task, TRUE);
                 g_clear_object (&io->close_task);
@@ -324,6 +376,7 @@ io_write (SoupClientMessageIOHTTP2 *io,
         if (ret < 0)
                 return FALSE;
 
+        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_BYTES_SENT, ret);
         io->written_bytes += ret;
         return TRUE;
 }
@@ -409,6 +462,8 @@ io_read (SoupClientMessageIOHTTP2  *io,
                 return FALSE;
         }
 
+        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_BYTES_RECEIVED, read);
+
         g_warn_if_fail (io->in_callback == 0);
         ret = nghttp2_session_mem_recv (io->session, buffer, read);
         NGCHECK (ret);
@@ -501,7 +556,7 @@ soup_client_message_io_http2_terminate_session (SoupClientMessageIOHTTP2 *io)
         if (io->session_terminated)
                 return;
 
-        if (g_hash_table_size (io->messages) != 0)
+        if (g_hash_table_size (io->messages) != 0 || g_hash_table_size (io->tunnels) != 0)
                 return;
 
         io->session_terminated = TRUE;
@@ -509,6 +564,41 @@ soup_client_message_io_http2_terminate_session (SoupClientMessageIOHTTP2 *io)
         io_try_write (io, !io->async);
 }
 
+static void
+soup_client_message_io_http2_release_tunnel (SoupClientMessageIOHTTP2 *io,
+                                             guint32                   stream_id)
+{
+        SoupConnection *conn;
+
+        if (!g_hash_table_remove (io->tunnels, GUINT_TO_POINTER (stream_id)))
+                return;
+
+        h2_debug (io, NULL, "[TUNNEL] Released stream %u", stream_id);
+
+        if (io->is_shutdown)
+                soup_client_message_io_http2_terminate_session (io);
+
+        conn = g_weak_ref_get (&io->conn);
+        if (conn) {
+                soup_connection_set_in_use (conn, FALSE);
+                g_object_unref (conn);
+        }
+}
+
+static void
+send_pending_connect_requests (SoupClientMessageIOHTTP2 *io)
+{
+        GList *pending, *l;
+
+        pending = g_list_reverse (g_steal_pointer (&io->pending_connect_messages));
+        for (l = pending; l; l = g_list_next (l)) {
+                SoupHTTP2MessageData *data = l->data;
+
+                send_message_request (data->msg, io, data);
+        }
+        g_list_free (pending);
+}
+
 /* HTTP2 read callbacks */
 
 static int
@@ -578,6 +668,17 @@ memory_stream_need_more_data_callback (SoupBodyInputStreamHttp2 *stream,
         return error;
 }
 
+static void
+memory_stream_read_data_callback (SoupBodyInputStreamHttp2 *stream,
+                                  guint64                   count,
+                                  gpointer                  user_data)
+{
+        SoupHTTP2MessageData *data = (SoupHTTP2MessageData*)user_data;
+
+        nghttp2_session_consume_stream (data->io->session, data->stream_id, count);
+        io_try_write (data->io, !data->item->async);
+}
+
 static int
 on_begin_frame_callback (nghttp2_session        *session,
                          const nghttp2_frame_hd *hd,
@@ -605,6 +706,10 @@ on_begin_frame_callback (nghttp2_session        *session,
                         data->body_istream = soup_body_input_stream_http2_new ();
                         g_signal_connect (data->body_istream, "need-more-data",
                                           G_CALLBACK (memory_stream_need_more_data_callback), data);
+                        if (data->tunnel_ostream) {
+                                g_signal_connect (data->body_istream, "read-data",
+                                                  G_CALLBACK (memory_stream_read_data_callback), data);
+                        }
 
                         g_assert (!data->decoded_data_istream);
                         data->decoded_data_istream = soup_session_setup_message_body_input_stream (data->item->session,
@@ -644,6 +749,30 @@ handle_goaway (SoupClientMessageIOHTTP2 *io,
         }
 }
 
+static void
+handle_tunnel_frame (SoupHTTP2Tunnel     *tunnel,
+                     const nghttp2_frame *frame)
+{
+        SoupClientMessageIOHTTP2 *io = tunnel->io;
+
+        switch (frame->hd.type) {
+        case NGHTTP2_HEADERS:
+        case NGHTTP2_DATA:
+                if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM)
+                        soup_body_input_stream_http2_complete (SOUP_BODY_INPUT_STREAM_HTTP2 (tunnel->istream));
+                else if (frame->hd.type == NGHTTP2_DATA)
+                        io_try_write (io, FALSE);
+                break;
+        case NGHTTP2_RST_STREAM:
+                h2_debug (io, NULL, "[TUNNEL] Stream %u reset: %s", tunnel->stream_id, nghttp2_http2_strerror (frame->rst_stream.error_code));
+                soup_http2_tunnel_abort (tunnel, NULL);
+                break;
+        case NGHTTP2_WINDOW_UPDATE:
+                io_try_write (io, FALSE);
+                break;
+        }
+}
+
 static int
 on_frame_recv_callback (nghttp2_session     *session,
                         const nghttp2_frame *frame,
@@ -671,6 +800,12 @@ on_frame_recv_callback (nghttp2_session     *session,
                         h2_debug (io, NULL, "[RECV] WINDOW_UPDATE: increment=%d, total=%d", frame->window_update.window_size_increment,
                                   nghttp2_session_get_remote_window_size (session));
                         break;
+                case NGHTTP2_SETTINGS:
+                        if (!(frame->hd.flags & NGHTTP2_FLAG_ACK) && !io->remote_settings_received) {
+                                io->remote_settings_received = TRUE;
+                                send_pending_connect_requests (io);
+                        }
+                        break;
                 }
 
                 io->in_callback--;
@@ -681,7 +816,12 @@ on_frame_recv_callback (nghttp2_session     *session,
         h2_debug (io, data, "[RECV] [%s] Received: stream_id=%u, flags=%u", soup_http2_frame_type_to_string (frame->hd.type), frame->hd.stream_id, frame->hd.flags);
 
         if (!data) {
-                /* This can happen in case of cancellation */
+                SoupHTTP2Tunnel *tunnel = g_hash_table_lookup (io->tunnels, GUINT_TO_POINTER (frame->hd.stream_id));
+
+                /* Otherwise this can happen in case of cancellation */
+                if (tunnel)
+                        handle_tunnel_frame (tunnel, frame);
+
                 io->in_callback--;
                 return 0;
         }
@@ -728,6 +868,12 @@ on_frame_recv_callback (nghttp2_session     *session,
 
                 soup_message_got_headers (data->msg);
 
+                /* The stream might have been stolen or finished by a got-headers handler */
+                if (nghttp2_session_get_stream_user_data (session, frame->hd.stream_id) != data) {
+                        io->in_callback--;
+                        return 0;
+                }
+
                 if (soup_message_get_status (data->msg) == SOUP_STATUS_NO_CONTENT || frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
                         h2_debug (io, data, "Stream done");
                         advance_state_from (data, STATE_READ_HEADERS, STATE_READ_DATA_START);
@@ -785,12 +931,27 @@ on_data_chunk_recv_callback (nghttp2_session *session,
         h2_debug (io, msgdata, "[DATA] Received chunk, stream_id=%u len=%zu, flags=%u, paused=%d", stream_id, len, flags, msgdata ? msgdata->paused : 0);
 
         if (!msgdata) {
-                /* This can happen in case of cancellation */
+                SoupHTTP2Tunnel *tunnel = g_hash_table_lookup (io->tunnels, GUINT_TO_POINTER (stream_id));
+
+                /* Otherwise this can happen in case of cancellation */
+                if (tunnel) {
+                        nghttp2_session_consume_connection (session, len);
+                        soup_body_input_stream_http2_add_data (SOUP_BODY_INPUT_STREAM_HTTP2 (tunnel->istream), data, len);
+                } else
+                        nghttp2_session_consume (session, stream_id, len);
                 return 0;
         }
 
         io->in_callback++;
 
+        /* Window updates are sent manually. Extended CONNECT streams only
+         * get their window back as the data is read, see tunnel_read_data().
+         */
+        if (msgdata->tunnel_ostream)
+                nghttp2_session_consume_connection (session, len);
+        else
+                nghttp2_session_consume (session, stream_id, len);
+
         g_assert (msgdata->body_istream != NULL);
         soup_body_input_stream_http2_add_data (SOUP_BODY_INPUT_STREAM_HTTP2 (msgdata->body_istream), data, len);
         if (msgdata->state == STATE_READ_DATA_START)
@@ -983,8 +1144,23 @@ on_stream_close_callback (nghttp2_session *session,
         SoupHTTP2MessageData *data = nghttp2_session_get_stream_user_data (session, stream_id);
 
         h2_debug (user_data, data, "[SESSION] Closed stream %u: %s", stream_id, nghttp2_http2_strerror (error_code));
-        if (!data)
+        if (!data) {
+                SoupClientMessageIOHTTP2 *io = user_data;
+
+                io->in_callback++;
+                soup_client_message_io_http2_release_tunnel (io, stream_id);
+                io->in_callback--;
                 return 0;
+        }
+
+        if (data->begin_time && soup_profiler_is_active ()) {
+                GUri *uri = soup_message_get_uri (data->msg);
+
+                soup_profiler_mark (data->begin_time, "HTTP/2 stream", "%u %s %s%s: %s",
+                                    stream_id, soup_message_get_method (data->msg),
+                                    g_uri_get_host (uri), g_uri_get_path (uri),
+                                    nghttp2_http2_strerror (error_code));
+        }
 
         data->io->in_callback++;
 
@@ -1195,6 +1371,47 @@ on_data_source_read_callback (nghttp2_session     *session,
         }
 }
 
+static ssize_t
+on_tunnel_data_source_read_callback (nghttp2_session     *session,
+                                     int32_t              stream_id,
+                                     uint8_t             *buf,
+                                     size_t               length,
+                                     uint32_t            *data_flags,
+                                     nghttp2_data_source *source,
+                                     void                *user_data)
+{
+        SoupClientMessageIOHTTP2 *io = user_data;
+        SoupHTTP2MessageData *data = nghttp2_session_get_stream_user_data (session, stream_id);
+        SoupBodyOutputStreamHttp2 *ostream = NULL;
+        gsize read;
+
+        if (data)
+                ostream = SOUP_BODY_OUTPUT_STREAM_HTTP2 (data->tunnel_ostream);
+        else {
+                SoupHTTP2Tunnel *tunnel = g_hash_table_lookup (io->tunnels, GUINT_TO_POINTER (stream_id));
+
+                if (tunnel)
+                        ostream = SOUP_BODY_OUTPUT_STREAM_HTTP2 (tunnel->ostream);
+        }
+
+        if (!ostream)
+                return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+
+        read = soup_body_output_stream_http2_read_data (ostream, buf, length);
+        if (read > 0) {
+                h2_debug (io, data, "[TUNNEL] stream_id=%u, sending %zu", stream_id, read);
+                return read;
+        }
+
+        if (soup_body_output_stream_http2_is_eof (ostream)) {
+                h2_debug (io, data, "[TUNNEL] stream_id=%u, EOF", stream_id);
+                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                return 0;
+        }
+
+        return NGHTTP2_ERR_DEFERRED;
+}
+
 /* HTTP2 IO functions */
 
 static int32_t
@@ -1286,6 +1503,7 @@ soup_http2_message_data_close (SoupHTTP2MessageData *data)
 
         g_clear_error (&data->data_source_error);
         g_clear_pointer (&data->data_source_buffer, g_byte_array_unref);
+        g_clear_object (&data->tunnel_ostream);
 
         g_clear_error (&data->error);
 
@@ -1321,11 +1539,43 @@ request_header_is_valid (const char *name)
         return !g_hash_table_contains (invalid_request_headers, name);
 }
 
+static gboolean
+peer_supports_extended_connect (SoupClientMessageIOHTTP2 *io)
+{
+#ifdef HAVE_NGHTTP2_EXTENDED_CONNECT
+        return nghttp2_session_get_remote_settings (io->session, NGHTTP2_SETTINGS_ENABLE_CONNECT_PROTOCOL) == 1;
+#else
+        return FALSE;
+#endif
+}
+
 static void
 send_message_request (SoupMessage          *msg,
                       SoupClientMessageIOHTTP2   *io,
                       SoupHTTP2MessageData *data)
 {
+        const char *connect_protocol = soup_message_get_connect_protocol (msg);
+
+        if (connect_protocol) {
+                /* RFC 8441: extended CONNECT can only be used once the server
+                 * has announced SETTINGS_ENABLE_CONNECT_PROTOCOL.
+                 */
+                if (!io->remote_settings_received) {
+                        h2_debug (io, data, "[SESSION] Waiting for server settings to send extended CONNECT");
+                        io->pending_connect_messages = g_list_prepend (io->pending_connect_messages, data);
+                        return;
+                }
+
+                if (!peer_supports_extended_connect (io)) {
+                        set_error_for_data (data,
+                                            g_error_new_literal (G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                                                 "HTTP/2 Error: server does not support extended CONNECT"));
+                        soup_message_set_force_http_version (msg, SOUP_HTTP_1_1);
+                        data->can_be_restarted = TRUE;
+                        return;
+                }
+        }
+
         GArray *headers = g_array_new (FALSE, FALSE, sizeof (nghttp2_nv));
 
         GUri *uri = soup_message_get_uri (msg);
@@ -1341,9 +1591,14 @@ send_message_request (SoupMessage          *msg,
         else
                 path_and_query = g_strdup_printf ("%s%c%s", g_uri_get_path (uri), g_uri_get_query (uri) ? '?' : '\0', g_uri_get_query (uri));
 
+        /* Extended CONNECT requests for ws:// and wss:// URIs use the
+         * scheme of the underlying connection (RFC 8441 section 5).
+         */
+        const char *scheme = soup_uri_is_https (uri) ? "https" : "http";
+
         const nghttp2_nv pseudo_headers[] = {
-                MAKE_NV3 (":method", soup_message_get_method (msg), NGHTTP2_NV_FLAG_NO_COPY_VALUE),
-                MAKE_NV2 (":scheme", g_uri_get_scheme (uri)),
+                MAKE_NV3 (":method", connect_protocol ? SOUP_METHOD_CONNECT : soup_message_get_method (msg), NGHTTP2_NV_FLAG_NO_COPY_VALUE),
+                MAKE_NV3 (":scheme", scheme, NGHTTP2_NV_FLAG_NO_COPY_VALUE),
                 MAKE_NV2 (":authority", authority_header),
                 MAKE_NV2 (":path", path_and_query),
         };
@@ -1352,6 +1607,12 @@ send_message_request (SoupMessage          *msg,
                 g_array_append_val (headers, pseudo_headers[i]);
         }
 
+        if (connect_protocol) {
+                const nghttp2_nv protocol_header = MAKE_NV3 (":protocol", connect_protocol, NGHTTP2_NV_FLAG_NO_COPY_VALUE);
+
+                g_array_append_val (headers, protocol_header);
+        }
+
         SoupMessageHeadersIter iter;
         const char *name, *value;
         soup_message_headers_iter_init (&iter, soup_message_get_request_headers (msg));
@@ -1359,6 +1620,10 @@ send_message_request (SoupMessage          *msg,
                 if (!request_header_is_valid (name))
                         continue;
 
+                /* The key is only used by the HTTP/1.1 Upgrade handshake */
+                if (connect_protocol && g_ascii_strcasecmp (name, "Sec-WebSocket-Key") == 0)
+                        continue;
+
                 const nghttp2_nv nv = MAKE_NV2 (name, value);
                 g_array_append_val (headers, nv);
         }
@@ -1372,7 +1637,16 @@ send_message_request (SoupMessage          *msg,
         nghttp2_priority_spec_init (&priority_spec, 0, message_priority_to_weight (msg), 0);
 
         int32_t stream_id;
-        if (body_stream && soup_message_headers_get_expectations (soup_message_get_request_headers (msg)) & SOUP_EXPECTATION_CONTINUE) {
+        if (connect_protocol) {
+                nghttp2_data_provider data_provider;
+
+                /* The stream stays open in both directions, the provider is
+                 * deferred until the tunnel is stolen and written to. */
+                data->tunnel_ostream = soup_body_output_stream_http2_new ();
+                data_provider.source.ptr = NULL;
+                data_provider.read_callback = on_tunnel_data_source_read_callback;
+                stream_id = nghttp2_submit_request (io->session, &priority_spec, (const nghttp2_nv *)headers->data, headers->len, &data_provider, data);
+        } else if (body_stream && soup_message_headers_get_expectations (soup_message_get_request_headers (msg)) & SOUP_EXPECTATION_CONTINUE) {
                 data->expect_continue = TRUE;
                 stream_id = nghttp2_submit_headers (io->session, 0, -1, &priority_spec, (const nghttp2_nv *)headers->data, headers->len, data);
         } else {
@@ -1391,6 +1665,7 @@ send_message_request (SoupMessage          *msg,
         } else {
                 NGCHECK (stream_id);
                 data->stream_id = stream_id;
+                data->begin_time = soup_profiler_get_time ();
                 h2_debug (io, data, "[SESSION] Request made for %s%s", authority_header, path_and_query);
                 io_try_write (io, !data->item->async);
         }
@@ -1442,6 +1717,16 @@ soup_client_message_io_http2_finished (SoupClientMessageIO *iface,
 
 	g_object_ref (msg);
 
+        io->pending_connect_messages = g_list_remove (io->pending_connect_messages, data);
+        if (data->io_run && data->task) {
+                GTask *task = g_steal_pointer (&data->task);
+
+                io->pending_io_messages = g_list_remove (io->pending_io_messages, data);
+                g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                         _("Operation was cancelled"));
+                g_object_unref (task);
+        }
+
         is_closed = nghttp2_session_get_stream_user_data (io->session, data->stream_id) == NULL;
         nghttp2_session_set_stream_user_data (io->session, data->stream_id, NULL);
 
@@ -1516,6 +1801,110 @@ soup_client_message_io_http2_stolen (SoupClientMessageIO *iface)
         g_assert_not_reached ();
 }
 
+static void
+tunnel_data_available (SoupBodyOutputStreamHttp2 *ostream,
+                       SoupHTTP2Tunnel           *tunnel)
+{
+        SoupClientMessageIOHTTP2 *io = tunnel->io;
+
+        if (io->error) {
+                /* The session is gone, so nghttp2 won't close the stream */
+                if (soup_body_output_stream_http2_is_eof (ostream))
+                        soup_client_message_io_http2_release_tunnel (io, tunnel->stream_id);
+                return;
+        }
+
+        nghttp2_session_resume_data (io->session, tunnel->stream_id);
+        io_try_write (io, FALSE);
+}
+
+/* The stream window is only replenished with what the tunnel's
+ * reader has consumed, so that a peer can't send faster than the
+ * data is read.
+ */
+static void
+tunnel_read_data (SoupBodyInputStreamHttp2 *istream,
+                  guint64                   count,
+                  SoupHTTP2Tunnel          *tunnel)
+{
+        SoupClientMessageIOHTTP2 *io = tunnel->io;
+
+        if (io->error)
+                return;
+
+        nghttp2_session_consume_stream (io->session, tunnel->stream_id, count);
+        io_try_write (io, FALSE);
+}
+
+GIOStream *
+soup_client_message_io_http2_steal_stream (SoupClientMessageIO *iface,
+                                           SoupMessage         *msg)
+{
+        SoupClientMessageIOHTTP2 *io = (SoupClientMessageIOHTTP2 *)iface;
+        SoupHTTP2MessageData *data = get_data_for_message (io, msg);
+        SoupHTTP2Tunnel *tunnel;
+        SoupMessageIOCompletionFn completion_cb;
+        gpointer completion_data;
+        SoupConnection *conn;
+        GTask *task;
+        GIOStream *stream;
+
+        if (!data || !data->tunnel_ostream || data->state < STATE_READ_HEADERS || data->state >= STATE_READ_DONE)
+                return NULL;
+
+        h2_debug (io, data, "[TUNNEL] Stealing stream");
+
+        tunnel = g_new0 (SoupHTTP2Tunnel, 1);
+        tunnel->io = io;
+        tunnel->stream_id = data->stream_id;
+        if (data->body_istream) {
+                g_signal_handlers_disconnect_by_data (data->body_istream, data);
+                tunnel->istream = g_object_ref (data->body_istream);
+        } else
+                tunnel->istream = soup_body_input_stream_http2_new ();
+        tunnel->ostream = g_steal_pointer (&data->tunnel_ostream);
+        g_signal_connect (tunnel->istream, "read-data",
+                          G_CALLBACK (tunnel_read_data), tunnel);
+        g_signal_connect (tunnel->ostream, "data-available",
+                          G_CALLBACK (tunnel_data_available), tunnel);
+        g_hash_table_insert (io->tunnels, GUINT_TO_POINTER (tunnel->stream_id), tunnel);
+
+        /* From now on frames for this stream are routed to the tunnel */
+        nghttp2_session_set_stream_user_data (io->session, data->stream_id, NULL);
+
+        /* The tunnel keeps the connection in use until the stream is closed */
+        conn = g_weak_ref_get (&io->conn);
+        if (conn) {
+                soup_connection_set_in_use (conn, TRUE);
+                g_object_unref (conn);
+        }
+
+        task = g_steal_pointer (&data->task);
+        if (task)
+                io->pending_io_messages = g_list_remove (io->pending_io_messages, data);
+
+        completion_cb = data->completion_cb;
+        completion_data = data->completion_data;
+
+        g_object_ref (msg);
+        if (!g_hash_table_remove (io->messages, msg))
+                g_warn_if_reached ();
+
+        if (task) {
+                g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                         _("Operation was cancelled"));
+                g_object_unref (task);
+        }
+
+        stream = g_simple_io_stream_new (tunnel->istream, tunnel->ostream);
+
+        if (completion_cb)
+                completion_cb (G_OBJECT (msg), SOUP_MESSAGE_IO_STOLEN, completion_data);
+        g_object_unref (msg);
+
+        return stream;
+}
+
 static gboolean
 soup_client_message_io_http2_in_progress (SoupClientMessageIO *iface,
                                           SoupMessage         *msg)
@@ -1724,14 +2113,6 @@ soup_client_message_io_http2_skip (SoupClientMessageIO *iface,
         return TRUE;
 }
 
-static void
-soup_client_message_io_http2_run (SoupClientMessageIO *iface,
-                                  SoupMessage         *msg,
-		                  gboolean             blocking)
-{
-        g_assert_not_reached ();
-}
-
 static void
 soup_client_message_io_http2_run_until_read_async (SoupClientMessageIO *iface,
                                                    SoupMessage         *msg,
@@ -1750,6 +2131,40 @@ soup_client_message_io_http2_run_until_read_async (SoupClientMessageIO *iface,
                 soup_http2_message_data_check_status (data);
 }
 
+static void
+io_run_ready (SoupMessage  *msg,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+        /* Errors and stolen streams have already finished the message */
+        if (!g_task_propagate_boolean (G_TASK (result), NULL))
+                return;
+
+        soup_message_io_finished (msg);
+}
+
+static void
+soup_client_message_io_http2_run (SoupClientMessageIO *iface,
+                                  SoupMessage         *msg,
+		                  gboolean             blocking)
+{
+        SoupClientMessageIOHTTP2 *io = (SoupClientMessageIOHTTP2 *)iface;
+        SoupHTTP2MessageData *data = get_data_for_message (io, msg);
+
+        /* This is only used by messages without a response body stream,
+         * like WebSocket handshakes, which are always async. The response
+         * is handled from the message signals, the body is discarded.
+         */
+        g_assert (!blocking);
+
+        data->io_run = TRUE;
+        soup_client_message_io_http2_run_until_read_async (iface, msg,
+                                                           data->item->io_priority,
+                                                           data->item->cancellable,
+                                                           (GAsyncReadyCallback)io_run_ready,
+                                                           NULL);
+}
+
 static void
 soup_client_message_io_http2_set_owner (SoupClientMessageIOHTTP2 *io,
                                         GThread                  *owner)
@@ -1822,6 +2237,8 @@ soup_client_message_io_http2_destroy (SoupClientMessageIO *iface)
         g_clear_pointer (&io->messages, g_hash_table_unref);
         g_clear_pointer (&io->closed_messages, g_hash_table_unref);
         g_clear_pointer (&io->pending_io_messages, g_list_free);
+        g_clear_pointer (&io->pending_connect_messages, g_list_free);
+        g_clear_pointer (&io->tunnels, g_hash_table_unref);
         g_clear_error (&io->error);
 
         g_free (io);
@@ -1873,21 +2290,22 @@ soup_client_message_io_http2_init (SoupClientMessageIOHTTP2 *io)
         nghttp2_session_callbacks_set_on_frame_send_callback (callbacks, on_frame_send_callback);
         nghttp2_session_callbacks_set_on_stream_close_callback (callbacks, on_stream_close_callback);
 
-#ifdef HAVE_NGHTTP2_OPTION_SET_NO_RFC9113_LEADING_AND_TRAILING_WS_VALIDATION
         nghttp2_option *option;
 
         nghttp2_option_new (&option);
+        /* Window updates are sent as data is consumed, see on_data_chunk_recv_callback() */
+        nghttp2_option_set_no_auto_window_update (option, 1);
+#ifdef HAVE_NGHTTP2_OPTION_SET_NO_RFC9113_LEADING_AND_TRAILING_WS_VALIDATION
         nghttp2_option_set_no_rfc9113_leading_and_trailing_ws_validation (option, 1);
+#endif
         NGCHECK (nghttp2_session_client_new2 (&io->session, callbacks, io, option));
         nghttp2_option_del (option);
-#else
-        NGCHECK (nghttp2_session_client_new (&io->session, callbacks, io));
-#endif
 
         nghttp2_session_callbacks_del (callbacks);
 
         io->messages = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)soup_http2_message_data_free);
         io->closed_messages = g_hash_table_new_full (g_direct_hash, g_direct_equal, (GDestroyNotify)soup_http2_message_data_free, NULL);
+        io->tunnels = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)soup_http2_tunnel_free);
 
         io->iface.funcs = &io_funcs;
 }
@@ -9,6 +9,9 @@
 
 G_BEGIN_DECLS
 
-SoupClientMessageIO *soup_client_message_io_http2_new (SoupConnection *conn);
+SoupClientMessageIO *soup_client_message_io_http2_new          (SoupConnection      *conn);
+
+GIOStream           *soup_client_message_io_http2_steal_stream (SoupClientMessageIO *iface,
+                                                                SoupMessage         *msg);
 
 G_END_DECLS
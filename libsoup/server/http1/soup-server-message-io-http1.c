@@ -19,7 +19,9 @@
 #include "soup-message-io-data.h"
 #include "soup-message-headers-private.h"
 #include "soup-server-message-private.h"
+#include "soup-server-message-metrics-private.h"
 #include "soup-misc.h"
+#include "soup-profiler.h"
 
 typedef struct {
         SoupMessageIOData base;
@@ -29,9 +31,17 @@ typedef struct {
         GBytes  *write_chunk;
 	goffset  write_body_offset;
 
+        GBytes  *read_block;
+        guchar  *read_block_data;
+        gsize    read_block_offset;
+        goffset  read_body_length;
+
         GSource *unpause_source;
 
 	GMainContext *async_context;
+
+        SoupServerMessageMetrics *metrics;
+        guint64 write_blocked_since;
 } SoupMessageIOHTTP1;
 
 typedef struct {
@@ -50,6 +60,7 @@ typedef struct {
 } SoupServerMessageIOHTTP1;
 
 #define RESPONSE_BLOCK_SIZE 8192
+#define REQUEST_BLOCK_SIZE (64 * 1024)
 #define HEADER_SIZE_LIMIT (64 * 1024)
 
 static gboolean io_run_ready (SoupServerMessage *msg,
@@ -68,6 +79,7 @@ soup_message_io_http1_new (SoupServerMessage *msg)
         msg_io->base.read_state = SOUP_MESSAGE_IO_STATE_HEADERS;
         msg_io->base.write_state = SOUP_MESSAGE_IO_STATE_NOT_STARTED;
         msg_io->async_context = g_main_context_ref_thread_default ();
+        msg_io->metrics = soup_server_message_get_metrics (msg);
 
         return msg_io;
 }
@@ -86,6 +98,7 @@ soup_message_io_http1_free (SoupMessageIOHTTP1 *msg_io)
         g_clear_object (&msg_io->msg);
         g_clear_pointer (&msg_io->async_context, g_main_context_unref);
         g_clear_pointer (&msg_io->write_chunk, g_bytes_unref);
+        g_clear_pointer (&msg_io->read_block, g_bytes_unref);
 
         g_free (msg_io);
 }
@@ -220,116 +233,6 @@ closed_async (GObject      *source,
  *      W:DONE     / R:DONE               R:DONE     / W:DONE
  */
 
-static void
-handle_partial_get (SoupServerMessage *msg)
-{
-        SoupRange *ranges;
-        int nranges;
-        GBytes *full_response;
-        guint status;
-	SoupMessageHeaders *request_headers;
-	SoupMessageHeaders *response_headers;
-	SoupMessageBody *response_body;
-
-	request_headers = soup_server_message_get_request_headers (msg);
-	response_headers = soup_server_message_get_response_headers (msg);
-	response_body = soup_server_message_get_response_body (msg);
-
-        /* Make sure the message is set up right for us to return a
-         * partial response; it has to be a GET, the status must be
-         * 200 OK (and in particular, NOT already 206 Partial
-         * Content), and the SoupServer must have already filled in
-         * the response body
-         */
-        if (soup_server_message_get_method (msg) != SOUP_METHOD_GET ||
-            soup_server_message_get_status (msg) != SOUP_STATUS_OK ||
-            soup_message_headers_get_encoding (response_headers) !=
-            SOUP_ENCODING_CONTENT_LENGTH ||
-            response_body->length == 0 ||
-            !soup_message_body_get_accumulate (response_body))
-                return;
-
-        /* Oh, and there has to have been a valid Range header on the
-         * request, of course.
-         */
-        status = soup_message_headers_get_ranges_internal (request_headers,
-                                                           response_body->length,
-                                                           TRUE,
-                                                           &ranges, &nranges);
-        if (status == SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE) {
-                soup_server_message_set_status (msg, status, NULL);
-                soup_message_body_truncate (response_body);
-                return;
-        } else if (status != SOUP_STATUS_PARTIAL_CONTENT)
-                return;
-
-        full_response = soup_message_body_flatten (response_body);
-        if (!full_response) {
-                soup_message_headers_free_ranges (request_headers, ranges);
-                return;
-        }
-
-        soup_server_message_set_status (msg, SOUP_STATUS_PARTIAL_CONTENT, NULL);
-        soup_message_body_truncate (response_body);
-
-        if (nranges == 1) {
-                GBytes *range_buf;
-
-                /* Single range, so just set Content-Range and fix the body. */
-
-                soup_message_headers_set_content_range (response_headers,
-                                                        ranges[0].start,
-                                                        ranges[0].end,
-                                                        g_bytes_get_size (full_response));
-                range_buf = g_bytes_new_from_bytes (full_response,
-                                                    ranges[0].start,
-                                                    ranges[0].end - ranges[0].start + 1);
-                soup_message_body_append_bytes (response_body, range_buf);
-                g_bytes_unref (range_buf);
-        } else {
-                SoupMultipart *multipart;
-                SoupMessageHeaders *part_headers;
-                GBytes *part_body;
-                GBytes *body = NULL;
-                const char *content_type;
-                int i;
-
-                /* Multiple ranges, so build a multipart/byteranges response
-                 * to replace msg->response_body with.
-                 */
-
-                multipart = soup_multipart_new ("multipart/byteranges");
-                content_type = soup_message_headers_get_one_common (response_headers, SOUP_HEADER_CONTENT_TYPE);
-                for (i = 0; i < nranges; i++) {
-                        part_headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_MULTIPART);
-                        if (content_type) {
-                                soup_message_headers_append_common (part_headers,
-                                                                    SOUP_HEADER_CONTENT_TYPE,
-                                                                    content_type);
-                        }
-                        soup_message_headers_set_content_range (part_headers,
-                                                                ranges[i].start,
-                                                                ranges[i].end,
-                                                                g_bytes_get_size (full_response));
-                        part_body = g_bytes_new_from_bytes (full_response,
-                                                            ranges[i].start,
-                                                            ranges[i].end - ranges[i].start + 1);
-                        soup_multipart_append_part (multipart, part_headers,
-                                                    part_body);
-                        soup_message_headers_unref (part_headers);
-                        g_bytes_unref (part_body);
-                }
-
-                soup_multipart_to_message (multipart, response_headers, &body);
-                soup_message_body_append_bytes (response_body, body);
-                g_bytes_unref (body);
-                soup_multipart_free (multipart);
-        }
-
-        g_bytes_unref (full_response);
-        soup_message_headers_free_ranges (request_headers, ranges);
-}
-
 static void
 write_headers (SoupServerMessage  *msg,
                GString            *headers,
@@ -346,7 +249,8 @@ write_headers (SoupServerMessage  *msg,
         if (soup_server_message_get_status (msg) == 0)
                 soup_server_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR, NULL);
 
-        handle_partial_get (msg);
+        soup_server_message_handle_partial_get (msg);
+        soup_server_message_encode_response (msg);
 
 	status_code = soup_server_message_get_status (msg);
         reason_phrase = soup_server_message_get_reason_phrase (msg);
@@ -391,6 +295,37 @@ write_headers (SoupServerMessage  *msg,
         g_string_append (headers, "\r\n");
 }
 
+static void
+response_body_stream_wrote_data_cb (SoupServerMessage *msg,
+                                    const void        *buffer,
+                                    guint              count,
+                                    gboolean           is_metadata)
+{
+        soup_server_message_get_metrics (msg)->response_body_bytes_sent += count;
+        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_SERVER_BYTES_SENT, count);
+}
+
+/* The time spent waiting for the socket to become writable is
+ * accounted from the write that would block to the next attempt.
+ */
+static void
+write_blocked_start (SoupMessageIOHTTP1 *msg_io,
+                     GError             *error)
+{
+        if (!msg_io->write_blocked_since && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+                msg_io->write_blocked_since = g_get_monotonic_time ();
+}
+
+static void
+write_blocked_end (SoupMessageIOHTTP1 *msg_io)
+{
+        if (!msg_io->write_blocked_since)
+                return;
+
+        msg_io->metrics->write_blocked_time += g_get_monotonic_time () - msg_io->write_blocked_since;
+        msg_io->write_blocked_since = 0;
+}
+
 /* Attempts to push forward the writing side of @msg's I/O. Returns
  * %TRUE if it manages to make some progress, and it is likely that
  * further progress can be made. Returns %FALSE if it has reached a
@@ -418,6 +353,8 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                 return FALSE;
         }
 
+        write_blocked_end (server_io->msg_io);
+
         switch (io->write_state) {
         case SOUP_MESSAGE_IO_STATE_HEADERS:
 		status_code = soup_server_message_get_status (msg);
@@ -428,8 +365,11 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                         soup_server_message_set_status (msg, SOUP_STATUS_CONTINUE, NULL);
                 }
 
-                if (!io->write_buf->len)
+                if (!io->write_buf->len) {
+                        if (!SOUP_STATUS_IS_INFORMATIONAL (soup_server_message_get_status (msg)))
+                                soup_server_message_set_metrics_timestamp (msg, SOUP_SERVER_MESSAGE_METRICS_RESPONSE_START);
                         write_headers (msg, io->write_buf, &io->write_encoding);
+                }
 
                 while (io->written < io->write_buf->len) {
                         nwrote = g_pollable_stream_write (server_io->ostream,
@@ -437,9 +377,13 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                                                           io->write_buf->len - io->written,
                                                           FALSE,
                                                           NULL, error);
-                        if (nwrote == -1)
+                        if (nwrote == -1) {
+                                write_blocked_start (server_io->msg_io, *error);
                                 return FALSE;
+                        }
                         io->written += nwrote;
+                        server_io->msg_io->metrics->response_header_bytes_sent += nwrote;
+                        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_SERVER_BYTES_SENT, nwrote);
                 }
 
                 io->written = 0;
@@ -492,6 +436,10 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                 io->body_ostream = soup_body_output_stream_new (server_io->ostream,
                                                                 io->write_encoding,
                                                                 io->write_length);
+                g_signal_connect_object (io->body_ostream,
+                                         "wrote-data",
+                                         G_CALLBACK (response_body_stream_wrote_data_cb),
+                                         msg, G_CONNECT_SWAPPED);
                 io->write_state = SOUP_MESSAGE_IO_STATE_BODY;
                 break;
 
@@ -504,7 +452,7 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                 }
 
                 if (!server_io->msg_io->write_chunk) {
-                        server_io->msg_io->write_chunk = soup_message_body_get_chunk (soup_server_message_get_response_body (msg),
+                        server_io->msg_io->write_chunk = soup_message_body_get_chunk (soup_server_message_get_write_body (msg),
                                                                                       server_io->msg_io->write_body_offset);
                         if (!server_io->msg_io->write_chunk) {
                                 soup_server_message_pause (msg);
@@ -521,8 +469,10 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                                                   g_bytes_get_size (server_io->msg_io->write_chunk) - io->written,
                                                   FALSE,
                                                   NULL, error);
-                if (nwrote == -1)
+                if (nwrote == -1) {
+                        write_blocked_start (server_io->msg_io, *error);
                         return FALSE;
+                }
 
                 chunk = g_bytes_new_from_bytes (server_io->msg_io->write_chunk, io->written, nwrote);
                 io->written += nwrote;
@@ -543,7 +493,7 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                         break;
                 }
 
-                soup_message_body_wrote_chunk (soup_server_message_get_response_body (msg),
+                soup_message_body_wrote_chunk (soup_server_message_get_write_body (msg),
 					       server_io->msg_io->write_chunk);
                 server_io->msg_io->write_body_offset += g_bytes_get_size (server_io->msg_io->write_chunk);
                 g_clear_pointer (&server_io->msg_io->write_chunk, g_bytes_unref);
@@ -573,6 +523,7 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
 
         case SOUP_MESSAGE_IO_STATE_BODY_DONE:
                 io->write_state = SOUP_MESSAGE_IO_STATE_FINISHING;
+                soup_server_message_set_metrics_timestamp (msg, SOUP_SERVER_MESSAGE_METRICS_RESPONSE_END);
                 soup_server_message_wrote_body (msg);
                 break;
 
@@ -735,8 +686,11 @@ io_read (SoupServerMessageIOHTTP1 *server_io,
                 is_first_read = io->read_header_buf->len == 0 && !soup_server_message_get_method (msg);
 
                 succeeded = soup_message_io_data_read_headers (io, SOUP_FILTER_INPUT_STREAM (server_io->istream), FALSE, NULL, NULL, error);
-                if (is_first_read && io->read_header_buf->len > 0 && !io->completion_cb)
-                        server_io->started_cb (msg, server_io->started_user_data);
+                if (is_first_read && io->read_header_buf->len > 0) {
+                        soup_server_message_set_metrics_timestamp (msg, SOUP_SERVER_MESSAGE_METRICS_REQUEST_START);
+                        if (!io->completion_cb)
+                                server_io->started_cb (msg, server_io->started_user_data);
+                }
 
                 if (!succeeded) {
                         if (g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT))
@@ -744,6 +698,8 @@ io_read (SoupServerMessageIOHTTP1 *server_io,
                         return FALSE;
 		}
 
+                server_io->msg_io->metrics->request_header_bytes_received += io->read_header_buf->len;
+                soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_SERVER_BYTES_RECEIVED, io->read_header_buf->len);
                 status = parse_headers (msg,
                                         (char *)io->read_header_buf->data,
                                         io->read_header_buf->len,
@@ -783,7 +739,16 @@ io_read (SoupServerMessageIOHTTP1 *server_io,
                 else
                         io->read_length = -1;
 
+                soup_server_message_set_metrics_timestamp (msg, SOUP_SERVER_MESSAGE_METRICS_REQUEST_HEADERS_END);
                 soup_server_message_got_headers (msg);
+
+                /* A got-headers handler answered with an error and
+                 * asked to close the connection, so there's no point
+                 * in reading the body.
+                 */
+                status = soup_server_message_get_status (msg);
+                if (status >= SOUP_STATUS_BAD_REQUEST && !soup_server_message_is_keepalive (msg))
+                        io->read_state = SOUP_MESSAGE_IO_STATE_FINISHING;
                 break;
 
         case SOUP_MESSAGE_IO_STATE_BODY_START:
@@ -798,22 +763,54 @@ io_read (SoupServerMessageIOHTTP1 *server_io,
                 break;
 
         case SOUP_MESSAGE_IO_STATE_BODY: {
-                guchar buf[RESPONSE_BLOCK_SIZE];
+                SoupMessageIOHTTP1 *msg_io = server_io->msg_io;
+                gsize block_size;
+
+                /* Read into a refcounted block and hand out slices
+                 * of it, so the request body chunks share the block
+                 * instead of copying each read.
+                 */
+                if (!msg_io->read_block) {
+                        block_size = REQUEST_BLOCK_SIZE;
+                        if (io->read_encoding == SOUP_ENCODING_CONTENT_LENGTH)
+                                block_size = CLAMP (io->read_length - msg_io->read_body_length, 1, REQUEST_BLOCK_SIZE);
+
+                        msg_io->read_block_data = g_malloc (block_size);
+                        msg_io->read_block = g_bytes_new_take (msg_io->read_block_data, block_size);
+                        msg_io->read_block_offset = 0;
+                }
 
+                block_size = g_bytes_get_size (msg_io->read_block);
                 nread = g_pollable_stream_read (io->body_istream,
-                                                buf,
-                                                RESPONSE_BLOCK_SIZE,
+                                                msg_io->read_block_data + msg_io->read_block_offset,
+                                                block_size - msg_io->read_block_offset,
                                                 FALSE,
                                                 NULL, error);
                 if (nread > 0) {
-			SoupMessageBody *request_body;
-
-			request_body = soup_server_message_get_request_body (msg);
-                        if (request_body) {
-                                GBytes *bytes = g_bytes_new (buf, nread);
-                                soup_message_body_got_chunk (request_body, bytes);
+                        GBytes *bytes;
+
+                        bytes = g_bytes_new_from_bytes (msg_io->read_block, msg_io->read_block_offset, nread);
+                        msg_io->read_block_offset += nread;
+                        msg_io->read_body_length += nread;
+                        msg_io->metrics->request_body_bytes_received += nread;
+                        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_SERVER_BYTES_RECEIVED, nread);
+                        if (block_size - msg_io->read_block_offset < RESPONSE_BLOCK_SIZE)
+                                g_clear_pointer (&msg_io->read_block, g_bytes_unref);
+
+                        succeeded = soup_server_message_got_request_chunk (msg, bytes, error);
+                        if (succeeded)
                                 soup_server_message_got_chunk (msg, bytes);
-                                g_bytes_unref (bytes);
+                        g_bytes_unref (bytes);
+                        if (!succeeded)
+                                return FALSE;
+
+                        /* Like for got-headers, a got-chunk handler
+                         * can reject the body and skip the rest of it.
+                         */
+                        status = soup_server_message_get_status (msg);
+                        if (status >= SOUP_STATUS_BAD_REQUEST && !soup_server_message_is_keepalive (msg)) {
+                                g_clear_pointer (&msg_io->read_block, g_bytes_unref);
+                                io->read_state = SOUP_MESSAGE_IO_STATE_FINISHING;
                         }
                         break;
                 }
@@ -822,12 +819,14 @@ io_read (SoupServerMessageIOHTTP1 *server_io,
                         return FALSE;
 
                 /* else nread == 0 */
+                g_clear_pointer (&msg_io->read_block, g_bytes_unref);
                 io->read_state = SOUP_MESSAGE_IO_STATE_BODY_DONE;
                 break;
         }
 
         case SOUP_MESSAGE_IO_STATE_BODY_DONE:
                 io->read_state = SOUP_MESSAGE_IO_STATE_FINISHING;
+                soup_server_message_set_metrics_timestamp (msg, SOUP_SERVER_MESSAGE_METRICS_REQUEST_END);
                 soup_server_message_got_body (msg);
                 break;
 
@@ -1033,10 +1032,12 @@ static const SoupServerMessageIOFuncs io_funcs = {
         soup_server_message_io_http1_destroy,
         soup_server_message_io_http1_finished,
         soup_server_message_io_http1_steal,
+        NULL,
         soup_server_message_io_http1_read_request,
         soup_server_message_io_http1_pause,
         soup_server_message_io_http1_unpause,
-        soup_server_message_io_http1_is_paused
+        soup_server_message_io_http1_is_paused,
+        NULL
 };
 
 SoupServerMessageIO *
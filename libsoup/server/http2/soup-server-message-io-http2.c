@@ -22,12 +22,25 @@
 #include "soup-message-io-data.h"
 #include "soup-message-headers-private.h"
 #include "soup-server-message-private.h"
+#include "soup-server-message-metrics-private.h"
 #include "soup-misc.h"
+#include "soup-profiler.h"
 #include "soup-http2-utils.h"
+#include "soup-body-input-stream-http2.h"
+#include "soup-body-output-stream-http2.h"
+
+#define FRAME_HEADER_SIZE 9
+#define READ_BUFFER_SIZE 16384
+/* DATA chunks at least this big are passed on as slices of the read
+ * buffer instead of being copied. Smaller ones are copied so that they
+ * don't keep a whole buffer alive.
+ */
+#define MIN_SLICE_SIZE (READ_BUFFER_SIZE / 4)
 
 typedef struct {
         SoupServerMessage *msg;
         guint32 stream_id;
+        gint64 begin_time;
         SoupHTTP2IOState state;
         GSource *unpause_source;
         gboolean paused;
@@ -42,6 +55,16 @@ typedef struct {
         GBytes *write_chunk;
         goffset write_offset;
         goffset chunk_written;
+        /* The Content-Length of the response, or -1 */
+        goffset write_length;
+
+        /* Outgoing half of an accepted extended CONNECT stream */
+        GOutputStream *tunnel_ostream;
+
+        /* Request body bytes received while the body was held, not
+         * yet given back to the stream's flow control window.
+         */
+        gsize unconsumed;
 } SoupMessageIOHTTP2;
 
 typedef struct {
@@ -54,6 +77,11 @@ typedef struct {
 
         GSource *read_source;
         GSource *write_source;
+        guint64 write_blocked_since;
+
+        guint8 *read_buffer;
+        /* Owns read_buffer once chunks of it have been handed out */
+        GBytes *read_bytes;
 
         nghttp2_session *session;
 
@@ -67,9 +95,19 @@ typedef struct {
 
         GHashTable *messages;
 
+        /* Streams stolen for WebSockets, stream id -> SoupHTTP2Tunnel */
+        GHashTable *tunnels;
+
         guint in_callback;
 } SoupServerMessageIOHTTP2;
 
+typedef struct {
+        SoupServerMessageIOHTTP2 *io; /* Unowned */
+        guint32 stream_id;
+        GInputStream *istream;
+        GOutputStream *ostream;
+} SoupHTTP2Tunnel;
+
 static void soup_server_message_io_http2_send_response (SoupServerMessageIOHTTP2 *io,
                                                         SoupMessageIOHTTP2       *msg_io);
 
@@ -137,9 +175,30 @@ soup_message_io_http2_free (SoupMessageIOHTTP2 *msg_io)
         g_free (msg_io->authority);
         g_free (msg_io->path);
         g_clear_pointer (&msg_io->write_chunk, g_bytes_unref);
+        g_clear_object (&msg_io->tunnel_ostream);
         g_free (msg_io);
 }
 
+static void
+soup_http2_tunnel_abort (SoupHTTP2Tunnel *tunnel)
+{
+        soup_body_input_stream_http2_complete (SOUP_BODY_INPUT_STREAM_HTTP2 (tunnel->istream));
+        soup_body_output_stream_http2_set_error (SOUP_BODY_OUTPUT_STREAM_HTTP2 (tunnel->ostream),
+                                                 g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                                                                      _("Connection terminated unexpectedly")));
+}
+
+static void
+soup_http2_tunnel_free (SoupHTTP2Tunnel *tunnel)
+{
+        g_signal_handlers_disconnect_by_data (tunnel->istream, tunnel);
+        g_signal_handlers_disconnect_by_data (tunnel->ostream, tunnel);
+        soup_http2_tunnel_abort (tunnel);
+        g_object_unref (tunnel->istream);
+        g_object_unref (tunnel->ostream);
+        g_free (tunnel);
+}
+
 static void
 soup_server_message_io_http2_destroy (SoupServerMessageIO *iface)
 {
@@ -154,9 +213,15 @@ soup_server_message_io_http2_destroy (SoupServerMessageIO *iface)
                 g_source_unref (io->write_source);
         }
 
+        if (io->read_bytes)
+                g_bytes_unref (io->read_bytes);
+        else
+                g_free (io->read_buffer);
+
         g_clear_object (&io->iostream);
         g_clear_pointer (&io->session, nghttp2_session_del);
         g_clear_pointer (&io->messages, g_hash_table_unref);
+        g_clear_pointer (&io->tunnels, g_hash_table_unref);
 
         g_free (io);
 }
@@ -195,6 +260,78 @@ soup_server_message_io_http2_steal (SoupServerMessageIO *iface)
         return NULL;
 }
 
+static void io_try_write (SoupServerMessageIOHTTP2 *io);
+
+static void
+tunnel_data_available (SoupBodyOutputStreamHttp2 *ostream,
+                       SoupHTTP2Tunnel           *tunnel)
+{
+        nghttp2_session_resume_data (tunnel->io->session, tunnel->stream_id);
+        io_try_write (tunnel->io);
+}
+
+/* The stream window is only replenished with what the tunnel's
+ * reader has consumed, so that a peer can't send faster than the
+ * data is read.
+ */
+static void
+tunnel_read_data (SoupBodyInputStreamHttp2 *istream,
+                  guint64                   count,
+                  SoupHTTP2Tunnel          *tunnel)
+{
+        nghttp2_session_consume_stream (tunnel->io->session, tunnel->stream_id, count);
+        io_try_write (tunnel->io);
+}
+
+static GIOStream *
+soup_server_message_io_http2_steal_stream (SoupServerMessageIO *iface,
+                                           SoupServerMessage   *msg)
+{
+        SoupServerMessageIOHTTP2 *io = (SoupServerMessageIOHTTP2 *)iface;
+        SoupMessageIOHTTP2 *msg_io = NULL;
+        SoupMessageIOCompletionFn completion_cb;
+        gpointer completion_data;
+        SoupHTTP2Tunnel *tunnel;
+        GIOStream *stream;
+
+        msg_io = g_hash_table_lookup (io->messages, msg);
+        if (!msg_io || !msg_io->tunnel_ostream || msg_io->state < STATE_WRITE_DATA)
+                return NULL;
+
+        h2_debug (io, msg_io, "[TUNNEL] Stealing stream");
+
+        g_hash_table_steal (io->messages, msg);
+
+        tunnel = g_new0 (SoupHTTP2Tunnel, 1);
+        tunnel->io = io;
+        tunnel->stream_id = msg_io->stream_id;
+        tunnel->istream = soup_body_input_stream_http2_new ();
+        tunnel->ostream = g_steal_pointer (&msg_io->tunnel_ostream);
+        g_signal_connect (tunnel->istream, "read-data",
+                          G_CALLBACK (tunnel_read_data), tunnel);
+        g_signal_connect (tunnel->ostream, "data-available",
+                          G_CALLBACK (tunnel_data_available), tunnel);
+        g_hash_table_insert (io->tunnels, GUINT_TO_POINTER (tunnel->stream_id), tunnel);
+
+        /* From now on frames for this stream are routed to the tunnel */
+        nghttp2_session_set_stream_user_data (io->session, msg_io->stream_id, NULL);
+
+        stream = g_simple_io_stream_new (tunnel->istream, tunnel->ostream);
+
+        completion_cb = msg_io->completion_cb;
+        completion_data = msg_io->completion_data;
+
+        g_object_ref (msg);
+        soup_message_io_http2_free (msg_io);
+
+        if (completion_cb)
+                completion_cb (G_OBJECT (msg), SOUP_MESSAGE_IO_STOLEN, completion_data);
+
+        g_object_unref (msg);
+
+        return stream;
+}
+
 static void
 soup_server_message_io_http2_read_request (SoupServerMessageIO      *iface,
                                            SoupServerMessage        *msg,
@@ -259,6 +396,12 @@ io_unpause_internal (UnpauseSourceData *data)
         case STATE_READ_DONE:
                 soup_server_message_io_http2_send_response (data->io, msg_io);
                 break;
+        case STATE_WRITE_HEADERS:
+        case STATE_WRITE_DATA:
+                /* More of a streamed response body is available */
+                nghttp2_session_resume_data (data->io->session, msg_io->stream_id);
+                io_try_write (data->io);
+                break;
         default:
                 g_warn_if_reached ();
         }
@@ -306,14 +449,34 @@ soup_server_message_io_http2_is_paused (SoupServerMessageIO *iface,
         return msg_io->paused;
 }
 
+static void
+soup_server_message_io_http2_request_body_released (SoupServerMessageIO *iface,
+                                                    SoupServerMessage   *msg)
+{
+        SoupServerMessageIOHTTP2 *io = (SoupServerMessageIOHTTP2 *)iface;
+        SoupMessageIOHTTP2 *msg_io;
+
+        msg_io = g_hash_table_lookup (io->messages, msg);
+        if (!msg_io || !msg_io->unconsumed)
+                return;
+
+        h2_debug (io, msg_io, "[DATA] Request body released, consumed %zu", msg_io->unconsumed);
+
+        nghttp2_session_consume_stream (io->session, msg_io->stream_id, msg_io->unconsumed);
+        msg_io->unconsumed = 0;
+        io_try_write (io);
+}
+
 static const SoupServerMessageIOFuncs io_funcs = {
         soup_server_message_io_http2_destroy,
         soup_server_message_io_http2_finished,
         soup_server_message_io_http2_steal,
+        soup_server_message_io_http2_steal_stream,
         soup_server_message_io_http2_read_request,
         soup_server_message_io_http2_pause,
         soup_server_message_io_http2_unpause,
-        soup_server_message_io_http2_is_paused
+        soup_server_message_io_http2_is_paused,
+        soup_server_message_io_http2_request_body_released
 };
 
 static gboolean
@@ -342,10 +505,34 @@ io_write (SoupServerMessageIOHTTP2 *io,
         if (ret < 0)
                 return FALSE;
 
+        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_SERVER_BYTES_SENT, ret);
         io->written_bytes += ret;
         return TRUE;
 }
 
+/* The connection being blocked on write delays all the responses
+ * being written at that time, so it's accounted to each of them.
+ */
+static void
+write_blocked_end (SoupServerMessageIOHTTP2 *io)
+{
+        GHashTableIter iter;
+        SoupMessageIOHTTP2 *msg_io;
+        guint64 blocked_time;
+
+        if (!io->write_blocked_since)
+                return;
+
+        blocked_time = g_get_monotonic_time () - io->write_blocked_since;
+        io->write_blocked_since = 0;
+
+        g_hash_table_iter_init (&iter, io->messages);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&msg_io)) {
+                if (msg_io->state == STATE_WRITE_HEADERS || msg_io->state == STATE_WRITE_DATA)
+                        soup_server_message_get_metrics (msg_io->msg)->write_blocked_time += blocked_time;
+        }
+}
+
 static gboolean
 io_write_ready (GObject                  *stream,
                 SoupServerMessageIOHTTP2 *io)
@@ -355,10 +542,13 @@ io_write_ready (GObject                  *stream,
 
         g_object_ref (conn);
 
+        write_blocked_end (io);
+
         while (!error && soup_server_connection_get_io_data (conn) == (SoupServerMessageIO *)io && nghttp2_session_want_write (io->session))
                 io_write (io, &error);
 
         if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+                io->write_blocked_since = g_get_monotonic_time ();
                 g_error_free (error);
                 g_object_unref (conn);
                 return G_SOURCE_CONTINUE;
@@ -396,6 +586,8 @@ io_try_write (SoupServerMessageIOHTTP2 *io)
 
         if (soup_server_connection_get_io_data (conn) == (SoupServerMessageIO *)io) {
                 if (io->in_callback || g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+                        if (error)
+                                io->write_blocked_since = g_get_monotonic_time ();
                         g_clear_error (&error);
                         io->write_source = g_pollable_output_stream_create_source (G_POLLABLE_OUTPUT_STREAM (io->ostream), NULL);
                         g_source_set_name (io->write_source, "S oup server HTTP/2 write source");
@@ -418,11 +610,13 @@ static gboolean
 io_read (SoupServerMessageIOHTTP2 *io,
          GError                  **error)
 {
-        guint8 buffer[8192];
         gssize read;
         int ret;
 
-        if ((read = g_pollable_stream_read (io->istream, buffer, sizeof (buffer), FALSE, NULL, error)) < 0)
+        if (!io->read_buffer)
+                io->read_buffer = g_malloc (READ_BUFFER_SIZE);
+
+        if ((read = g_pollable_stream_read (io->istream, io->read_buffer, READ_BUFFER_SIZE, FALSE, NULL, error)) < 0)
                 return FALSE;
 
         if (read == 0) {
@@ -432,8 +626,17 @@ io_read (SoupServerMessageIOHTTP2 *io,
                 return FALSE;
         }
 
+        soup_profiler_bytes_add (SOUP_PROFILER_COUNTER_SERVER_BYTES_RECEIVED, read);
+
         g_assert (io->in_callback == 0);
-        ret = nghttp2_session_mem_recv (io->session, buffer, read);
+        ret = nghttp2_session_mem_recv (io->session, io->read_buffer, read);
+
+        /* Chunks handed out keep the buffer alive, use a new one for the next read */
+        if (io->read_bytes) {
+                g_clear_pointer (&io->read_bytes, g_bytes_unref);
+                io->read_buffer = NULL;
+        }
+
         if (ret < 0) {
                 g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "HTTP/2 IO error: %s", nghttp2_strerror (ret));
                 return FALSE;
@@ -522,6 +725,8 @@ on_begin_headers_callback (nghttp2_session     *session,
         h2_debug (io, msg_io, "[SESSION] Message IO created");
 
         nghttp2_session_set_stream_user_data (session, frame->hd.stream_id, msg_io);
+        soup_server_message_set_metrics_timestamp (msg_io->msg, SOUP_SERVER_MESSAGE_METRICS_REQUEST_START);
+        msg_io->begin_time = soup_profiler_get_time ();
 
         if (!msg_io->completion_cb)
                 io->started_cb (msg_io->msg, io->started_user_data);
@@ -569,6 +774,8 @@ on_header_callback (nghttp2_session     *session,
                         msg_io->authority = g_strndup ((char *)value, valuelen);
                 else if (strcmp ((char *)name, ":path") == 0)
                         msg_io->path = g_strndup ((char *)value, valuelen);
+                else if (strcmp ((char *)name, ":protocol") == 0)
+                        soup_server_message_set_connect_protocol (msg, (char *)value);
                 else
                         g_debug ("Unknown header: %s = %s", name, value);
                 io->in_callback--;
@@ -582,6 +789,20 @@ on_header_callback (nghttp2_session     *session,
         return 0;
 }
 
+static GBytes *
+io_get_read_chunk (SoupServerMessageIOHTTP2 *io,
+                   const uint8_t            *data,
+                   size_t                    len)
+{
+        if (len < MIN_SLICE_SIZE || data < io->read_buffer || data + len > io->read_buffer + READ_BUFFER_SIZE)
+                return g_bytes_new (data, len);
+
+        if (!io->read_bytes)
+                io->read_bytes = g_bytes_new_take (io->read_buffer, READ_BUFFER_SIZE);
+
+        return g_bytes_new_from_bytes (io->read_bytes, data - io->read_buffer, len);
+}
+
 static int
 on_data_chunk_recv_callback (nghttp2_session *session,
                              uint8_t          flags,
@@ -593,25 +814,76 @@ on_data_chunk_recv_callback (nghttp2_session *session,
         SoupServerMessageIOHTTP2 *io = (SoupServerMessageIOHTTP2 *)user_data;
         SoupMessageIOHTTP2 *msg_io;
         GBytes *bytes;
+        GError *error = NULL;
 
         msg_io = nghttp2_session_get_stream_user_data (session, stream_id);
-        if (!msg_io)
-                return NGHTTP2_ERR_CALLBACK_FAILURE;
+        if (!msg_io) {
+                SoupHTTP2Tunnel *tunnel = g_hash_table_lookup (io->tunnels, GUINT_TO_POINTER (stream_id));
+
+                if (!tunnel)
+                        return NGHTTP2_ERR_CALLBACK_FAILURE;
+
+                nghttp2_session_consume_connection (session, len);
+                soup_body_input_stream_http2_add_data (SOUP_BODY_INPUT_STREAM_HTTP2 (tunnel->istream), data, len);
+                return 0;
+        }
 
         h2_debug (user_data, msg_io, "[DATA] Received chunk, len=%zu, flags=%u, paused=%d", len, flags, msg_io->paused);
 
         io->in_callback++;
 
-        bytes = g_bytes_new (data, len);
-        soup_message_body_got_chunk (soup_server_message_get_request_body (msg_io->msg), bytes);
-        soup_server_message_got_chunk (msg_io->msg, bytes);
+        /* Window updates are sent manually. The connection window is
+         * replenished right away so that other streams can make progress,
+         * the stream window only once the chunk has been handed off.
+         */
+        nghttp2_session_consume_connection (session, len);
+
+        bytes = io_get_read_chunk (io, data, len);
+        if (soup_server_message_got_request_chunk (msg_io->msg, bytes, &error)) {
+                soup_server_message_got_chunk (msg_io->msg, bytes);
+        } else {
+                h2_debug (user_data, msg_io, "[DATA] Failed to store chunk: %s", error->message);
+                nghttp2_submit_rst_stream (session, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_INTERNAL_ERROR);
+                g_error_free (error);
+        }
         g_bytes_unref (bytes);
 
+        if (soup_server_message_is_request_body_held (msg_io->msg))
+                msg_io->unconsumed += len;
+        else
+                nghttp2_session_consume_stream (session, stream_id, len);
+
         io->in_callback--;
 
         return 0;
 }
 
+/* Whether the whole response body has been written once the written
+ * data caught up with @body.
+ */
+static gboolean
+soup_message_io_http2_wrote_whole_body (SoupMessageIOHTTP2 *msg_io,
+                                        SoupMessageBody    *body)
+{
+        GBytes *chunk;
+
+        if (msg_io->write_length >= 0 && msg_io->write_offset >= msg_io->write_length)
+                return TRUE;
+
+        /* Bodies that are not streamed are complete once the response is sent */
+        if (!soup_server_message_has_response_encoder (msg_io->msg) &&
+            soup_message_body_get_accumulate (soup_server_message_get_response_body (msg_io->msg)))
+                return TRUE;
+
+        /* Otherwise only an empty chunk, added by soup_message_body_complete(), is left */
+        chunk = soup_message_body_get_chunk (body, msg_io->write_offset);
+        if (!chunk)
+                return FALSE;
+
+        g_bytes_unref (chunk);
+        return TRUE;
+}
+
 static ssize_t
 on_data_source_read_callback (nghttp2_session     *session,
                               int32_t              stream_id,
@@ -624,11 +896,12 @@ on_data_source_read_callback (nghttp2_session     *session,
         SoupServerMessageIOHTTP2 *io = (SoupServerMessageIOHTTP2 *)user_data;
         SoupMessageIOHTTP2 *msg_io;
         gsize bytes_written = 0;
-        SoupMessageBody *response_body = (SoupMessageBody *)source->ptr;
+        SoupMessageBody *response_body;
 
         io->in_callback++;
 
         msg_io = nghttp2_session_get_stream_user_data (session, stream_id);
+        response_body = soup_server_message_get_write_body (msg_io->msg);
 
         h2_debug (user_data, msg_io, "[SEND_BODY] paused=%d", msg_io->paused);
 
@@ -658,9 +931,19 @@ on_data_source_read_callback (nghttp2_session     *session,
         }
 
         if (msg_io->write_offset == response_body->length) {
-                soup_server_message_wrote_body (msg_io->msg);
-                h2_debug (user_data, msg_io, "[SEND_BODY] EOF");
-                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                if (soup_message_io_http2_wrote_whole_body (msg_io, response_body)) {
+                        soup_server_message_wrote_body (msg_io->msg);
+                        h2_debug (user_data, msg_io, "[SEND_BODY] EOF");
+                        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                } else if (bytes_written == 0) {
+                        /* Wait for more of a streamed body, like the
+                         * HTTP/1 backend does; unpausing resumes the data.
+                         */
+                        h2_debug (user_data, msg_io, "[SEND_BODY] Waiting for data");
+                        soup_server_message_pause (msg_io->msg);
+                        io->in_callback--;
+                        return NGHTTP2_ERR_DEFERRED;
+                }
         }
 
         io->in_callback--;
@@ -668,6 +951,53 @@ on_data_source_read_callback (nghttp2_session     *session,
         return bytes_written;
 }
 
+static ssize_t
+on_tunnel_data_source_read_callback (nghttp2_session     *session,
+                                     int32_t              stream_id,
+                                     uint8_t             *buf,
+                                     size_t               length,
+                                     uint32_t            *data_flags,
+                                     nghttp2_data_source *source,
+                                     void                *user_data)
+{
+        SoupServerMessageIOHTTP2 *io = (SoupServerMessageIOHTTP2 *)user_data;
+        SoupMessageIOHTTP2 *msg_io;
+        SoupBodyOutputStreamHttp2 *ostream = NULL;
+        gsize read;
+
+        msg_io = nghttp2_session_get_stream_user_data (session, stream_id);
+        if (msg_io)
+                ostream = SOUP_BODY_OUTPUT_STREAM_HTTP2 (msg_io->tunnel_ostream);
+        else {
+                SoupHTTP2Tunnel *tunnel = g_hash_table_lookup (io->tunnels, GUINT_TO_POINTER (stream_id));
+
+                if (tunnel)
+                        ostream = SOUP_BODY_OUTPUT_STREAM_HTTP2 (tunnel->ostream);
+        }
+
+        if (!ostream)
+                return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+
+        read = soup_body_output_stream_http2_read_data (ostream, buf, length);
+        if (read > 0)
+                return read;
+
+        if (soup_body_output_stream_http2_is_eof (ostream)) {
+                h2_debug (io, msg_io, "[TUNNEL] stream_id=%u, EOF", stream_id);
+                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                return 0;
+        }
+
+        return NGHTTP2_ERR_DEFERRED;
+}
+
+static gboolean
+soup_message_io_http2_is_extended_connect (SoupMessageIOHTTP2 *msg_io)
+{
+        return soup_server_message_get_method (msg_io->msg) == SOUP_METHOD_CONNECT &&
+                soup_server_message_get_connect_protocol (msg_io->msg) != NULL;
+}
+
 static void
 soup_server_message_io_http2_send_response (SoupServerMessageIOHTTP2 *io,
                                             SoupMessageIOHTTP2       *msg_io)
@@ -677,26 +1007,45 @@ soup_server_message_io_http2_send_response (SoupServerMessageIOHTTP2 *io,
                 return;
 
         SoupServerMessage *msg = msg_io->msg;
+        soup_server_message_set_metrics_timestamp (msg, SOUP_SERVER_MESSAGE_METRICS_RESPONSE_START);
         GArray *headers = g_array_new (FALSE, FALSE, sizeof (nghttp2_nv));
         guint status_code = soup_server_message_get_status (msg);
         if (status_code == 0) {
                 status_code = SOUP_STATUS_INTERNAL_SERVER_ERROR;
                 soup_server_message_set_status (msg, status_code, NULL);
         }
+        soup_server_message_handle_partial_get (msg);
+        status_code = soup_server_message_get_status (msg);
         char *status = g_strdup_printf ("%u", status_code);
         const nghttp2_nv status_nv = MAKE_NV2 (":status", status);
         g_array_append_val (headers, status_nv);
 
+        /* A successful response to a WebSocket extended CONNECT turns the
+         * stream into a tunnel that stays open until stolen and closed.
+         */
+        gboolean is_tunnel = SOUP_STATUS_IS_SUCCESSFUL (status_code) &&
+                soup_message_io_http2_is_extended_connect (msg_io) &&
+                g_strcmp0 (soup_server_message_get_connect_protocol (msg), "websocket") == 0;
+
         SoupMessageHeaders *response_headers = soup_server_message_get_response_headers (msg);
-        if (status_code == SOUP_STATUS_NO_CONTENT || SOUP_STATUS_IS_INFORMATIONAL (status_code)) {
+        if (!is_tunnel)
+                soup_server_message_encode_response (msg);
+
+        if (is_tunnel || status_code == SOUP_STATUS_NO_CONTENT || SOUP_STATUS_IS_INFORMATIONAL (status_code)) {
                 soup_message_headers_remove (response_headers, "Content-Length");
-        } else if (!soup_message_headers_get_content_length (response_headers)) {
+        } else if (!soup_server_message_has_response_encoder (msg) &&
+                   !soup_message_headers_get_content_length (response_headers)) {
                 SoupMessageBody *response_body;
 
                 response_body = soup_server_message_get_response_body (msg);
                 soup_message_headers_set_content_length (response_headers, response_body->length);
         }
 
+        if (soup_message_headers_get_encoding (response_headers) == SOUP_ENCODING_CONTENT_LENGTH)
+                msg_io->write_length = soup_message_headers_get_content_length (response_headers);
+        else
+                msg_io->write_length = -1;
+
         SoupMessageHeadersIter iter;
         const char *name, *value;
         soup_message_headers_iter_init (&iter, response_headers);
@@ -708,8 +1057,14 @@ soup_server_message_io_http2_send_response (SoupServerMessageIOHTTP2 *io,
         advance_state_from (msg_io, STATE_READ_DONE, STATE_WRITE_HEADERS);
 
         nghttp2_data_provider data_provider;
-        data_provider.source.ptr = soup_server_message_get_response_body (msg);
-        data_provider.read_callback = on_data_source_read_callback;
+        if (is_tunnel) {
+                msg_io->tunnel_ostream = soup_body_output_stream_http2_new ();
+                data_provider.source.ptr = NULL;
+                data_provider.read_callback = on_tunnel_data_source_read_callback;
+        } else {
+                data_provider.source.ptr = NULL;
+                data_provider.read_callback = on_data_source_read_callback;
+        }
         nghttp2_submit_response (io->session, msg_io->stream_id, (const nghttp2_nv *)headers->data, headers->len, &data_provider);
         io_try_write (io);
         g_array_free (headers, TRUE);
@@ -726,8 +1081,29 @@ on_frame_recv_callback (nghttp2_session     *session,
 
         msg_io = nghttp2_session_get_stream_user_data (session, frame->hd.stream_id);
         h2_debug (io, msg_io, "[RECV] [%s] Received (%u)", soup_http2_frame_type_to_string (frame->hd.type), frame->hd.flags);
-        if (!msg_io)
+        if (!msg_io) {
+                SoupHTTP2Tunnel *tunnel = frame->hd.stream_id ? g_hash_table_lookup (io->tunnels, GUINT_TO_POINTER (frame->hd.stream_id)) : NULL;
+
+                if (!tunnel)
+                        return 0;
+
+                io->in_callback++;
+                switch (frame->hd.type) {
+                case NGHTTP2_HEADERS:
+                case NGHTTP2_DATA:
+                        if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM)
+                                soup_body_input_stream_http2_complete (SOUP_BODY_INPUT_STREAM_HTTP2 (tunnel->istream));
+                        break;
+                case NGHTTP2_RST_STREAM:
+                        soup_http2_tunnel_abort (tunnel);
+                        break;
+                case NGHTTP2_WINDOW_UPDATE:
+                        io_try_write (io);
+                        break;
+                }
+                io->in_callback--;
                 return 0;
+        }
 
         io->in_callback++;
 
@@ -742,19 +1118,27 @@ on_frame_recv_callback (nghttp2_session     *session,
                 soup_server_message_set_uri (msg_io->msg, uri);
                 g_uri_unref (uri);
 
+                soup_server_message_get_metrics (msg_io->msg)->request_header_bytes_received += frame->hd.length + FRAME_HEADER_SIZE;
                 advance_state_from (msg_io, STATE_READ_HEADERS, STATE_READ_DATA);
+                soup_server_message_set_metrics_timestamp (msg_io->msg, SOUP_SERVER_MESSAGE_METRICS_REQUEST_HEADERS_END);
                 soup_server_message_got_headers (msg_io->msg);
                 break;
         }
         case NGHTTP2_DATA:
+                soup_server_message_get_metrics (msg_io->msg)->request_body_bytes_received += frame->hd.length + FRAME_HEADER_SIZE;
                 break;
         default:
                 io->in_callback--;
                 return 0;
         }
 
-        if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
+        /* Extended CONNECT requests (RFC 8441) have no body, the stream
+         * is kept open to be used as a tunnel once the request is accepted.
+         */
+        if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM ||
+            (frame->hd.type == NGHTTP2_HEADERS && soup_message_io_http2_is_extended_connect (msg_io))) {
                 advance_state_from (msg_io, STATE_READ_DATA, STATE_READ_DONE);
+                soup_server_message_set_metrics_timestamp (msg_io->msg, SOUP_SERVER_MESSAGE_METRICS_REQUEST_END);
                 soup_server_message_got_body (msg_io->msg);
                 soup_server_message_io_http2_send_response (io, msg_io);
         }
@@ -777,16 +1161,25 @@ on_frame_send_callback (nghttp2_session     *session,
 
         h2_debug (user_data, msg_io, "[SEND] [%s]", soup_http2_frame_type_to_string (frame->hd.type));
 
+        /* Frames of stolen streams */
+        if (!msg_io) {
+                io->in_callback--;
+                return 0;
+        }
+
         switch (frame->hd.type) {
         case NGHTTP2_HEADERS:
+                soup_server_message_get_metrics (msg_io->msg)->response_header_bytes_sent += frame->hd.length + FRAME_HEADER_SIZE;
                 if (frame->hd.flags & NGHTTP2_FLAG_END_HEADERS) {
                         advance_state_from (msg_io, STATE_WRITE_HEADERS, STATE_WRITE_DATA);
                         soup_server_message_wrote_headers (msg_io->msg);
                 }
                 break;
         case NGHTTP2_DATA:
+                soup_server_message_get_metrics (msg_io->msg)->response_body_bytes_sent += frame->hd.length + FRAME_HEADER_SIZE;
                 if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
                         advance_state_from (msg_io, STATE_WRITE_DATA, STATE_WRITE_DONE);
+                        soup_server_message_set_metrics_timestamp (msg_io->msg, SOUP_SERVER_MESSAGE_METRICS_RESPONSE_END);
                         soup_server_message_wrote_body (msg_io->msg);
                 }
                 break;
@@ -809,8 +1202,19 @@ on_stream_close_callback (nghttp2_session *session,
 
         msg_io = nghttp2_session_get_stream_user_data (session, stream_id);
         h2_debug (user_data, msg_io, "[SESSION] Closed %u, error: %s", stream_id, nghttp2_http2_strerror (error_code));
-        if (!msg_io)
+        if (!msg_io) {
+                g_hash_table_remove (io->tunnels, GUINT_TO_POINTER (stream_id));
                 return 0;
+        }
+
+        if (msg_io->begin_time && soup_profiler_is_active ()) {
+                const char *method = soup_server_message_get_method (msg_io->msg);
+
+                soup_profiler_mark (msg_io->begin_time, "HTTP/2 server stream", "%u %s %s: %s",
+                                    stream_id, method ? method : "",
+                                    msg_io->path ? msg_io->path : "",
+                                    nghttp2_http2_strerror (error_code));
+        }
 
         io->in_callback++;
 
@@ -825,6 +1229,7 @@ static void
 soup_server_message_io_http2_init (SoupServerMessageIOHTTP2 *io)
 {
         nghttp2_session_callbacks *callbacks;
+        nghttp2_option *option;
 
         soup_http2_debug_init ();
 
@@ -836,8 +1241,12 @@ soup_server_message_io_http2_init (SoupServerMessageIOHTTP2 *io)
         nghttp2_session_callbacks_set_on_frame_send_callback (callbacks, on_frame_send_callback);
         nghttp2_session_callbacks_set_on_stream_close_callback (callbacks, on_stream_close_callback);
 
-        nghttp2_session_server_new (&io->session, callbacks, io);
+        nghttp2_option_new (&option);
+        nghttp2_option_set_no_auto_window_update (option, 1);
+
+        nghttp2_session_server_new2 (&io->session, callbacks, io, option);
         nghttp2_session_callbacks_del (callbacks);
+        nghttp2_option_del (option);
 }
 
 SoupServerMessageIO *
@@ -867,12 +1276,16 @@ soup_server_message_io_http2_new (SoupServerConnection  *conn,
         io->iface.funcs = &io_funcs;
 
         io->messages = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)soup_message_io_http2_free);
+        io->tunnels = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)soup_http2_tunnel_free);
         g_hash_table_insert (io->messages, msg, soup_message_io_http2_new (msg));
         soup_server_message_set_http_version (msg, SOUP_HTTP_2_0);
 
         const nghttp2_settings_entry settings[] = {
                 { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100 },
-                { NGHTTP2_SETTINGS_ENABLE_PUSH, 0 }
+                { NGHTTP2_SETTINGS_ENABLE_PUSH, 0 },
+#ifdef HAVE_NGHTTP2_EXTENDED_CONNECT
+                { NGHTTP2_SETTINGS_ENABLE_CONNECT_PROTOCOL, 1 },
+#endif
         };
         nghttp2_submit_settings (io->session, NGHTTP2_FLAG_NONE, settings, G_N_ELEMENTS (settings));
         io_try_write (io);
@@ -0,0 +1,22 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-content-encoder.h"
+
+G_BEGIN_DECLS
+
+void     soup_content_encoder_encode_response (SoupContentEncoder *encoder,
+                                               SoupServerMessage  *msg);
+
+gboolean soup_content_encoder_convert         (GConverter         *converter,
+                                               const guint8       *data,
+                                               gsize               size,
+                                               GConverterFlags     flags,
+                                               GByteArray         *output,
+                                               GError            **error);
+
+G_END_DECLS
@@ -0,0 +1,818 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-content-encoder.c
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "soup-content-encoder-private.h"
+#include "soup-server-message-private.h"
+#include "soup-message-headers-private.h"
+#include "soup-headers.h"
+#include "soup.h"
+#ifdef WITH_ZSTD
+#include "content-decoder/soup-zstd-compressor.h"
+#endif
+
+/**
+ * SoupContentEncoder:
+ *
+ * Compresses [class@Server] responses.
+ *
+ * Once added to a server with [method@Server.set_content_encoder],
+ * #SoupContentEncoder negotiates a content coding for every successful
+ * response using the request's "Accept-Encoding" header, and compresses
+ * the response body with it. The "gzip" and "deflate" codings are
+ * always supported, and "zstd" is too if libsoup was built with
+ * Zstandard support. The encoder picks the coding the client gives the
+ * highest quality value. When several of them have the same one, it
+ * prefers the one that is cheapest to decode, in that order: "zstd",
+ * "gzip" and "deflate".
+ *
+ * Only responses whose Content-Type is allowed by the content type
+ * policies (see [method@ContentEncoder.set_content_type_policy]) and
+ * whose body is not smaller than
+ * [property@ContentEncoder:min-size] are compressed. Responses that
+ * already have a Content-Encoding, partial responses and responses to
+ * HEAD requests are left untouched.
+ *
+ * Responses whose body is complete when their headers are written are
+ * compressed at once and kept in a cache of
+ * [property@ContentEncoder:cache-size] bytes, so that sending the same
+ * body again doesn't need to compress it again. Bodies are looked up by
+ * URI and their "ETag" or "Last-Modified" header, so bodies without
+ * any of them are compressed every time. Responses using chunked
+ * encoding are compressed as they are written instead, flushing the
+ * encoder every time new data is available.
+ *
+ * Since: 3.4
+ */
+
+#define DEFAULT_MIN_SIZE 1024
+#define DEFAULT_CACHE_SIZE (8 * 1024 * 1024)
+
+#define ENCODE_BUFFER_SIZE (16 * 1024)
+
+/* Cached variants are compressed once, so it's worth spending more CPU */
+#define GZIP_STREAMING_LEVEL 6
+#define GZIP_CACHED_LEVEL 9
+#define ZSTD_STREAMING_LEVEL 3
+#define ZSTD_CACHED_LEVEL 12
+
+struct _SoupContentEncoder {
+        GObject parent;
+};
+
+typedef struct {
+        char *key;
+        GBytes *encoded;
+        gsize original_size;
+        GList link;
+} SoupContentEncoderCacheEntry;
+
+typedef struct {
+        GHashTable *policies;
+        gsize min_size;
+
+        GMutex cache_mutex;
+        GHashTable *cache;
+        GQueue lru;
+        gsize cache_used;
+        gsize cache_size;
+} SoupContentEncoderPrivate;
+
+enum {
+        PROP_0,
+
+        PROP_MIN_SIZE,
+        PROP_CACHE_SIZE,
+
+        LAST_PROPERTY
+};
+
+static GParamSpec *properties[LAST_PROPERTY] = { NULL, };
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupContentEncoder, soup_content_encoder, G_TYPE_OBJECT)
+
+/* In order of server preference */
+static const char *supported_codings[] = {
+#ifdef WITH_ZSTD
+        "zstd",
+#endif
+        "gzip",
+        "deflate"
+};
+
+static const char *default_compressed_types[] = {
+        "text/*",
+        "application/javascript",
+        "application/json",
+        "application/manifest+json",
+        "application/wasm",
+        "application/xhtml+xml",
+        "application/xml",
+        "image/svg+xml",
+        "image/x-icon"
+};
+
+static void
+cache_entry_free (SoupContentEncoderCacheEntry *entry)
+{
+        g_free (entry->key);
+        g_bytes_unref (entry->encoded);
+        g_free (entry);
+}
+
+static gsize
+cache_entry_get_size (SoupContentEncoderCacheEntry *entry)
+{
+        return g_bytes_get_size (entry->encoded);
+}
+
+static void
+soup_content_encoder_init (SoupContentEncoder *encoder)
+{
+        SoupContentEncoderPrivate *priv = soup_content_encoder_get_instance_private (encoder);
+        guint i;
+
+        priv->policies = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        for (i = 0; i < G_N_ELEMENTS (default_compressed_types); i++)
+                g_hash_table_insert (priv->policies, g_strdup (default_compressed_types[i]), GINT_TO_POINTER (TRUE));
+        priv->min_size = DEFAULT_MIN_SIZE;
+
+        g_mutex_init (&priv->cache_mutex);
+        priv->cache = g_hash_table_new (g_str_hash, g_str_equal);
+        g_queue_init (&priv->lru);
+        priv->cache_size = DEFAULT_CACHE_SIZE;
+}
+
+static void
+soup_content_encoder_finalize (GObject *object)
+{
+        SoupContentEncoder *encoder = SOUP_CONTENT_ENCODER (object);
+        SoupContentEncoderPrivate *priv = soup_content_encoder_get_instance_private (encoder);
+        GList *l;
+
+        g_hash_table_destroy (priv->policies);
+
+        g_hash_table_destroy (priv->cache);
+        while ((l = g_queue_pop_head_link (&priv->lru)))
+                cache_entry_free (l->data);
+        g_mutex_clear (&priv->cache_mutex);
+
+        G_OBJECT_CLASS (soup_content_encoder_parent_class)->finalize (object);
+}
+
+static void
+soup_content_encoder_set_property (GObject *object, guint prop_id,
+                                   const GValue *value, GParamSpec *pspec)
+{
+        SoupContentEncoder *encoder = SOUP_CONTENT_ENCODER (object);
+
+        switch (prop_id) {
+        case PROP_MIN_SIZE:
+                soup_content_encoder_set_min_size (encoder, g_value_get_uint64 (value));
+                break;
+        case PROP_CACHE_SIZE:
+                soup_content_encoder_set_cache_size (encoder, g_value_get_uint64 (value));
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+soup_content_encoder_get_property (GObject *object, guint prop_id,
+                                   GValue *value, GParamSpec *pspec)
+{
+        SoupContentEncoder *encoder = SOUP_CONTENT_ENCODER (object);
+
+        switch (prop_id) {
+        case PROP_MIN_SIZE:
+                g_value_set_uint64 (value, soup_content_encoder_get_min_size (encoder));
+                break;
+        case PROP_CACHE_SIZE:
+                g_value_set_uint64 (value, soup_content_encoder_get_cache_size (encoder));
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+soup_content_encoder_class_init (SoupContentEncoderClass *encoder_class)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (encoder_class);
+
+        object_class->finalize = soup_content_encoder_finalize;
+        object_class->set_property = soup_content_encoder_set_property;
+        object_class->get_property = soup_content_encoder_get_property;
+
+        /**
+         * SoupContentEncoder:min-size:
+         *
+         * Responses with a body known to be smaller than this are not
+         * compressed.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_MIN_SIZE] =
+                g_param_spec_uint64 ("min-size",
+                                     "Minimum size",
+                                     "Minimum size of the response bodies to compress",
+                                     0, G_MAXUINT64, DEFAULT_MIN_SIZE,
+                                     G_PARAM_READWRITE |
+                                     G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupContentEncoder:cache-size:
+         *
+         * Maximum amount of memory, in bytes, used to keep compressed
+         * variants of complete response bodies. 0 disables the cache.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_CACHE_SIZE] =
+                g_param_spec_uint64 ("cache-size",
+                                     "Cache size",
+                                     "Maximum size of the compressed variants cache",
+                                     0, G_MAXUINT64, DEFAULT_CACHE_SIZE,
+                                     G_PARAM_READWRITE |
+                                     G_PARAM_STATIC_STRINGS);
+
+        g_object_class_install_properties (object_class, LAST_PROPERTY, properties);
+}
+
+/**
+ * soup_content_encoder_new:
+ *
+ * Creates a new #SoupContentEncoder.
+ *
+ * Returns: (transfer full): a new #SoupContentEncoder
+ *
+ * Since: 3.4
+ */
+SoupContentEncoder *
+soup_content_encoder_new (void)
+{
+        return g_object_new (SOUP_TYPE_CONTENT_ENCODER, NULL);
+}
+
+/**
+ * soup_content_encoder_set_content_type_policy:
+ * @encoder: a #SoupContentEncoder
+ * @content_type: a media type, like "text/html", or a wildcard like "text/\*"
+ * @compress: whether responses of @content_type should be compressed
+ *
+ * Sets whether responses of @content_type should be compressed. A policy
+ * for an exact media type takes precedence over one for its wildcard.
+ *
+ * By default, text types, JSON, XML, JavaScript, WebAssembly and SVG are
+ * compressed, as well as any type with a "+json" or "+xml" suffix. Other
+ * types, like images or archives, usually are compressed already.
+ *
+ * Since: 3.4
+ */
+void
+soup_content_encoder_set_content_type_policy (SoupContentEncoder *encoder,
+                                              const char         *content_type,
+                                              gboolean            compress)
+{
+        SoupContentEncoderPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_CONTENT_ENCODER (encoder));
+        g_return_if_fail (content_type != NULL);
+
+        priv = soup_content_encoder_get_instance_private (encoder);
+        g_hash_table_replace (priv->policies, g_ascii_strdown (content_type, -1),
+                              GINT_TO_POINTER (compress));
+}
+
+/**
+ * soup_content_encoder_set_min_size:
+ * @encoder: a #SoupContentEncoder
+ * @min_size: a size in bytes
+ *
+ * Sets the [property@ContentEncoder:min-size] of @encoder.
+ *
+ * Since: 3.4
+ */
+void
+soup_content_encoder_set_min_size (SoupContentEncoder *encoder,
+                                   gsize               min_size)
+{
+        SoupContentEncoderPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_CONTENT_ENCODER (encoder));
+
+        priv = soup_content_encoder_get_instance_private (encoder);
+        if (priv->min_size == min_size)
+                return;
+
+        priv->min_size = min_size;
+        g_object_notify_by_pspec (G_OBJECT (encoder), properties[PROP_MIN_SIZE]);
+}
+
+/**
+ * soup_content_encoder_get_min_size:
+ * @encoder: a #SoupContentEncoder
+ *
+ * Gets the [property@ContentEncoder:min-size] of @encoder.
+ *
+ * Returns: the minimum size of the response bodies to compress
+ *
+ * Since: 3.4
+ */
+gsize
+soup_content_encoder_get_min_size (SoupContentEncoder *encoder)
+{
+        SoupContentEncoderPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_CONTENT_ENCODER (encoder), 0);
+
+        priv = soup_content_encoder_get_instance_private (encoder);
+        return priv->min_size;
+}
+
+static void
+soup_content_encoder_evict (SoupContentEncoder *encoder,
+                            gsize               max_size)
+{
+        SoupContentEncoderPrivate *priv = soup_content_encoder_get_instance_private (encoder);
+
+        while (priv->cache_used > max_size) {
+                GList *l = g_queue_pop_tail_link (&priv->lru);
+                SoupContentEncoderCacheEntry *entry = l->data;
+
+                g_hash_table_remove (priv->cache, entry->key);
+                priv->cache_used -= cache_entry_get_size (entry);
+                cache_entry_free (entry);
+        }
+}
+
+/**
+ * soup_content_encoder_set_cache_size:
+ * @encoder: a #SoupContentEncoder
+ * @cache_size: a size in bytes
+ *
+ * Sets the [property@ContentEncoder:cache-size] of @encoder.
+ *
+ * Since: 3.4
+ */
+void
+soup_content_encoder_set_cache_size (SoupContentEncoder *encoder,
+                                     gsize               cache_size)
+{
+        SoupContentEncoderPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_CONTENT_ENCODER (encoder));
+
+        priv = soup_content_encoder_get_instance_private (encoder);
+        g_mutex_lock (&priv->cache_mutex);
+        if (priv->cache_size == cache_size) {
+                g_mutex_unlock (&priv->cache_mutex);
+                return;
+        }
+        priv->cache_size = cache_size;
+        soup_content_encoder_evict (encoder, cache_size);
+        g_mutex_unlock (&priv->cache_mutex);
+
+        g_object_notify_by_pspec (G_OBJECT (encoder), properties[PROP_CACHE_SIZE]);
+}
+
+/**
+ * soup_content_encoder_get_cache_size:
+ * @encoder: a #SoupContentEncoder
+ *
+ * Gets the [property@ContentEncoder:cache-size] of @encoder.
+ *
+ * Returns: the maximum size of the compressed variants cache
+ *
+ * Since: 3.4
+ */
+gsize
+soup_content_encoder_get_cache_size (SoupContentEncoder *encoder)
+{
+        SoupContentEncoderPrivate *priv;
+        gsize cache_size;
+
+        g_return_val_if_fail (SOUP_IS_CONTENT_ENCODER (encoder), 0);
+
+        priv = soup_content_encoder_get_instance_private (encoder);
+        g_mutex_lock (&priv->cache_mutex);
+        cache_size = priv->cache_size;
+        g_mutex_unlock (&priv->cache_mutex);
+
+        return cache_size;
+}
+
+static gboolean
+soup_content_encoder_should_compress_type (SoupContentEncoder *encoder,
+                                           const char         *content_type)
+{
+        SoupContentEncoderPrivate *priv = soup_content_encoder_get_instance_private (encoder);
+        gpointer compress;
+        char *type, *slash;
+        gboolean retval;
+
+        if (!content_type)
+                return FALSE;
+
+        type = g_ascii_strdown (content_type, -1);
+        if (g_hash_table_lookup_extended (priv->policies, type, NULL, &compress)) {
+                g_free (type);
+                return GPOINTER_TO_INT (compress);
+        }
+
+        slash = strchr (type, '/');
+        if (slash) {
+                char *wildcard = g_strdup_printf ("%.*s/*", (int)(slash - type), type);
+                gboolean found;
+
+                found = g_hash_table_lookup_extended (priv->policies, wildcard, NULL, &compress);
+                g_free (wildcard);
+                if (found) {
+                        g_free (type);
+                        return GPOINTER_TO_INT (compress);
+                }
+        }
+
+        retval = g_str_has_suffix (type, "+json") || g_str_has_suffix (type, "+xml");
+        g_free (type);
+
+        return retval;
+}
+
+static gboolean
+coding_matches (const char *item,
+                const char *coding)
+{
+        if (!g_ascii_strcasecmp (item, coding))
+                return TRUE;
+
+        return !strcmp (coding, "gzip") && !g_ascii_strcasecmp (item, "x-gzip");
+}
+
+/* Returns the quality value of a list item in thousandths, and strips
+ * its parameters.
+ */
+static guint
+parse_coding_quality (char *item)
+{
+        char *semi, *param, *value;
+        guint qval, scale, i;
+
+        semi = strchr (item, ';');
+        if (!semi)
+                return 1000;
+        *semi = '\0';
+        g_strchomp (item);
+
+        for (param = semi + 1; param; param = semi ? semi + 1 : NULL) {
+                semi = strchr (param, ';');
+                param = g_strchug (param);
+                if (*param != 'q' && *param != 'Q')
+                        continue;
+                value = g_strchug (param + 1);
+                if (*value != '=')
+                        continue;
+                value = g_strchug (value + 1);
+                if (*value != '0' && *value != '1')
+                        continue;
+
+                qval = (*value - '0') * 1000;
+                if (*value == '0' && value[1] == '.') {
+                        for (i = 2, scale = 100; scale > 0 && g_ascii_isdigit (value[i]); i++, scale /= 10)
+                                qval += (value[i] - '0') * scale;
+                }
+
+                return qval;
+        }
+
+        return 1000;
+}
+
+static const char *
+soup_content_encoder_negotiate (const char *accept_encoding)
+{
+        GSList *items, *l;
+        guint qvals[G_N_ELEMENTS (supported_codings)] = { 0, };
+        gboolean explicit[G_N_ELEMENTS (supported_codings)] = { FALSE, };
+        guint any = 0, best = 0, i;
+        const char *coding = NULL;
+
+        if (!accept_encoding)
+                return NULL;
+
+        /* An explicit coding overrides "*", whatever their order */
+        items = soup_header_parse_list (accept_encoding);
+        for (l = items; l; l = l->next) {
+                char *item = l->data;
+                guint qval = parse_coding_quality (item);
+
+                if (!strcmp (item, "*")) {
+                        any = qval;
+                        continue;
+                }
+
+                for (i = 0; i < G_N_ELEMENTS (supported_codings); i++) {
+                        if (!coding_matches (item, supported_codings[i]))
+                                continue;
+                        qvals[i] = explicit[i] ? MAX (qvals[i], qval) : qval;
+                        explicit[i] = TRUE;
+                }
+        }
+        soup_header_free_list (items);
+
+        /* Ties are broken by server preference */
+        for (i = 0; i < G_N_ELEMENTS (supported_codings); i++) {
+                guint qval = explicit[i] ? qvals[i] : any;
+
+                if (qval > best) {
+                        best = qval;
+                        coding = supported_codings[i];
+                }
+        }
+
+        return coding;
+}
+
+static GConverter *
+soup_content_encoder_create_converter (const char *coding,
+                                       gboolean    cached)
+{
+#ifdef WITH_ZSTD
+        if (!strcmp (coding, "zstd"))
+                return (GConverter *)soup_zstd_compressor_new (cached ? ZSTD_CACHED_LEVEL : ZSTD_STREAMING_LEVEL);
+#endif
+        if (!strcmp (coding, "gzip"))
+                return (GConverter *)g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, cached ? GZIP_CACHED_LEVEL : GZIP_STREAMING_LEVEL);
+
+        return (GConverter *)g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_ZLIB, cached ? GZIP_CACHED_LEVEL : GZIP_STREAMING_LEVEL);
+}
+
+gboolean
+soup_content_encoder_convert (GConverter     *converter,
+                              const guint8   *data,
+                              gsize           size,
+                              GConverterFlags flags,
+                              GByteArray     *output,
+                              GError        **error)
+{
+        while (TRUE) {
+                GConverterResult result;
+                gsize bytes_read, bytes_written;
+                guint offset = output->len;
+
+                g_byte_array_set_size (output, offset + ENCODE_BUFFER_SIZE);
+                result = g_converter_convert (converter, data, size,
+                                              output->data + offset, ENCODE_BUFFER_SIZE,
+                                              flags, &bytes_read, &bytes_written, error);
+                if (result == G_CONVERTER_ERROR) {
+                        g_byte_array_set_size (output, offset);
+                        return FALSE;
+                }
+
+                g_byte_array_set_size (output, offset + bytes_written);
+                data += bytes_read;
+                size -= bytes_read;
+
+                if (result == G_CONVERTER_FINISHED || result == G_CONVERTER_FLUSHED)
+                        return TRUE;
+
+                if (size == 0 && !(flags & (G_CONVERTER_INPUT_AT_END | G_CONVERTER_FLUSH)))
+                        return TRUE;
+        }
+}
+
+/* Bodies that will be cached are worth the slower, higher levels */
+static GBytes *
+soup_content_encoder_encode_body (const char      *coding,
+                                  SoupMessageBody *body,
+                                  gboolean         cached)
+{
+        GConverter *converter = soup_content_encoder_create_converter (coding, cached);
+        GByteArray *output = g_byte_array_new ();
+        goffset offset = 0;
+        GError *error = NULL;
+
+        while (offset < body->length) {
+                GBytes *chunk = soup_message_body_get_chunk (body, offset);
+                gsize size;
+                gconstpointer data = g_bytes_get_data (chunk, &size);
+                gboolean ok;
+
+                ok = soup_content_encoder_convert (converter, data, size, G_CONVERTER_NO_FLAGS, output, &error);
+                g_bytes_unref (chunk);
+                if (!ok)
+                        break;
+                offset += size;
+        }
+
+        if (!error)
+                soup_content_encoder_convert (converter, NULL, 0, G_CONVERTER_INPUT_AT_END, output, &error);
+        g_object_unref (converter);
+
+        if (error) {
+                g_warning ("Failed to compress response body: %s", error->message);
+                g_error_free (error);
+                g_byte_array_free (output, TRUE);
+                return NULL;
+        }
+
+        return g_byte_array_free_to_bytes (output);
+}
+
+/* Bodies without a validator can't be told apart without hashing
+ * all of them on every response, so they are not cached.
+ */
+static char *
+soup_content_encoder_get_cache_key (SoupServerMessage *msg,
+                                    const char        *coding)
+{
+        SoupMessageHeaders *response_headers = soup_server_message_get_response_headers (msg);
+        const char *etag, *last_modified;
+        char *uri, *key;
+
+        etag = soup_message_headers_get_one_common (response_headers, SOUP_HEADER_ETAG);
+        last_modified = soup_message_headers_get_one_common (response_headers, SOUP_HEADER_LAST_MODIFIED);
+        if (!etag && !last_modified)
+                return NULL;
+
+        uri = g_uri_to_string (soup_server_message_get_uri (msg));
+        key = g_strdup_printf ("%s %s %s %s", coding, uri,
+                               etag ? etag : "", last_modified ? last_modified : "");
+        g_free (uri);
+
+        return key;
+}
+
+static GBytes *
+soup_content_encoder_get_cached_variant (SoupContentEncoder *encoder,
+                                         SoupServerMessage  *msg,
+                                         const char         *coding)
+{
+        SoupContentEncoderPrivate *priv = soup_content_encoder_get_instance_private (encoder);
+        SoupMessageBody *body = soup_server_message_get_response_body (msg);
+        SoupContentEncoderCacheEntry *entry;
+        GBytes *encoded = NULL;
+        char *key;
+
+        key = soup_content_encoder_get_cache_key (msg, coding);
+        if (!key)
+                return soup_content_encoder_encode_body (coding, body, FALSE);
+
+        g_mutex_lock (&priv->cache_mutex);
+        entry = g_hash_table_lookup (priv->cache, key);
+        if (entry && entry->original_size == (gsize)body->length) {
+                g_queue_unlink (&priv->lru, &entry->link);
+                g_queue_push_head_link (&priv->lru, &entry->link);
+                encoded = g_bytes_ref (entry->encoded);
+        }
+        g_mutex_unlock (&priv->cache_mutex);
+
+        if (encoded) {
+                g_free (key);
+                return encoded;
+        }
+
+        encoded = soup_content_encoder_encode_body (coding, body, TRUE);
+        if (!encoded) {
+                g_free (key);
+                return NULL;
+        }
+
+        entry = g_new0 (SoupContentEncoderCacheEntry, 1);
+        entry->key = key;
+        entry->encoded = g_bytes_ref (encoded);
+        entry->original_size = body->length;
+        entry->link.data = entry;
+
+        g_mutex_lock (&priv->cache_mutex);
+        if (cache_entry_get_size (entry) <= priv->cache_size / 4 &&
+            !g_hash_table_contains (priv->cache, key)) {
+                g_hash_table_insert (priv->cache, entry->key, entry);
+                g_queue_push_head_link (&priv->lru, &entry->link);
+                priv->cache_used += cache_entry_get_size (entry);
+                soup_content_encoder_evict (encoder, priv->cache_size);
+                entry = NULL;
+        }
+        g_mutex_unlock (&priv->cache_mutex);
+
+        if (entry)
+                cache_entry_free (entry);
+
+        return encoded;
+}
+
+static void
+weaken_etag (SoupMessageHeaders *headers)
+{
+        const char *etag = soup_message_headers_get_one_common (headers, SOUP_HEADER_ETAG);
+        char *weak_etag;
+
+        /* The encoded representation is not byte-for-byte the same */
+        if (!etag || g_str_has_prefix (etag, "W/"))
+                return;
+
+        weak_etag = g_strdup_printf ("W/%s", etag);
+        soup_message_headers_replace_common (headers, SOUP_HEADER_ETAG, weak_etag);
+        g_free (weak_etag);
+}
+
+void
+soup_content_encoder_encode_response (SoupContentEncoder *encoder,
+                                      SoupServerMessage  *msg)
+{
+        SoupContentEncoderPrivate *priv = soup_content_encoder_get_instance_private (encoder);
+        SoupMessageHeaders *request_headers = soup_server_message_get_request_headers (msg);
+        SoupMessageHeaders *response_headers = soup_server_message_get_response_headers (msg);
+        SoupMessageBody *body = soup_server_message_get_response_body (msg);
+        const char *method = soup_server_message_get_method (msg);
+        guint status = soup_server_message_get_status (msg);
+        const char *vary, *coding;
+        SoupEncoding encoding;
+        gboolean complete = FALSE;
+        goffset input_length = -1;
+        gsize cache_size;
+
+        if (method == SOUP_METHOD_HEAD || method == SOUP_METHOD_CONNECT ||
+            !SOUP_STATUS_IS_SUCCESSFUL (status) ||
+            status == SOUP_STATUS_NO_CONTENT ||
+            status == SOUP_STATUS_PARTIAL_CONTENT)
+                return;
+
+        if (soup_message_headers_get_one_common (response_headers, SOUP_HEADER_CONTENT_ENCODING) ||
+            soup_message_headers_get_one_common (response_headers, SOUP_HEADER_CONTENT_RANGE))
+                return;
+
+        if (!soup_content_encoder_should_compress_type (encoder, soup_message_headers_get_content_type (response_headers, NULL)))
+                return;
+
+        encoding = soup_message_headers_get_encoding (response_headers);
+        if (encoding == SOUP_ENCODING_CONTENT_LENGTH) {
+                goffset length = body->length;
+
+                if (soup_message_headers_get_one_common (response_headers, SOUP_HEADER_CONTENT_LENGTH))
+                        length = soup_message_headers_get_content_length (response_headers);
+                if (length < (goffset)priv->min_size)
+                        return;
+
+                complete = length == body->length && soup_message_body_get_accumulate (body);
+                input_length = length;
+        }
+
+        /* From here on the response depends on the Accept-Encoding */
+        vary = soup_message_headers_get_list_common (response_headers, SOUP_HEADER_VARY);
+        if (!vary || (!soup_header_contains (vary, "Accept-Encoding") && !soup_header_contains (vary, "*")))
+                soup_message_headers_append_common (response_headers, SOUP_HEADER_VARY, "Accept-Encoding");
+
+        /* Keep Range requests working on the identity representation */
+        if (soup_message_headers_get_one_common (request_headers, SOUP_HEADER_RANGE))
+                return;
+
+        coding = soup_content_encoder_negotiate (soup_message_headers_get_list_common (request_headers, SOUP_HEADER_ACCEPT_ENCODING));
+        if (!coding)
+                return;
+
+        cache_size = soup_content_encoder_get_cache_size (encoder);
+        if (complete && cache_size > 0 && (gsize)body->length <= cache_size / 4) {
+                GBytes *encoded = soup_content_encoder_get_cached_variant (encoder, msg, coding);
+
+                if (!encoded)
+                        return;
+
+                soup_message_body_truncate (body);
+                soup_message_body_append_bytes (body, encoded);
+                soup_message_headers_set_content_length (response_headers, g_bytes_get_size (encoded));
+                soup_message_headers_append_common (response_headers, SOUP_HEADER_CONTENT_ENCODING, coding);
+                weaken_etag (response_headers);
+                g_bytes_unref (encoded);
+                return;
+        }
+
+        /* Compress as the body is written. The length isn't known in advance */
+        if (soup_server_message_get_http_version (msg) == SOUP_HTTP_1_1)
+                soup_message_headers_set_encoding (response_headers, SOUP_ENCODING_CHUNKED);
+        else
+                soup_message_headers_set_encoding (response_headers, SOUP_ENCODING_EOF);
+        soup_message_headers_append_common (response_headers, SOUP_HEADER_CONTENT_ENCODING, coding);
+        weaken_etag (response_headers);
+
+        /* The encoder stops after the declared Content-Length. Without
+         * one, a Content-Length response is complete already, and other
+         * bodies end when the handler calls soup_message_body_complete(),
+         * even if they are streamed while the message is paused.
+         */
+        soup_server_message_set_response_encoder (msg,
+                                                  soup_content_encoder_create_converter (coding, FALSE),
+                                                  input_length);
+}
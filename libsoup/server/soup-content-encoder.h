@@ -0,0 +1,36 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-types.h"
+
+G_BEGIN_DECLS
+
+#define SOUP_TYPE_CONTENT_ENCODER (soup_content_encoder_get_type ())
+SOUP_AVAILABLE_IN_3_4
+G_DECLARE_FINAL_TYPE (SoupContentEncoder, soup_content_encoder, SOUP, CONTENT_ENCODER, GObject)
+
+SOUP_AVAILABLE_IN_3_4
+SoupContentEncoder *soup_content_encoder_new                     (void);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_content_encoder_set_content_type_policy (SoupContentEncoder *encoder,
+                                                                  const char         *content_type,
+                                                                  gboolean            compress);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_content_encoder_set_min_size            (SoupContentEncoder *encoder,
+                                                                  gsize               min_size);
+SOUP_AVAILABLE_IN_3_4
+gsize               soup_content_encoder_get_min_size            (SoupContentEncoder *encoder);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_content_encoder_set_cache_size          (SoupContentEncoder *encoder,
+                                                                  gsize               cache_size);
+SOUP_AVAILABLE_IN_3_4
+gsize               soup_content_encoder_get_cache_size          (SoupContentEncoder *encoder);
+
+G_END_DECLS
@@ -0,0 +1,341 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-file-writer.c: Writing to files off the main context
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "soup-file-writer.h"
+
+/* Writes, closes and deletes a file from a worker thread, so that a
+ * slow disk doesn't stall every connection of the server.
+ *
+ * Operations are queued in order and run by a single task at a time,
+ * which keeps going until the queue is empty. The idle function is
+ * called in the thread-default main context the writer was created in
+ * once everything queued has been done. The task keeps its own
+ * reference, so freeing the writer doesn't wait for it.
+ */
+
+struct _SoupFileWriter {
+        gatomicrefcount ref_count;
+
+        GMutex mutex;
+        GQueue chunks;
+        gboolean running;
+        gboolean closing;
+        gboolean closed;
+        gboolean discarding;
+        gboolean deleted;
+        gboolean unlinked;
+
+        /* Only used from the task, or once it is idle */
+        GFile *file;
+        GIOStream *iostream;
+        GOutputStream *ostream;
+        GError *error;
+
+        GMainContext *context;
+        SoupFileWriterIdleFunc idle_func;
+        gpointer idle_data;
+};
+
+static SoupFileWriter *
+soup_file_writer_ref (SoupFileWriter *writer)
+{
+        g_atomic_ref_count_inc (&writer->ref_count);
+
+        return writer;
+}
+
+static void
+soup_file_writer_unref (SoupFileWriter *writer)
+{
+        if (!g_atomic_ref_count_dec (&writer->ref_count))
+                return;
+
+        g_queue_clear_full (&writer->chunks, (GDestroyNotify)g_bytes_unref);
+        g_clear_object (&writer->ostream);
+        g_clear_object (&writer->iostream);
+        g_clear_object (&writer->file);
+        g_clear_error (&writer->error);
+        g_main_context_unref (writer->context);
+        g_mutex_clear (&writer->mutex);
+        g_free (writer);
+}
+
+/* @file is created from the worker thread and must not exist. If it's
+ * %NULL, a temporary file is used instead, which is unlinked as soon as
+ * it's created where the platform allows it, so that it doesn't outlive
+ * the process. Its contents are then only available through
+ * soup_file_writer_read().
+ */
+SoupFileWriter *
+soup_file_writer_new (GFile                  *file,
+                      SoupFileWriterIdleFunc  idle_func,
+                      gpointer                user_data)
+{
+        SoupFileWriter *writer;
+
+        writer = g_new0 (SoupFileWriter, 1);
+        g_atomic_ref_count_init (&writer->ref_count);
+        g_mutex_init (&writer->mutex);
+        g_queue_init (&writer->chunks);
+        writer->file = file ? g_object_ref (file) : NULL;
+        writer->context = g_main_context_ref_thread_default ();
+        writer->idle_func = idle_func;
+        writer->idle_data = user_data;
+
+        return writer;
+}
+
+static gboolean
+soup_file_writer_open (SoupFileWriter *writer)
+{
+        if (writer->ostream)
+                return TRUE;
+        if (writer->error)
+                return FALSE;
+
+        if (writer->file) {
+                writer->ostream = G_OUTPUT_STREAM (g_file_create (writer->file, G_FILE_CREATE_PRIVATE,
+                                                                  NULL, &writer->error));
+        } else {
+                GFileIOStream *iostream;
+
+                writer->file = g_file_new_tmp ("libsoup-request-body-XXXXXX", &iostream, &writer->error);
+                if (writer->file) {
+                        writer->iostream = G_IO_STREAM (iostream);
+                        writer->ostream = g_object_ref (g_io_stream_get_output_stream (writer->iostream));
+                        /* Fails where open files can't be deleted, it's deleted when discarded then */
+                        writer->unlinked = g_file_delete (writer->file, NULL, NULL);
+                }
+        }
+
+        return writer->ostream != NULL;
+}
+
+static void
+soup_file_writer_write_chunk (SoupFileWriter *writer,
+                              GBytes         *chunk)
+{
+        gconstpointer data;
+        gsize size;
+
+        if (writer->error || !soup_file_writer_open (writer))
+                return;
+
+        data = g_bytes_get_data (chunk, &size);
+        g_output_stream_write_all (writer->ostream, data, size, NULL, NULL, &writer->error);
+}
+
+static void
+soup_file_writer_close_file (SoupFileWriter *writer,
+                             gboolean        discarding)
+{
+        GError *error = NULL;
+
+        /* Files closed without any data written are still created */
+        if (discarding ? !writer->ostream : !soup_file_writer_open (writer))
+                return;
+
+        if (writer->iostream)
+                g_io_stream_close (writer->iostream, NULL, &error);
+        else
+                g_output_stream_close (writer->ostream, NULL, &error);
+        if (error && !writer->error)
+                g_propagate_error (&writer->error, error);
+        else
+                g_clear_error (&error);
+}
+
+static void
+soup_file_writer_thread (GTask        *task,
+                         gpointer      source_object,
+                         gpointer      task_data,
+                         GCancellable *cancellable)
+{
+        SoupFileWriter *writer = task_data;
+
+        g_mutex_lock (&writer->mutex);
+        while (TRUE) {
+                GBytes *chunk = g_queue_pop_head (&writer->chunks);
+                gboolean close, delete;
+
+                if (chunk) {
+                        gboolean discarding = writer->discarding;
+
+                        g_mutex_unlock (&writer->mutex);
+                        if (!discarding)
+                                soup_file_writer_write_chunk (writer, chunk);
+                        g_bytes_unref (chunk);
+                        g_mutex_lock (&writer->mutex);
+                        continue;
+                }
+
+                close = writer->closing && !writer->closed;
+                delete = writer->discarding && !writer->deleted;
+                if (!close && !delete)
+                        break;
+
+                writer->closed |= close;
+                writer->deleted |= delete;
+                g_mutex_unlock (&writer->mutex);
+                if (close)
+                        soup_file_writer_close_file (writer, delete);
+                if (delete && writer->ostream && !writer->unlinked)
+                        g_file_delete (writer->file, NULL, NULL);
+                g_mutex_lock (&writer->mutex);
+        }
+        writer->running = FALSE;
+        g_mutex_unlock (&writer->mutex);
+
+        g_task_return_boolean (task, TRUE);
+}
+
+static void
+soup_file_writer_task_done (GObject      *source,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+        SoupFileWriter *writer = g_task_get_task_data (G_TASK (result));
+
+        /* A new task was started meanwhile, it will notify */
+        if (!soup_file_writer_is_idle (writer))
+                return;
+
+        if (writer->idle_func)
+                writer->idle_func (writer->idle_data);
+}
+
+/* Must be called with the mutex held */
+static void
+soup_file_writer_schedule (SoupFileWriter *writer)
+{
+        GTask *task;
+
+        if (writer->running)
+                return;
+
+        writer->running = TRUE;
+        g_main_context_push_thread_default (writer->context);
+        task = g_task_new (NULL, NULL, soup_file_writer_task_done, NULL);
+        g_main_context_pop_thread_default (writer->context);
+        g_task_set_source_tag (task, soup_file_writer_schedule);
+        g_task_set_task_data (task, soup_file_writer_ref (writer), (GDestroyNotify)soup_file_writer_unref);
+        g_task_run_in_thread (task, soup_file_writer_thread);
+        g_object_unref (task);
+}
+
+/* Stops notifying and deletes the file once everything queued is
+ * done, unless it was closed.
+ */
+void
+soup_file_writer_free (SoupFileWriter *writer)
+{
+        writer->idle_func = NULL;
+        writer->idle_data = NULL;
+        soup_file_writer_unref (writer);
+}
+
+void
+soup_file_writer_write (SoupFileWriter *writer,
+                        GBytes         *bytes)
+{
+        g_mutex_lock (&writer->mutex);
+        if (!writer->closing) {
+                g_queue_push_tail (&writer->chunks, g_bytes_ref (bytes));
+                soup_file_writer_schedule (writer);
+        }
+        g_mutex_unlock (&writer->mutex);
+}
+
+void
+soup_file_writer_close (SoupFileWriter *writer)
+{
+        g_mutex_lock (&writer->mutex);
+        writer->closing = TRUE;
+        soup_file_writer_schedule (writer);
+        g_mutex_unlock (&writer->mutex);
+}
+
+/* Closes the file and deletes it */
+void
+soup_file_writer_discard (SoupFileWriter *writer)
+{
+        g_mutex_lock (&writer->mutex);
+        writer->closing = TRUE;
+        writer->discarding = TRUE;
+        soup_file_writer_schedule (writer);
+        g_mutex_unlock (&writer->mutex);
+}
+
+gboolean
+soup_file_writer_is_idle (SoupFileWriter *writer)
+{
+        gboolean idle;
+
+        g_mutex_lock (&writer->mutex);
+        idle = !writer->running && g_queue_is_empty (&writer->chunks);
+        g_mutex_unlock (&writer->mutex);
+
+        return idle;
+}
+
+/* Returns %FALSE, setting @error, if writing failed */
+gboolean
+soup_file_writer_get_error (SoupFileWriter  *writer,
+                            GError         **error)
+{
+        gboolean success = TRUE;
+
+        g_mutex_lock (&writer->mutex);
+        if (!writer->running && writer->error) {
+                g_propagate_error (error, g_error_copy (writer->error));
+                success = FALSE;
+        }
+        g_mutex_unlock (&writer->mutex);
+
+        return success;
+}
+
+/* Returns a stream to read what was written from the start, or %NULL
+ * with %G_IO_ERROR_PENDING while writes are in flight. For temporary
+ * files all the streams returned share the file position, so they
+ * must be read one at a time.
+ */
+GInputStream *
+soup_file_writer_read (SoupFileWriter  *writer,
+                       GError         **error)
+{
+        GInputStream *stream;
+
+        if (!soup_file_writer_is_idle (writer)) {
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PENDING,
+                                     "The file is still being written");
+                return NULL;
+        }
+
+        if (!soup_file_writer_get_error (writer, error))
+                return NULL;
+
+        /* Nothing was written yet */
+        if (!writer->ostream)
+                return g_memory_input_stream_new ();
+
+        if (!writer->iostream)
+                return G_INPUT_STREAM (g_file_read (writer->file, NULL, error));
+
+        if (!g_seekable_seek (G_SEEKABLE (writer->iostream), 0, G_SEEK_SET, NULL, error))
+                return NULL;
+
+        /* Closing the returned stream must not close the file */
+        stream = g_buffered_input_stream_new (g_io_stream_get_input_stream (writer->iostream));
+        g_filter_input_stream_set_close_base_stream (G_FILTER_INPUT_STREAM (stream), FALSE);
+
+        return stream;
+}
@@ -0,0 +1,30 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SoupFileWriter SoupFileWriter;
+
+typedef void (*SoupFileWriterIdleFunc) (gpointer user_data);
+
+SoupFileWriter *soup_file_writer_new       (GFile                  *file,
+                                            SoupFileWriterIdleFunc  idle_func,
+                                            gpointer                user_data);
+void            soup_file_writer_free      (SoupFileWriter         *writer);
+void            soup_file_writer_write     (SoupFileWriter         *writer,
+                                            GBytes                 *bytes);
+void            soup_file_writer_close     (SoupFileWriter         *writer);
+void            soup_file_writer_discard   (SoupFileWriter         *writer);
+gboolean        soup_file_writer_is_idle   (SoupFileWriter         *writer);
+gboolean        soup_file_writer_get_error (SoupFileWriter         *writer,
+                                            GError                **error);
+GInputStream   *soup_file_writer_read      (SoupFileWriter         *writer,
+                                            GError                **error);
+
+G_END_DECLS
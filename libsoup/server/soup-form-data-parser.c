@@ -0,0 +1,1050 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-form-data-parser.c
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib/gi18n-lib.h>
+
+#include "soup-form-data-parser.h"
+#include "soup-file-writer.h"
+#include "soup-headers.h"
+#include "soup-server-message-private.h"
+#include "soup.h"
+
+/**
+ * SoupFormDataParser:
+ *
+ * Incremental parser for "multipart/form-data" request bodies.
+ *
+ * Unlike [func@form_decode_multipart], which needs the whole request
+ * body in memory, #SoupFormDataParser parses the body as it is received,
+ * so that large file uploads don't need to be buffered.
+ *
+ * [ctor@FormDataParser.new_for_message] creates a parser that is fed
+ * with the [signal@ServerMessage::got-chunk] signal of a message, and
+ * disables the accumulation of its request body. It should be created
+ * before the body is read, for example from an early handler (see
+ * [method@Server.add_early_handler]). The request handler can then use
+ * [method@FormDataParser.finish] to check whether the body was valid.
+ *
+ * Every part of the form emits [signal@FormDataParser::part-started],
+ * [signal@FormDataParser::part-data] for every piece of its body, and
+ * [signal@FormDataParser::part-finished]. In addition, the values of
+ * the regular fields are collected and can be retrieved with
+ * [method@FormDataParser.get_fields]. The contents of file parts (the
+ * ones with a "filename" parameter) are not kept in memory; if
+ * [property@FormDataParser:upload-directory] is set, they are written
+ * to files in that directory, which can be retrieved with
+ * [method@FormDataParser.get_file].
+ *
+ * Files are written from a worker thread. For parsers created with
+ * [ctor@FormDataParser.new_for_message], [signal@ServerMessage::got-body]
+ * is not emitted until they have been written, and reading the request
+ * body is suspended while a write is in progress when possible.
+ *
+ * Parts bigger than [property@FormDataParser:max-part-size], and regular
+ * fields bigger than [property@FormDataParser:max-field-size], make the
+ * parser fail with %G_IO_ERROR_MESSAGE_TOO_LARGE. The message of a
+ * parser created with [ctor@FormDataParser.new_for_message] is then
+ * answered with %SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE, and the rest of
+ * its body is not read when the connection allows it.
+ *
+ * Since: 3.4
+ */
+
+/* Maximum size of the headers of a part */
+#define MAX_PART_HEADERS_SIZE (64 * 1024)
+
+/* Regular fields are kept in memory, so they are limited by default */
+#define DEFAULT_MAX_FIELD_SIZE (1024 * 1024)
+
+struct _SoupFormDataParser {
+        GObject parent;
+};
+
+typedef enum {
+        SOUP_FORM_DATA_PARSER_STATE_PREAMBLE,
+        SOUP_FORM_DATA_PARSER_STATE_BOUNDARY,
+        SOUP_FORM_DATA_PARSER_STATE_HEADERS,
+        SOUP_FORM_DATA_PARSER_STATE_BODY,
+        SOUP_FORM_DATA_PARSER_STATE_DONE,
+        SOUP_FORM_DATA_PARSER_STATE_ERROR
+} SoupFormDataParserState;
+
+typedef struct {
+        SoupFormDataParser *parser;
+        SoupFileWriter *writer;
+        gboolean writing;
+        GFile *file;
+        char *filename;
+        char *content_type;
+} SoupFormDataFile;
+
+typedef struct {
+        char *delimiter;
+        gsize delimiter_len;
+        GByteArray *buffer;
+        SoupFormDataParserState state;
+        GError *error;
+
+        goffset max_part_size;
+        goffset max_field_size;
+        GFile *upload_directory;
+
+        SoupServerMessage *msg;
+        guint pending_writes;
+
+        SoupMessageHeaders *part_headers;
+        char *part_name;
+        char *part_filename;
+        goffset part_size;
+        GString *part_value;
+        SoupFormDataFile *part_file;
+
+        GHashTable *fields;
+        GHashTable *files;
+} SoupFormDataParserPrivate;
+
+enum {
+        PROP_0,
+
+        PROP_MAX_PART_SIZE,
+        PROP_MAX_FIELD_SIZE,
+        PROP_UPLOAD_DIRECTORY,
+
+        LAST_PROPERTY
+};
+
+static GParamSpec *properties[LAST_PROPERTY] = { NULL, };
+
+enum {
+        PART_STARTED,
+        PART_DATA,
+        PART_FINISHED,
+
+        LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupFormDataParser, soup_form_data_parser, G_TYPE_OBJECT)
+
+static void
+soup_form_data_file_idle (SoupFormDataFile *file)
+{
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (file->parser);
+
+        if (!file->writing)
+                return;
+
+        file->writing = FALSE;
+        priv->pending_writes--;
+        if (priv->msg)
+                soup_server_message_release_request_body (priv->msg);
+}
+
+static SoupFormDataFile *
+soup_form_data_file_new (SoupFormDataParser *parser,
+                         GFile              *file)
+{
+        SoupFormDataFile *data;
+
+        data = g_new0 (SoupFormDataFile, 1);
+        data->parser = parser;
+        data->file = file;
+        data->writer = soup_file_writer_new (file,
+                                             (SoupFileWriterIdleFunc)soup_form_data_file_idle,
+                                             data);
+
+        return data;
+}
+
+static void
+soup_form_data_file_write (SoupFormDataFile *file,
+                           GBytes           *chunk)
+{
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (file->parser);
+
+        if (chunk)
+                soup_file_writer_write (file->writer, chunk);
+        else
+                soup_file_writer_close (file->writer);
+
+        if (file->writing)
+                return;
+
+        file->writing = TRUE;
+        priv->pending_writes++;
+        if (priv->msg)
+                soup_server_message_hold_request_body (priv->msg);
+}
+
+static void
+soup_form_data_file_free (SoupFormDataFile *file)
+{
+        /* The writer deletes the file from its thread */
+        soup_form_data_file_idle (file);
+        soup_file_writer_discard (file->writer);
+        soup_file_writer_free (file->writer);
+        g_object_unref (file->file);
+        g_free (file->filename);
+        g_free (file->content_type);
+        g_free (file);
+}
+
+static void
+soup_form_data_parser_init (SoupFormDataParser *parser)
+{
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (parser);
+
+        priv->buffer = g_byte_array_new ();
+        priv->max_field_size = DEFAULT_MAX_FIELD_SIZE;
+        priv->fields = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+        priv->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                             (GDestroyNotify)soup_form_data_file_free);
+}
+
+static void
+clear_part (SoupFormDataParser *parser)
+{
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (parser);
+
+        g_clear_pointer (&priv->part_file, soup_form_data_file_free);
+        g_clear_pointer (&priv->part_headers, soup_message_headers_unref);
+        g_clear_pointer (&priv->part_name, g_free);
+        g_clear_pointer (&priv->part_filename, g_free);
+        if (priv->part_value) {
+                g_string_free (priv->part_value, TRUE);
+                priv->part_value = NULL;
+        }
+        priv->part_size = 0;
+}
+
+static void
+soup_form_data_parser_finalize (GObject *object)
+{
+        SoupFormDataParser *parser = SOUP_FORM_DATA_PARSER (object);
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (parser);
+
+        clear_part (parser);
+        g_hash_table_destroy (priv->files);
+        if (priv->msg)
+                g_object_remove_weak_pointer (G_OBJECT (priv->msg), (gpointer *)&priv->msg);
+        g_free (priv->delimiter);
+        g_byte_array_unref (priv->buffer);
+        g_clear_error (&priv->error);
+        g_clear_object (&priv->upload_directory);
+        g_hash_table_destroy (priv->fields);
+
+        G_OBJECT_CLASS (soup_form_data_parser_parent_class)->finalize (object);
+}
+
+static void
+soup_form_data_parser_set_property (GObject      *object,
+                                    guint         prop_id,
+                                    const GValue *value,
+                                    GParamSpec   *pspec)
+{
+        SoupFormDataParser *parser = SOUP_FORM_DATA_PARSER (object);
+
+        switch (prop_id) {
+        case PROP_MAX_PART_SIZE:
+                soup_form_data_parser_set_max_part_size (parser, g_value_get_int64 (value));
+                break;
+        case PROP_MAX_FIELD_SIZE:
+                soup_form_data_parser_set_max_field_size (parser, g_value_get_int64 (value));
+                break;
+        case PROP_UPLOAD_DIRECTORY:
+                soup_form_data_parser_set_upload_directory (parser, g_value_get_object (value));
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+soup_form_data_parser_get_property (GObject    *object,
+                                    guint       prop_id,
+                                    GValue     *value,
+                                    GParamSpec *pspec)
+{
+        SoupFormDataParser *parser = SOUP_FORM_DATA_PARSER (object);
+
+        switch (prop_id) {
+        case PROP_MAX_PART_SIZE:
+                g_value_set_int64 (value, soup_form_data_parser_get_max_part_size (parser));
+                break;
+        case PROP_MAX_FIELD_SIZE:
+                g_value_set_int64 (value, soup_form_data_parser_get_max_field_size (parser));
+                break;
+        case PROP_UPLOAD_DIRECTORY:
+                g_value_set_object (value, soup_form_data_parser_get_upload_directory (parser));
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+soup_form_data_parser_class_init (SoupFormDataParserClass *parser_class)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (parser_class);
+
+        object_class->finalize = soup_form_data_parser_finalize;
+        object_class->set_property = soup_form_data_parser_set_property;
+        object_class->get_property = soup_form_data_parser_get_property;
+
+        /**
+         * SoupFormDataParser::part-started:
+         * @parser: the parser
+         * @name: (nullable): the name of the form field
+         * @filename: (nullable): the filename of the part, if it is a file
+         * @headers: the headers of the part
+         *
+         * Emitted when the headers of a new part have been parsed.
+         *
+         * Since: 3.4
+         */
+        signals[PART_STARTED] =
+                g_signal_new ("part-started",
+                              G_OBJECT_CLASS_TYPE (object_class),
+                              G_SIGNAL_RUN_FIRST,
+                              0,
+                              NULL, NULL,
+                              NULL,
+                              G_TYPE_NONE, 3,
+                              G_TYPE_STRING,
+                              G_TYPE_STRING,
+                              SOUP_TYPE_MESSAGE_HEADERS);
+
+        /**
+         * SoupFormDataParser::part-data:
+         * @parser: the parser
+         * @chunk: the data
+         *
+         * Emitted for every piece of the body of the current part.
+         *
+         * Since: 3.4
+         */
+        signals[PART_DATA] =
+                g_signal_new ("part-data",
+                              G_OBJECT_CLASS_TYPE (object_class),
+                              G_SIGNAL_RUN_FIRST,
+                              0,
+                              NULL, NULL,
+                              NULL,
+                              G_TYPE_NONE, 1,
+                              G_TYPE_BYTES);
+
+        /**
+         * SoupFormDataParser::part-finished:
+         * @parser: the parser
+         *
+         * Emitted when the body of the current part is complete.
+         *
+         * Since: 3.4
+         */
+        signals[PART_FINISHED] =
+                g_signal_new ("part-finished",
+                              G_OBJECT_CLASS_TYPE (object_class),
+                              G_SIGNAL_RUN_FIRST,
+                              0,
+                              NULL, NULL,
+                              NULL,
+                              G_TYPE_NONE, 0);
+
+        /**
+         * SoupFormDataParser:max-part-size:
+         *
+         * Maximum size, in bytes, of the body of a part. 0 means no limit.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_MAX_PART_SIZE] =
+                g_param_spec_int64 ("max-part-size",
+                                    "Max part size",
+                                    "Maximum size of the body of a part",
+                                    0, G_MAXINT64, 0,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupFormDataParser:max-field-size:
+         *
+         * Maximum size, in bytes, of the value of a regular field (one
+         * without a "filename" parameter). These values are kept in
+         * memory, so unlike [property@FormDataParser:max-part-size] they
+         * are limited to 1 MiB by default. 0 means no limit.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_MAX_FIELD_SIZE] =
+                g_param_spec_int64 ("max-field-size",
+                                    "Max field size",
+                                    "Maximum size of the value of a regular field",
+                                    0, G_MAXINT64, DEFAULT_MAX_FIELD_SIZE,
+                                    G_PARAM_READWRITE |
+                                    G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupFormDataParser:upload-directory:
+         *
+         * Directory where the contents of file parts are written, or
+         * %NULL to not store them.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_UPLOAD_DIRECTORY] =
+                g_param_spec_object ("upload-directory",
+                                     "Upload directory",
+                                     "Directory where uploaded files are written",
+                                     G_TYPE_FILE,
+                                     G_PARAM_READWRITE |
+                                     G_PARAM_STATIC_STRINGS);
+
+        g_object_class_install_properties (object_class, LAST_PROPERTY, properties);
+}
+
+/**
+ * soup_form_data_parser_new:
+ * @boundary: the boundary of the multipart body
+ *
+ * Creates a new #SoupFormDataParser for a "multipart/form-data" body
+ * delimited by @boundary. The body must be passed to the parser with
+ * [method@FormDataParser.feed].
+ *
+ * Returns: (transfer full): a new #SoupFormDataParser
+ *
+ * Since: 3.4
+ */
+SoupFormDataParser *
+soup_form_data_parser_new (const char *boundary)
+{
+        SoupFormDataParser *parser;
+        SoupFormDataParserPrivate *priv;
+
+        g_return_val_if_fail (boundary != NULL && *boundary, NULL);
+
+        parser = g_object_new (SOUP_TYPE_FORM_DATA_PARSER, NULL);
+        priv = soup_form_data_parser_get_instance_private (parser);
+        priv->delimiter = g_strdup_printf ("\r\n--%s", boundary);
+        priv->delimiter_len = strlen (priv->delimiter);
+
+        /* So that a boundary at the very start of the body is found
+         * like the ones preceded by a line break.
+         */
+        g_byte_array_append (priv->buffer, (const guint8 *)"\r\n", 2);
+
+        return parser;
+}
+
+static void
+got_chunk (SoupServerMessage  *msg,
+           GBytes             *chunk,
+           SoupFormDataParser *parser)
+{
+        GError *error = NULL;
+
+        /* Other errors are kept until soup_form_data_parser_finish() */
+        if (soup_form_data_parser_feed (parser, chunk, &error))
+                return;
+
+        /* Don't bother reading the rest of a body that is too large */
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE) &&
+            soup_server_message_get_status (msg) == SOUP_STATUS_NONE) {
+                soup_server_message_set_status (msg, SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE, NULL);
+                if (soup_server_message_get_http_version (msg) != SOUP_HTTP_2_0) {
+                        soup_message_headers_append_common (soup_server_message_get_response_headers (msg),
+                                                            SOUP_HEADER_CONNECTION, "close");
+                }
+        }
+        g_error_free (error);
+}
+
+/**
+ * soup_form_data_parser_new_for_message:
+ * @msg: a #SoupServerMessage
+ *
+ * Creates a new #SoupFormDataParser for the request body of @msg.
+ *
+ * The parser is fed as the body of @msg is received, and the request body
+ * of @msg is no longer accumulated. If a part is bigger than
+ * [property@FormDataParser:max-part-size] or a regular field is bigger than
+ * [property@FormDataParser:max-field-size], @msg is answered with
+ * %SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE without reading the rest of the
+ * body, and the request handler is not called.
+ *
+ * Returns: (transfer full) (nullable): a new #SoupFormDataParser, or %NULL
+ *   if the request body of @msg is not "multipart/form-data".
+ *
+ * Since: 3.4
+ */
+SoupFormDataParser *
+soup_form_data_parser_new_for_message (SoupServerMessage *msg)
+{
+        SoupFormDataParser *parser;
+        SoupFormDataParserPrivate *priv;
+        const char *content_type, *boundary;
+        GHashTable *params;
+
+        g_return_val_if_fail (SOUP_IS_SERVER_MESSAGE (msg), NULL);
+
+        content_type = soup_message_headers_get_content_type (soup_server_message_get_request_headers (msg), &params);
+        if (!content_type)
+                return NULL;
+
+        boundary = g_hash_table_lookup (params, "boundary");
+        if (g_ascii_strcasecmp (content_type, "multipart/form-data") != 0 || !boundary || !*boundary) {
+                g_hash_table_destroy (params);
+                return NULL;
+        }
+
+        parser = soup_form_data_parser_new (boundary);
+        g_hash_table_destroy (params);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        priv->msg = msg;
+        g_object_add_weak_pointer (G_OBJECT (msg), (gpointer *)&priv->msg);
+
+        soup_message_body_set_accumulate (soup_server_message_get_request_body (msg), FALSE);
+        g_signal_connect_object (msg, "got-chunk",
+                                 G_CALLBACK (got_chunk),
+                                 parser, 0);
+
+        return parser;
+}
+
+/**
+ * soup_form_data_parser_set_max_part_size:
+ * @parser: a #SoupFormDataParser
+ * @max_part_size: the maximum size in bytes, or 0 for no limit
+ *
+ * Sets the maximum size of the body of a part.
+ *
+ * Since: 3.4
+ */
+void
+soup_form_data_parser_set_max_part_size (SoupFormDataParser *parser,
+                                         goffset             max_part_size)
+{
+        SoupFormDataParserPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_FORM_DATA_PARSER (parser));
+        g_return_if_fail (max_part_size >= 0);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        if (priv->max_part_size == max_part_size)
+                return;
+
+        priv->max_part_size = max_part_size;
+        g_object_notify_by_pspec (G_OBJECT (parser), properties[PROP_MAX_PART_SIZE]);
+}
+
+/**
+ * soup_form_data_parser_get_max_part_size:
+ * @parser: a #SoupFormDataParser
+ *
+ * Gets the maximum size of the body of a part.
+ *
+ * Returns: the maximum size in bytes, or 0 if there is no limit
+ *
+ * Since: 3.4
+ */
+goffset
+soup_form_data_parser_get_max_part_size (SoupFormDataParser *parser)
+{
+        SoupFormDataParserPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_FORM_DATA_PARSER (parser), 0);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        return priv->max_part_size;
+}
+
+/**
+ * soup_form_data_parser_set_max_field_size:
+ * @parser: a #SoupFormDataParser
+ * @max_field_size: the maximum size in bytes, or 0 for no limit
+ *
+ * Sets the maximum size of the value of a regular field.
+ *
+ * Since: 3.4
+ */
+void
+soup_form_data_parser_set_max_field_size (SoupFormDataParser *parser,
+                                          goffset             max_field_size)
+{
+        SoupFormDataParserPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_FORM_DATA_PARSER (parser));
+        g_return_if_fail (max_field_size >= 0);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        if (priv->max_field_size == max_field_size)
+                return;
+
+        priv->max_field_size = max_field_size;
+        g_object_notify_by_pspec (G_OBJECT (parser), properties[PROP_MAX_FIELD_SIZE]);
+}
+
+/**
+ * soup_form_data_parser_get_max_field_size:
+ * @parser: a #SoupFormDataParser
+ *
+ * Gets the maximum size of the value of a regular field.
+ *
+ * Returns: the maximum size in bytes, or 0 if there is no limit
+ *
+ * Since: 3.4
+ */
+goffset
+soup_form_data_parser_get_max_field_size (SoupFormDataParser *parser)
+{
+        SoupFormDataParserPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_FORM_DATA_PARSER (parser), 0);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        return priv->max_field_size;
+}
+
+/**
+ * soup_form_data_parser_set_upload_directory:
+ * @parser: a #SoupFormDataParser
+ * @directory: (nullable): a #GFile, or %NULL
+ *
+ * Sets the directory where the contents of the file parts are written.
+ *
+ * Since: 3.4
+ */
+void
+soup_form_data_parser_set_upload_directory (SoupFormDataParser *parser,
+                                            GFile              *directory)
+{
+        SoupFormDataParserPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_FORM_DATA_PARSER (parser));
+        g_return_if_fail (!directory || G_IS_FILE (directory));
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        if (g_set_object (&priv->upload_directory, directory))
+                g_object_notify_by_pspec (G_OBJECT (parser), properties[PROP_UPLOAD_DIRECTORY]);
+}
+
+/**
+ * soup_form_data_parser_get_upload_directory:
+ * @parser: a #SoupFormDataParser
+ *
+ * Gets the directory where the contents of the file parts are written.
+ *
+ * Returns: (transfer none) (nullable): a #GFile, or %NULL
+ *
+ * Since: 3.4
+ */
+GFile *
+soup_form_data_parser_get_upload_directory (SoupFormDataParser *parser)
+{
+        SoupFormDataParserPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_FORM_DATA_PARSER (parser), NULL);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        return priv->upload_directory;
+}
+
+static gssize
+find_sequence (const guint8 *data,
+               gsize         len,
+               const char   *sequence,
+               gsize         sequence_len)
+{
+        const guint8 *p = data, *end = data + len;
+
+        while (end - p >= (gssize)sequence_len) {
+                p = memchr (p, sequence[0], end - p - sequence_len + 1);
+                if (!p)
+                        break;
+                if (memcmp (p, sequence, sequence_len) == 0)
+                        return p - data;
+                p++;
+        }
+
+        return -1;
+}
+
+static gboolean
+start_part (SoupFormDataParser *parser,
+            gsize               headers_len,
+            GError            **error)
+{
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (parser);
+        char *disposition;
+        GHashTable *params;
+
+        /* The buffer starts with the rest of the boundary line, which
+         * soup_headers_parse() skips.
+         */
+        priv->part_headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_MULTIPART);
+        if (!soup_headers_parse ((const char *)priv->buffer->data, headers_len, priv->part_headers)) {
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                                     _("Invalid multipart part headers"));
+                return FALSE;
+        }
+
+        if (soup_message_headers_get_content_disposition (priv->part_headers, &disposition, &params)) {
+                if (g_ascii_strcasecmp (disposition, "form-data") == 0) {
+                        priv->part_name = g_strdup (g_hash_table_lookup (params, "name"));
+                        priv->part_filename = g_strdup (g_hash_table_lookup (params, "filename"));
+                }
+                g_free (disposition);
+                g_hash_table_destroy (params);
+        }
+
+        if (priv->part_name && priv->part_filename && priv->upload_directory) {
+                char *uuid = g_uuid_string_random ();
+                char *basename = g_strdup_printf ("soup-upload-%s", uuid);
+
+                priv->part_file = soup_form_data_file_new (parser, g_file_get_child (priv->upload_directory, basename));
+                g_free (basename);
+                g_free (uuid);
+        } else if (priv->part_name && !priv->part_filename)
+                priv->part_value = g_string_new (NULL);
+
+        g_signal_emit (parser, signals[PART_STARTED], 0,
+                       priv->part_name, priv->part_filename, priv->part_headers);
+
+        return TRUE;
+}
+
+static gboolean
+part_data (SoupFormDataParser *parser,
+           gsize               len,
+           GError            **error)
+{
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (parser);
+        const guint8 *data = priv->buffer->data;
+        GBytes *chunk = NULL;
+
+        if (len == 0)
+                return TRUE;
+
+        priv->part_size += len;
+        if ((priv->max_part_size > 0 && priv->part_size > priv->max_part_size) ||
+            (priv->part_value && priv->max_field_size > 0 && priv->part_size > priv->max_field_size)) {
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                             _("Form field “%s” is too large"),
+                             priv->part_name ? priv->part_name : "");
+                return FALSE;
+        }
+
+        /* Errors of previous writes */
+        if (priv->part_file && !soup_file_writer_get_error (priv->part_file->writer, error))
+                return FALSE;
+
+        if (priv->part_file || g_signal_has_handler_pending (parser, signals[PART_DATA], 0, TRUE))
+                chunk = g_bytes_new (data, len);
+
+        if (priv->part_file)
+                soup_form_data_file_write (priv->part_file, chunk);
+
+        if (priv->part_value)
+                g_string_append_len (priv->part_value, (const char *)data, len);
+
+        if (chunk) {
+                g_signal_emit (parser, signals[PART_DATA], 0, chunk);
+                g_bytes_unref (chunk);
+        }
+
+        g_byte_array_remove_range (priv->buffer, 0, len);
+
+        return TRUE;
+}
+
+static gboolean
+finish_part (SoupFormDataParser *parser,
+             GError            **error)
+{
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (parser);
+
+        if (priv->part_file) {
+                SoupFormDataFile *file = g_steal_pointer (&priv->part_file);
+
+                if (!soup_file_writer_get_error (file->writer, error)) {
+                        soup_form_data_file_free (file);
+                        return FALSE;
+                }
+                soup_form_data_file_write (file, NULL);
+
+                file->filename = g_strdup (priv->part_filename);
+                file->content_type = g_strdup (soup_message_headers_get_content_type (priv->part_headers, NULL));
+                g_hash_table_replace (priv->files, g_strdup (priv->part_name), file);
+        } else if (priv->part_value) {
+                g_hash_table_replace (priv->fields, g_strdup (priv->part_name),
+                                      g_string_free (priv->part_value, FALSE));
+                priv->part_value = NULL;
+        }
+
+        g_signal_emit (parser, signals[PART_FINISHED], 0);
+        clear_part (parser);
+
+        return TRUE;
+}
+
+static gboolean
+parse (SoupFormDataParser *parser,
+       GError            **error)
+{
+        SoupFormDataParserPrivate *priv = soup_form_data_parser_get_instance_private (parser);
+        GByteArray *buffer = priv->buffer;
+        gssize pos;
+
+        while (TRUE) {
+                switch (priv->state) {
+                case SOUP_FORM_DATA_PARSER_STATE_PREAMBLE:
+                        pos = find_sequence (buffer->data, buffer->len, priv->delimiter, priv->delimiter_len);
+                        if (pos == -1) {
+                                /* Keep what could be the start of the boundary */
+                                if (buffer->len >= priv->delimiter_len)
+                                        g_byte_array_remove_range (buffer, 0, buffer->len - priv->delimiter_len + 1);
+                                return TRUE;
+                        }
+
+                        g_byte_array_remove_range (buffer, 0, pos + priv->delimiter_len);
+                        priv->state = SOUP_FORM_DATA_PARSER_STATE_BOUNDARY;
+                        break;
+
+                case SOUP_FORM_DATA_PARSER_STATE_BOUNDARY:
+                        if (buffer->len < 2)
+                                return TRUE;
+
+                        if (buffer->data[0] == '-' && buffer->data[1] == '-') {
+                                g_byte_array_set_size (buffer, 0);
+                                priv->state = SOUP_FORM_DATA_PARSER_STATE_DONE;
+                        } else
+                                priv->state = SOUP_FORM_DATA_PARSER_STATE_HEADERS;
+                        break;
+
+                case SOUP_FORM_DATA_PARSER_STATE_HEADERS:
+                        pos = find_sequence (buffer->data, buffer->len, "\r\n\r\n", 4);
+                        if (pos == -1) {
+                                if (buffer->len > MAX_PART_HEADERS_SIZE) {
+                                        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                                                             _("Multipart part headers are too large"));
+                                        return FALSE;
+                                }
+                                return TRUE;
+                        }
+
+                        if (!start_part (parser, pos + 2, error))
+                                return FALSE;
+
+                        g_byte_array_remove_range (buffer, 0, pos + 4);
+                        priv->state = SOUP_FORM_DATA_PARSER_STATE_BODY;
+                        break;
+
+                case SOUP_FORM_DATA_PARSER_STATE_BODY:
+                        pos = find_sequence (buffer->data, buffer->len, priv->delimiter, priv->delimiter_len);
+                        if (pos == -1) {
+                                if (buffer->len < priv->delimiter_len)
+                                        return TRUE;
+                                return part_data (parser, buffer->len - priv->delimiter_len + 1, error);
+                        }
+
+                        if (!part_data (parser, pos, error) || !finish_part (parser, error))
+                                return FALSE;
+
+                        g_byte_array_remove_range (buffer, 0, priv->delimiter_len);
+                        priv->state = SOUP_FORM_DATA_PARSER_STATE_BOUNDARY;
+                        break;
+
+                case SOUP_FORM_DATA_PARSER_STATE_DONE:
+                        /* Ignore the epilogue */
+                        g_byte_array_set_size (buffer, 0);
+                        return TRUE;
+
+                case SOUP_FORM_DATA_PARSER_STATE_ERROR:
+                        g_assert_not_reached ();
+                }
+        }
+}
+
+/**
+ * soup_form_data_parser_feed:
+ * @parser: a #SoupFormDataParser
+ * @chunk: the next piece of the body
+ * @error: return location for a #GError
+ *
+ * Parses the next piece of the body, emitting the signals of @parser for
+ * the parts it contains.
+ *
+ * Once this has failed, @parser ignores the rest of the body and keeps
+ * returning the same error.
+ *
+ * Returns: %TRUE on success, or %FALSE if the body is not valid
+ *
+ * Since: 3.4
+ */
+gboolean
+soup_form_data_parser_feed (SoupFormDataParser *parser,
+                            GBytes             *chunk,
+                            GError            **error)
+{
+        SoupFormDataParserPrivate *priv;
+        const guint8 *data;
+        gsize size;
+
+        g_return_val_if_fail (SOUP_IS_FORM_DATA_PARSER (parser), FALSE);
+        g_return_val_if_fail (chunk != NULL, FALSE);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        if (priv->state == SOUP_FORM_DATA_PARSER_STATE_ERROR) {
+                if (error)
+                        *error = g_error_copy (priv->error);
+                return FALSE;
+        }
+
+        if (priv->state == SOUP_FORM_DATA_PARSER_STATE_DONE)
+                return TRUE;
+
+        data = g_bytes_get_data (chunk, &size);
+        g_byte_array_append (priv->buffer, data, size);
+
+        g_object_ref (parser);
+        if (!parse (parser, &priv->error)) {
+                priv->state = SOUP_FORM_DATA_PARSER_STATE_ERROR;
+                g_byte_array_set_size (priv->buffer, 0);
+                clear_part (parser);
+                if (error)
+                        *error = g_error_copy (priv->error);
+                g_object_unref (parser);
+                return FALSE;
+        }
+        g_object_unref (parser);
+
+        return TRUE;
+}
+
+/**
+ * soup_form_data_parser_finish:
+ * @parser: a #SoupFormDataParser
+ * @error: return location for a #GError
+ *
+ * Checks that the whole body was parsed successfully and that the file
+ * parts were written. This should be called once all of the body has been
+ * passed to @parser. If files are still being written, this fails with
+ * %G_IO_ERROR_PENDING; that doesn't happen for parsers created with
+ * [ctor@FormDataParser.new_for_message] once
+ * [signal@ServerMessage::got-body] has been emitted.
+ *
+ * Returns: %TRUE if the body was complete and valid, or %FALSE otherwise
+ *
+ * Since: 3.4
+ */
+gboolean
+soup_form_data_parser_finish (SoupFormDataParser *parser,
+                              GError            **error)
+{
+        SoupFormDataParserPrivate *priv;
+        GHashTableIter iter;
+        SoupFormDataFile *file;
+
+        g_return_val_if_fail (SOUP_IS_FORM_DATA_PARSER (parser), FALSE);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        switch (priv->state) {
+        case SOUP_FORM_DATA_PARSER_STATE_DONE:
+                if (priv->pending_writes > 0) {
+                        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PENDING,
+                                             _("Uploaded files are still being written"));
+                        return FALSE;
+                }
+
+                g_hash_table_iter_init (&iter, priv->files);
+                while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&file)) {
+                        if (!soup_file_writer_get_error (file->writer, error))
+                                return FALSE;
+                }
+                return TRUE;
+        case SOUP_FORM_DATA_PARSER_STATE_ERROR:
+                if (error)
+                        *error = g_error_copy (priv->error);
+                return FALSE;
+        default:
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                                     _("Multipart body ended unexpectedly"));
+                return FALSE;
+        }
+}
+
+/**
+ * soup_form_data_parser_get_fields:
+ * @parser: a #SoupFormDataParser
+ *
+ * Gets the values of the form fields that are not files parsed so far.
+ *
+ * Returns: (transfer none) (element-type utf8 utf8): a hash table mapping
+ *   field names to their values
+ *
+ * Since: 3.4
+ */
+GHashTable *
+soup_form_data_parser_get_fields (SoupFormDataParser *parser)
+{
+        SoupFormDataParserPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_FORM_DATA_PARSER (parser), NULL);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        return priv->fields;
+}
+
+/**
+ * soup_form_data_parser_get_file:
+ * @parser: a #SoupFormDataParser
+ * @name: the name of a file field
+ * @filename: (out) (optional) (transfer none) (nullable): return location
+ *   for the filename sent by the client
+ * @content_type: (out) (optional) (transfer none) (nullable): return
+ *   location for the Content-Type of the file
+ *
+ * Gets the file where the contents of the file field @name were written.
+ * Files are only written if [property@FormDataParser:upload-directory] is
+ * set.
+ *
+ * The file is deleted when @parser is destroyed, so it must be moved or
+ * copied elsewhere to be kept.
+ *
+ * Returns: (transfer none) (nullable): a #GFile, or %NULL
+ *
+ * Since: 3.4
+ */
+GFile *
+soup_form_data_parser_get_file (SoupFormDataParser *parser,
+                                const char         *name,
+                                const char        **filename,
+                                const char        **content_type)
+{
+        SoupFormDataParserPrivate *priv;
+        SoupFormDataFile *file;
+
+        g_return_val_if_fail (SOUP_IS_FORM_DATA_PARSER (parser), NULL);
+        g_return_val_if_fail (name != NULL, NULL);
+
+        priv = soup_form_data_parser_get_instance_private (parser);
+        file = g_hash_table_lookup (priv->files, name);
+        if (filename)
+                *filename = file ? file->filename : NULL;
+        if (content_type)
+                *content_type = file ? file->content_type : NULL;
+
+        return file ? file->file : NULL;
+}
@@ -0,0 +1,57 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-types.h"
+
+G_BEGIN_DECLS
+
+#define SOUP_TYPE_FORM_DATA_PARSER (soup_form_data_parser_get_type ())
+SOUP_AVAILABLE_IN_3_4
+G_DECLARE_FINAL_TYPE (SoupFormDataParser, soup_form_data_parser, SOUP, FORM_DATA_PARSER, GObject)
+
+SOUP_AVAILABLE_IN_3_4
+SoupFormDataParser *soup_form_data_parser_new                  (const char         *boundary);
+
+SOUP_AVAILABLE_IN_3_4
+SoupFormDataParser *soup_form_data_parser_new_for_message      (SoupServerMessage  *msg);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_form_data_parser_set_max_part_size    (SoupFormDataParser *parser,
+                                                                goffset             max_part_size);
+SOUP_AVAILABLE_IN_3_4
+goffset             soup_form_data_parser_get_max_part_size    (SoupFormDataParser *parser);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_form_data_parser_set_max_field_size   (SoupFormDataParser *parser,
+                                                                goffset             max_field_size);
+SOUP_AVAILABLE_IN_3_4
+goffset             soup_form_data_parser_get_max_field_size   (SoupFormDataParser *parser);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_form_data_parser_set_upload_directory (SoupFormDataParser *parser,
+                                                                GFile              *directory);
+SOUP_AVAILABLE_IN_3_4
+GFile              *soup_form_data_parser_get_upload_directory (SoupFormDataParser *parser);
+
+SOUP_AVAILABLE_IN_3_4
+gboolean            soup_form_data_parser_feed                 (SoupFormDataParser *parser,
+                                                                GBytes             *chunk,
+                                                                GError            **error);
+SOUP_AVAILABLE_IN_3_4
+gboolean            soup_form_data_parser_finish               (SoupFormDataParser *parser,
+                                                                GError            **error);
+
+SOUP_AVAILABLE_IN_3_4
+GHashTable         *soup_form_data_parser_get_fields           (SoupFormDataParser *parser);
+
+SOUP_AVAILABLE_IN_3_4
+GFile              *soup_form_data_parser_get_file             (SoupFormDataParser *parser,
+                                                                const char         *name,
+                                                                const char        **filename,
+                                                                const char        **content_type);
+
+G_END_DECLS
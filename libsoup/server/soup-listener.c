@@ -64,6 +64,11 @@ soup_listener_init (SoupListener *listener)
 {
 }
 
+/* Upper bound on the connections accepted per wakeup, so that a
+ * connection storm doesn't starve the rest of the main context.
+ */
+#define ACCEPT_BATCH_SIZE 32
+
 static gboolean
 listen_watch (GObject      *pollable,
               SoupListener *listener)
@@ -71,16 +76,46 @@ listen_watch (GObject      *pollable,
         SoupListenerPrivate *priv = soup_listener_get_instance_private (listener);
         GSocket *socket;
         SoupServerConnection *conn;
+        GError *error = NULL;
+        gboolean disconnected;
+        guint i;
 
-        socket = g_socket_accept (priv->socket, NULL, NULL);
-        if (!socket)
+        g_object_ref (listener);
+
+        for (i = 0; i < ACCEPT_BATCH_SIZE && priv->socket; i++) {
+                socket = g_socket_accept (priv->socket, NULL, &error);
+                if (!socket)
+                        break;
+
+                conn = soup_server_connection_new (socket, priv->tls_certificate, priv->tls_database, priv->tls_auth_mode);
+                g_object_unref (socket);
+                g_signal_emit (listener, signals[NEW_CONNECTION], 0, conn);
+                g_object_unref (conn);
+        }
+
+        /* A new-connection handler may have disconnected us */
+        disconnected = priv->socket == NULL;
+        g_object_unref (listener);
+
+        if (disconnected) {
+                g_clear_error (&error);
                 return G_SOURCE_REMOVE;
+        }
 
-        conn = soup_server_connection_new (socket, priv->tls_certificate, priv->tls_database, priv->tls_auth_mode);
-        g_signal_emit (listener, signals[NEW_CONNECTION], 0, conn);
-        g_object_unref (conn);
+        if (!error)
+                return G_SOURCE_CONTINUE;
 
-        return G_SOURCE_CONTINUE;
+        /* Either the backlog is drained or the client went away
+         * before we got to it; neither should stop the listener.
+         */
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK) ||
+            g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED)) {
+                g_error_free (error);
+                return G_SOURCE_CONTINUE;
+        }
+
+        g_error_free (error);
+        return G_SOURCE_REMOVE;
 }
 
 static void
@@ -90,6 +125,8 @@ soup_listener_constructed (GObject *object)
         SoupListenerPrivate *priv = soup_listener_get_instance_private (listener);
 
         g_socket_set_option (priv->socket, IPPROTO_TCP, TCP_NODELAY, TRUE, NULL);
+        /* listen_watch() accepts until the backlog is empty */
+        g_socket_set_blocking (priv->socket, FALSE);
 
         priv->conn = (GIOStream *)g_socket_connection_factory_create_connection (priv->socket);
         priv->iostream = soup_io_stream_new (priv->conn, FALSE);
@@ -273,6 +310,7 @@ soup_listener_new (GSocket *socket,
 
 SoupListener *
 soup_listener_new_for_address (GSocketAddress *address,
+                               gboolean        reuse_port,
                                GError        **error)
 {
         GSocket *socket;
@@ -297,6 +335,26 @@ soup_listener_new_for_address (GSocketAddress *address,
                 }
         }
 
+        if (reuse_port) {
+#ifdef SO_REUSEPORT
+                /* Lets several servers, typically one per thread, listen
+                 * on the same port and have the kernel spread the
+                 * incoming connections between them.
+                 */
+                if (!g_socket_set_option (socket, SOL_SOCKET, SO_REUSEPORT, TRUE, error)) {
+                        g_object_unref (socket);
+
+                        return NULL;
+                }
+#else
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                     _("Listening on a shared port is not supported on this platform"));
+                g_object_unref (socket);
+
+                return NULL;
+#endif
+        }
+
         if (!g_socket_bind (socket, address, TRUE, error)) {
                 g_object_unref (socket);
 
@@ -16,6 +16,7 @@ G_DECLARE_FINAL_TYPE (SoupListener, soup_listener, SOUP, LISTENER, GObject)
 SoupListener       *soup_listener_new              (GSocket        *socket,
                                                     GError        **error);
 SoupListener       *soup_listener_new_for_address  (GSocketAddress *address,
+                                                    gboolean        reuse_port,
                                                     GError        **error);
 
 void                soup_listener_disconnect       (SoupListener   *listener);
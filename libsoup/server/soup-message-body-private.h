@@ -0,0 +1,19 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-message-body.h"
+
+G_BEGIN_DECLS
+
+void soup_message_body_get_slices (SoupMessageBody *body,
+                                   goffset          offset,
+                                   goffset          length,
+                                   GPtrArray       *slices);
+
+goffset soup_message_body_get_unwritten_length (SoupMessageBody *body);
+
+G_END_DECLS
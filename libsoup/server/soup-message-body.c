@@ -11,7 +11,7 @@
 
 #include <string.h>
 
-#include "soup-message-body.h"
+#include "soup-message-body-private.h"
 #include "soup.h"
 
 /**
@@ -323,6 +323,39 @@ soup_message_body_get_chunk (SoupMessageBody *body, goffset offset)
         return g_bytes_new_from_bytes (chunk, offset, g_bytes_get_size (chunk) - offset);
 }
 
+/*
+ * Appends to @slices references to the data of @body between @offset
+ * and @offset + @length, without copying it. @body must accumulate.
+ */
+void
+soup_message_body_get_slices (SoupMessageBody *body,
+                              goffset          offset,
+                              goffset          length,
+                              GPtrArray       *slices)
+{
+	SoupMessageBodyPrivate *priv = (SoupMessageBodyPrivate *)body;
+	GSList *iter;
+
+	g_return_if_fail (priv->accumulate);
+	g_return_if_fail (offset >= 0 && length >= 0 && offset + length <= body->length);
+
+	for (iter = priv->chunks; iter && length > 0; iter = iter->next) {
+		GBytes *chunk = iter->data;
+		goffset chunk_length = g_bytes_get_size (chunk);
+		goffset slice_length;
+
+		if (offset >= chunk_length) {
+			offset -= chunk_length;
+			continue;
+		}
+
+		slice_length = MIN (chunk_length - offset, length);
+		g_ptr_array_add (slices, g_bytes_new_from_bytes (chunk, offset, slice_length));
+		length -= slice_length;
+		offset = 0;
+	}
+}
+
 /**
  * soup_message_body_got_chunk:
  * @body: a #SoupMessageBody
@@ -385,6 +418,18 @@ soup_message_body_wrote_chunk (SoupMessageBody *body, GBytes *chunk)
 	g_bytes_unref (chunk2);
 }
 
+/*
+ * Returns the number of bytes of @body that have not been written yet,
+ * which is all of them if @body accumulates.
+ */
+goffset
+soup_message_body_get_unwritten_length (SoupMessageBody *body)
+{
+	SoupMessageBodyPrivate *priv = (SoupMessageBodyPrivate *)body;
+
+	return body->length - priv->base_offset;
+}
+
 /**
  * soup_message_body_ref:
  * @body: a #SoupMessageBody
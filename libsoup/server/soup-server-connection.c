@@ -21,6 +21,7 @@
 #include "soup-server-message-private.h"
 #include "soup-server-message-io-http1.h"
 #include "soup-server-message-io-http2.h"
+#include "soup-tls-handshake-pool.h"
 
 enum {
         CONNECTED,
@@ -62,6 +63,7 @@ typedef struct {
         gboolean advertise_http2;
         SoupHTTPVersion http_version;
         SoupServerMessageIO *io_data;
+        guint64 accept_time;
 
         GSocketAddress *local_addr;
         GSocketAddress *remote_addr;
@@ -69,6 +71,8 @@ typedef struct {
         GTlsCertificate *tls_certificate;
         GTlsDatabase *tls_database;
         GTlsAuthenticationMode tls_auth_mode;
+        SoupTlsHandshakePool *tls_handshake_pool;
+        GCancellable *tls_handshake_cancellable;
 } SoupServerConnectionPrivate;
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupServerConnection, soup_server_connection, G_TYPE_OBJECT)
@@ -86,6 +90,7 @@ soup_server_connection_init (SoupServerConnection *conn)
         SoupServerConnectionPrivate *priv = soup_server_connection_get_instance_private (conn);
 
         priv->http_version = SOUP_HTTP_1_1;
+        priv->accept_time = g_get_monotonic_time ();
 }
 
 static void
@@ -95,6 +100,11 @@ disconnect_internal (SoupServerConnection *conn)
 
         g_clear_object (&priv->socket);
 
+        if (priv->tls_handshake_cancellable) {
+                g_cancellable_cancel (priv->tls_handshake_cancellable);
+                g_clear_object (&priv->tls_handshake_cancellable);
+        }
+
         g_io_stream_close (priv->conn, NULL, NULL);
         g_signal_handlers_disconnect_by_data (priv->conn, conn);
         g_clear_object (&priv->conn);
@@ -423,13 +433,13 @@ tls_connection_peer_certificate_changed (SoupServerConnection *conn)
 }
 
 static void
-tls_connection_handshake_ready_cb (GTlsConnection       *tls_conn,
-                                   GAsyncResult         *result,
-                                   SoupServerConnection *conn)
+tls_connection_handshake_complete (SoupServerConnection *conn,
+                                   GTlsConnection       *tls_conn,
+                                   gboolean              success)
 {
         SoupServerConnectionPrivate *priv = soup_server_connection_get_instance_private (conn);
 
-        if (g_tls_connection_handshake_finish (tls_conn, result, NULL)) {
+        if (success) {
                 const char *protocol = g_tls_connection_get_negotiated_protocol (tls_conn);
 
                 if (g_strcmp0 (protocol, "h2") == 0)
@@ -445,6 +455,31 @@ tls_connection_handshake_ready_cb (GTlsConnection       *tls_conn,
         }
 }
 
+static void
+tls_connection_handshake_ready_cb (GTlsConnection       *tls_conn,
+                                   GAsyncResult         *result,
+                                   SoupServerConnection *conn)
+{
+        tls_connection_handshake_complete (conn, tls_conn,
+                                           g_tls_connection_handshake_finish (tls_conn, result, NULL));
+}
+
+static void
+tls_connection_pool_handshake_ready_cb (GTlsConnection       *tls_conn,
+                                        GAsyncResult         *result,
+                                        SoupServerConnection *conn)
+{
+        SoupServerConnectionPrivate *priv = soup_server_connection_get_instance_private (conn);
+        gboolean success;
+
+        success = soup_tls_handshake_pool_handshake_finish (result, NULL);
+        if (priv->tls_handshake_cancellable) {
+                g_clear_object (&priv->tls_handshake_cancellable);
+                tls_connection_handshake_complete (conn, tls_conn, success);
+        }
+        g_object_unref (conn);
+}
+
 void
 soup_server_connection_set_advertise_http2 (SoupServerConnection *conn,
                                             gboolean              advertise_http2)
@@ -457,6 +492,21 @@ soup_server_connection_set_advertise_http2 (SoupServerConnection *conn,
         priv->advertise_http2 = advertise_http2;
 }
 
+/* Connections accepted after this run their TLS handshake on @pool.
+ * The pool is only used from soup_server_connection_accepted().
+ */
+void
+soup_server_connection_set_tls_handshake_pool (SoupServerConnection *conn,
+                                               SoupTlsHandshakePool *pool)
+{
+        SoupServerConnectionPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_SERVER_CONNECTION (conn));
+
+        priv = soup_server_connection_get_instance_private (conn);
+        priv->tls_handshake_pool = pool;
+}
+
 void
 soup_server_connection_accepted (SoupServerConnection *conn)
 {
@@ -517,6 +567,21 @@ soup_server_connection_accepted (SoupServerConnection *conn)
                                          G_CALLBACK (tls_connection_peer_certificate_changed),
                                          conn, G_CONNECT_SWAPPED);
 
+                /* Certificate validation signals must be emitted in the
+                 * server context, so client authentication keeps the
+                 * handshake there.
+                 */
+                if (priv->tls_handshake_pool && priv->tls_auth_mode == G_TLS_AUTHENTICATION_NONE) {
+                        priv->tls_handshake_cancellable = g_cancellable_new ();
+                        soup_tls_handshake_pool_handshake_async (priv->tls_handshake_pool,
+                                                                 G_TLS_CONNECTION (priv->conn),
+                                                                 priv->tls_handshake_cancellable,
+                                                                 (GAsyncReadyCallback)tls_connection_pool_handshake_ready_cb,
+                                                                 g_object_ref (conn));
+                        priv->tls_handshake_pool = NULL;
+                        return;
+                }
+
                 g_tls_connection_handshake_async (G_TLS_CONNECTION (priv->conn),
                                                   G_PRIORITY_DEFAULT, NULL,
                                                   (GAsyncReadyCallback)tls_connection_handshake_ready_cb,
@@ -529,6 +594,18 @@ soup_server_connection_accepted (SoupServerConnection *conn)
         soup_server_connection_connected (conn);
 }
 
+guint64
+soup_server_connection_get_accept_time (SoupServerConnection *conn)
+{
+        SoupServerConnectionPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_SERVER_CONNECTION (conn), 0);
+
+        priv = soup_server_connection_get_instance_private (conn);
+
+        return priv->accept_time;
+}
+
 GSocket *
 soup_server_connection_get_socket (SoupServerConnection *conn)
 {
@@ -571,6 +648,19 @@ soup_server_connection_steal (SoupServerConnection *conn)
         return stream;
 }
 
+GIOStream *
+soup_server_connection_steal_message_stream (SoupServerConnection *conn,
+                                             SoupServerMessage    *msg)
+{
+        SoupServerConnectionPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_SERVER_CONNECTION (conn), NULL);
+
+        priv = soup_server_connection_get_instance_private (conn);
+
+        return priv->io_data ? soup_server_message_io_steal_stream (priv->io_data, msg) : NULL;
+}
+
 GIOStream *
 soup_server_connection_get_iostream (SoupServerConnection *conn)
 {
@@ -8,6 +8,7 @@
 
 #include "soup-types.h"
 #include "soup-server-message-io.h"
+#include "soup-tls-handshake-pool.h"
 #include <gio/gio.h>
 
 G_BEGIN_DECLS
@@ -24,13 +25,18 @@ SoupServerConnection *soup_server_connection_new_for_connection              (GI
                                                                               GSocketAddress        *remote_addr);
 void                  soup_server_connection_set_advertise_http2             (SoupServerConnection *conn,
                                                                               gboolean              advertise_http2);
+void                  soup_server_connection_set_tls_handshake_pool          (SoupServerConnection  *conn,
+                                                                              SoupTlsHandshakePool  *pool);
 void                  soup_server_connection_accepted                        (SoupServerConnection  *conn);
 SoupServerMessageIO  *soup_server_connection_get_io_data                     (SoupServerConnection  *conn);
 gboolean              soup_server_connection_is_ssl                          (SoupServerConnection  *conn);
 void                  soup_server_connection_disconnect                      (SoupServerConnection  *conn);
 gboolean              soup_server_connection_is_connected                    (SoupServerConnection  *conn);
+guint64               soup_server_connection_get_accept_time                 (SoupServerConnection  *conn);
 GSocket              *soup_server_connection_get_socket                      (SoupServerConnection  *conn);
 GIOStream            *soup_server_connection_steal                           (SoupServerConnection  *conn);
+GIOStream            *soup_server_connection_steal_message_stream            (SoupServerConnection  *conn,
+                                                                              SoupServerMessage     *msg);
 GIOStream            *soup_server_connection_get_iostream                    (SoupServerConnection  *conn);
 GSocketAddress       *soup_server_connection_get_local_address               (SoupServerConnection  *conn);
 GSocketAddress       *soup_server_connection_get_remote_address              (SoupServerConnection  *conn);
@@ -31,6 +31,16 @@ soup_server_message_io_steal (SoupServerMessageIO *io)
         return io->funcs->steal (io);
 }
 
+GIOStream *
+soup_server_message_io_steal_stream (SoupServerMessageIO *io,
+                                     SoupServerMessage   *msg)
+{
+        if (!io->funcs->steal_stream)
+                return NULL;
+
+        return io->funcs->steal_stream (io, msg);
+}
+
 void
 soup_server_message_io_read_request (SoupServerMessageIO       *io,
                                      SoupServerMessage         *msg,
@@ -60,3 +70,13 @@ soup_server_message_io_is_paused (SoupServerMessageIO *io,
 {
         return io->funcs->is_paused (io, msg);
 }
+
+void
+soup_server_message_io_request_body_released (SoupServerMessageIO *io,
+                                              SoupServerMessage   *msg)
+{
+        if (!io->funcs->request_body_released)
+                return;
+
+        io->funcs->request_body_released (io, msg);
+}
@@ -15,6 +15,8 @@ typedef struct {
         void       (*finished)     (SoupServerMessageIO       *io,
                                     SoupServerMessage         *msg);
         GIOStream *(*steal)        (SoupServerMessageIO       *io);
+        GIOStream *(*steal_stream) (SoupServerMessageIO       *io,
+                                    SoupServerMessage         *msg);
         void       (*read_request) (SoupServerMessageIO       *io,
                                     SoupServerMessage         *msg,
                                     SoupMessageIOCompletionFn  completion_cb,
@@ -25,6 +27,8 @@ typedef struct {
                                     SoupServerMessage         *msg);
         gboolean   (*is_paused)    (SoupServerMessageIO       *io,
                                     SoupServerMessage         *msg);
+        void       (*request_body_released) (SoupServerMessageIO *io,
+                                             SoupServerMessage   *msg);
 } SoupServerMessageIOFuncs;
 
 struct _SoupServerMessageIO {
@@ -38,6 +42,8 @@ void       soup_server_message_io_destroy      (SoupServerMessageIO       *io);
 void       soup_server_message_io_finished     (SoupServerMessageIO       *io,
                                                 SoupServerMessage         *msg);
 GIOStream *soup_server_message_io_steal        (SoupServerMessageIO       *io);
+GIOStream *soup_server_message_io_steal_stream (SoupServerMessageIO       *io,
+                                                SoupServerMessage         *msg);
 void       soup_server_message_io_read_request (SoupServerMessageIO       *io,
                                                 SoupServerMessage         *msg,
                                                 SoupMessageIOCompletionFn  completion_cb,
@@ -48,3 +54,5 @@ void       soup_server_message_io_unpause      (SoupServerMessageIO       *io,
                                                 SoupServerMessage         *msg);
 gboolean   soup_server_message_io_is_paused    (SoupServerMessageIO       *io,
                                                 SoupServerMessage         *msg);
+void       soup_server_message_io_request_body_released (SoupServerMessageIO *io,
+                                                         SoupServerMessage   *msg);
@@ -0,0 +1,30 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-server-message-metrics.h"
+
+G_BEGIN_DECLS
+
+struct _SoupServerMessageMetrics {
+        guint64 connection_start;
+        guint64 request_start;
+        guint64 request_headers_end;
+        guint64 request_end;
+        guint64 response_start;
+        guint64 response_end;
+
+        guint64 write_blocked_time;
+
+        guint64 request_header_bytes_received;
+        guint64 request_body_bytes_received;
+        guint64 response_header_bytes_sent;
+        guint64 response_body_bytes_sent;
+};
+
+SoupServerMessageMetrics *soup_server_message_metrics_new (void);
+
+G_END_DECLS
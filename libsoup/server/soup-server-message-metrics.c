@@ -0,0 +1,298 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-server-message-metrics.c
+ *
+ * Copyright (C) 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "soup-server-message-metrics-private.h"
+
+/**
+ * SoupServerMessageMetrics:
+ *
+ * Contains metrics collected while a [class@ServerMessage] is read from and
+ * written to the network.
+ *
+ * Metrics are always collected for a [class@ServerMessage], and they can be
+ * retrieved with [method@ServerMessage.get_metrics].
+ *
+ * Temporal metrics are expressed as a monotonic time. An event can be 0
+ * because it hasn't happened yet or because the connection was closed before
+ * the event was reached.
+ *
+ * Size metrics are expressed in bytes and are updated while the
+ * [class@ServerMessage] is being processed. For HTTP/2 they include the
+ * frame headers, and header sizes are the size of the compressed header
+ * blocks.
+ *
+ * Since: 3.4
+ */
+
+G_DEFINE_BOXED_TYPE (SoupServerMessageMetrics, soup_server_message_metrics, soup_server_message_metrics_copy, soup_server_message_metrics_free)
+
+SoupServerMessageMetrics *
+soup_server_message_metrics_new (void)
+{
+        return g_slice_new0 (SoupServerMessageMetrics);
+}
+
+/**
+ * soup_server_message_metrics_copy:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Copies @metrics.
+ *
+ * Returns: a copy of @metrics
+ *
+ * Since: 3.4
+ **/
+SoupServerMessageMetrics *
+soup_server_message_metrics_copy (SoupServerMessageMetrics *metrics)
+{
+        SoupServerMessageMetrics *copy;
+
+        g_return_val_if_fail (metrics != NULL, NULL);
+
+        copy = soup_server_message_metrics_new ();
+        *copy = *metrics;
+
+        return copy;
+}
+
+/**
+ * soup_server_message_metrics_free:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Frees @metrics.
+ *
+ * Since: 3.4
+ */
+void
+soup_server_message_metrics_free (SoupServerMessageMetrics *metrics)
+{
+        g_return_if_fail (metrics != NULL);
+
+        g_slice_free (SoupServerMessageMetrics, metrics);
+}
+
+/**
+ * soup_server_message_metrics_get_connection_start:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the time immediately after the connection the [class@ServerMessage]
+ * was received on was accepted.
+ *
+ * For persistent connections this is the same for every message received
+ * on the connection.
+ *
+ * Returns: the connection start time
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_connection_start (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->connection_start;
+}
+
+/**
+ * soup_server_message_metrics_get_request_start:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the time immediately after the first bytes of the request were
+ * received.
+ *
+ * Returns: the request start time
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_request_start (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->request_start;
+}
+
+/**
+ * soup_server_message_metrics_get_request_headers_end:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the time immediately after the request headers were received and
+ * parsed, before [signal@ServerMessage::got-headers] is emitted.
+ *
+ * Returns: the request headers end time
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_request_headers_end (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->request_headers_end;
+}
+
+/**
+ * soup_server_message_metrics_get_request_end:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the time immediately after the whole request body was received,
+ * before [signal@ServerMessage::got-body] is emitted.
+ *
+ * Returns: the request end time
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_request_end (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->request_end;
+}
+
+/**
+ * soup_server_message_metrics_get_response_start:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the time immediately before the final response headers started to
+ * be written. Informational responses are not taken into account.
+ *
+ * The time between the request end and the response start is spent in the
+ * server handlers.
+ *
+ * Returns: the response start time
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_response_start (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->response_start;
+}
+
+/**
+ * soup_server_message_metrics_get_response_end:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the time immediately after the whole response was written.
+ *
+ * Returns: the response end time
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_response_end (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->response_end;
+}
+
+/**
+ * soup_server_message_metrics_get_write_blocked_time:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the time, in microseconds, the response spent waiting for the
+ * connection to become writable, because the peer was not reading fast
+ * enough.
+ *
+ * For HTTP/2 this is the time the connection was blocked while the
+ * response was being written, which is shared with the other streams
+ * being written at the same time.
+ *
+ * Returns: the write blocked time
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_write_blocked_time (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->write_blocked_time;
+}
+
+/**
+ * soup_server_message_metrics_get_request_header_bytes_received:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the number of bytes received from the network for the request headers.
+ *
+ * Returns: the request header bytes received
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_request_header_bytes_received (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->request_header_bytes_received;
+}
+
+/**
+ * soup_server_message_metrics_get_request_body_bytes_received:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the number of bytes received from the network for the request body.
+ *
+ * Returns: the request body bytes received
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_request_body_bytes_received (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->request_body_bytes_received;
+}
+
+/**
+ * soup_server_message_metrics_get_response_header_bytes_sent:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the number of bytes sent to the network for the response headers,
+ * including the ones of informational responses.
+ *
+ * Returns: the response header bytes sent
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_response_header_bytes_sent (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->response_header_bytes_sent;
+}
+
+/**
+ * soup_server_message_metrics_get_response_body_bytes_sent:
+ * @metrics: a #SoupServerMessageMetrics
+ *
+ * Get the number of bytes sent to the network for the response body. This
+ * includes the transfer encoding framing, so it can be bigger than the
+ * response body size.
+ *
+ * Returns: the response body bytes sent
+ *
+ * Since: 3.4
+ */
+guint64
+soup_server_message_metrics_get_response_body_bytes_sent (SoupServerMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->response_body_bytes_sent;
+}
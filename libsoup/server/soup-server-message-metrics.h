@@ -0,0 +1,59 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-types.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SoupServerMessageMetrics SoupServerMessageMetrics;
+
+SOUP_AVAILABLE_IN_3_4
+GType soup_server_message_metrics_get_type (void);
+#define SOUP_TYPE_SERVER_MESSAGE_METRICS (soup_server_message_metrics_get_type())
+
+SOUP_AVAILABLE_IN_3_4
+SoupServerMessageMetrics *soup_server_message_metrics_copy                  (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+void                      soup_server_message_metrics_free                  (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_connection_start  (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_request_start     (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_request_headers_end (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_request_end       (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_response_start    (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_response_end      (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_write_blocked_time (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_request_header_bytes_received (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_request_body_bytes_received   (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_response_header_bytes_sent    (SoupServerMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_server_message_metrics_get_response_body_bytes_sent      (SoupServerMessageMetrics *metrics);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(SoupServerMessageMetrics, soup_server_message_metrics_free)
+
+G_END_DECLS
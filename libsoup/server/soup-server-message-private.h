@@ -9,6 +9,7 @@
 #include "soup-auth-domain.h"
 #include "soup-message-io-data.h"
 #include "soup-server-connection.h"
+#include "soup-content-encoder.h"
 
 SoupServerMessage *soup_server_message_new                 (SoupServerConnection     *conn);
 void               soup_server_message_set_uri             (SoupServerMessage        *msg,
@@ -32,16 +33,51 @@ void               soup_server_message_wrote_body          (SoupServerMessage
 void               soup_server_message_got_headers         (SoupServerMessage        *msg);
 void               soup_server_message_got_chunk           (SoupServerMessage        *msg,
                                                             GBytes                   *chunk);
+gboolean           soup_server_message_got_request_chunk   (SoupServerMessage        *msg,
+                                                            GBytes                   *chunk,
+                                                            GError                  **error);
 void               soup_server_message_got_body            (SoupServerMessage        *msg);
 void               soup_server_message_finished            (SoupServerMessage        *msg);
 void               soup_server_message_read_request        (SoupServerMessage        *msg,
                                                             SoupMessageIOCompletionFn completion_cb,
                                                             gpointer                  user_data);
 
+void               soup_server_message_set_connect_protocol (SoupServerMessage       *msg,
+                                                             const char              *protocol);
+const char        *soup_server_message_get_connect_protocol (SoupServerMessage       *msg);
+
 void               soup_server_message_set_options_ping    (SoupServerMessage        *msg,
                                                             gboolean                  is_options_ping);
 
 SoupServerMessageIO *soup_server_message_get_io_data       (SoupServerMessage        *msg);
 
+void               soup_server_message_handle_partial_get   (SoupServerMessage       *msg);
+
+void               soup_server_message_set_content_encoder  (SoupServerMessage       *msg,
+                                                             SoupContentEncoder      *encoder);
+void               soup_server_message_encode_response      (SoupServerMessage       *msg);
+void               soup_server_message_set_response_encoder (SoupServerMessage       *msg,
+                                                             GConverter              *converter,
+                                                             goffset                  input_length);
+gboolean           soup_server_message_has_response_encoder (SoupServerMessage       *msg);
+SoupMessageBody   *soup_server_message_get_write_body       (SoupServerMessage       *msg);
+
+void               soup_server_message_set_request_body_spill_threshold (SoupServerMessage *msg,
+                                                                         goffset            threshold);
+void               soup_server_message_hold_request_body    (SoupServerMessage       *msg);
+void               soup_server_message_release_request_body (SoupServerMessage       *msg);
+gboolean           soup_server_message_is_request_body_held (SoupServerMessage       *msg);
+
+typedef enum {
+        SOUP_SERVER_MESSAGE_METRICS_REQUEST_START,
+        SOUP_SERVER_MESSAGE_METRICS_REQUEST_HEADERS_END,
+        SOUP_SERVER_MESSAGE_METRICS_REQUEST_END,
+        SOUP_SERVER_MESSAGE_METRICS_RESPONSE_START,
+        SOUP_SERVER_MESSAGE_METRICS_RESPONSE_END
+} SoupServerMessageMetricsType;
+
+void               soup_server_message_set_metrics_timestamp (SoupServerMessage           *msg,
+                                                              SoupServerMessageMetricsType type);
+
 
 #endif /* __SOUP_SERVER_MESSAGE_PRIVATE_H__ */
@@ -14,8 +14,14 @@
 #include "soup.h"
 #include "soup-connection.h"
 #include "soup-server-message-private.h"
+#include "soup-server-message-metrics-private.h"
 #include "soup-message-headers-private.h"
 #include "soup-uri-utils-private.h"
+#include "soup-content-encoder-private.h"
+#include "soup-message-body-private.h"
+#include "soup-multipart-private.h"
+#include "soup-file-writer.h"
+#include "soup-misc.h"
 
 /**
  * SoupServerMessage:
@@ -61,9 +67,25 @@ struct _SoupServerMessage {
         SoupServerMessageIO *io_data;
 
         gboolean                 options_ping;
+        char                    *connect_protocol;
 
         GTlsCertificate      *tls_peer_certificate;
         GTlsCertificateFlags  tls_peer_certificate_errors;
+
+        SoupContentEncoder   *content_encoder;
+        GConverter           *response_encoder;
+        SoupMessageBody      *encoded_body;
+        goffset               encoder_offset;
+        goffset               encoder_input_length;
+
+        goffset               request_body_spill_threshold;
+        SoupFileWriter       *request_body_writer;
+        gboolean              request_body_writing;
+        guint                 request_body_holds;
+        gboolean              request_body_paused;
+        gboolean              got_body_pending;
+
+        SoupServerMessageMetrics *metrics;
 };
 
 struct _SoupServerMessageClass {
@@ -113,6 +135,7 @@ soup_server_message_init (SoupServerMessage *msg)
         msg->response_body = soup_message_body_new ();
         msg->response_headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
         soup_message_headers_set_encoding (msg->response_headers, SOUP_ENCODING_CONTENT_LENGTH);
+        msg->metrics = soup_server_message_metrics_new ();
 }
 
 static void
@@ -122,6 +145,7 @@ soup_server_message_finalize (GObject *object)
 
         g_clear_object (&msg->auth_domain);
         g_clear_pointer (&msg->auth_user, g_free);
+        g_clear_pointer (&msg->connect_protocol, g_free);
 
         if (msg->conn) {
                 g_signal_handlers_disconnect_by_data (msg->conn, msg);
@@ -137,6 +161,18 @@ soup_server_message_finalize (GObject *object)
         soup_message_body_unref (msg->response_body);
         soup_message_headers_unref (msg->response_headers);
 
+        g_clear_object (&msg->content_encoder);
+        g_clear_object (&msg->response_encoder);
+        g_clear_pointer (&msg->encoded_body, soup_message_body_unref);
+
+        /* The writer deletes the file from its thread */
+        if (msg->request_body_writer) {
+                soup_file_writer_discard (msg->request_body_writer);
+                soup_file_writer_free (msg->request_body_writer);
+        }
+
+        soup_server_message_metrics_free (msg->metrics);
+
         G_OBJECT_CLASS (soup_server_message_parent_class)->finalize (object);
 }
 
@@ -468,6 +504,7 @@ soup_server_message_new (SoupServerConnection *conn)
         msg = g_object_new (SOUP_TYPE_SERVER_MESSAGE, NULL);
         msg->conn = g_object_ref (conn);
         msg->io_data = soup_server_connection_get_io_data (msg->conn);
+        msg->metrics->connection_start = soup_server_connection_get_accept_time (msg->conn);
 
         g_signal_connect_object (conn, "connected",
                                  G_CALLBACK (connection_connected),
@@ -568,6 +605,245 @@ soup_server_message_get_io_data (SoupServerMessage *msg)
         return msg->io_data;
 }
 
+static void
+append_string (GPtrArray *pieces,
+               GString   *str)
+{
+        g_ptr_array_add (pieces, g_string_free_to_bytes (str));
+}
+
+/* Turns a 200 response into a 206 one if the request had a valid Range
+ * header. The ranges are sliced out of the chunks already in the
+ * response body, so the data is never copied.
+ */
+void
+soup_server_message_handle_partial_get (SoupServerMessage *msg)
+{
+        SoupRange *ranges;
+        int nranges;
+        guint status;
+        goffset full_length;
+        GPtrArray *pieces;
+        guint i;
+
+        /* Make sure the message is set up right for us to return a
+         * partial response; it has to be a GET, the status must be
+         * 200 OK (and in particular, NOT already 206 Partial
+         * Content), and the SoupServer must have already filled in
+         * the response body
+         */
+        if (msg->method != SOUP_METHOD_GET ||
+            msg->status_code != SOUP_STATUS_OK ||
+            soup_message_headers_get_encoding (msg->response_headers) !=
+            SOUP_ENCODING_CONTENT_LENGTH ||
+            msg->response_body->length == 0 ||
+            !soup_message_body_get_accumulate (msg->response_body))
+                return;
+
+        /* Oh, and there has to have been a valid Range header on the
+         * request, of course.
+         */
+        full_length = msg->response_body->length;
+        status = soup_message_headers_get_ranges_internal (msg->request_headers,
+                                                           full_length,
+                                                           TRUE,
+                                                           &ranges, &nranges);
+        if (status == SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE) {
+                soup_server_message_set_status (msg, status, NULL);
+                soup_message_body_truncate (msg->response_body);
+                return;
+        } else if (status != SOUP_STATUS_PARTIAL_CONTENT)
+                return;
+
+        soup_server_message_set_status (msg, SOUP_STATUS_PARTIAL_CONTENT, NULL);
+
+        pieces = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+        if (nranges == 1) {
+                /* Single range, so just set Content-Range and fix the body. */
+                soup_message_headers_set_content_range (msg->response_headers,
+                                                        ranges[0].start,
+                                                        ranges[0].end,
+                                                        full_length);
+                soup_message_body_get_slices (msg->response_body,
+                                              ranges[0].start,
+                                              ranges[0].end - ranges[0].start + 1,
+                                              pieces);
+        } else {
+                char *boundary, *content_type;
+                GHashTable *params;
+                GString *str;
+
+                /* Multiple ranges, so build a multipart/byteranges
+                 * body where only the part headers are new data.
+                 */
+                boundary = soup_multipart_generate_boundary ();
+                content_type = g_strdup (soup_message_headers_get_one_common (msg->response_headers, SOUP_HEADER_CONTENT_TYPE));
+                for (i = 0; i < (guint)nranges; i++) {
+                        str = g_string_new (i > 0 ? "\r\n--" : "--");
+                        g_string_append (str, boundary);
+                        g_string_append (str, "\r\n");
+                        if (content_type)
+                                g_string_append_printf (str, "Content-Type: %s\r\n", content_type);
+                        g_string_append_printf (str, "Content-Range: bytes %" G_GINT64_FORMAT "-%" G_GINT64_FORMAT "/%" G_GINT64_FORMAT "\r\n\r\n",
+                                                ranges[i].start, ranges[i].end, full_length);
+                        append_string (pieces, str);
+
+                        soup_message_body_get_slices (msg->response_body,
+                                                      ranges[i].start,
+                                                      ranges[i].end - ranges[i].start + 1,
+                                                      pieces);
+                }
+
+                str = g_string_new ("\r\n--");
+                g_string_append (str, boundary);
+                g_string_append (str, "--\r\n");
+                append_string (pieces, str);
+
+                params = g_hash_table_new (g_str_hash, g_str_equal);
+                g_hash_table_insert (params, "boundary", boundary);
+                soup_message_headers_set_content_type (msg->response_headers,
+                                                       "multipart/byteranges",
+                                                       params);
+                g_hash_table_destroy (params);
+                g_free (content_type);
+                g_free (boundary);
+        }
+
+        soup_message_body_truncate (msg->response_body);
+        for (i = 0; i < pieces->len; i++)
+                soup_message_body_append_bytes (msg->response_body, pieces->pdata[i]);
+        soup_message_headers_set_content_length (msg->response_headers, msg->response_body->length);
+
+        g_ptr_array_unref (pieces);
+        soup_message_headers_free_ranges (msg->request_headers, ranges);
+}
+
+void
+soup_server_message_set_content_encoder (SoupServerMessage  *msg,
+                                         SoupContentEncoder *encoder)
+{
+        g_set_object (&msg->content_encoder, encoder);
+}
+
+void
+soup_server_message_encode_response (SoupServerMessage *msg)
+{
+        if (!msg->content_encoder || msg->encoded_body)
+                return;
+
+        soup_content_encoder_encode_response (msg->content_encoder, msg);
+}
+
+void
+soup_server_message_set_response_encoder (SoupServerMessage *msg,
+                                          GConverter        *converter,
+                                          goffset            input_length)
+{
+        g_clear_object (&msg->response_encoder);
+        g_clear_pointer (&msg->encoded_body, soup_message_body_unref);
+
+        msg->response_encoder = converter;
+        if (!converter)
+                return;
+
+        msg->encoded_body = soup_message_body_new ();
+        soup_message_body_set_accumulate (msg->encoded_body, FALSE);
+        msg->encoder_offset = 0;
+        msg->encoder_input_length = input_length;
+}
+
+gboolean
+soup_server_message_has_response_encoder (SoupServerMessage *msg)
+{
+        return msg->encoded_body != NULL;
+}
+
+static void
+soup_server_message_pump_response_encoder (SoupServerMessage *msg)
+{
+        GByteArray *output;
+        gboolean done = FALSE;
+        gboolean converted = FALSE;
+        GError *error = NULL;
+
+        output = g_byte_array_new ();
+        while (!done) {
+                GBytes *chunk;
+                gconstpointer data;
+                gsize size;
+
+                if (msg->encoder_input_length >= 0 && msg->encoder_offset >= msg->encoder_input_length) {
+                        done = TRUE;
+                        break;
+                }
+
+                chunk = soup_message_body_get_chunk (msg->response_body, msg->encoder_offset);
+                if (!chunk)
+                        break;
+
+                data = g_bytes_get_data (chunk, &size);
+                if (size == 0) {
+                        g_bytes_unref (chunk);
+                        done = TRUE;
+                        break;
+                }
+
+                if (!soup_content_encoder_convert (msg->response_encoder, data, size, G_CONVERTER_NO_FLAGS, output, &error)) {
+                        g_bytes_unref (chunk);
+                        break;
+                }
+
+                soup_message_body_wrote_chunk (msg->response_body, chunk);
+                msg->encoder_offset += size;
+                converted = TRUE;
+                g_bytes_unref (chunk);
+        }
+
+        /* Flush after every batch so that streamed data is not
+         * held back by the encoder waiting for more input.
+         */
+        if (!error && (done || converted)) {
+                soup_content_encoder_convert (msg->response_encoder, NULL, 0,
+                                              done ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_FLUSH,
+                                              output, &error);
+        }
+
+        if (error) {
+                g_warning ("Failed to compress response body: %s", error->message);
+                g_error_free (error);
+                done = TRUE;
+        }
+
+        if (output->len > 0) {
+                GBytes *encoded = g_byte_array_free_to_bytes (output);
+
+                soup_message_body_append_bytes (msg->encoded_body, encoded);
+                g_bytes_unref (encoded);
+        } else {
+                g_byte_array_free (output, TRUE);
+        }
+
+        if (done) {
+                soup_message_body_complete (msg->encoded_body);
+                g_clear_object (&msg->response_encoder);
+        }
+}
+
+/* Returns the body that the I/O backends must write: @msg's response
+ * body, or the result of compressing it if a response encoder is set.
+ */
+SoupMessageBody *
+soup_server_message_get_write_body (SoupServerMessage *msg)
+{
+        if (!msg->encoded_body)
+                return msg->response_body;
+
+        if (msg->response_encoder)
+                soup_server_message_pump_response_encoder (msg);
+
+        return msg->encoded_body;
+}
+
 /**
  * soup_server_message_pause:
  * @msg: a SoupServerMessage
@@ -635,6 +911,8 @@ soup_server_message_cleanup_response (SoupServerMessage *msg)
         msg->status_code = SOUP_STATUS_NONE;
         g_clear_pointer (&msg->reason_phrase, g_free);
         msg->http_version = msg->orig_http_version;
+        g_clear_object (&msg->response_encoder);
+        g_clear_pointer (&msg->encoded_body, soup_message_body_unref);
 }
 
 void
@@ -681,12 +959,167 @@ soup_server_message_got_chunk (SoupServerMessage *msg,
         g_signal_emit (msg, signals[GOT_CHUNK], 0, chunk);
 }
 
+void
+soup_server_message_set_request_body_spill_threshold (SoupServerMessage *msg,
+                                                      goffset            threshold)
+{
+        msg->request_body_spill_threshold = threshold;
+}
+
+/* Request body chunks are written to files from a worker thread, so
+ * whatever writes them holds the request body until the writes are
+ * done. For HTTP/1 reading stops while the body is held. For HTTP/2 the
+ * stream's flow control window is not replenished until the body is
+ * released, so the peer can't send more than a window's worth of data.
+ * got-body is delayed in both cases until the body is released.
+ */
+void
+soup_server_message_hold_request_body (SoupServerMessage *msg)
+{
+        if (msg->request_body_holds++ > 0)
+                return;
+
+        if (msg->http_version != SOUP_HTTP_2_0 && msg->io_data && !msg->request_body_paused) {
+                soup_server_message_io_pause (msg->io_data, msg);
+                msg->request_body_paused = TRUE;
+        }
+}
+
+static void
+emit_got_body (SoupServerMessage *msg)
+{
+        GError *error = NULL;
+
+        if (msg->request_body_writer &&
+            !soup_file_writer_get_error (msg->request_body_writer, &error)) {
+                soup_server_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR, error->message);
+                g_error_free (error);
+        }
+
+        g_signal_emit (msg, signals[GOT_BODY], 0);
+}
+
+gboolean
+soup_server_message_is_request_body_held (SoupServerMessage *msg)
+{
+        return msg->request_body_holds > 0;
+}
+
+void
+soup_server_message_release_request_body (SoupServerMessage *msg)
+{
+        g_return_if_fail (msg->request_body_holds > 0);
+
+        if (--msg->request_body_holds > 0)
+                return;
+
+        if (msg->io_data)
+                soup_server_message_io_request_body_released (msg->io_data, msg);
+
+        if (msg->request_body_paused) {
+                msg->request_body_paused = FALSE;
+                if (msg->io_data)
+                        soup_server_message_io_unpause (msg->io_data, msg);
+        }
+
+        if (msg->got_body_pending) {
+                msg->got_body_pending = FALSE;
+                if (msg->io_data)
+                        emit_got_body (msg);
+        }
+}
+
+static void
+request_body_writer_idle (SoupServerMessage *msg)
+{
+        if (!msg->request_body_writing)
+                return;
+
+        msg->request_body_writing = FALSE;
+        soup_server_message_release_request_body (msg);
+}
+
+static void
+write_request_body (SoupServerMessage *msg,
+                    GBytes            *chunk)
+{
+        soup_file_writer_write (msg->request_body_writer, chunk);
+        if (!msg->request_body_writing) {
+                msg->request_body_writing = TRUE;
+                soup_server_message_hold_request_body (msg);
+        }
+}
+
+static void
+spill_request_body (SoupServerMessage *msg)
+{
+        GBytes *chunk;
+        goffset offset = 0;
+
+        msg->request_body_writer = soup_file_writer_new (NULL,
+                                                         (SoupFileWriterIdleFunc)request_body_writer_idle,
+                                                         msg);
+
+        /* Move what was received so far out of memory */
+        while ((chunk = soup_message_body_get_chunk (msg->request_body, offset))) {
+                gsize size = g_bytes_get_size (chunk);
+
+                if (size > 0)
+                        write_request_body (msg, chunk);
+                g_bytes_unref (chunk);
+                if (size == 0)
+                        break;
+                offset += size;
+        }
+        soup_message_body_truncate (msg->request_body);
+}
+
+gboolean
+soup_server_message_got_request_chunk (SoupServerMessage *msg,
+                                       GBytes            *chunk,
+                                       GError           **error)
+{
+        if (!msg->request_body_writer && msg->request_body_spill_threshold > 0 &&
+            soup_message_body_get_accumulate (msg->request_body)) {
+                goffset expected_length = msg->request_body->length + g_bytes_get_size (chunk);
+
+                if (soup_message_headers_get_encoding (msg->request_headers) == SOUP_ENCODING_CONTENT_LENGTH)
+                        expected_length = MAX (expected_length, soup_message_headers_get_content_length (msg->request_headers));
+
+                if (expected_length > msg->request_body_spill_threshold)
+                        spill_request_body (msg);
+        }
+
+        if (!msg->request_body_writer) {
+                soup_message_body_got_chunk (msg->request_body, chunk);
+                return TRUE;
+        }
+
+        /* Report errors of previous writes */
+        if (!soup_file_writer_get_error (msg->request_body_writer, error))
+                return FALSE;
+
+        write_request_body (msg, chunk);
+
+        return TRUE;
+}
+
 void
 soup_server_message_got_body (SoupServerMessage *msg)
 {
         if (soup_message_body_get_accumulate (msg->request_body))
                 g_bytes_unref (soup_message_body_flatten (msg->request_body));
-        g_signal_emit (msg, signals[GOT_BODY], 0);
+
+        if (msg->request_body_holds > 0) {
+                msg->got_body_pending = TRUE;
+                if (!msg->request_body_paused) {
+                        soup_server_message_io_pause (msg->io_data, msg);
+                        msg->request_body_paused = TRUE;
+                }
+                return;
+        }
+
+        emit_got_body (msg);
 }
 
 void
@@ -743,6 +1176,63 @@ soup_server_message_get_request_body (SoupServerMessage *msg)
         return msg->request_body;
 }
 
+/**
+ * soup_server_message_get_request_body_stream:
+ * @msg: a #SoupServerMessage
+ * @error: return location for a #GError
+ *
+ * Creates a [class@Gio.InputStream] to read the request body of @msg from
+ * the beginning, whether it was kept in memory or written to a
+ * temporary file.
+ *
+ * When [method@Server.set_request_body_spill_threshold] is used, request
+ * bodies larger than the threshold are written to a temporary file
+ * instead of being kept in the [struct@MessageBody] returned by
+ * [method@ServerMessage.get_request_body], which is left empty. The file
+ * is written from a worker thread and is complete once
+ * [signal@ServerMessage::got-body] is emitted. It is removed from the
+ * file system as soon as it's created, so it's only reachable through
+ * the streams returned by this function, which can be used while @msg
+ * is alive. All of them share the file position, so they must be read
+ * one at a time.
+ *
+ * The in-memory case does not copy the body data. This should be called
+ * once the body has been received, for example from a
+ * [signal@ServerMessage::got-body] handler or a server handler.
+ *
+ * Returns: (transfer full) (nullable): a new #GInputStream, or %NULL on error.
+ *
+ * Since: 3.4
+ */
+GInputStream *
+soup_server_message_get_request_body_stream (SoupServerMessage *msg,
+                                             GError           **error)
+{
+        GInputStream *stream;
+        GBytes *chunk;
+        goffset offset = 0;
+
+        g_return_val_if_fail (SOUP_IS_SERVER_MESSAGE (msg), NULL);
+        g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+        if (msg->request_body_writer)
+                return soup_file_writer_read (msg->request_body_writer, error);
+
+        stream = g_memory_input_stream_new ();
+        while ((chunk = soup_message_body_get_chunk (msg->request_body, offset))) {
+                gsize size = g_bytes_get_size (chunk);
+
+                if (size > 0)
+                        g_memory_input_stream_add_bytes (G_MEMORY_INPUT_STREAM (stream), chunk);
+                g_bytes_unref (chunk);
+                if (size == 0)
+                        break;
+                offset += size;
+        }
+
+        return stream;
+}
+
 /**
  * soup_server_message_get_response_body:
  * @msg: a #SoupServerMessage
@@ -782,6 +1272,20 @@ soup_server_message_set_method (SoupServerMessage *msg,
         msg->method = g_intern_string (method);
 }
 
+void
+soup_server_message_set_connect_protocol (SoupServerMessage *msg,
+                                          const char        *protocol)
+{
+        g_free (msg->connect_protocol);
+        msg->connect_protocol = g_strdup (protocol);
+}
+
+const char *
+soup_server_message_get_connect_protocol (SoupServerMessage *msg)
+{
+        return msg->connect_protocol;
+}
+
 void
 soup_server_message_set_options_ping (SoupServerMessage *msg,
                                       gboolean           is_options_ping)
@@ -1087,7 +1591,9 @@ soup_server_message_get_remote_host (SoupServerMessage *msg)
  * discarded; you can steal the connection from a
  * [signal@ServerMessage::wrote-informational] or
  * [signal@ServerMessage::wrote-body] signal handler if you need to wait for
- * part or all of the response to be sent.
+ * part or all of the response to be sent. For HTTP/2 messages, only the
+ * stream of @msg is stolen, for example for WebSockets bootstrapped with an
+ * extended CONNECT request, and the connection is kept by the server.
  *
  * Note that when calling this function from C, @msg will most
  * likely be freed as a side effect.
@@ -1103,7 +1609,10 @@ soup_server_message_steal_connection (SoupServerMessage *msg)
         GIOStream *stream;
 
         g_object_ref (msg);
-        stream = soup_server_connection_steal (msg->conn);
+        if (msg->http_version == SOUP_HTTP_2_0)
+                stream = soup_server_connection_steal_message_stream (msg->conn, msg);
+        else
+                stream = soup_server_connection_steal (msg->conn);
         g_signal_handlers_disconnect_by_data (msg, msg->conn);
         g_object_unref (msg);
 
@@ -1150,3 +1659,46 @@ soup_server_message_get_tls_peer_certificate_errors (SoupServerMessage *msg)
 
         return msg->tls_peer_certificate_errors;
 }
+
+/**
+ * soup_server_message_get_metrics:
+ * @msg: a #SoupServerMessage
+ *
+ * Get the [struct@ServerMessageMetrics] of @msg.
+ *
+ * Returns: (transfer none): a #SoupServerMessageMetrics
+ *
+ * Since: 3.4
+ */
+SoupServerMessageMetrics *
+soup_server_message_get_metrics (SoupServerMessage *msg)
+{
+        g_return_val_if_fail (SOUP_IS_SERVER_MESSAGE (msg), NULL);
+
+        return msg->metrics;
+}
+
+void
+soup_server_message_set_metrics_timestamp (SoupServerMessage           *msg,
+                                           SoupServerMessageMetricsType type)
+{
+        guint64 timestamp = g_get_monotonic_time ();
+
+        switch (type) {
+        case SOUP_SERVER_MESSAGE_METRICS_REQUEST_START:
+                msg->metrics->request_start = timestamp;
+                break;
+        case SOUP_SERVER_MESSAGE_METRICS_REQUEST_HEADERS_END:
+                msg->metrics->request_headers_end = timestamp;
+                break;
+        case SOUP_SERVER_MESSAGE_METRICS_REQUEST_END:
+                msg->metrics->request_end = timestamp;
+                break;
+        case SOUP_SERVER_MESSAGE_METRICS_RESPONSE_START:
+                msg->metrics->response_start = timestamp;
+                break;
+        case SOUP_SERVER_MESSAGE_METRICS_RESPONSE_END:
+                msg->metrics->response_end = timestamp;
+                break;
+        }
+}
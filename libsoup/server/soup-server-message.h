@@ -9,6 +9,7 @@
 #include "soup-message-body.h"
 #include "soup-message-headers.h"
 #include "soup-method.h"
+#include "soup-server-message-metrics.h"
 
 G_BEGIN_DECLS
 
@@ -25,6 +26,10 @@ SoupMessageHeaders *soup_server_message_get_response_headers (SoupServerMessage
 SOUP_AVAILABLE_IN_ALL
 SoupMessageBody    *soup_server_message_get_request_body     (SoupServerMessage *msg);
 
+SOUP_AVAILABLE_IN_3_4
+GInputStream       *soup_server_message_get_request_body_stream (SoupServerMessage *msg,
+                                                                 GError           **error);
+
 SOUP_AVAILABLE_IN_ALL
 SoupMessageBody    *soup_server_message_get_response_body    (SoupServerMessage *msg);
 
@@ -92,6 +97,9 @@ GTlsCertificate     *soup_server_message_get_tls_peer_certificate          (Soup
 SOUP_AVAILABLE_IN_3_2
 GTlsCertificateFlags soup_server_message_get_tls_peer_certificate_errors   (SoupServerMessage *msg);
 
+SOUP_AVAILABLE_IN_3_4
+SoupServerMessageMetrics *soup_server_message_get_metrics            (SoupServerMessage *msg);
+
 G_END_DECLS
 
 #endif /* __SOUP_SERVER_MESSAGE_H__ */
@@ -19,7 +19,11 @@
 #include "soup.h"
 #include "soup-misc.h"
 #include "soup-path-map.h"
+#include "soup-profiler.h"
 #include "soup-listener.h"
+#include "soup-tls-handshake-pool.h"
+#include "soup-histogram.h"
+#include "soup-static-handler.h"
 #include "soup-uri-utils-private.h"
 #include "websocket/soup-websocket.h"
 #include "websocket/soup-websocket-connection.h"
@@ -163,6 +167,29 @@ typedef struct {
 
 	GPtrArray         *websocket_extension_types;
 
+        SoupContentEncoder *content_encoder;
+        goffset            request_body_spill_threshold;
+
+        guint              max_connections;
+        guint              max_requests;
+        guint              max_queued_requests;
+        guint              max_client_connections;
+        double             client_request_rate;
+        guint              client_request_burst;
+        guint              retry_after;
+
+        guint              n_connections;
+        GHashTable        *client_states;
+        GQueue             client_states_lru;
+        GHashTable        *connection_clients;
+        GHashTable        *in_flight;
+        GQueue            *waiting;
+        guint64            counters[SOUP_SERVER_COUNTER_REQUESTS_WAITING + 1];
+        SoupHistogram     *metrics;
+
+        guint                 tls_handshake_threads;
+        SoupTlsHandshakePool *tls_handshake_pool;
+
 	gboolean           disposed;
         gboolean           http2_enabled;
 
@@ -186,6 +213,29 @@ static GParamSpec *properties[LAST_PROPERTY] = { NULL, };
 
 G_DEFINE_TYPE_WITH_PRIVATE (SoupServer, soup_server, G_TYPE_OBJECT)
 
+/* Per remote address admission state. @tokens is a token bucket
+ * refilled at client_request_rate up to client_request_burst; every
+ * request takes one token. @link is the entry of the state in
+ * client_states_lru, least recently used first.
+ */
+typedef struct {
+        char   *address;
+        guint   connections;
+        double  tokens;
+        gint64  last_refill;
+        GList   link;
+} SoupServerClientState;
+
+/* A request admitted past the in-flight limit, waiting for a slot */
+typedef struct {
+        SoupServerMessage *msg;
+        gboolean           got_body;
+} SoupServerWaitingRequest;
+
+#define CLIENT_STATES_PRUNE_THRESHOLD 1024
+/* Number of least recently used states looked at per new client */
+#define CLIENT_STATES_PRUNE_BATCH 8
+
 static void request_finished (SoupServerMessage      *msg,
                               SoupMessageIOCompletion completion,
                               SoupServer             *server);
@@ -206,6 +256,20 @@ free_handler (SoupServerHandler *handler)
 	g_slice_free (SoupServerHandler, handler);
 }
 
+static void
+client_state_free (SoupServerClientState *state)
+{
+        g_free (state->address);
+        g_free (state);
+}
+
+static void
+waiting_request_free (SoupServerWaitingRequest *waiting)
+{
+        g_object_unref (waiting->msg);
+        g_free (waiting);
+}
+
 static void
 soup_server_init (SoupServer *server)
 {
@@ -218,6 +282,13 @@ soup_server_init (SoupServer *server)
 
 	/* Use permessage-deflate extension by default */
 	g_ptr_array_add (priv->websocket_extension_types, g_type_class_ref (SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE));
+
+        priv->retry_after = 1;
+        priv->client_states = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)client_state_free);
+        priv->connection_clients = g_hash_table_new (NULL, NULL);
+        priv->in_flight = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+        priv->waiting = g_queue_new ();
+        priv->metrics = g_new0 (SoupHistogram, SOUP_SERVER_METRICS_PHASE_TOTAL + 1);
 }
 
 static void
@@ -250,6 +321,16 @@ soup_server_finalize (GObject *object)
 	g_clear_pointer (&priv->loop, g_main_loop_unref);
 
 	g_ptr_array_free (priv->websocket_extension_types, TRUE);
+        g_clear_object (&priv->content_encoder);
+
+        /* The LRU links are embedded in the states */
+        g_queue_init (&priv->client_states_lru);
+        g_hash_table_destroy (priv->client_states);
+        g_hash_table_destroy (priv->connection_clients);
+        g_hash_table_destroy (priv->in_flight);
+        g_queue_free_full (priv->waiting, (GDestroyNotify)waiting_request_free);
+        g_clear_pointer (&priv->tls_handshake_pool, soup_tls_handshake_pool_free);
+        g_free (priv->metrics);
 
 	G_OBJECT_CLASS (soup_server_parent_class)->finalize (object);
 }
@@ -829,6 +910,237 @@ call_handler (SoupServer        *server,
 		g_hash_table_unref (form_data_set);
 }
 
+static void
+client_state_refill (SoupServerPrivate     *priv,
+                     SoupServerClientState *state,
+                     gint64                 now)
+{
+        if (priv->client_request_rate <= 0)
+                return;
+
+        state->tokens = MIN (state->tokens + (now - state->last_refill) * priv->client_request_rate / G_USEC_PER_SEC,
+                             priv->client_request_burst);
+        state->last_refill = now;
+}
+
+static gboolean
+client_state_is_idle (SoupServerPrivate     *priv,
+                      SoupServerClientState *state,
+                      gint64                 now)
+{
+        if (state->connections > 0)
+                return FALSE;
+
+        client_state_refill (priv, state, now);
+        return priv->client_request_rate <= 0 || state->tokens >= priv->client_request_burst;
+}
+
+static void
+remove_client_state (SoupServerPrivate     *priv,
+                     SoupServerClientState *state)
+{
+        g_queue_unlink (&priv->client_states_lru, &state->link);
+        g_hash_table_remove (priv->client_states, state->address);
+}
+
+static void
+touch_client_state (SoupServerPrivate     *priv,
+                    SoupServerClientState *state)
+{
+        g_queue_unlink (&priv->client_states_lru, &state->link);
+        g_queue_push_tail_link (&priv->client_states_lru, &state->link);
+}
+
+/* Looks at a few of the least recently used states, forgetting the
+ * idle ones and moving the others to the back of the list, so that
+ * every new client costs a bounded amount of work.
+ */
+static void
+prune_client_states (SoupServerPrivate *priv)
+{
+        gint64 now = g_get_monotonic_time ();
+        guint i;
+
+        for (i = 0; i < CLIENT_STATES_PRUNE_BATCH && priv->client_states_lru.head; i++) {
+                SoupServerClientState *state = priv->client_states_lru.head->data;
+
+                if (client_state_is_idle (priv, state, now))
+                        remove_client_state (priv, state);
+                else
+                        touch_client_state (priv, state);
+        }
+}
+
+static SoupServerClientState *
+lookup_client_state (SoupServerPrivate    *priv,
+                     SoupServerConnection *conn)
+{
+        GSocketAddress *addr;
+        SoupServerClientState *state;
+        char *address;
+
+        if (!priv->max_client_connections && priv->client_request_rate <= 0)
+                return NULL;
+
+        addr = soup_server_connection_get_remote_address (conn);
+        if (!G_IS_INET_SOCKET_ADDRESS (addr))
+                return NULL;
+
+        address = g_inet_address_to_string (g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (addr)));
+        state = g_hash_table_lookup (priv->client_states, address);
+        if (state) {
+                g_free (address);
+                touch_client_state (priv, state);
+                return state;
+        }
+
+        if (g_hash_table_size (priv->client_states) >= CLIENT_STATES_PRUNE_THRESHOLD)
+                prune_client_states (priv);
+
+        state = g_new0 (SoupServerClientState, 1);
+        state->address = address;
+        state->tokens = priv->client_request_burst;
+        state->last_refill = g_get_monotonic_time ();
+        state->link.data = state;
+        g_hash_table_insert (priv->client_states, state->address, state);
+        g_queue_push_tail_link (&priv->client_states_lru, &state->link);
+
+        return state;
+}
+
+static gboolean
+admit_connection (SoupServer           *server,
+                  SoupServerConnection *conn)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupServerClientState *state;
+
+        if (priv->max_connections && priv->n_connections >= priv->max_connections)
+                return FALSE;
+
+        state = lookup_client_state (priv, conn);
+        if (state && priv->max_client_connections && state->connections >= priv->max_client_connections)
+                return FALSE;
+
+        priv->n_connections++;
+        soup_profiler_counter_add (SOUP_PROFILER_COUNTER_SERVER_CONNECTIONS, 1);
+        if (state) {
+                state->connections++;
+                g_hash_table_insert (priv->connection_clients, conn, state);
+        }
+
+        return TRUE;
+}
+
+static void
+release_connection (SoupServer           *server,
+                    SoupServerConnection *conn)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupServerClientState *state;
+
+        priv->n_connections--;
+        soup_profiler_counter_add (SOUP_PROFILER_COUNTER_SERVER_CONNECTIONS, -1);
+
+        state = g_hash_table_lookup (priv->connection_clients, conn);
+        if (!state)
+                return;
+
+        g_hash_table_remove (priv->connection_clients, conn);
+        state->connections--;
+        if (client_state_is_idle (priv, state, g_get_monotonic_time ()))
+                remove_client_state (priv, state);
+}
+
+static void
+reject_connection (SoupServerConnection *conn)
+{
+        GIOStream *iostream;
+        GSocket *socket;
+
+        /* The connection hasn't been accepted yet, so there is no
+         * I/O to tear down; just close the underlying stream.
+         */
+        iostream = soup_server_connection_get_iostream (conn);
+        socket = soup_server_connection_get_socket (conn);
+        if (iostream)
+                g_io_stream_close (iostream, NULL, NULL);
+        else if (socket)
+                g_socket_close (socket, NULL);
+}
+
+static gboolean
+admit_request (SoupServer        *server,
+               SoupServerMessage *msg)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupServerClientState *state;
+        SoupServerWaitingRequest *waiting;
+
+        state = g_hash_table_lookup (priv->connection_clients,
+                                     soup_server_message_get_connection (msg));
+        if (state && priv->client_request_rate > 0) {
+                client_state_refill (priv, state, g_get_monotonic_time ());
+                if (state->tokens < 1)
+                        return FALSE;
+                state->tokens -= 1;
+        }
+
+        if (!priv->max_requests || g_hash_table_size (priv->in_flight) < priv->max_requests) {
+                g_hash_table_add (priv->in_flight, g_object_ref (msg));
+                soup_profiler_counter_add (SOUP_PROFILER_COUNTER_SERVER_REQUESTS, 1);
+                return TRUE;
+        }
+
+        if (priv->waiting->length >= priv->max_queued_requests)
+                return FALSE;
+
+        waiting = g_new0 (SoupServerWaitingRequest, 1);
+        waiting->msg = g_object_ref (msg);
+        g_queue_push_tail (priv->waiting, waiting);
+        priv->counters[SOUP_SERVER_COUNTER_REQUESTS_QUEUED]++;
+
+        return TRUE;
+}
+
+static void
+reject_request (SoupServer        *server,
+                SoupServerMessage *msg)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupMessageHeaders *headers;
+
+        soup_server_message_set_status (msg, SOUP_STATUS_SERVICE_UNAVAILABLE, NULL);
+
+        headers = soup_server_message_get_response_headers (msg);
+        if (priv->retry_after) {
+                char *retry_after = g_strdup_printf ("%u", priv->retry_after);
+
+                soup_message_headers_replace (headers, "Retry-After", retry_after);
+                g_free (retry_after);
+        }
+
+        /* Closing the connection lets the I/O skip the request body */
+        if (soup_server_message_get_http_version (msg) < SOUP_HTTP_2_0)
+                soup_message_headers_replace_common (headers, SOUP_HEADER_CONNECTION, "close");
+}
+
+static SoupServerWaitingRequest *
+find_waiting_request (SoupServerPrivate *priv,
+                      SoupServerMessage *msg)
+{
+        GList *l;
+
+        for (l = priv->waiting->head; l; l = l->next) {
+                SoupServerWaitingRequest *waiting = l->data;
+
+                if (waiting->msg == msg)
+                        return waiting;
+        }
+
+        return NULL;
+}
+
 static void
 got_headers (SoupServer        *server,
 	     SoupServerMessage *msg)
@@ -857,6 +1169,14 @@ got_headers (SoupServer        *server,
 	if (soup_server_message_get_status (msg) != 0)
 		return;
 
+        /* Shed load before doing any work for the request */
+        if (!admit_request (server, msg)) {
+                priv->counters[SOUP_SERVER_COUNTER_REQUESTS_REJECTED]++;
+                reject_request (server, msg);
+                return;
+        }
+        priv->counters[SOUP_SERVER_COUNTER_REQUESTS_ACCEPTED]++;
+
 	conn = soup_server_message_get_connection (msg);
 	uri = soup_server_message_get_uri (msg);
 	if ((soup_server_connection_is_ssl (conn) && !soup_uri_is_https (uri)) ||
@@ -960,8 +1280,8 @@ complete_websocket_upgrade (SoupServer        *server,
 }
 
 static void
-got_body (SoupServer        *server,
-	  SoupServerMessage *msg)
+dispatch_request (SoupServer        *server,
+                  SoupServerMessage *msg)
 {
 	SoupServerHandler *handler;
 
@@ -989,13 +1309,75 @@ got_body (SoupServer        *server,
 							     handler->websocket_protocols,
 							     priv->websocket_extension_types,
 							     &handler->websocket_extensions)) {
-			g_signal_connect_object (msg, "wrote-informational",
+			/* Over HTTP/2 the handshake is accepted with a 200
+			 * response and the stream becomes the WebSocket.
+			 */
+			g_signal_connect_object (msg,
+						 soup_server_message_get_http_version (msg) == SOUP_HTTP_2_0 ?
+						 "wrote-headers" : "wrote-informational",
 						 G_CALLBACK (complete_websocket_upgrade),
 						 server, G_CONNECT_SWAPPED);
 		}
 	}
 }
 
+static void
+got_body (SoupServer        *server,
+	  SoupServerMessage *msg)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupServerWaitingRequest *waiting;
+
+        /* Over the in-flight limit: hold the request until
+         * release_request() hands it a slot.
+         */
+        waiting = find_waiting_request (priv, msg);
+        if (waiting) {
+                waiting->got_body = TRUE;
+                soup_server_message_pause (msg);
+                return;
+        }
+
+        dispatch_request (server, msg);
+}
+
+static void
+release_request (SoupServer        *server,
+                 SoupServerMessage *msg)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupServerWaitingRequest *waiting;
+
+        if (!g_hash_table_remove (priv->in_flight, msg)) {
+                waiting = find_waiting_request (priv, msg);
+                if (waiting) {
+                        g_queue_remove (priv->waiting, waiting);
+                        waiting_request_free (waiting);
+                }
+                return;
+        }
+        soup_profiler_counter_add (SOUP_PROFILER_COUNTER_SERVER_REQUESTS, -1);
+
+        while (!g_queue_is_empty (priv->waiting) &&
+               (!priv->max_requests || g_hash_table_size (priv->in_flight) < priv->max_requests)) {
+                SoupServerMessage *next;
+                gboolean got_body;
+
+                waiting = g_queue_pop_head (priv->waiting);
+                next = waiting->msg;
+                got_body = waiting->got_body;
+                g_free (waiting);
+
+                /* The in-flight set takes over the reference */
+                g_hash_table_add (priv->in_flight, next);
+                soup_profiler_counter_add (SOUP_PROFILER_COUNTER_SERVER_REQUESTS, 1);
+                if (got_body) {
+                        soup_server_message_unpause (next);
+                        dispatch_request (server, next);
+                }
+        }
+}
+
 static void
 message_connected (SoupServer        *server,
                    SoupServerMessage *msg)
@@ -1005,12 +1387,45 @@ message_connected (SoupServer        *server,
                                           server);
 }
 
+static void
+release_connection_requests (SoupServer           *server,
+                             SoupServerConnection *conn)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        GHashTableIter iter;
+        SoupServerMessage *msg;
+        GList *l;
+        GSList *msgs = NULL, *m;
+
+        /* Tearing down the connection destroys its I/O without
+         * completing the messages, so give their slots back here.
+         */
+        g_hash_table_iter_init (&iter, priv->in_flight);
+        while (g_hash_table_iter_next (&iter, (gpointer *)&msg, NULL)) {
+                if (soup_server_message_get_connection (msg) == conn)
+                        msgs = g_slist_prepend (msgs, g_object_ref (msg));
+        }
+        for (l = priv->waiting->head; l; l = l->next) {
+                SoupServerWaitingRequest *waiting = l->data;
+
+                if (soup_server_message_get_connection (waiting->msg) == conn)
+                        msgs = g_slist_prepend (msgs, g_object_ref (waiting->msg));
+        }
+
+        for (m = msgs; m; m = m->next)
+                release_request (server, m->data);
+        g_slist_free_full (msgs, g_object_unref);
+}
+
 static void
 client_disconnected (SoupServer           *server,
 		     SoupServerConnection *conn)
 {
 	SoupServerPrivate *priv = soup_server_get_instance_private (server);
 
+        release_connection (server, conn);
+        release_connection_requests (server, conn);
+
 	priv->clients = g_slist_remove (priv->clients, conn);
         g_object_unref (conn);
 }
@@ -1037,6 +1452,11 @@ request_started_cb (SoupServer           *server,
                                                     priv->server_header);
         }
 
+        if (priv->content_encoder)
+                soup_server_message_set_content_encoder (msg, priv->content_encoder);
+        if (priv->request_body_spill_threshold > 0)
+                soup_server_message_set_request_body_spill_threshold (msg, priv->request_body_spill_threshold);
+
         g_signal_emit (server, signals[REQUEST_STARTED], 0, msg);
 
         if (soup_server_message_get_io_data (msg)) {
@@ -1049,12 +1469,19 @@ request_started_cb (SoupServer           *server,
                                  server, G_CONNECT_SWAPPED);
 }
 
-static void
+static gboolean
 soup_server_accept_connection (SoupServer           *server,
                                SoupServerConnection *conn)
 {
 	SoupServerPrivate *priv = soup_server_get_instance_private (server);
 
+        if (!admit_connection (server, conn)) {
+                priv->counters[SOUP_SERVER_COUNTER_CONNECTIONS_REJECTED]++;
+                reject_connection (conn);
+                return FALSE;
+        }
+        priv->counters[SOUP_SERVER_COUNTER_CONNECTIONS_ACCEPTED]++;
+
         priv->clients = g_slist_prepend (priv->clients, g_object_ref (conn));
         g_signal_connect_object (conn, "disconnected",
                                  G_CALLBACK (client_disconnected),
@@ -1064,6 +1491,52 @@ soup_server_accept_connection (SoupServer           *server,
                                  server, G_CONNECT_SWAPPED);
 
         soup_server_connection_accepted (conn);
+
+        return TRUE;
+}
+
+static void
+record_metrics_phase (SoupServerPrivate     *priv,
+                      SoupServerMetricsPhase phase,
+                      guint64                start,
+                      guint64                end)
+{
+        if (start && end >= start)
+                soup_histogram_record (&priv->metrics[phase], end - start);
+}
+
+static void
+record_metrics (SoupServer        *server,
+                SoupServerMessage *msg)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupServerMessageMetrics *metrics = soup_server_message_get_metrics (msg);
+        guint64 request_start, request_headers_end, request_end, response_start, response_end;
+
+        request_start = soup_server_message_metrics_get_request_start (metrics);
+        request_headers_end = soup_server_message_metrics_get_request_headers_end (metrics);
+        request_end = soup_server_message_metrics_get_request_end (metrics);
+        response_start = soup_server_message_metrics_get_response_start (metrics);
+        response_end = soup_server_message_metrics_get_response_end (metrics);
+        if (!response_end)
+                return;
+
+        record_metrics_phase (priv, SOUP_SERVER_METRICS_PHASE_REQUEST_HEADERS, request_start, request_headers_end);
+        record_metrics_phase (priv, SOUP_SERVER_METRICS_PHASE_REQUEST_BODY, request_headers_end, request_end);
+        record_metrics_phase (priv, SOUP_SERVER_METRICS_PHASE_HANDLER, request_end, response_start);
+        record_metrics_phase (priv, SOUP_SERVER_METRICS_PHASE_RESPONSE, response_start, response_end);
+        soup_histogram_record (&priv->metrics[SOUP_SERVER_METRICS_PHASE_WRITE_BLOCKED],
+                               soup_server_message_metrics_get_write_blocked_time (metrics));
+        record_metrics_phase (priv, SOUP_SERVER_METRICS_PHASE_TOTAL, request_start, response_end);
+
+        if (soup_profiler_is_active ()) {
+                const char *method = soup_server_message_get_method (msg);
+                const char *path = g_uri_get_path (soup_server_message_get_uri (msg));
+
+                soup_profiler_mark_usec (request_start, request_headers_end, "Server request headers", "%s %s", method, path);
+                soup_profiler_mark_usec (request_end, response_start, "Server handler", "%s %s", method, path);
+                soup_profiler_mark_usec (response_start, response_end, "Server response", "%s %s", method, path);
+        }
 }
 
 static void
@@ -1075,11 +1548,15 @@ request_finished (SoupServerMessage      *msg,
 	SoupServerConnection *conn = soup_server_message_get_connection (msg);
 	gboolean failed;
 
+        release_request (server, msg);
+
 	if (completion == SOUP_MESSAGE_IO_STOLEN)
 		return;
 
 	/* Complete the message, assuming it actually really started. */
 	if (soup_server_message_get_method (msg)) {
+		if (completion == SOUP_MESSAGE_IO_COMPLETE)
+			record_metrics (server, msg);
 		soup_server_message_finished (msg);
 
 		failed = (completion == SOUP_MESSAGE_IO_INTERRUPTED ||
@@ -1111,6 +1588,10 @@ request_finished (SoupServerMessage      *msg,
  *
  * Adds a new client stream to the @server.
  *
+ * If the connection limits of @server (see [method@Server.set_max_connections]
+ * and [method@Server.set_client_limits]) don't allow a new connection,
+ * @stream is closed and %G_IO_ERROR_CONNECTION_REFUSED is returned.
+ *
  * Returns: %TRUE on success, %FALSE if the stream could not be
  *   accepted or any other error occurred (in which case @error will be
  *   set).
@@ -1123,11 +1604,18 @@ soup_server_accept_iostream (SoupServer     *server,
 			     GError        **error)
 {
 	SoupServerConnection *conn;
+        gboolean accepted;
 
         conn = soup_server_connection_new_for_connection (stream, local_addr, remote_addr);
-	soup_server_accept_connection (server, conn);
+	accepted = soup_server_accept_connection (server, conn);
 	g_object_unref (conn);
 
+        if (!accepted) {
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_REFUSED,
+                                     _("Too many connections"));
+                return FALSE;
+        }
+
 	return TRUE;
 }
 
@@ -1139,6 +1627,7 @@ new_connection (SoupListener         *listener,
         SoupServerPrivate *priv = soup_server_get_instance_private (server);
 
         soup_server_connection_set_advertise_http2 (conn, priv->http2_enabled);
+        soup_server_connection_set_tls_handshake_pool (conn, priv->tls_handshake_pool);
 	soup_server_accept_connection (server, conn);
 }
 
@@ -1191,6 +1680,9 @@ soup_server_disconnect (SoupServer *server)
  *   than plain http.
  * @SOUP_SERVER_LISTEN_IPV4_ONLY: Only listen on IPv4 interfaces.
  * @SOUP_SERVER_LISTEN_IPV6_ONLY: Only listen on IPv6 interfaces.
+ * @SOUP_SERVER_LISTEN_REUSE_PORT: Allow other sockets to listen on the
+ *   same address and port, so that several servers, each running in
+ *   its own thread, can share the incoming connections. Since: 3.4
  *
  * Options to pass to [method@Server.listen], etc.
  *
@@ -1284,7 +1776,9 @@ soup_server_listen (SoupServer *server, GSocketAddress *address,
 	priv = soup_server_get_instance_private (server);
 	g_return_val_if_fail (priv->disposed == FALSE, FALSE);
 
-        listener = soup_listener_new_for_address (address, error);
+        listener = soup_listener_new_for_address (address,
+                                                  (options & SOUP_SERVER_LISTEN_REUSE_PORT) != 0,
+                                                  error);
         if (!listener)
                 return FALSE;
 
@@ -1739,6 +2233,70 @@ soup_server_add_early_handler (SoupServer            *server,
 	handler->early_user_data  = user_data;
 }
 
+/**
+ * SoupServerStaticFlags:
+ * @SOUP_SERVER_STATIC_NONE: No flags.
+ * @SOUP_SERVER_STATIC_INDEX: Serve the `index.html` file of directories
+ *   for paths ending in `/`, and redirect requests for directories to
+ *   the path ending in `/`.
+ * @SOUP_SERVER_STATIC_SHOW_HIDDEN: Serve files whose name, or the name of
+ *   one of their parent directories, starts with a dot.
+ * @SOUP_SERVER_STATIC_FOLLOW_SYMLINKS: Serve files that are symbolic links
+ *   to, or are in a directory linked to, files outside of the root
+ *   directory.
+ *
+ * Flags to pass to [method@Server.add_static_handler].
+ *
+ * Since: 3.4
+ */
+
+/**
+ * soup_server_add_static_handler:
+ * @server: a #SoupServer
+ * @path: (nullable): the toplevel path for the handler
+ * @root_dir: (type filename): the directory to serve files from
+ * @flags: a set of #SoupServerStaticFlags
+ *
+ * Adds a handler to @server that serves the files in @root_dir for
+ * `GET` and `HEAD` requests prefixed by @path. The rest of the request
+ * path is mapped to a file under @root_dir, so with a @path of
+ * `/static`, a request to `/static/css/style.css` gets the file
+ * `css/style.css` of @root_dir. Paths with `..` components and, unless
+ * %SOUP_SERVER_STATIC_SHOW_HIDDEN is given, hidden files get a
+ * %SOUP_STATUS_NOT_FOUND response.
+ *
+ * Responses include strong `ETag` and `Last-Modified` headers, conditional
+ * requests are answered with %SOUP_STATUS_NOT_MODIFIED and `Range` requests
+ * (including `If-Range`) with %SOUP_STATUS_PARTIAL_CONTENT.
+ *
+ * The handler remembers the most recently served files, with the
+ * contents of small ones in memory, and checks them again for changes
+ * at most once per second. Larger files are streamed from disk in
+ * blocks as the response is written, starting at the requested range,
+ * and requests for several ranges of them get the whole file. Requests
+ * for a file modified in place can get outdated contents or a
+ * %SOUP_STATUS_INTERNAL_SERVER_ERROR response until it is checked again,
+ * and if it changes while being streamed the connection is closed.
+ *
+ * This replaces any handler previously added for @path.
+ *
+ * Since: 3.4
+ */
+void
+soup_server_add_static_handler (SoupServer            *server,
+                                const char            *path,
+                                const char            *root_dir,
+                                SoupServerStaticFlags  flags)
+{
+        g_return_if_fail (SOUP_IS_SERVER (server));
+        g_return_if_fail (root_dir != NULL);
+
+        soup_server_add_handler (server, path,
+                                 soup_static_handler_callback,
+                                 soup_static_handler_new (path, root_dir, flags),
+                                 (GDestroyNotify)soup_static_handler_free);
+}
+
 /**
  * SoupServerWebsocketCallback:
  * @server: the #SoupServer
@@ -1786,6 +2344,10 @@ soup_server_add_early_handler (SoupServer            *server,
  * handled by adding a normal handler to @path, and having it perform
  * whatever checks are needed and
  * setting a failure status code if the handshake should be rejected.
+ *
+ * On HTTP/2 connections, WebSocket handshakes are extended CONNECT
+ * requests (RFC 8441) and each WebSocket runs over its own stream of
+ * the shared connection.
  **/
 void
 soup_server_add_websocket_handler (SoupServer                   *server,
@@ -1884,6 +2446,594 @@ soup_server_remove_auth_domain (SoupServer *server, SoupAuthDomain *auth_domain)
 	g_object_unref (auth_domain);
 }
 
+/**
+ * soup_server_set_content_encoder:
+ * @server: a #SoupServer
+ * @encoder: (nullable): a #SoupContentEncoder, or %NULL
+ *
+ * Sets the [class@ContentEncoder] used to compress the responses of
+ * @server. Responses are not compressed by default.
+ *
+ * The encoder applies to the messages received after this call.
+ *
+ * Since: 3.4
+ **/
+void
+soup_server_set_content_encoder (SoupServer         *server,
+                                 SoupContentEncoder *encoder)
+{
+	SoupServerPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	g_return_if_fail (!encoder || SOUP_IS_CONTENT_ENCODER (encoder));
+	priv = soup_server_get_instance_private (server);
+
+	g_set_object (&priv->content_encoder, encoder);
+}
+
+/**
+ * soup_server_get_content_encoder:
+ * @server: a #SoupServer
+ *
+ * Gets the [class@ContentEncoder] used to compress the responses of
+ * @server.
+ *
+ * Returns: (nullable) (transfer none): a #SoupContentEncoder, or %NULL
+ *
+ * Since: 3.4
+ **/
+SoupContentEncoder *
+soup_server_get_content_encoder (SoupServer *server)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), NULL);
+	priv = soup_server_get_instance_private (server);
+
+	return priv->content_encoder;
+}
+
+/**
+ * soup_server_set_request_body_spill_threshold:
+ * @server: a #SoupServer
+ * @threshold: size in bytes, or 0 to keep all request bodies in memory
+ *
+ * Sets the size above which request bodies received by @server are
+ * written to a temporary file instead of being kept in memory, so that
+ * large uploads do not grow the memory used by the server.
+ *
+ * A spilled body is not available from
+ * [method@ServerMessage.get_request_body]; use
+ * [method@ServerMessage.get_request_body_stream] instead. Request bodies
+ * are kept in memory by default.
+ *
+ * The threshold applies to the messages received after this call.
+ *
+ * Since: 3.4
+ **/
+void
+soup_server_set_request_body_spill_threshold (SoupServer *server,
+                                              goffset     threshold)
+{
+	SoupServerPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	g_return_if_fail (threshold >= 0);
+	priv = soup_server_get_instance_private (server);
+
+	priv->request_body_spill_threshold = threshold;
+}
+
+/**
+ * soup_server_get_request_body_spill_threshold:
+ * @server: a #SoupServer
+ *
+ * Gets the size above which request bodies received by @server are
+ * written to a temporary file.
+ *
+ * Returns: the threshold in bytes, or 0 if request bodies are kept in memory
+ *
+ * Since: 3.4
+ **/
+goffset
+soup_server_get_request_body_spill_threshold (SoupServer *server)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	priv = soup_server_get_instance_private (server);
+
+	return priv->request_body_spill_threshold;
+}
+
+/**
+ * soup_server_set_tls_handshake_threads:
+ * @server: a #SoupServer
+ * @max_threads: the number of threads, or 0 to handshake in the main context
+ *
+ * Sets the number of threads @server uses to perform the TLS handshakes
+ * of new connections.
+ *
+ * By default handshakes are started from the [struct@GLib.MainContext] of
+ * @server. With handshake threads, the handshake crypto doesn't compete
+ * with request processing, and a burst of new clients queues for at most
+ * @max_threads threads. Connections are processed in the main context
+ * of @server once the handshake completes. Use
+ * %SOUP_SERVER_COUNTER_TLS_HANDSHAKES_PENDING and
+ * %SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME to monitor the queue.
+ *
+ * Connections requesting client certificates, see
+ * [property@Server:tls-auth-mode], always handshake in the main context.
+ *
+ * Since: 3.4
+ **/
+void
+soup_server_set_tls_handshake_threads (SoupServer *server,
+                                       guint       max_threads)
+{
+	SoupServerPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	priv = soup_server_get_instance_private (server);
+
+	if (priv->tls_handshake_threads == max_threads)
+		return;
+
+	priv->tls_handshake_threads = max_threads;
+	if (!max_threads)
+		g_clear_pointer (&priv->tls_handshake_pool, soup_tls_handshake_pool_free);
+	else if (priv->tls_handshake_pool)
+		soup_tls_handshake_pool_set_max_threads (priv->tls_handshake_pool, max_threads);
+	else
+		priv->tls_handshake_pool = soup_tls_handshake_pool_new (max_threads);
+}
+
+/**
+ * soup_server_get_tls_handshake_threads:
+ * @server: a #SoupServer
+ *
+ * Gets the number of threads @server uses to perform TLS handshakes.
+ *
+ * Returns: the number of threads, or 0 if handshakes are done in the
+ *   main context
+ *
+ * Since: 3.4
+ **/
+guint
+soup_server_get_tls_handshake_threads (SoupServer *server)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	priv = soup_server_get_instance_private (server);
+
+	return priv->tls_handshake_threads;
+}
+
+/**
+ * SoupServerCounter:
+ * @SOUP_SERVER_COUNTER_CONNECTIONS_ACCEPTED: connections accepted so far
+ * @SOUP_SERVER_COUNTER_CONNECTIONS_REJECTED: connections closed because
+ *   of a connection limit
+ * @SOUP_SERVER_COUNTER_CONNECTIONS_ACTIVE: connections currently open
+ * @SOUP_SERVER_COUNTER_REQUESTS_ACCEPTED: requests admitted so far,
+ *   including the ones that had to wait for a slot
+ * @SOUP_SERVER_COUNTER_REQUESTS_REJECTED: requests answered with
+ *   %SOUP_STATUS_SERVICE_UNAVAILABLE because of a request limit
+ * @SOUP_SERVER_COUNTER_REQUESTS_QUEUED: requests that had to wait for a
+ *   slot so far
+ * @SOUP_SERVER_COUNTER_REQUESTS_IN_FLIGHT: requests currently being
+ *   processed
+ * @SOUP_SERVER_COUNTER_REQUESTS_WAITING: requests currently waiting for
+ *   a slot
+ * @SOUP_SERVER_COUNTER_TLS_HANDSHAKES_PENDING: TLS handshakes currently
+ *   queued or running on the handshake threads
+ * @SOUP_SERVER_COUNTER_TLS_HANDSHAKES_COMPLETED: TLS handshakes completed
+ *   on the handshake threads so far
+ * @SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME: total time, in microseconds,
+ *   from queueing to completion of those handshakes
+ *
+ * Admission control counters of a [class@Server], see
+ * [method@Server.get_counter].
+ *
+ * Since: 3.4
+ */
+
+/**
+ * SoupServerMetricsPhase:
+ * @SOUP_SERVER_METRICS_PHASE_REQUEST_HEADERS: time from the first byte of
+ *   the request to the end of its headers
+ * @SOUP_SERVER_METRICS_PHASE_REQUEST_BODY: time to receive the request body
+ * @SOUP_SERVER_METRICS_PHASE_HANDLER: time from the end of the request to
+ *   the start of the response, spent in the server handlers
+ * @SOUP_SERVER_METRICS_PHASE_RESPONSE: time to write the response
+ * @SOUP_SERVER_METRICS_PHASE_WRITE_BLOCKED: time the response waited for
+ *   the connection to become writable
+ * @SOUP_SERVER_METRICS_PHASE_TOTAL: time from the first byte of the request
+ *   to the end of the response
+ *
+ * The durations, in microseconds, recorded by a [class@Server] for every
+ * request it completes, computed from its [struct@ServerMessageMetrics].
+ * See [method@Server.get_metrics_percentile].
+ *
+ * Since: 3.4
+ */
+
+/**
+ * soup_server_set_max_connections:
+ * @server: a #SoupServer
+ * @max_connections: the maximum number of connections, or 0 for no limit
+ *
+ * Sets the maximum number of client connections @server keeps open at
+ * the same time.
+ *
+ * Connections accepted while @server is at the limit are closed
+ * immediately, before any data is read from them.
+ *
+ * Since: 3.4
+ **/
+void
+soup_server_set_max_connections (SoupServer *server,
+                                 guint       max_connections)
+{
+	SoupServerPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	priv = soup_server_get_instance_private (server);
+
+	priv->max_connections = max_connections;
+}
+
+/**
+ * soup_server_get_max_connections:
+ * @server: a #SoupServer
+ *
+ * Gets the maximum number of client connections of @server.
+ *
+ * Returns: the maximum number of connections, or 0 if there is no limit
+ *
+ * Since: 3.4
+ **/
+guint
+soup_server_get_max_connections (SoupServer *server)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	priv = soup_server_get_instance_private (server);
+
+	return priv->max_connections;
+}
+
+/**
+ * soup_server_set_max_requests:
+ * @server: a #SoupServer
+ * @max_requests: the maximum number of requests in flight, or 0 for no limit
+ * @max_queued_requests: the maximum number of requests waiting for a slot
+ *
+ * Sets the maximum number of requests @server processes at the same time.
+ *
+ * A request is in flight from the moment its headers are read until its
+ * response has been written. When @server is at the limit, up to
+ * @max_queued_requests further requests are read but their handlers are
+ * not run until a slot is available. Any other request is answered
+ * with %SOUP_STATUS_SERVICE_UNAVAILABLE right after its headers are read,
+ * without running any handler or reading the request body.
+ *
+ * Since: 3.4
+ **/
+void
+soup_server_set_max_requests (SoupServer *server,
+                              guint       max_requests,
+                              guint       max_queued_requests)
+{
+	SoupServerPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	priv = soup_server_get_instance_private (server);
+
+	priv->max_requests = max_requests;
+	priv->max_queued_requests = max_queued_requests;
+}
+
+/**
+ * soup_server_get_max_requests:
+ * @server: a #SoupServer
+ * @max_queued_requests: (out) (optional): return location for the maximum
+ *   number of requests waiting for a slot
+ *
+ * Gets the maximum number of requests @server processes at the same time.
+ *
+ * Returns: the maximum number of requests in flight, or 0 if there is no limit
+ *
+ * Since: 3.4
+ **/
+guint
+soup_server_get_max_requests (SoupServer *server,
+                              guint      *max_queued_requests)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	priv = soup_server_get_instance_private (server);
+
+	if (max_queued_requests)
+		*max_queued_requests = priv->max_queued_requests;
+
+	return priv->max_requests;
+}
+
+/**
+ * soup_server_set_client_limits:
+ * @server: a #SoupServer
+ * @max_connections: the maximum number of connections per client, or 0
+ *   for no limit
+ * @requests_per_second: the rate at which a client may send requests,
+ *   or 0 for no limit
+ * @burst: the number of requests a client may send at once
+ *
+ * Sets limits applied to each client IP address of @server.
+ *
+ * Connections from a client that already has @max_connections open are
+ * closed immediately. Requests are rate limited with a token bucket that
+ * holds up to @burst tokens and is refilled at @requests_per_second;
+ * requests sent when the bucket is empty are answered with
+ * %SOUP_STATUS_SERVICE_UNAVAILABLE without running any handler.
+ *
+ * The limits are enforced on connections accepted after this call.
+ *
+ * Since: 3.4
+ **/
+void
+soup_server_set_client_limits (SoupServer *server,
+                               guint       max_connections,
+                               double      requests_per_second,
+                               guint       burst)
+{
+	SoupServerPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	g_return_if_fail (requests_per_second >= 0);
+	priv = soup_server_get_instance_private (server);
+
+	priv->max_client_connections = max_connections;
+	priv->client_request_rate = requests_per_second;
+	priv->client_request_burst = MAX (burst, 1);
+}
+
+/**
+ * soup_server_set_retry_after:
+ * @server: a #SoupServer
+ * @seconds: the delay to advertise, or 0 to omit the header
+ *
+ * Sets the value of the "Retry-After" header sent with the
+ * %SOUP_STATUS_SERVICE_UNAVAILABLE responses of requests rejected by the
+ * limits set with [method@Server.set_max_requests] and
+ * [method@Server.set_client_limits]. The default is 1 second.
+ *
+ * Since: 3.4
+ **/
+void
+soup_server_set_retry_after (SoupServer *server,
+                             guint       seconds)
+{
+	SoupServerPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	priv = soup_server_get_instance_private (server);
+
+	priv->retry_after = seconds;
+}
+
+/**
+ * soup_server_get_counter:
+ * @server: a #SoupServer
+ * @counter: a #SoupServerCounter
+ *
+ * Gets the current value of one of the admission control counters of
+ * @server.
+ *
+ * Returns: the value of @counter
+ *
+ * Since: 3.4
+ **/
+guint64
+soup_server_get_counter (SoupServer        *server,
+                         SoupServerCounter  counter)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	g_return_val_if_fail (counter <= SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME, 0);
+	priv = soup_server_get_instance_private (server);
+
+	switch (counter) {
+	case SOUP_SERVER_COUNTER_TLS_HANDSHAKES_PENDING:
+	case SOUP_SERVER_COUNTER_TLS_HANDSHAKES_COMPLETED:
+	case SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME: {
+		guint pending = 0;
+		guint64 completed = 0, total_time = 0;
+
+		if (priv->tls_handshake_pool)
+			soup_tls_handshake_pool_get_stats (priv->tls_handshake_pool, &pending, &completed, &total_time);
+		if (counter == SOUP_SERVER_COUNTER_TLS_HANDSHAKES_PENDING)
+			return pending;
+		return counter == SOUP_SERVER_COUNTER_TLS_HANDSHAKES_COMPLETED ? completed : total_time;
+	}
+	case SOUP_SERVER_COUNTER_CONNECTIONS_ACTIVE:
+		return priv->n_connections;
+	case SOUP_SERVER_COUNTER_REQUESTS_IN_FLIGHT:
+		return g_hash_table_size (priv->in_flight);
+	case SOUP_SERVER_COUNTER_REQUESTS_WAITING:
+		return priv->waiting->length;
+	default:
+		return priv->counters[counter];
+	}
+}
+
+/**
+ * soup_server_get_metrics_count:
+ * @server: a #SoupServer
+ * @phase: a #SoupServerMetricsPhase
+ *
+ * Gets the number of values of @phase recorded by @server since it was
+ * created or [method@Server.reset_metrics] was called.
+ *
+ * Returns: the number of values recorded
+ *
+ * Since: 3.4
+ **/
+guint64
+soup_server_get_metrics_count (SoupServer             *server,
+                               SoupServerMetricsPhase  phase)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	g_return_val_if_fail (phase <= SOUP_SERVER_METRICS_PHASE_TOTAL, 0);
+	priv = soup_server_get_instance_private (server);
+
+	return soup_histogram_get_count (&priv->metrics[phase]);
+}
+
+/**
+ * soup_server_get_metrics_percentile:
+ * @server: a #SoupServer
+ * @phase: a #SoupServerMetricsPhase
+ * @percentile: the percentile, between 0 and 100
+ *
+ * Gets the value of @phase below which @percentile percent of the values
+ * recorded by @server are. Values are kept in buckets, so the result is
+ * within 1/16 of the real value.
+ *
+ * Returns: the value of @percentile in microseconds, or 0 if nothing was
+ *   recorded
+ *
+ * Since: 3.4
+ **/
+guint64
+soup_server_get_metrics_percentile (SoupServer             *server,
+                                    SoupServerMetricsPhase  phase,
+                                    double                  percentile)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	g_return_val_if_fail (phase <= SOUP_SERVER_METRICS_PHASE_TOTAL, 0);
+	priv = soup_server_get_instance_private (server);
+
+	return soup_histogram_get_percentile (&priv->metrics[phase], percentile);
+}
+
+/**
+ * soup_server_reset_metrics:
+ * @server: a #SoupServer
+ *
+ * Clears the values recorded by @server for every
+ * [enum@ServerMetricsPhase]. Counters are not affected.
+ *
+ * Since: 3.4
+ **/
+void
+soup_server_reset_metrics (SoupServer *server)
+{
+	SoupServerPrivate *priv;
+	guint phase;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	priv = soup_server_get_instance_private (server);
+
+	for (phase = 0; phase <= SOUP_SERVER_METRICS_PHASE_TOTAL; phase++)
+		soup_histogram_reset (&priv->metrics[phase]);
+}
+
+static const struct {
+	const char *name;
+	const char *help;
+} phase_metrics[SOUP_SERVER_METRICS_PHASE_TOTAL + 1] = {
+	{ "soup_server_request_headers_seconds", "Time from the first byte of requests to the end of their headers" },
+	{ "soup_server_request_body_seconds", "Time to receive request bodies" },
+	{ "soup_server_handler_seconds", "Time from the end of requests to the start of their responses" },
+	{ "soup_server_response_seconds", "Time to write responses" },
+	{ "soup_server_write_blocked_seconds", "Time responses waited for the connection to become writable" },
+	{ "soup_server_request_duration_seconds", "Time from the first byte of requests to the end of their responses" }
+};
+
+static const struct {
+	const char *name;
+	gboolean is_gauge;
+	const char *help;
+} counter_metrics[SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME + 1] = {
+	{ "soup_server_connections_accepted", FALSE, "Connections accepted" },
+	{ "soup_server_connections_rejected", FALSE, "Connections closed because of a connection limit" },
+	{ "soup_server_connections_active", TRUE, "Connections currently open" },
+	{ "soup_server_requests_accepted", FALSE, "Requests admitted" },
+	{ "soup_server_requests_rejected", FALSE, "Requests rejected because of a request limit" },
+	{ "soup_server_requests_queued", FALSE, "Requests that had to wait for a slot" },
+	{ "soup_server_requests_in_flight", TRUE, "Requests currently being processed" },
+	{ "soup_server_requests_waiting", TRUE, "Requests currently waiting for a slot" },
+	{ "soup_server_tls_handshakes_pending", TRUE, "TLS handshakes currently queued or running on the handshake threads" },
+	{ "soup_server_tls_handshakes_completed", FALSE, "TLS handshakes completed on the handshake threads" },
+	{ "soup_server_tls_handshake_seconds", FALSE, "Time from queueing to completion of TLS handshakes on the handshake threads" }
+};
+
+/**
+ * soup_server_get_openmetrics:
+ * @server: a #SoupServer
+ *
+ * Formats the metrics of @server in the OpenMetrics text format: a
+ * summary metric for every [enum@ServerMetricsPhase] that includes the
+ * 0.5, 0.9, 0.99 and 0.999 quantiles, and a counter or gauge metric for
+ * every [enum@ServerCounter].
+ *
+ * Returns: (transfer full): the OpenMetrics exposition of @server metrics
+ *
+ * Since: 3.4
+ **/
+char *
+soup_server_get_openmetrics (SoupServer *server)
+{
+	SoupServerPrivate *priv;
+	GString *str;
+	guint i;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), NULL);
+	priv = soup_server_get_instance_private (server);
+
+	str = g_string_new (NULL);
+	for (i = 0; i <= SOUP_SERVER_METRICS_PHASE_TOTAL; i++) {
+		const char *name = phase_metrics[i].name;
+
+		g_string_append_printf (str, "# TYPE %s summary\n", name);
+		g_string_append_printf (str, "# UNIT %s seconds\n", name);
+		g_string_append_printf (str, "# HELP %s %s.\n", name, phase_metrics[i].help);
+		if (soup_histogram_get_count (&priv->metrics[i]))
+			soup_histogram_append_openmetrics (&priv->metrics[i], str, name, NULL, G_USEC_PER_SEC);
+	}
+
+	for (i = 0; i <= SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME; i++) {
+		const char *name = counter_metrics[i].name;
+		guint64 value = soup_server_get_counter (server, i);
+
+		g_string_append_printf (str, "# TYPE %s %s\n", name, counter_metrics[i].is_gauge ? "gauge" : "counter");
+		if (i == SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME)
+			g_string_append_printf (str, "# UNIT %s seconds\n", name);
+		g_string_append_printf (str, "# HELP %s %s.\n", name, counter_metrics[i].help);
+		if (i == SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME) {
+			char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+			g_string_append_printf (str, "%s_total %s\n", name,
+						g_ascii_formatd (buffer, sizeof (buffer), "%g", (double)value / G_USEC_PER_SEC));
+		} else {
+			g_string_append_printf (str, "%s%s %" G_GUINT64_FORMAT "\n", name,
+						counter_metrics[i].is_gauge ? "" : "_total", value);
+		}
+	}
+	g_string_append (str, "# EOF\n");
+
+	return g_string_free (str, FALSE);
+}
+
 /**
  * soup_server_pause_message:
  * @server: a #SoupServer
@@ -8,6 +8,7 @@
 #include "soup-types.h"
 #include "soup-uri-utils.h"
 #include "soup-websocket-connection.h"
+#include "soup-content-encoder.h"
 
 G_BEGIN_DECLS
 
@@ -18,9 +19,40 @@ G_DECLARE_DERIVABLE_TYPE (SoupServer, soup_server, SOUP, SERVER, GObject)
 typedef enum {
 	SOUP_SERVER_LISTEN_HTTPS     = (1 << 0),
 	SOUP_SERVER_LISTEN_IPV4_ONLY = (1 << 1),
-	SOUP_SERVER_LISTEN_IPV6_ONLY = (1 << 2)
+	SOUP_SERVER_LISTEN_IPV6_ONLY = (1 << 2),
+	SOUP_SERVER_LISTEN_REUSE_PORT = (1 << 3)
 } SoupServerListenOptions;
 
+typedef enum {
+	SOUP_SERVER_COUNTER_CONNECTIONS_ACCEPTED,
+	SOUP_SERVER_COUNTER_CONNECTIONS_REJECTED,
+	SOUP_SERVER_COUNTER_CONNECTIONS_ACTIVE,
+	SOUP_SERVER_COUNTER_REQUESTS_ACCEPTED,
+	SOUP_SERVER_COUNTER_REQUESTS_REJECTED,
+	SOUP_SERVER_COUNTER_REQUESTS_QUEUED,
+	SOUP_SERVER_COUNTER_REQUESTS_IN_FLIGHT,
+	SOUP_SERVER_COUNTER_REQUESTS_WAITING,
+	SOUP_SERVER_COUNTER_TLS_HANDSHAKES_PENDING,
+	SOUP_SERVER_COUNTER_TLS_HANDSHAKES_COMPLETED,
+	SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME
+} SoupServerCounter;
+
+typedef enum {
+	SOUP_SERVER_METRICS_PHASE_REQUEST_HEADERS,
+	SOUP_SERVER_METRICS_PHASE_REQUEST_BODY,
+	SOUP_SERVER_METRICS_PHASE_HANDLER,
+	SOUP_SERVER_METRICS_PHASE_RESPONSE,
+	SOUP_SERVER_METRICS_PHASE_WRITE_BLOCKED,
+	SOUP_SERVER_METRICS_PHASE_TOTAL
+} SoupServerMetricsPhase;
+
+typedef enum {
+	SOUP_SERVER_STATIC_NONE            = 0,
+	SOUP_SERVER_STATIC_INDEX           = (1 << 0),
+	SOUP_SERVER_STATIC_SHOW_HIDDEN     = (1 << 1),
+	SOUP_SERVER_STATIC_FOLLOW_SYMLINKS = (1 << 2)
+} SoupServerStaticFlags;
+
 struct _SoupServerClass {
 	GObjectClass parent_class;
 
@@ -118,6 +150,12 @@ void            soup_server_add_early_handler  (SoupServer         *server,
 						gpointer            user_data,
 						GDestroyNotify      destroy);
 
+SOUP_AVAILABLE_IN_3_4
+void            soup_server_add_static_handler (SoupServer            *server,
+                                                const char            *path,
+                                                const char            *root_dir,
+                                                SoupServerStaticFlags  flags);
+
 typedef void (*SoupServerWebsocketCallback) (SoupServer              *server,
 					     SoupServerMessage       *msg,
 					     const char              *path,
@@ -149,6 +187,64 @@ SOUP_AVAILABLE_IN_ALL
 void            soup_server_remove_auth_domain (SoupServer         *server,
 					        SoupAuthDomain     *auth_domain);
 
+SOUP_AVAILABLE_IN_3_4
+void                soup_server_set_content_encoder (SoupServer         *server,
+                                                     SoupContentEncoder *encoder);
+SOUP_AVAILABLE_IN_3_4
+SoupContentEncoder *soup_server_get_content_encoder (SoupServer         *server);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_server_set_request_body_spill_threshold (SoupServer *server,
+                                                                  goffset     threshold);
+SOUP_AVAILABLE_IN_3_4
+goffset             soup_server_get_request_body_spill_threshold (SoupServer *server);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_server_set_max_connections (SoupServer *server,
+                                                     guint       max_connections);
+SOUP_AVAILABLE_IN_3_4
+guint               soup_server_get_max_connections (SoupServer *server);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_server_set_max_requests    (SoupServer *server,
+                                                     guint       max_requests,
+                                                     guint       max_queued_requests);
+SOUP_AVAILABLE_IN_3_4
+guint               soup_server_get_max_requests    (SoupServer *server,
+                                                     guint      *max_queued_requests);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_server_set_client_limits   (SoupServer *server,
+                                                     guint       max_connections,
+                                                     double      requests_per_second,
+                                                     guint       burst);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_server_set_retry_after     (SoupServer *server,
+                                                     guint       seconds);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_server_set_tls_handshake_threads (SoupServer *server,
+                                                           guint       max_threads);
+SOUP_AVAILABLE_IN_3_4
+guint               soup_server_get_tls_handshake_threads (SoupServer *server);
+
+SOUP_AVAILABLE_IN_3_4
+guint64             soup_server_get_counter         (SoupServer        *server,
+                                                     SoupServerCounter  counter);
+
+SOUP_AVAILABLE_IN_3_4
+guint64             soup_server_get_metrics_count      (SoupServer             *server,
+                                                        SoupServerMetricsPhase  phase);
+SOUP_AVAILABLE_IN_3_4
+guint64             soup_server_get_metrics_percentile (SoupServer             *server,
+                                                        SoupServerMetricsPhase  phase,
+                                                        double                  percentile);
+SOUP_AVAILABLE_IN_3_4
+void                soup_server_reset_metrics          (SoupServer             *server);
+SOUP_AVAILABLE_IN_3_4
+char               *soup_server_get_openmetrics        (SoupServer             *server);
+
 /* I/O */
 SOUP_DEPRECATED_IN_3_2_FOR(soup_server_message_pause)
 void            soup_server_pause_message   (SoupServer        *server,
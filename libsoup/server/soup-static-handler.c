@@ -0,0 +1,762 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-static-handler.c: Serving files from a directory
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "soup-static-handler.h"
+#include "soup-message-body-private.h"
+#include "soup-message-headers-private.h"
+#include "soup-misc.h"
+#include "soup-server-message-private.h"
+#include "soup.h"
+
+/* Maximum number of cached files, how often the metadata of a cached
+ * file is checked again for changes, the size up to which the contents
+ * of a file are kept in memory, and the size of the blocks in which
+ * larger files are read.
+ */
+#define STATIC_FILE_CACHE_SIZE 256
+#define STATIC_FILE_CHECK_INTERVAL G_USEC_PER_SEC
+#define STATIC_FILE_MAX_CONTENTS_SIZE (64 * 1024)
+#define STATIC_FILE_BLOCK_SIZE (64 * 1024)
+
+typedef struct {
+        char *filename;
+        GList *link;
+
+        /* Small files are read once, larger ones streamed on every request */
+        GBytes *contents;
+        goffset size;
+        gint64 mtime;
+        guint64 ino;
+        char *etag;
+        char *last_modified;
+        char *content_type;
+
+        gint64 checked_at;
+} SoupStaticFile;
+
+struct _SoupStaticHandler {
+        char *path;
+        char *root_dir;
+        char *real_root_dir;
+        SoupServerStaticFlags flags;
+
+        GHashTable *files;
+        GQueue lru;
+};
+
+static void
+soup_static_file_free (SoupStaticFile *file)
+{
+        g_free (file->filename);
+        g_clear_pointer (&file->contents, g_bytes_unref);
+        g_free (file->etag);
+        g_free (file->last_modified);
+        g_free (file->content_type);
+        g_free (file);
+}
+
+static gboolean
+soup_static_file_matches_stat (SoupStaticFile *file,
+                               GStatBuf       *st)
+{
+        return file->size == st->st_size &&
+                file->mtime == st->st_mtime &&
+                file->ino == (guint64)st->st_ino;
+}
+
+/* Returns the first @length bytes of @stream, or %NULL if they can't
+ * be read, like when the file was truncated since it was opened.
+ */
+static GBytes *
+soup_static_file_read_contents (GFileInputStream *stream,
+                                gsize             length)
+{
+        guchar *data;
+        gsize nread;
+
+        data = g_malloc (length);
+        if (!g_input_stream_read_all (G_INPUT_STREAM (stream), data, length, &nread, NULL, NULL) ||
+            nread != length) {
+                g_free (data);
+                return NULL;
+        }
+
+        return g_bytes_new_take (data, length);
+}
+
+#define STATIC_FILE_INFO_ATTRIBUTES             \
+        G_FILE_ATTRIBUTE_STANDARD_TYPE ","      \
+        G_FILE_ATTRIBUTE_STANDARD_SIZE ","      \
+        G_FILE_ATTRIBUTE_TIME_MODIFIED ","      \
+        G_FILE_ATTRIBUTE_UNIX_INODE
+
+/* The data of files is copied out of them, never mapped: a mapping
+ * would crash the process with SIGBUS if the file was truncated while
+ * served. The metadata is taken from the open file so it matches the
+ * data read.
+ */
+static SoupStaticFile *
+soup_static_file_new (const char *filename)
+{
+        SoupStaticFile *file;
+        GFile *gfile;
+        GFileInputStream *stream;
+        GFileInfo *info;
+        GDateTime *date;
+        char *content_type;
+
+        gfile = g_file_new_for_path (filename);
+        stream = g_file_read (gfile, NULL, NULL);
+        g_object_unref (gfile);
+        if (!stream)
+                return NULL;
+
+        info = g_file_input_stream_query_info (stream, STATIC_FILE_INFO_ATTRIBUTES, NULL, NULL);
+        if (!info || g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR) {
+                g_clear_object (&info);
+                g_object_unref (stream);
+                return NULL;
+        }
+
+        file = g_new0 (SoupStaticFile, 1);
+        file->filename = g_strdup (filename);
+        file->size = g_file_info_get_size (info);
+        file->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        file->ino = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+        g_object_unref (info);
+
+        if (file->size <= STATIC_FILE_MAX_CONTENTS_SIZE) {
+                file->contents = soup_static_file_read_contents (stream, file->size);
+                if (!file->contents) {
+                        /* Changed while reading it, try again later. */
+                        g_object_unref (stream);
+                        soup_static_file_free (file);
+                        return NULL;
+                }
+        }
+        g_object_unref (stream);
+
+        file->etag = g_strdup_printf ("\"%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x\"",
+                                      file->ino, (guint64)file->mtime, (guint64)file->size);
+
+        date = g_date_time_new_from_unix_utc (file->mtime);
+        file->last_modified = soup_date_time_to_string (date, SOUP_DATE_HTTP);
+        g_date_time_unref (date);
+
+        content_type = g_content_type_guess (filename, NULL, 0, NULL);
+        file->content_type = g_content_type_get_mime_type (content_type);
+        g_free (content_type);
+        if (!file->content_type)
+                file->content_type = g_strdup ("application/octet-stream");
+
+        return file;
+}
+
+SoupStaticHandler *
+soup_static_handler_new (const char            *path,
+                         const char            *root_dir,
+                         SoupServerStaticFlags  flags)
+{
+        SoupStaticHandler *handler;
+
+        handler = g_new0 (SoupStaticHandler, 1);
+        handler->path = g_strdup (path && *path ? path : "/");
+        handler->root_dir = g_canonicalize_filename (root_dir, NULL);
+#ifdef G_OS_UNIX
+        handler->real_root_dir = realpath (handler->root_dir, NULL);
+#endif
+        handler->flags = flags;
+        handler->files = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                NULL, (GDestroyNotify)soup_static_file_free);
+        g_queue_init (&handler->lru);
+
+        return handler;
+}
+
+void
+soup_static_handler_free (SoupStaticHandler *handler)
+{
+        g_queue_clear (&handler->lru);
+        g_hash_table_destroy (handler->files);
+        g_free (handler->path);
+        g_free (handler->root_dir);
+        g_free (handler->real_root_dir);
+        g_free (handler);
+}
+
+/* Maps the request @path to a file under the root directory, refusing
+ * anything that could escape it. Returns %NULL if there's no such file.
+ */
+static char *
+soup_static_handler_get_filename (SoupStaticHandler *handler,
+                                  const char        *path)
+{
+        GPtrArray *components;
+        const char *relative_path;
+        char **segments;
+        char *filename;
+        guint i;
+
+        if (!g_str_has_prefix (path, handler->path))
+                return NULL;
+        relative_path = path + strlen (handler->path);
+
+        components = g_ptr_array_new_with_free_func (g_free);
+        g_ptr_array_add (components, g_strdup (handler->root_dir));
+
+        segments = g_strsplit (relative_path, "/", -1);
+        for (i = 0; segments[i]; i++) {
+                char *segment;
+
+                if (!*segments[i])
+                        continue;
+
+                segment = g_uri_unescape_string (segments[i], "/\\");
+                if (!segment ||
+                    strcmp (segment, ".") == 0 || strcmp (segment, "..") == 0 ||
+                    (segment[0] == '.' && !(handler->flags & SOUP_SERVER_STATIC_SHOW_HIDDEN))) {
+                        g_free (segment);
+                        g_strfreev (segments);
+                        g_ptr_array_unref (components);
+                        return NULL;
+                }
+                g_ptr_array_add (components, segment);
+        }
+        g_strfreev (segments);
+
+        if ((handler->flags & SOUP_SERVER_STATIC_INDEX) && g_str_has_suffix (path, "/"))
+                g_ptr_array_add (components, g_strdup ("index.html"));
+        g_ptr_array_add (components, NULL);
+
+        filename = g_build_filenamev ((char **)components->pdata);
+        g_ptr_array_unref (components);
+
+        return filename;
+}
+
+static gboolean
+soup_static_handler_is_contained (SoupStaticHandler *handler,
+                                  const char        *filename)
+{
+#ifdef G_OS_UNIX
+        char *real_filename;
+        gsize root_len;
+        gboolean contained;
+
+        if (handler->flags & SOUP_SERVER_STATIC_FOLLOW_SYMLINKS)
+                return TRUE;
+
+        if (!handler->real_root_dir)
+                return FALSE;
+
+        real_filename = realpath (filename, NULL);
+        if (!real_filename)
+                return FALSE;
+
+        root_len = strlen (handler->real_root_dir);
+        contained = strncmp (real_filename, handler->real_root_dir, root_len) == 0 &&
+                (real_filename[root_len] == G_DIR_SEPARATOR || handler->real_root_dir[root_len - 1] == G_DIR_SEPARATOR);
+        free (real_filename);
+
+        return contained;
+#else
+        return TRUE;
+#endif
+}
+
+static void
+soup_static_handler_remove_file (SoupStaticHandler *handler,
+                                 SoupStaticFile    *file)
+{
+        g_queue_delete_link (&handler->lru, file->link);
+        g_hash_table_remove (handler->files, file->filename);
+}
+
+/* Returns the cached file for @filename, checking the file again if
+ * it wasn't recently. On failure, @status is set to the status to
+ * respond with.
+ */
+static SoupStaticFile *
+soup_static_handler_lookup_file (SoupStaticHandler *handler,
+                                 const char        *filename,
+                                 guint             *status)
+{
+        SoupStaticFile *file;
+        GStatBuf st;
+        gint64 now;
+
+        now = g_get_monotonic_time ();
+        file = g_hash_table_lookup (handler->files, filename);
+        if (file && now - file->checked_at < STATIC_FILE_CHECK_INTERVAL)
+                goto found;
+
+        if (g_stat (filename, &st) == -1) {
+                if (file)
+                        soup_static_handler_remove_file (handler, file);
+                *status = errno == EACCES ? SOUP_STATUS_FORBIDDEN : SOUP_STATUS_NOT_FOUND;
+                return NULL;
+        }
+
+        if (file && soup_static_file_matches_stat (file, &st)) {
+                file->checked_at = now;
+                goto found;
+        }
+
+        if (file)
+                soup_static_handler_remove_file (handler, file);
+
+        if (S_ISDIR (st.st_mode)) {
+                *status = SOUP_STATUS_MOVED_PERMANENTLY;
+                return NULL;
+        }
+
+        if (!S_ISREG (st.st_mode) || !soup_static_handler_is_contained (handler, filename)) {
+                *status = SOUP_STATUS_NOT_FOUND;
+                return NULL;
+        }
+
+        file = soup_static_file_new (filename);
+        if (!file) {
+                *status = SOUP_STATUS_NOT_FOUND;
+                return NULL;
+        }
+        file->checked_at = now;
+
+        g_hash_table_insert (handler->files, file->filename, file);
+        g_queue_push_head (&handler->lru, file);
+        file->link = handler->lru.head;
+
+        while (g_queue_get_length (&handler->lru) > STATIC_FILE_CACHE_SIZE)
+                soup_static_handler_remove_file (handler, g_queue_peek_tail (&handler->lru));
+
+        return file;
+
+found:
+        g_queue_unlink (&handler->lru, file->link);
+        g_queue_push_head_link (&handler->lru, file->link);
+
+        return file;
+}
+
+static gboolean
+soup_static_file_matches_date (SoupStaticFile *file,
+                               const char     *header,
+                               gboolean        newer)
+{
+        GDateTime *date;
+        gint64 time;
+
+        date = soup_date_time_new_from_http_string (header);
+        if (!date)
+                return FALSE;
+
+        time = g_date_time_to_unix (date);
+        g_date_time_unref (date);
+
+        return newer ? file->mtime <= time : file->mtime == time;
+}
+
+static gboolean
+soup_static_file_matches_etag_list (SoupStaticFile *file,
+                                    const char     *header)
+{
+        GSList *etags, *l;
+        gboolean matches = FALSE;
+
+        etags = soup_header_parse_list (header);
+        for (l = etags; l && !matches; l = l->next) {
+                const char *etag = l->data;
+
+                /* If-None-Match uses the weak comparison */
+                if (g_str_has_prefix (etag, "W/"))
+                        etag += 2;
+                matches = strcmp (etag, "*") == 0 || strcmp (etag, file->etag) == 0;
+        }
+        soup_header_free_list (etags);
+
+        return matches;
+}
+
+static gboolean
+soup_static_file_is_not_modified (SoupStaticFile     *file,
+                                  SoupMessageHeaders *request_headers)
+{
+        const char *header;
+
+        /* If-None-Match takes precedence over If-Modified-Since */
+        header = soup_message_headers_get_list_common (request_headers, SOUP_HEADER_IF_NONE_MATCH);
+        if (header)
+                return soup_static_file_matches_etag_list (file, header);
+
+        header = soup_message_headers_get_one_common (request_headers, SOUP_HEADER_IF_MODIFIED_SINCE);
+        if (header)
+                return soup_static_file_matches_date (file, header, TRUE);
+
+        return FALSE;
+}
+
+static void
+soup_static_file_check_if_range (SoupStaticFile     *file,
+                                 SoupMessageHeaders *request_headers)
+{
+        const char *header;
+        gboolean matches;
+
+        header = soup_message_headers_get_one_common (request_headers, SOUP_HEADER_IF_RANGE);
+        if (!header)
+                return;
+
+        if (*header == '"')
+                matches = strcmp (header, file->etag) == 0;
+        else
+                matches = soup_static_file_matches_date (file, header, FALSE);
+
+        /* The representation changed, send all of it */
+        if (!matches)
+                soup_message_headers_remove_common (request_headers, SOUP_HEADER_RANGE);
+}
+
+/* A file streamed in blocks into the response body of a message. The
+ * metadata is copied from the cached file, which may be gone by the
+ * time the reads complete.
+ */
+typedef struct {
+        SoupServerMessage *msg;
+        GFile *gfile;
+        GFileInputStream *stream;
+        GCancellable *cancellable;
+        goffset size;
+        gint64 mtime;
+        guint64 ino;
+        goffset offset;
+        goffset remaining;
+        gboolean pending;
+        gboolean started;
+} SoupStaticTransfer;
+
+static void soup_static_transfer_read (SoupStaticTransfer *transfer);
+
+static void
+soup_static_transfer_free (SoupStaticTransfer *transfer)
+{
+        g_signal_handlers_disconnect_by_data (transfer->msg, transfer);
+        g_object_unref (transfer->msg);
+        g_object_unref (transfer->gfile);
+        g_clear_object (&transfer->stream);
+        g_object_unref (transfer->cancellable);
+        g_free (transfer);
+}
+
+/* The file can't be read or changed while being served. If nothing
+ * was sent yet, respond with an error instead; otherwise the headers
+ * already promised more data than there is, so close the connection.
+ */
+static void
+soup_static_transfer_fail (SoupStaticTransfer *transfer)
+{
+        SoupServerMessage *msg = g_object_ref (transfer->msg);
+        gboolean started = transfer->started;
+
+        soup_static_transfer_free (transfer);
+
+        if (started) {
+                soup_server_connection_disconnect (soup_server_message_get_connection (msg));
+        } else {
+                soup_server_message_cleanup_response (msg);
+                soup_message_body_set_accumulate (soup_server_message_get_response_body (msg), TRUE);
+                soup_server_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR, NULL);
+                if (soup_server_message_is_io_paused (msg))
+                        soup_server_message_unpause (msg);
+        }
+        g_object_unref (msg);
+}
+
+static void
+soup_static_transfer_read_cb (GObject      *source,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+        SoupStaticTransfer *transfer = user_data;
+        SoupMessageBody *body;
+        GBytes *block;
+        gsize size;
+
+        transfer->pending = FALSE;
+        block = g_input_stream_read_bytes_finish (G_INPUT_STREAM (source), result, NULL);
+        if (g_cancellable_is_cancelled (transfer->cancellable)) {
+                g_clear_pointer (&block, g_bytes_unref);
+                soup_static_transfer_free (transfer);
+                return;
+        }
+
+        size = block ? g_bytes_get_size (block) : 0;
+        if (size == 0 || (goffset)size > transfer->remaining) {
+                /* Failed or truncated since it was opened */
+                g_clear_pointer (&block, g_bytes_unref);
+                soup_static_transfer_fail (transfer);
+                return;
+        }
+
+        body = soup_server_message_get_response_body (transfer->msg);
+        soup_message_body_append_bytes (body, block);
+        g_bytes_unref (block);
+        transfer->started = TRUE;
+        transfer->remaining -= size;
+        if (transfer->remaining == 0)
+                soup_message_body_complete (body);
+
+        if (soup_server_message_is_io_paused (transfer->msg))
+                soup_server_message_unpause (transfer->msg);
+
+        if (transfer->remaining == 0)
+                soup_static_transfer_free (transfer);
+        else
+                soup_static_transfer_read (transfer);
+}
+
+/* Reads the next block, unless one is being read already or enough
+ * of them are waiting to be written; "wrote-chunk" calls this again
+ * as the connection drains.
+ */
+static void
+soup_static_transfer_read (SoupStaticTransfer *transfer)
+{
+        SoupMessageBody *body;
+
+        body = soup_server_message_get_response_body (transfer->msg);
+        if (transfer->pending || !transfer->stream ||
+            soup_message_body_get_unwritten_length (body) >= 2 * STATIC_FILE_BLOCK_SIZE)
+                return;
+
+        transfer->pending = TRUE;
+        g_input_stream_read_bytes_async (G_INPUT_STREAM (transfer->stream),
+                                         MIN (transfer->remaining, STATIC_FILE_BLOCK_SIZE),
+                                         G_PRIORITY_DEFAULT,
+                                         transfer->cancellable,
+                                         soup_static_transfer_read_cb,
+                                         transfer);
+}
+
+static void
+soup_static_transfer_query_info_cb (GObject      *source,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
+{
+        SoupStaticTransfer *transfer = user_data;
+        GFileInfo *info;
+        gboolean matches;
+
+        transfer->pending = FALSE;
+        info = g_file_input_stream_query_info_finish (G_FILE_INPUT_STREAM (source), result, NULL);
+        if (g_cancellable_is_cancelled (transfer->cancellable)) {
+                g_clear_object (&info);
+                soup_static_transfer_free (transfer);
+                return;
+        }
+
+        /* Make sure the file opened is the one the headers describe */
+        matches = info &&
+                g_file_info_get_size (info) == transfer->size &&
+                (gint64)g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) == transfer->mtime &&
+                g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE) == transfer->ino;
+        g_clear_object (&info);
+
+        if (!matches ||
+            !g_seekable_seek (G_SEEKABLE (transfer->stream), transfer->offset, G_SEEK_SET, NULL, NULL)) {
+                soup_static_transfer_fail (transfer);
+                return;
+        }
+
+        soup_static_transfer_read (transfer);
+}
+
+static void
+soup_static_transfer_open_cb (GObject      *source,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+        SoupStaticTransfer *transfer = user_data;
+
+        transfer->pending = FALSE;
+        transfer->stream = g_file_read_finish (G_FILE (source), result, NULL);
+        if (g_cancellable_is_cancelled (transfer->cancellable)) {
+                soup_static_transfer_free (transfer);
+                return;
+        }
+
+        if (!transfer->stream) {
+                soup_static_transfer_fail (transfer);
+                return;
+        }
+
+        transfer->pending = TRUE;
+        g_file_input_stream_query_info_async (transfer->stream,
+                                              STATIC_FILE_INFO_ATTRIBUTES,
+                                              G_PRIORITY_DEFAULT,
+                                              transfer->cancellable,
+                                              soup_static_transfer_query_info_cb,
+                                              transfer);
+}
+
+static void
+soup_static_transfer_finished (SoupServerMessage  *msg,
+                               SoupStaticTransfer *transfer)
+{
+        /* The callback in flight frees it */
+        if (transfer->pending) {
+                g_signal_handlers_disconnect_by_data (msg, transfer);
+                g_cancellable_cancel (transfer->cancellable);
+        } else {
+                soup_static_transfer_free (transfer);
+        }
+}
+
+static void
+soup_static_transfer_start (SoupServerMessage *msg,
+                            SoupStaticFile    *file,
+                            goffset            offset,
+                            goffset            length)
+{
+        SoupStaticTransfer *transfer;
+
+        transfer = g_new0 (SoupStaticTransfer, 1);
+        transfer->msg = g_object_ref (msg);
+        transfer->gfile = g_file_new_for_path (file->filename);
+        transfer->cancellable = g_cancellable_new ();
+        transfer->size = file->size;
+        transfer->mtime = file->mtime;
+        transfer->ino = file->ino;
+        transfer->offset = offset;
+        transfer->remaining = length;
+
+        /* Nothing is sent until the first block was read, so that
+         * failing to open the file can still be reported.
+         */
+        soup_message_body_set_accumulate (soup_server_message_get_response_body (msg), FALSE);
+        soup_server_message_pause (msg);
+
+        g_signal_connect_swapped (msg, "wrote-chunk",
+                                  G_CALLBACK (soup_static_transfer_read), transfer);
+        g_signal_connect (msg, "finished",
+                          G_CALLBACK (soup_static_transfer_finished), transfer);
+
+        transfer->pending = TRUE;
+        g_file_read_async (transfer->gfile, G_PRIORITY_DEFAULT, transfer->cancellable,
+                           soup_static_transfer_open_cb, transfer);
+}
+
+/* Sets the response to the file contents. Files kept in memory are
+ * appended whole and any ranges are sliced out of them by the server.
+ * Larger files are streamed from disk in blocks: a single range is
+ * read from its offset, while several ones get the whole file, which
+ * is allowed and avoids reading it more than once.
+ */
+static void
+soup_static_file_send (SoupStaticFile    *file,
+                       SoupServerMessage *msg)
+{
+        SoupMessageHeaders *request_headers, *response_headers;
+        SoupRange *ranges;
+        int nranges;
+        goffset offset = 0;
+        goffset length = file->size;
+        guint status = SOUP_STATUS_OK;
+
+        request_headers = soup_server_message_get_request_headers (msg);
+        response_headers = soup_server_message_get_response_headers (msg);
+        if (!file->contents && soup_server_message_get_method (msg) == SOUP_METHOD_GET) {
+                status = soup_message_headers_get_ranges_internal (request_headers, file->size, TRUE,
+                                                                   &ranges, &nranges);
+                if (status == SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE) {
+                        soup_server_message_set_status (msg, status, NULL);
+                        return;
+                }
+
+                if (status == SOUP_STATUS_PARTIAL_CONTENT) {
+                        if (nranges == 1) {
+                                offset = ranges[0].start;
+                                length = ranges[0].end - ranges[0].start + 1;
+                        } else {
+                                status = SOUP_STATUS_OK;
+                        }
+                        soup_message_headers_free_ranges (request_headers, ranges);
+                }
+        }
+
+        soup_message_headers_replace_common (response_headers, SOUP_HEADER_ACCEPT_RANGES, "bytes");
+        soup_message_headers_replace_common (response_headers, SOUP_HEADER_CONTENT_TYPE, file->content_type);
+        if (status == SOUP_STATUS_PARTIAL_CONTENT)
+                soup_message_headers_set_content_range (response_headers, offset, offset + length - 1, file->size);
+        soup_message_headers_set_content_length (response_headers, length);
+        soup_server_message_set_status (msg, status, NULL);
+
+        if (file->contents)
+                soup_message_body_append_bytes (soup_server_message_get_response_body (msg), file->contents);
+        else if (soup_server_message_get_method (msg) == SOUP_METHOD_GET)
+                soup_static_transfer_start (msg, file, offset, length);
+}
+
+void
+soup_static_handler_callback (SoupServer        *server,
+                              SoupServerMessage *msg,
+                              const char        *path,
+                              GHashTable        *query,
+                              gpointer           user_data)
+{
+        SoupStaticHandler *handler = user_data;
+        SoupMessageHeaders *request_headers, *response_headers;
+        const char *method;
+        SoupStaticFile *file;
+        char *filename;
+        guint status = SOUP_STATUS_NOT_FOUND;
+
+        method = soup_server_message_get_method (msg);
+        response_headers = soup_server_message_get_response_headers (msg);
+        if (method != SOUP_METHOD_GET && method != SOUP_METHOD_HEAD) {
+                soup_message_headers_replace (response_headers, "Allow", "GET, HEAD");
+                soup_server_message_set_status (msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+                return;
+        }
+
+        filename = soup_static_handler_get_filename (handler, path);
+        file = filename ? soup_static_handler_lookup_file (handler, filename, &status) : NULL;
+        g_free (filename);
+
+        if (!file) {
+                if (status == SOUP_STATUS_MOVED_PERMANENTLY && (handler->flags & SOUP_SERVER_STATIC_INDEX)) {
+                        char *redirect;
+
+                        redirect = g_strconcat (g_uri_get_path (soup_server_message_get_uri (msg)), "/", NULL);
+                        soup_server_message_set_redirect (msg, status, redirect);
+                        g_free (redirect);
+                } else {
+                        soup_server_message_set_status (msg, status == SOUP_STATUS_MOVED_PERMANENTLY ? SOUP_STATUS_NOT_FOUND : status, NULL);
+                }
+                return;
+        }
+
+        soup_message_headers_replace_common (response_headers, SOUP_HEADER_ETAG, file->etag);
+        soup_message_headers_replace_common (response_headers, SOUP_HEADER_LAST_MODIFIED, file->last_modified);
+
+        request_headers = soup_server_message_get_request_headers (msg);
+        if (soup_static_file_is_not_modified (file, request_headers)) {
+                soup_server_message_set_status (msg, SOUP_STATUS_NOT_MODIFIED, NULL);
+                return;
+        }
+
+        soup_static_file_check_if_range (file, request_headers);
+        soup_static_file_send (file, msg);
+}
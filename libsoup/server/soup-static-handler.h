@@ -0,0 +1,24 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-server.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SoupStaticHandler SoupStaticHandler;
+
+SoupStaticHandler *soup_static_handler_new  (const char            *path,
+                                             const char            *root_dir,
+                                             SoupServerStaticFlags  flags);
+void               soup_static_handler_free (SoupStaticHandler     *handler);
+void               soup_static_handler_callback (SoupServer        *server,
+                                                 SoupServerMessage *msg,
+                                                 const char        *path,
+                                                 GHashTable        *query,
+                                                 gpointer           user_data);
+
+G_END_DECLS
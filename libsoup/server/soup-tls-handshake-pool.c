@@ -0,0 +1,226 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-tls-handshake-pool.c: Server side TLS handshakes on worker threads
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "soup-tls-handshake-pool.h"
+
+/* A handshake that hasn't completed after this many seconds fails,
+ * so that slow or idle clients can't hold a worker thread forever.
+ */
+#define HANDSHAKE_TIMEOUT 10
+
+/* The pool is shared with the handshakes queued on it, so that freeing
+ * it doesn't have to wait for them.
+ */
+struct _SoupTlsHandshakePool {
+        gatomicrefcount ref_count;
+        GThreadPool *threads;
+
+        GMutex mutex;
+        GHashTable *handshakes;
+        guint pending;
+        guint64 completed;
+        guint64 total_time;
+};
+
+typedef struct {
+        SoupTlsHandshakePool *pool;
+        GCancellable *cancellable;
+        gint64 queued_at;
+} SoupTlsHandshakeData;
+
+static SoupTlsHandshakePool *
+soup_tls_handshake_pool_ref (SoupTlsHandshakePool *pool)
+{
+        g_atomic_ref_count_inc (&pool->ref_count);
+
+        return pool;
+}
+
+static void
+soup_tls_handshake_pool_unref (SoupTlsHandshakePool *pool)
+{
+        if (!g_atomic_ref_count_dec (&pool->ref_count))
+                return;
+
+        g_hash_table_destroy (pool->handshakes);
+        g_mutex_clear (&pool->mutex);
+        g_free (pool);
+}
+
+static void
+handshake_data_free (SoupTlsHandshakeData *data)
+{
+        g_object_unref (data->cancellable);
+        soup_tls_handshake_pool_unref (data->pool);
+        g_free (data);
+}
+
+static void
+handshake_cancelled (GCancellable *cancellable,
+                     GCancellable *handshake_cancellable)
+{
+        g_cancellable_cancel (handshake_cancellable);
+}
+
+static void
+handshake_thread (GTask *task,
+                  gpointer unused)
+{
+        SoupTlsHandshakeData *data = g_task_get_task_data (task);
+        SoupTlsHandshakePool *pool = data->pool;
+        GTlsConnection *conn = g_task_get_source_object (task);
+        GIOStream *base_stream = NULL;
+        GSocket *socket = NULL;
+        GError *error = NULL;
+        gboolean success;
+        gulong cancelled_id = 0;
+
+        /* The handshake is done with blocking I/O here, bound it with
+         * a socket timeout and restore the default once done.
+         */
+        g_object_get (conn, "base-io-stream", &base_stream, NULL);
+        if (G_IS_SOCKET_CONNECTION (base_stream))
+                socket = g_socket_connection_get_socket (G_SOCKET_CONNECTION (base_stream));
+        if (socket)
+                g_socket_set_timeout (socket, HANDSHAKE_TIMEOUT);
+
+        /* Cancelled either by the caller or when the pool is freed */
+        if (g_task_get_cancellable (task)) {
+                cancelled_id = g_cancellable_connect (g_task_get_cancellable (task),
+                                                      G_CALLBACK (handshake_cancelled),
+                                                      data->cancellable, NULL);
+        }
+        success = g_tls_connection_handshake (conn, data->cancellable, &error);
+        if (cancelled_id)
+                g_cancellable_disconnect (g_task_get_cancellable (task), cancelled_id);
+
+        if (socket)
+                g_socket_set_timeout (socket, 0);
+        g_clear_object (&base_stream);
+
+        g_mutex_lock (&pool->mutex);
+        g_hash_table_remove (pool->handshakes, data);
+        pool->pending--;
+        pool->completed++;
+        pool->total_time += g_get_monotonic_time () - data->queued_at;
+        g_mutex_unlock (&pool->mutex);
+
+        if (success)
+                g_task_return_boolean (task, TRUE);
+        else
+                g_task_return_error (task, error);
+        g_object_unref (task);
+}
+
+SoupTlsHandshakePool *
+soup_tls_handshake_pool_new (guint max_threads)
+{
+        SoupTlsHandshakePool *pool;
+
+        g_return_val_if_fail (max_threads > 0, NULL);
+
+        pool = g_new0 (SoupTlsHandshakePool, 1);
+        g_atomic_ref_count_init (&pool->ref_count);
+        g_mutex_init (&pool->mutex);
+        pool->handshakes = g_hash_table_new (NULL, NULL);
+        pool->threads = g_thread_pool_new ((GFunc)handshake_thread, NULL,
+                                           max_threads, FALSE, NULL);
+
+        return pool;
+}
+
+void
+soup_tls_handshake_pool_free (SoupTlsHandshakePool *pool)
+{
+        GHashTableIter iter;
+        SoupTlsHandshakeData *data;
+
+        /* Cancel the queued and running handshakes and don't wait for
+         * them; they keep the pool alive until they are done.
+         */
+        g_mutex_lock (&pool->mutex);
+        g_hash_table_iter_init (&iter, pool->handshakes);
+        while (g_hash_table_iter_next (&iter, (gpointer *)&data, NULL))
+                g_cancellable_cancel (data->cancellable);
+        g_mutex_unlock (&pool->mutex);
+
+        g_thread_pool_free (pool->threads, FALSE, FALSE);
+        pool->threads = NULL;
+        soup_tls_handshake_pool_unref (pool);
+}
+
+void
+soup_tls_handshake_pool_set_max_threads (SoupTlsHandshakePool *pool,
+                                         guint                 max_threads)
+{
+        g_return_if_fail (max_threads > 0);
+
+        g_thread_pool_set_max_threads (pool->threads, max_threads, NULL);
+}
+
+/* Like g_tls_connection_handshake_async(), but the handshake runs on
+ * one of the pool threads. @callback is called in the thread-default
+ * main context of the caller.
+ */
+void
+soup_tls_handshake_pool_handshake_async (SoupTlsHandshakePool *pool,
+                                         GTlsConnection       *conn,
+                                         GCancellable         *cancellable,
+                                         GAsyncReadyCallback   callback,
+                                         gpointer              user_data)
+{
+        SoupTlsHandshakeData *data;
+        GTask *task;
+
+        task = g_task_new (conn, cancellable, callback, user_data);
+        g_task_set_source_tag (task, soup_tls_handshake_pool_handshake_async);
+
+        data = g_new (SoupTlsHandshakeData, 1);
+        data->pool = soup_tls_handshake_pool_ref (pool);
+        data->cancellable = g_cancellable_new ();
+        data->queued_at = g_get_monotonic_time ();
+        g_task_set_task_data (task, data, (GDestroyNotify)handshake_data_free);
+
+        g_mutex_lock (&pool->mutex);
+        g_hash_table_add (pool->handshakes, data);
+        pool->pending++;
+        g_mutex_unlock (&pool->mutex);
+
+        g_thread_pool_push (pool->threads, task, NULL);
+}
+
+gboolean
+soup_tls_handshake_pool_handshake_finish (GAsyncResult *result,
+                                          GError      **error)
+{
+        g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+        return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* @total_time is the time, in microseconds, between queueing and
+ * completing all the handshakes done so far.
+ */
+void
+soup_tls_handshake_pool_get_stats (SoupTlsHandshakePool *pool,
+                                   guint                *pending,
+                                   guint64              *completed,
+                                   guint64              *total_time)
+{
+        g_mutex_lock (&pool->mutex);
+        if (pending)
+                *pending = pool->pending;
+        if (completed)
+                *completed = pool->completed;
+        if (total_time)
+                *total_time = pool->total_time;
+        g_mutex_unlock (&pool->mutex);
+}
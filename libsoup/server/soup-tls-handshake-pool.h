@@ -0,0 +1,30 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SoupTlsHandshakePool SoupTlsHandshakePool;
+
+SoupTlsHandshakePool *soup_tls_handshake_pool_new              (guint                 max_threads);
+void                  soup_tls_handshake_pool_free             (SoupTlsHandshakePool *pool);
+void                  soup_tls_handshake_pool_set_max_threads  (SoupTlsHandshakePool *pool,
+                                                                guint                 max_threads);
+void                  soup_tls_handshake_pool_handshake_async  (SoupTlsHandshakePool *pool,
+                                                                GTlsConnection       *conn,
+                                                                GCancellable         *cancellable,
+                                                                GAsyncReadyCallback   callback,
+                                                                gpointer              user_data);
+gboolean              soup_tls_handshake_pool_handshake_finish (GAsyncResult         *result,
+                                                                GError              **error);
+void                  soup_tls_handshake_pool_get_stats        (SoupTlsHandshakePool *pool,
+                                                                guint                *pending,
+                                                                guint64              *completed,
+                                                                guint64              *total_time);
+
+G_END_DECLS
@@ -10,6 +10,8 @@
 #include "soup-connection-manager.h"
 #include "soup-message-private.h"
 #include "soup-misc.h"
+#include "soup-profiler.h"
+#include "soup-timer-wheel.h"
 #include "soup-session-private.h"
 #include "soup-uri-utils-private.h"
 #include "soup.h"
@@ -41,7 +43,14 @@ typedef struct {
         guint  num_conns;
 
         GMainContext *context;
-        GSource *keep_alive_src;
+        SoupTimer *keep_alive_timer;
+
+        /* The last TLS connection that completed a request, used to
+         * resume its session in new connections to the host. It's kept
+         * after the connection is closed, so that reconnecting resumes
+         * the session, for as long as the host itself is kept.
+         */
+        GTlsClientConnection *tls_session;
 } SoupHost;
 
 #define HOST_KEEP_ALIVE 5 * 60 * 1000 /* 5 min in msecs */
@@ -83,10 +92,8 @@ soup_host_free (SoupHost *host)
 {
         g_warn_if_fail (host->conns == NULL);
 
-        if (host->keep_alive_src) {
-                g_source_destroy (host->keep_alive_src);
-                g_source_unref (host->keep_alive_src);
-        }
+        g_clear_pointer (&host->keep_alive_timer, soup_timer_free);
+        g_clear_object (&host->tls_session);
 
         g_uri_unref (host->uri);
         g_object_unref (host->addr);
@@ -125,7 +132,7 @@ soup_host_uri_equal (gconstpointer v1, gconstpointer v2)
         return g_ascii_strcasecmp (one_host, two_host) == 0;
 }
 
-static gboolean
+static void
 free_unused_host (gpointer user_data)
 {
         SoupHost *host = (SoupHost *)user_data;
@@ -133,16 +140,12 @@ free_unused_host (gpointer user_data)
 
         g_mutex_lock (mutex);
 
-        g_clear_pointer (&host->keep_alive_src, g_source_unref);
-
         if (!host->conns) {
                 /* This will free the host in addition to removing it from the hash table */
                 g_hash_table_remove (host->owner_map, host->uri);
         }
 
         g_mutex_unlock (mutex);
-
-        return G_SOURCE_REMOVE;
 }
 
 static void
@@ -152,11 +155,8 @@ soup_host_add_connection (SoupHost       *host,
         host->conns = g_list_prepend (host->conns, conn);
         host->num_conns++;
 
-        if (host->keep_alive_src) {
-                g_source_destroy (host->keep_alive_src);
-                g_source_unref (host->keep_alive_src);
-                host->keep_alive_src = NULL;
-        }
+        if (host->keep_alive_timer)
+                soup_timer_cancel (host->keep_alive_timer);
 }
 
 static void
@@ -171,11 +171,9 @@ soup_host_remove_connection (SoupHost       *host,
          * the last HOST_KEEP_ALIVE msecs.
          */
         if (host->num_conns == 0) {
-                g_assert (host->keep_alive_src == NULL);
-                host->keep_alive_src = soup_add_timeout (host->context,
-                                                         HOST_KEEP_ALIVE,
-                                                         free_unused_host,
-                                                         host);
+                if (!host->keep_alive_timer)
+                        host->keep_alive_timer = soup_timer_new (host->context, free_unused_host, host);
+                soup_timer_arm (host->keep_alive_timer, HOST_KEEP_ALIVE);
         }
 }
 
@@ -299,6 +297,7 @@ soup_connection_manager_drop_connection (SoupConnectionManager *manager,
 {
         g_signal_handlers_disconnect_by_data (conn, manager);
         manager->num_conns--;
+        soup_profiler_counter_add (SOUP_PROFILER_COUNTER_CONNECTIONS, -1);
         g_object_unref (conn);
 
         g_cond_broadcast (&manager->cond);
@@ -364,10 +363,20 @@ connection_state_changed (SoupConnection        *conn,
                           GParamSpec            *param,
                           SoupConnectionManager *manager)
 {
+        SoupHost *host;
+        GTlsClientConnection *tls_session;
+
         if (soup_connection_get_state (conn) != SOUP_CONNECTION_IDLE)
                 return;
 
         g_mutex_lock (&manager->mutex);
+        /* TLS 1.3 session tickets are sent after the handshake, so wait
+         * until the connection has been used before caching its session.
+         */
+        host = g_hash_table_lookup (manager->conns, conn);
+        tls_session = host ? soup_connection_get_tls_session (conn) : NULL;
+        if (tls_session)
+                g_set_object (&host->tls_session, tls_session);
         g_cond_broadcast (&manager->cond);
         g_mutex_unlock (&manager->mutex);
 
@@ -417,6 +426,10 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
                                         return conn;
                                 break;
                         case SOUP_CONNECTION_IDLE:
+                                /* An idle HTTP/1 connection can't be upgraded, extended CONNECT
+                                 * requests need either a fresh connection or an HTTP/2 one. */
+                                if (soup_message_get_connect_protocol (msg) && http_version != SOUP_HTTP_2_0)
+                                        break;
                                 if (!need_new_connection && soup_connection_is_idle_open (conn))
                                         return conn;
                                 break;
@@ -494,6 +507,8 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
                              "socket-properties", socket_props,
                              "force-http-version", force_http_version,
                              NULL);
+        if (host->tls_session)
+                soup_connection_set_tls_session_source (conn, host->tls_session);
 
         g_signal_connect (conn, "disconnected",
                           G_CALLBACK (connection_disconnected),
@@ -505,6 +520,7 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
         g_hash_table_insert (manager->conns, conn, host);
 
         manager->num_conns++;
+        soup_profiler_counter_add (SOUP_PROFILER_COUNTER_CONNECTIONS, 1);
         soup_host_add_connection (host, conn);
 
         return conn;
@@ -570,6 +586,16 @@ soup_connection_manager_steal_connection (SoupConnectionManager *manager,
                 return NULL;
         }
 
+        /* HTTP/2 connections are shared, so only the message stream is
+         * stolen and the connection stays in the pool. */
+        if (soup_connection_get_negotiated_protocol (conn) == SOUP_HTTP_2_0) {
+                stream = soup_connection_steal_message_stream (conn, msg);
+                soup_message_set_connection (msg, NULL);
+                g_object_unref (conn);
+
+                return stream;
+        }
+
         g_mutex_lock (&manager->mutex);
         host = soup_connection_manager_get_host_for_message (manager, msg);
         g_hash_table_remove (manager->conns, conn);
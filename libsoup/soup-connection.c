@@ -17,7 +17,9 @@
 #include "soup-client-message-io-http2.h"
 #include "soup-socket-properties.h"
 #include "soup-private-enum-types.h"
+#include "soup-profiler.h"
 #include "soup-tls-interaction.h"
+#include "soup-timer-wheel.h"
 #include <gio/gnetworking.h>
 
 struct _SoupConnection {
@@ -40,14 +42,17 @@ typedef struct {
         SoupClientMessageIO *io_data;
 	SoupConnectionState state;
 	time_t       unused_timeout;
-	GSource     *idle_timeout_src;
+	SoupTimer   *idle_timer;
         guint        in_use;
         SoupHTTPVersion http_version;
 
         GTlsCertificate *tls_client_cert;
+        GTlsClientConnection *tls_session_source;
 
 	GCancellable *cancellable;
         GThread *owner;
+
+        gint64 event_time;
 } SoupConnectionPrivate;
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupConnection, soup_connection, G_TYPE_OBJECT)
@@ -84,7 +89,7 @@ enum {
 
 static GParamSpec *properties[LAST_PROPERTY] = { NULL, };
 
-static gboolean idle_timeout (gpointer conn);
+static void idle_timeout (gpointer conn);
 
 /* Number of seconds after which we close a connection that hasn't yet
  * been used.
@@ -126,6 +131,7 @@ soup_connection_finalize (GObject *object)
 
 	g_clear_object (&priv->iostream);
         g_clear_object (&priv->tls_client_cert);
+        g_clear_object (&priv->tls_session_source);
 
 	G_OBJECT_CLASS (soup_connection_parent_class)->finalize (object);
 }
@@ -136,11 +142,7 @@ soup_connection_dispose (GObject *object)
 	SoupConnection *conn = SOUP_CONNECTION (object);
 	SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
 
-        if (priv->idle_timeout_src) {
-                g_source_destroy (priv->idle_timeout_src);
-                g_source_unref (priv->idle_timeout_src);
-                priv->idle_timeout_src = NULL;
-        }
+        g_clear_pointer (&priv->idle_timer, soup_timer_free);
 
 	G_OBJECT_CLASS (soup_connection_parent_class)->dispose (object);
 }
@@ -168,11 +170,7 @@ soup_connection_set_property (GObject *object, guint prop_id,
 		priv->force_http_version = g_value_get_uchar (value);
 		break;
         case PROP_CONTEXT:
-                priv->idle_timeout_src = g_timeout_source_new (0);
-                g_source_set_ready_time (priv->idle_timeout_src, -1);
-                g_source_set_name (priv->idle_timeout_src, "Soup connection idle timeout");
-                g_source_set_callback (priv->idle_timeout_src, idle_timeout, object, NULL);
-                g_source_attach (priv->idle_timeout_src, g_value_get_pointer (value));
+                priv->idle_timer = soup_timer_new (g_value_get_pointer (value), idle_timeout, object);
                 break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -376,6 +374,43 @@ soup_connection_class_init (SoupConnectionClass *connection_class)
         g_object_class_install_properties (object_class, LAST_PROPERTY, properties);
 }
 
+static void
+soup_connection_profile_event (SoupConnection     *conn,
+                               GSocketClientEvent  event,
+                               GIOStream          *connection)
+{
+	SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+        const char *name;
+        char *host;
+
+        switch (event) {
+        case G_SOCKET_CLIENT_RESOLVING:
+        case G_SOCKET_CLIENT_CONNECTING:
+        case G_SOCKET_CLIENT_TLS_HANDSHAKING:
+                priv->event_time = soup_profiler_get_time ();
+                return;
+        case G_SOCKET_CLIENT_RESOLVED:
+                name = "DNS";
+                break;
+        case G_SOCKET_CLIENT_CONNECTED:
+                name = "Connect";
+                break;
+        case G_SOCKET_CLIENT_TLS_HANDSHAKED:
+                name = "TLS handshake";
+                break;
+        default:
+                return;
+        }
+
+        if (!priv->event_time || !soup_profiler_is_active ())
+                return;
+
+        host = g_socket_connectable_to_string (priv->remote_connectable);
+        soup_profiler_mark (priv->event_time, name, "%s (connection %" G_GUINT64_FORMAT ")", host, priv->id);
+        g_free (host);
+        priv->event_time = 0;
+}
+
 static void
 soup_connection_event (SoupConnection      *conn,
 		       GSocketClientEvent   event,
@@ -385,13 +420,14 @@ soup_connection_event (SoupConnection      *conn,
 
 	g_signal_emit (conn, signals[EVENT], 0,
 		       event, connection ? connection : priv->connection);
+
+        soup_connection_profile_event (conn, event, connection ? connection : priv->connection);
 }
 
-static gboolean
+static void
 idle_timeout (gpointer conn)
 {
 	soup_connection_disconnect (conn);
-	return G_SOURCE_REMOVE;
 }
 
 static void
@@ -402,11 +438,10 @@ start_idle_timer (SoupConnection *conn)
 	if (priv->socket_props->idle_timeout == 0)
                 return;
 
-        if (g_source_get_ready_time (priv->idle_timeout_src) >= 0)
+        if (soup_timer_is_armed (priv->idle_timer))
                 return;
 
-        g_source_set_ready_time (priv->idle_timeout_src,
-                                 g_get_monotonic_time () + (guint64)priv->socket_props->idle_timeout * G_USEC_PER_SEC);
+        soup_timer_arm (priv->idle_timer, (guint64)priv->socket_props->idle_timeout * 1000);
 }
 
 static void
@@ -622,6 +657,14 @@ new_tls_connection (SoupConnection    *conn,
 	if (!priv->socket_props->tlsdb_use_default)
 		g_tls_connection_set_database (G_TLS_CONNECTION (tls_connection), priv->socket_props->tlsdb);
 
+        /* Only resume sessions established with the same client
+         * certificate we are going to use now.
+         */
+        if (priv->tls_session_source &&
+            g_tls_connection_get_certificate (G_TLS_CONNECTION (priv->tls_session_source)) == priv->tls_client_cert)
+                g_tls_client_connection_copy_session_state (tls_connection, priv->tls_session_source);
+        g_clear_object (&priv->tls_session_source);
+
 	g_signal_connect_object (tls_connection, "accept-certificate",
 				 G_CALLBACK (tls_connection_accept_certificate),
 				 conn, G_CONNECT_SWAPPED);
@@ -1070,6 +1113,34 @@ soup_connection_get_iostream (SoupConnection *conn)
         return priv->iostream;
 }
 
+/* Returns the TLS connection of @conn, whose handshake has completed,
+ * or %NULL if @conn is not connected with TLS.
+ */
+GTlsClientConnection *
+soup_connection_get_tls_session (SoupConnection *conn)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        g_return_val_if_fail (SOUP_IS_CONNECTION (conn), NULL);
+
+        return G_IS_TLS_CLIENT_CONNECTION (priv->connection) ? G_TLS_CLIENT_CONNECTION (priv->connection) : NULL;
+}
+
+/* Sets the connection whose TLS session state will be copied to try
+ * to resume the session in the handshake of @conn. @source may have
+ * been closed already: the session state outlives the connection.
+ */
+void
+soup_connection_set_tls_session_source (SoupConnection       *conn,
+                                        GTlsClientConnection *source)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        g_return_if_fail (SOUP_IS_CONNECTION (conn));
+
+        g_set_object (&priv->tls_session_source, source);
+}
+
 GIOStream *
 soup_connection_steal_iostream (SoupConnection *conn)
 {
@@ -1096,6 +1167,21 @@ soup_connection_steal_iostream (SoupConnection *conn)
         return iostream;
 }
 
+GIOStream *
+soup_connection_steal_message_stream (SoupConnection *conn,
+                                      SoupMessage    *msg)
+{
+        SoupConnectionPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_CONNECTION (conn), NULL);
+
+        priv = soup_connection_get_instance_private (conn);
+        if (!priv->io_data || priv->http_version != SOUP_HTTP_2_0)
+                return NULL;
+
+        return soup_client_message_io_http2_steal_stream (priv->io_data, msg);
+}
+
 GUri *
 soup_connection_get_proxy_uri (SoupConnection *conn)
 {
@@ -1181,7 +1267,7 @@ soup_connection_setup_message_io (SoupConnection *conn,
         g_assert (g_atomic_int_get (&priv->state) == SOUP_CONNECTION_IN_USE);
 
         priv->unused_timeout = 0;
-        g_source_set_ready_time (priv->idle_timeout_src, -1);
+        soup_timer_cancel (priv->idle_timer);
 
         if (priv->proxy_uri && soup_message_get_method (msg) == SOUP_METHOD_CONNECT)
                 set_proxy_msg (conn, msg);
@@ -50,6 +50,8 @@ void            soup_connection_disconnect     (SoupConnection   *conn);
 GSocket        *soup_connection_get_socket     (SoupConnection   *conn);
 GIOStream      *soup_connection_get_iostream   (SoupConnection   *conn);
 GIOStream      *soup_connection_steal_iostream (SoupConnection   *conn);
+GIOStream      *soup_connection_steal_message_stream (SoupConnection *conn,
+                                                      SoupMessage    *msg);
 GUri           *soup_connection_get_remote_uri (SoupConnection   *conn);
 GUri           *soup_connection_get_proxy_uri  (SoupConnection   *conn);
 gboolean        soup_connection_is_via_proxy   (SoupConnection   *conn);
@@ -80,6 +82,9 @@ void                 soup_connection_request_tls_certificate_password          (
                                                                                 GTask           *task);
 void                 soup_connection_complete_tls_certificate_password_request (SoupConnection  *conn,
                                                                                 GTask           *task);
+GTlsClientConnection *soup_connection_get_tls_session                           (SoupConnection  *conn);
+void                 soup_connection_set_tls_session_source                    (SoupConnection       *conn,
+                                                                                GTlsClientConnection *source);
 
 guint64              soup_connection_get_id                     (SoupConnection *conn);
 GSocketAddress      *soup_connection_get_remote_address         (SoupConnection *conn);
@@ -0,0 +1,628 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-flight-recorder.c: Recent exchanges of a session
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "soup-flight-recorder.h"
+#include "soup.h"
+#include "soup-message-private.h"
+#include "soup-message-metrics-private.h"
+#include "soup-misc.h"
+#include "soup-session-feature-private.h"
+
+/**
+ * SoupFlightRecorder:
+ *
+ * Keeps a summary of the last exchanges of a [class@Session].
+ *
+ * #SoupFlightRecorder is a [iface@SessionFeature] that records, for each of
+ * the last messages sent by the session it's added to, the timings and sizes
+ * from its [struct@MessageMetrics], the status, the connection it was sent on,
+ * the error it failed with if any and, optionally, the beginning of its
+ * request and response headers. Credentials and cookies in the headers are
+ * not recorded.
+ *
+ * Records have a fixed size and are written to a circular buffer allocated
+ * upfront, so recording is cheap enough to be left enabled in production,
+ * and the latest exchanges are available when something goes wrong. Use
+ * [method@FlightRecorder.to_json] to dump them, for example from a
+ * `SIGUSR1` handler installed with `g_unix_signal_add()`.
+ *
+ * Since: 3.4
+ */
+
+#define METHOD_SIZE 16
+#define URI_SIZE 256
+#define ERROR_SIZE 128
+
+typedef struct {
+        /* Odd while the slot is being written */
+        guint sequence;
+
+        gint64 start_time;
+        guint64 connection_id;
+        guint status;
+        SoupHTTPVersion http_version;
+
+        /* Microseconds, or -1 if the phase didn't happen */
+        gint64 dns;
+        gint64 connect;
+        gint64 tls;
+        gint64 ttfb;
+        gint64 total;
+
+        guint64 request_header_bytes;
+        guint64 request_body_bytes;
+        guint64 response_header_bytes;
+        guint64 response_body_bytes;
+
+        GQuark error_domain;
+        int error_code;
+
+        char method[METHOD_SIZE];
+        char uri[URI_SIZE];
+        char error[ERROR_SIZE];
+
+        /* NUL-terminated names and values of the request headers,
+         * followed by the response ones.
+         */
+        guint n_request_headers;
+        guint n_response_headers;
+        gboolean headers_truncated;
+        gsize headers_len;
+        char headers[];
+} SoupFlightRecorderSlot;
+
+struct _SoupFlightRecorder {
+        GObject parent_instance;
+
+        guint max_exchanges;
+        guint max_header_bytes;
+        gsize slot_size;
+        guint8 *slots;
+        guint n_slots;
+        guint next;
+};
+
+enum {
+        PROP_0,
+
+        PROP_MAX_EXCHANGES,
+        PROP_MAX_HEADER_BYTES,
+
+        LAST_PROPERTY
+};
+
+static GParamSpec *properties[LAST_PROPERTY] = { NULL, };
+
+static void soup_flight_recorder_session_feature_init (SoupSessionFeatureInterface *feature_interface, gpointer interface_data);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (SoupFlightRecorder, soup_flight_recorder, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (SOUP_TYPE_SESSION_FEATURE,
+                                                      soup_flight_recorder_session_feature_init))
+
+static void
+soup_flight_recorder_init (SoupFlightRecorder *recorder)
+{
+}
+
+static void
+soup_flight_recorder_constructed (GObject *object)
+{
+        SoupFlightRecorder *recorder = SOUP_FLIGHT_RECORDER (object);
+
+        G_OBJECT_CLASS (soup_flight_recorder_parent_class)->constructed (object);
+
+        recorder->slot_size = sizeof (SoupFlightRecorderSlot) + recorder->max_header_bytes;
+        recorder->slot_size = (recorder->slot_size + sizeof (gint64) - 1) & ~(sizeof (gint64) - 1);
+        /* A power of two, so slots are picked by masking positions,
+         * which keeps working when they wrap around.
+         */
+        recorder->n_slots = 1 << g_bit_storage (recorder->max_exchanges - 1);
+        recorder->slots = g_malloc0_n (recorder->n_slots, recorder->slot_size);
+}
+
+static void
+soup_flight_recorder_finalize (GObject *object)
+{
+        SoupFlightRecorder *recorder = SOUP_FLIGHT_RECORDER (object);
+
+        g_free (recorder->slots);
+
+        G_OBJECT_CLASS (soup_flight_recorder_parent_class)->finalize (object);
+}
+
+static void
+soup_flight_recorder_set_property (GObject      *object,
+                                   guint         prop_id,
+                                   const GValue *value,
+                                   GParamSpec   *pspec)
+{
+        SoupFlightRecorder *recorder = SOUP_FLIGHT_RECORDER (object);
+
+        switch (prop_id) {
+        case PROP_MAX_EXCHANGES:
+                recorder->max_exchanges = g_value_get_uint (value);
+                break;
+        case PROP_MAX_HEADER_BYTES:
+                recorder->max_header_bytes = g_value_get_uint (value);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+soup_flight_recorder_get_property (GObject    *object,
+                                   guint       prop_id,
+                                   GValue     *value,
+                                   GParamSpec *pspec)
+{
+        SoupFlightRecorder *recorder = SOUP_FLIGHT_RECORDER (object);
+
+        switch (prop_id) {
+        case PROP_MAX_EXCHANGES:
+                g_value_set_uint (value, recorder->max_exchanges);
+                break;
+        case PROP_MAX_HEADER_BYTES:
+                g_value_set_uint (value, recorder->max_header_bytes);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+soup_flight_recorder_class_init (SoupFlightRecorderClass *recorder_class)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (recorder_class);
+
+        object_class->constructed = soup_flight_recorder_constructed;
+        object_class->finalize = soup_flight_recorder_finalize;
+        object_class->set_property = soup_flight_recorder_set_property;
+        object_class->get_property = soup_flight_recorder_get_property;
+
+        /**
+         * SoupFlightRecorder:max-exchanges: (attributes org.gtk.Property.get=soup_flight_recorder_get_max_exchanges)
+         *
+         * The number of exchanges kept. Once reached, recording an exchange
+         * overwrites the oldest one.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_MAX_EXCHANGES] =
+                g_param_spec_uint ("max-exchanges",
+                                   "Max exchanges",
+                                   "The number of exchanges kept",
+                                   1, G_MAXUINT16, 128,
+                                   G_PARAM_READWRITE |
+                                   G_PARAM_CONSTRUCT_ONLY |
+                                   G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupFlightRecorder:max-header-bytes: (attributes org.gtk.Property.get=soup_flight_recorder_get_max_header_bytes)
+         *
+         * The number of bytes of request and response headers kept per
+         * exchange. Headers that don't fit are left out. 0 means no headers
+         * are recorded.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_MAX_HEADER_BYTES] =
+                g_param_spec_uint ("max-header-bytes",
+                                   "Max header bytes",
+                                   "The number of bytes of headers kept per exchange",
+                                   0, G_MAXUINT16, 0,
+                                   G_PARAM_READWRITE |
+                                   G_PARAM_CONSTRUCT_ONLY |
+                                   G_PARAM_STATIC_STRINGS);
+
+        g_object_class_install_properties (object_class, LAST_PROPERTY, properties);
+}
+
+static SoupFlightRecorderSlot *
+soup_flight_recorder_get_slot (SoupFlightRecorder *recorder,
+                               guint               position)
+{
+        return (SoupFlightRecorderSlot *)(recorder->slots + (position & (recorder->n_slots - 1)) * recorder->slot_size);
+}
+
+static gint64
+interval (guint64 start,
+          guint64 end)
+{
+        if (start == 0 || end < start)
+                return -1;
+
+        return end - start;
+}
+
+static gboolean
+header_is_sensitive (const char *name)
+{
+        return !g_ascii_strcasecmp (name, "Authorization") ||
+                !g_ascii_strcasecmp (name, "Proxy-Authorization") ||
+                !g_ascii_strcasecmp (name, "Cookie") ||
+                !g_ascii_strcasecmp (name, "Set-Cookie");
+}
+
+static guint
+record_headers (SoupFlightRecorder     *recorder,
+                SoupFlightRecorderSlot *slot,
+                SoupMessageHeaders     *headers)
+{
+        SoupMessageHeadersIter iter;
+        const char *name, *value;
+        gsize name_len, value_len;
+        guint n = 0;
+
+        if (slot->headers_truncated)
+                return 0;
+
+        soup_message_headers_iter_init (&iter, headers);
+        while (soup_message_headers_iter_next (&iter, &name, &value)) {
+                if (header_is_sensitive (name))
+                        value = "[redacted]";
+
+                name_len = strlen (name) + 1;
+                value_len = strlen (value) + 1;
+                if (slot->headers_len + name_len + value_len > recorder->max_header_bytes) {
+                        slot->headers_truncated = TRUE;
+                        break;
+                }
+
+                memcpy (slot->headers + slot->headers_len, name, name_len);
+                slot->headers_len += name_len;
+                memcpy (slot->headers + slot->headers_len, value, value_len);
+                slot->headers_len += value_len;
+                n++;
+        }
+
+        return n;
+}
+
+static void
+soup_flight_recorder_request_queued (SoupSessionFeature *feature,
+                                     SoupMessage        *msg)
+{
+        soup_message_enable_metrics (msg);
+}
+
+static void
+soup_flight_recorder_request_unqueued (SoupSessionFeature *feature,
+                                       SoupMessage        *msg)
+{
+        SoupFlightRecorder *recorder = SOUP_FLIGHT_RECORDER (feature);
+        SoupFlightRecorderSlot *slot;
+        SoupMessageMetrics *metrics;
+        const GError *error;
+        guint64 now;
+        GUri *uri;
+
+        metrics = soup_message_get_metrics (msg);
+        if (!metrics)
+                return;
+
+        slot = soup_flight_recorder_get_slot (recorder, g_atomic_int_add (&recorder->next, 1));
+
+        g_atomic_int_inc (&slot->sequence);
+
+        now = g_get_monotonic_time ();
+        slot->start_time = g_get_real_time () - (metrics->fetch_start ? now - metrics->fetch_start : 0);
+        slot->connection_id = soup_message_get_connection_id (msg);
+        slot->status = soup_message_get_status (msg);
+        slot->http_version = soup_message_get_http_version (msg);
+
+        slot->dns = interval (metrics->dns_start, metrics->dns_end);
+        slot->connect = interval (metrics->connect_start, metrics->connect_end);
+        slot->tls = interval (metrics->tls_start, metrics->tls_end);
+        slot->ttfb = interval (metrics->request_start, metrics->response_start);
+        slot->total = interval (metrics->fetch_start, metrics->response_end ? metrics->response_end : now);
+
+        slot->request_header_bytes = metrics->request_header_bytes_sent;
+        slot->request_body_bytes = metrics->request_body_bytes_sent;
+        slot->response_header_bytes = metrics->response_header_bytes_received;
+        slot->response_body_bytes = metrics->response_body_bytes_received;
+
+        error = soup_message_get_error (msg);
+        slot->error_domain = error ? error->domain : 0;
+        slot->error_code = error ? error->code : 0;
+        g_strlcpy (slot->error, error ? error->message : "", ERROR_SIZE);
+
+        /* The query and user info are left out on purpose */
+        uri = soup_message_get_uri (msg);
+        g_strlcpy (slot->method, soup_message_get_method (msg), METHOD_SIZE);
+        g_snprintf (slot->uri, URI_SIZE, "%s://%s%s%s:%d%s",
+                    g_uri_get_scheme (uri),
+                    strchr (g_uri_get_host (uri), ':') ? "[" : "",
+                    g_uri_get_host (uri),
+                    strchr (g_uri_get_host (uri), ':') ? "]" : "",
+                    g_uri_get_port (uri), g_uri_get_path (uri));
+
+        slot->headers_len = 0;
+        slot->headers_truncated = FALSE;
+        slot->n_request_headers = slot->n_response_headers = 0;
+        if (recorder->max_header_bytes) {
+                slot->n_request_headers = record_headers (recorder, slot, soup_message_get_request_headers (msg));
+                slot->n_response_headers = record_headers (recorder, slot, soup_message_get_response_headers (msg));
+        }
+
+        g_atomic_int_inc (&slot->sequence);
+}
+
+static void
+soup_flight_recorder_session_feature_init (SoupSessionFeatureInterface *feature_interface,
+                                           gpointer                     interface_data)
+{
+        feature_interface->request_queued = soup_flight_recorder_request_queued;
+        feature_interface->request_unqueued = soup_flight_recorder_request_unqueued;
+}
+
+/**
+ * soup_flight_recorder_new:
+ * @max_exchanges: the number of exchanges to keep
+ * @max_header_bytes: the number of bytes of headers to keep per exchange
+ *
+ * Creates a new #SoupFlightRecorder.
+ *
+ * All the memory needed for @max_exchanges exchanges is allocated now.
+ *
+ * Add it to a [class@Session] with [method@Session.add_feature] to
+ * start recording.
+ *
+ * Returns: (transfer full): a new #SoupFlightRecorder
+ *
+ * Since: 3.4
+ */
+SoupFlightRecorder *
+soup_flight_recorder_new (guint max_exchanges,
+                          guint max_header_bytes)
+{
+        return g_object_new (SOUP_TYPE_FLIGHT_RECORDER,
+                             "max-exchanges", max_exchanges,
+                             "max-header-bytes", max_header_bytes,
+                             NULL);
+}
+
+/**
+ * soup_flight_recorder_get_max_exchanges: (attributes org.gtk.Method.get_property=max-exchanges)
+ * @recorder: a #SoupFlightRecorder
+ *
+ * Gets the number of exchanges kept by @recorder.
+ *
+ * Returns: the number of exchanges kept
+ *
+ * Since: 3.4
+ */
+guint
+soup_flight_recorder_get_max_exchanges (SoupFlightRecorder *recorder)
+{
+        g_return_val_if_fail (SOUP_IS_FLIGHT_RECORDER (recorder), 0);
+
+        return recorder->max_exchanges;
+}
+
+/**
+ * soup_flight_recorder_get_max_header_bytes: (attributes org.gtk.Method.get_property=max-header-bytes)
+ * @recorder: a #SoupFlightRecorder
+ *
+ * Gets the number of bytes of headers kept by @recorder per exchange.
+ *
+ * Returns: the number of bytes of headers kept
+ *
+ * Since: 3.4
+ */
+guint
+soup_flight_recorder_get_max_header_bytes (SoupFlightRecorder *recorder)
+{
+        g_return_val_if_fail (SOUP_IS_FLIGHT_RECORDER (recorder), 0);
+
+        return recorder->max_header_bytes;
+}
+
+/* Copies the slot at @position to @copy, unless it's being written */
+static gboolean
+soup_flight_recorder_read_slot (SoupFlightRecorder     *recorder,
+                                guint                   position,
+                                SoupFlightRecorderSlot *copy)
+{
+        SoupFlightRecorderSlot *slot = soup_flight_recorder_get_slot (recorder, position);
+        guint sequence;
+
+        sequence = g_atomic_int_get (&slot->sequence);
+        if (sequence == 0 || sequence & 1)
+                return FALSE;
+
+        memcpy (copy, slot, recorder->slot_size);
+
+        return (guint)g_atomic_int_get (&slot->sequence) == sequence;
+}
+
+static void
+append_timing (GString    *str,
+               const char *name,
+               gint64      value,
+               gboolean   *first)
+{
+        if (value < 0)
+                return;
+
+        g_string_append_printf (str, "%s\"%s\":%" G_GINT64_FORMAT, *first ? "" : ",", name, value);
+        *first = FALSE;
+}
+
+static const char *
+append_headers (GString    *str,
+                const char *name,
+                const char *headers,
+                guint       n_headers)
+{
+        guint i;
+
+        g_string_append_printf (str, ",\"%s\":[", name);
+        for (i = 0; i < n_headers; i++) {
+                const char *value = headers + strlen (headers) + 1;
+
+                g_string_append (str, i ? ",[" : "[");
+                soup_json_append_string (str, headers, -1);
+                g_string_append_c (str, ',');
+                soup_json_append_string (str, value, -1);
+                g_string_append_c (str, ']');
+                headers = value + strlen (value) + 1;
+        }
+        g_string_append_c (str, ']');
+
+        return headers;
+}
+
+static void
+append_slot (GString                *str,
+             SoupFlightRecorderSlot *slot)
+{
+        GDateTime *date, *tmp;
+        const char *headers;
+        gboolean first = TRUE;
+        char *timestamp;
+
+        tmp = g_date_time_new_from_unix_utc (slot->start_time / G_USEC_PER_SEC);
+        date = g_date_time_add (tmp, slot->start_time % G_USEC_PER_SEC);
+        timestamp = g_date_time_format_iso8601 (date);
+        g_date_time_unref (date);
+        g_date_time_unref (tmp);
+
+        slot->method[METHOD_SIZE - 1] = '\0';
+        slot->uri[URI_SIZE - 1] = '\0';
+        slot->error[ERROR_SIZE - 1] = '\0';
+
+        g_string_append_printf (str, "{\"time\":\"%s\",\"method\":", timestamp);
+        g_free (timestamp);
+        soup_json_append_string (str, slot->method, -1);
+        g_string_append (str, ",\"uri\":");
+        soup_json_append_string (str, slot->uri, -1);
+        g_string_append_printf (str, ",\"status\":%u", slot->status);
+        if (slot->status != SOUP_STATUS_NONE)
+                g_string_append_printf (str, ",\"http_version\":\"%s\"", soup_http_version_to_string (slot->http_version));
+        if (slot->connection_id)
+                g_string_append_printf (str, ",\"connection\":%" G_GUINT64_FORMAT, slot->connection_id);
+
+        g_string_append (str, ",\"timing_us\":{");
+        append_timing (str, "dns", slot->dns, &first);
+        append_timing (str, "connect", slot->connect, &first);
+        append_timing (str, "tls", slot->tls, &first);
+        append_timing (str, "ttfb", slot->ttfb, &first);
+        append_timing (str, "total", slot->total, &first);
+        g_string_append_c (str, '}');
+
+        g_string_append_printf (str, ",\"bytes\":{\"request_headers\":%" G_GUINT64_FORMAT
+                                ",\"request_body\":%" G_GUINT64_FORMAT
+                                ",\"response_headers\":%" G_GUINT64_FORMAT
+                                ",\"response_body\":%" G_GUINT64_FORMAT "}",
+                                slot->request_header_bytes, slot->request_body_bytes,
+                                slot->response_header_bytes, slot->response_body_bytes);
+
+        if (slot->error_domain) {
+                g_string_append (str, ",\"error\":{\"domain\":");
+                soup_json_append_string (str, g_quark_to_string (slot->error_domain), -1);
+                g_string_append_printf (str, ",\"code\":%d,\"message\":", slot->error_code);
+                soup_json_append_string (str, slot->error, -1);
+                g_string_append_c (str, '}');
+        }
+
+        if (slot->headers_len) {
+                headers = append_headers (str, "request_headers", slot->headers, slot->n_request_headers);
+                append_headers (str, "response_headers", headers, slot->n_response_headers);
+        }
+        if (slot->headers_truncated)
+                g_string_append (str, ",\"headers_truncated\":true");
+
+        g_string_append_c (str, '}');
+}
+
+/**
+ * soup_flight_recorder_to_json:
+ * @recorder: a #SoupFlightRecorder
+ *
+ * Dumps the exchanges kept by @recorder as a JSON array, from the oldest
+ * to the most recent one.
+ *
+ * Each exchange is an object with the `method`, the `uri` without its query,
+ * the `status`, and the `time` it was queued at. It also has the `connection`
+ * ID from [method@Message.get_connection_id], the `timing_us` of each phase in
+ * microseconds, the `bytes` sent and received, the `error` if the exchange
+ * failed and, if [property@FlightRecorder:max-header-bytes] is not 0, the
+ * `request_headers` and `response_headers`.
+ *
+ * Exchanges being recorded while dumping are left out.
+ *
+ * Returns: (transfer full): a JSON array
+ *
+ * Since: 3.4
+ */
+char *
+soup_flight_recorder_to_json (SoupFlightRecorder *recorder)
+{
+        SoupFlightRecorderSlot *copy;
+        GString *str;
+        guint next, i;
+        gboolean empty = TRUE;
+
+        g_return_val_if_fail (SOUP_IS_FLIGHT_RECORDER (recorder), NULL);
+
+        copy = g_malloc (recorder->slot_size);
+        str = g_string_new ("[");
+
+        /* Positions before the first one recorded map to slots not
+         * written yet, which are skipped.
+         */
+        next = g_atomic_int_get (&recorder->next);
+        for (i = next - recorder->max_exchanges; i != next; i++) {
+                if (!soup_flight_recorder_read_slot (recorder, i, copy))
+                        continue;
+
+                g_string_append (str, empty ? "\n" : ",\n");
+                append_slot (str, copy);
+                empty = FALSE;
+        }
+
+        g_string_append (str, empty ? "]\n" : "\n]\n");
+        g_free (copy);
+
+        return g_string_free (str, FALSE);
+}
+
+/**
+ * soup_flight_recorder_clear:
+ * @recorder: a #SoupFlightRecorder
+ *
+ * Forgets the exchanges recorded so far.
+ *
+ * Since: 3.4
+ */
+void
+soup_flight_recorder_clear (SoupFlightRecorder *recorder)
+{
+        guint i;
+
+        g_return_if_fail (SOUP_IS_FLIGHT_RECORDER (recorder));
+
+        /* A sequence of 0 keeps the slot out of dumps until it's
+         * written again.
+         */
+        for (i = 0; i < recorder->n_slots; i++) {
+                SoupFlightRecorderSlot *slot = soup_flight_recorder_get_slot (recorder, i);
+                guint sequence = g_atomic_int_get (&slot->sequence);
+
+                if (sequence && !(sequence & 1))
+                        g_atomic_int_compare_and_exchange ((int *)&slot->sequence, sequence, 0);
+        }
+}
@@ -0,0 +1,32 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-types.h"
+
+G_BEGIN_DECLS
+
+#define SOUP_TYPE_FLIGHT_RECORDER (soup_flight_recorder_get_type ())
+SOUP_AVAILABLE_IN_3_4
+G_DECLARE_FINAL_TYPE (SoupFlightRecorder, soup_flight_recorder, SOUP, FLIGHT_RECORDER, GObject)
+
+SOUP_AVAILABLE_IN_3_4
+SoupFlightRecorder *soup_flight_recorder_new                  (guint               max_exchanges,
+                                                               guint               max_header_bytes);
+
+SOUP_AVAILABLE_IN_3_4
+guint               soup_flight_recorder_get_max_exchanges    (SoupFlightRecorder *recorder);
+
+SOUP_AVAILABLE_IN_3_4
+guint               soup_flight_recorder_get_max_header_bytes (SoupFlightRecorder *recorder);
+
+SOUP_AVAILABLE_IN_3_4
+char               *soup_flight_recorder_to_json              (SoupFlightRecorder *recorder);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_flight_recorder_clear                (SoupFlightRecorder *recorder);
+
+G_END_DECLS
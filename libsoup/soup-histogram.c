@@ -0,0 +1,227 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-histogram.c: Log-linear histograms
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "soup-histogram.h"
+
+/* Buckets are laid out like in HdrHistogram: values below
+ * 2^SUB_BITS get a bucket each, and every power of two range above
+ * that is split in 2^SUB_BITS buckets, so the error of any value
+ * read back is at most 1 / 2^SUB_BITS of it.
+ *
+ * Buckets and sums are only updated atomically, so recording never
+ * takes a lock and can happen concurrently with reading. A histogram
+ * being read while recording goes on may be off by the values recorded
+ * meanwhile. GLib has no 64-bit atomics, so the compiler builtins are
+ * used for the sums, which would overflow a gsize on 32-bit platforms.
+ * Only where those are not lock-free are the sums protected by a lock.
+ */
+
+#if defined (__ATOMIC_RELAXED) && defined (__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define sum_add(histogram, value) __atomic_fetch_add (&(histogram)->sum, (value), __ATOMIC_RELAXED)
+#define sum_get(histogram) __atomic_load_n (&(histogram)->sum, __ATOMIC_RELAXED)
+#define sum_set(histogram, value) __atomic_store_n (&(histogram)->sum, (value), __ATOMIC_RELAXED)
+#else
+G_LOCK_DEFINE_STATIC (sums);
+
+static void
+sum_add (SoupHistogram *histogram,
+         guint64        value)
+{
+        G_LOCK (sums);
+        histogram->sum += value;
+        G_UNLOCK (sums);
+}
+
+static guint64
+sum_get (const SoupHistogram *histogram)
+{
+        guint64 sum;
+
+        G_LOCK (sums);
+        sum = histogram->sum;
+        G_UNLOCK (sums);
+
+        return sum;
+}
+
+static void
+sum_set (SoupHistogram *histogram,
+         guint64        value)
+{
+        G_LOCK (sums);
+        histogram->sum = value;
+        G_UNLOCK (sums);
+}
+#endif
+
+#define SUB_COUNT (1 << SOUP_HISTOGRAM_SUB_BITS)
+#define MAX_VALUE ((G_GUINT64_CONSTANT (1) << SOUP_HISTOGRAM_MAX_BITS) - 1)
+
+static guint
+bucket_index (guint64 value)
+{
+        guint msb;
+
+        if (value > MAX_VALUE)
+                value = MAX_VALUE;
+        if (value < SUB_COUNT)
+                return value;
+
+        msb = g_bit_storage (value) - 1;
+        return ((msb - SOUP_HISTOGRAM_SUB_BITS + 1) << SOUP_HISTOGRAM_SUB_BITS) +
+                ((value >> (msb - SOUP_HISTOGRAM_SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+static guint64
+bucket_lower_bound (guint index)
+{
+        guint exponent = index >> SOUP_HISTOGRAM_SUB_BITS;
+        guint64 sub = index & (SUB_COUNT - 1);
+
+        if (exponent == 0)
+                return sub;
+
+        return (SUB_COUNT + sub) << (exponent - 1);
+}
+
+static guint64
+bucket_upper_bound (guint index)
+{
+        if (index + 1 == SOUP_HISTOGRAM_N_BUCKETS)
+                return MAX_VALUE;
+
+        return bucket_lower_bound (index + 1) - 1;
+}
+
+void
+soup_histogram_record (SoupHistogram *histogram,
+                       guint64        value)
+{
+        g_atomic_int_inc (&histogram->buckets[bucket_index (value)]);
+        sum_add (histogram, value);
+}
+
+/* Adds the values of @other to @histogram, which must not be
+ * recorded to meanwhile.
+ */
+void
+soup_histogram_merge (SoupHistogram       *histogram,
+                      const SoupHistogram *other)
+{
+        guint i;
+
+        for (i = 0; i < SOUP_HISTOGRAM_N_BUCKETS; i++)
+                histogram->buckets[i] += g_atomic_int_get (&other->buckets[i]);
+        histogram->sum += sum_get (other);
+}
+
+void
+soup_histogram_reset (SoupHistogram *histogram)
+{
+        guint i;
+
+        for (i = 0; i < SOUP_HISTOGRAM_N_BUCKETS; i++)
+                g_atomic_int_set (&histogram->buckets[i], 0);
+        sum_set (histogram, 0);
+}
+
+guint64
+soup_histogram_get_count (const SoupHistogram *histogram)
+{
+        guint64 count = 0;
+        guint i;
+
+        for (i = 0; i < SOUP_HISTOGRAM_N_BUCKETS; i++)
+                count += g_atomic_int_get (&histogram->buckets[i]);
+
+        return count;
+}
+
+guint64
+soup_histogram_get_sum (const SoupHistogram *histogram)
+{
+        return sum_get (histogram);
+}
+
+/* Returns the highest value equivalent to the one below which
+ * @percentile percent of the recorded values are, or 0 if nothing
+ * was recorded.
+ */
+guint64
+soup_histogram_get_percentile (const SoupHistogram *histogram,
+                               double               percentile)
+{
+        guint64 count, rank, seen = 0;
+        double exact_rank;
+        guint i;
+
+        count = soup_histogram_get_count (histogram);
+        if (count == 0)
+                return 0;
+
+        percentile = CLAMP (percentile, 0.0, 100.0);
+        exact_rank = percentile / 100.0 * count;
+        rank = (guint64)exact_rank;
+        if (rank < exact_rank || rank == 0)
+                rank++;
+        for (i = 0; i < SOUP_HISTOGRAM_N_BUCKETS; i++) {
+                seen += g_atomic_int_get (&histogram->buckets[i]);
+                if (seen >= rank)
+                        return bucket_upper_bound (i);
+        }
+
+        return MAX_VALUE;
+}
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static void
+append_value (GString *str,
+              double   value)
+{
+        char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+        g_string_append (str, g_ascii_formatd (buffer, sizeof (buffer), "%g", value));
+}
+
+/* Appends the samples of an OpenMetrics summary named @name to @str,
+ * with values divided by @scale. @labels, if not %NULL, must be
+ * already escaped and are added to every sample.
+ */
+void
+soup_histogram_append_openmetrics (const SoupHistogram *histogram,
+                                   GString             *str,
+                                   const char          *name,
+                                   const char          *labels,
+                                   double               scale)
+{
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (quantiles); i++) {
+                g_string_append_printf (str, "%s{%s%squantile=\"", name, labels ? labels : "", labels ? "," : "");
+                append_value (str, quantiles[i]);
+                g_string_append (str, "\"} ");
+                append_value (str, soup_histogram_get_percentile (histogram, quantiles[i] * 100) / scale);
+                g_string_append_c (str, '\n');
+        }
+
+        g_string_append_printf (str, "%s_sum", name);
+        if (labels)
+                g_string_append_printf (str, "{%s}", labels);
+        g_string_append_c (str, ' ');
+        append_value (str, soup_histogram_get_sum (histogram) / scale);
+        g_string_append_c (str, '\n');
+
+        g_string_append_printf (str, "%s_count", name);
+        if (labels)
+                g_string_append_printf (str, "{%s}", labels);
+        g_string_append_printf (str, " %" G_GUINT64_FORMAT "\n", soup_histogram_get_count (histogram));
+}
@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifndef __SOUP_HISTOGRAM_H__
+#define __SOUP_HISTOGRAM_H__ 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Values up to 2^(SOUP_HISTOGRAM_MAX_BITS) - 1 are recorded, each power
+ * of two range split in 2^(SOUP_HISTOGRAM_SUB_BITS) buckets.
+ */
+#define SOUP_HISTOGRAM_SUB_BITS 4
+#define SOUP_HISTOGRAM_MAX_BITS 36
+#define SOUP_HISTOGRAM_N_BUCKETS ((SOUP_HISTOGRAM_MAX_BITS - SOUP_HISTOGRAM_SUB_BITS + 1) << SOUP_HISTOGRAM_SUB_BITS)
+
+typedef struct {
+        guint buckets[SOUP_HISTOGRAM_N_BUCKETS];
+        /* 64-bit atomics need it aligned on 32-bit platforms too */
+#ifdef __GNUC__
+        guint64 sum __attribute__ ((aligned (8)));
+#else
+        guint64 sum;
+#endif
+} SoupHistogram;
+
+void    soup_histogram_record         (SoupHistogram       *histogram,
+                                       guint64              value);
+void    soup_histogram_merge          (SoupHistogram       *histogram,
+                                       const SoupHistogram *other);
+void    soup_histogram_reset          (SoupHistogram       *histogram);
+guint64 soup_histogram_get_count      (const SoupHistogram *histogram);
+guint64 soup_histogram_get_sum        (const SoupHistogram *histogram);
+guint64 soup_histogram_get_percentile (const SoupHistogram *histogram,
+                                       double               percentile);
+void    soup_histogram_append_openmetrics (const SoupHistogram *histogram,
+                                           GString             *str,
+                                           const char          *name,
+                                           const char          *labels,
+                                           double               scale);
+
+G_END_DECLS
+
+#endif /* __SOUP_HISTOGRAM_H__ */
@@ -0,0 +1,115 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-logger-ring.c: Bounded lock-free queue
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "soup-logger-ring.h"
+
+/* A bounded multiple producer, single consumer queue, as described by
+ * Dmitry Vyukov. Every slot has a sequence number telling whether it
+ * can be written (sequence == position) or read (sequence ==
+ * position + 1) at a given position. Producers claim a position with
+ * a compare and exchange, so pushing never blocks: when the ring is
+ * full, soup_logger_ring_push() just fails.
+ */
+
+typedef struct {
+        guint sequence;
+        gpointer data;
+} SoupLoggerRingSlot;
+
+struct _SoupLoggerRing {
+        guint mask;
+        guint push_pos;
+        guint pop_pos;
+        SoupLoggerRingSlot *slots;
+};
+
+SoupLoggerRing *
+soup_logger_ring_new (guint size)
+{
+        SoupLoggerRing *ring;
+        guint i;
+
+        size = 1 << g_bit_storage (MAX (size, 2) - 1);
+
+        ring = g_new0 (SoupLoggerRing, 1);
+        ring->mask = size - 1;
+        ring->slots = g_new0 (SoupLoggerRingSlot, size);
+        for (i = 0; i < size; i++)
+                ring->slots[i].sequence = i;
+
+        return ring;
+}
+
+/* There must be no producers nor consumer left. */
+void
+soup_logger_ring_free (SoupLoggerRing *ring,
+                       GDestroyNotify  free_func)
+{
+        gpointer data;
+
+        while ((data = soup_logger_ring_pop (ring))) {
+                if (free_func)
+                        free_func (data);
+        }
+
+        g_free (ring->slots);
+        g_free (ring);
+}
+
+gboolean
+soup_logger_ring_push (SoupLoggerRing *ring,
+                       gpointer        data)
+{
+        SoupLoggerRingSlot *slot;
+        guint pos;
+        int diff;
+
+        g_return_val_if_fail (data != NULL, FALSE);
+
+        pos = (guint)g_atomic_int_get (&ring->push_pos);
+        for (;;) {
+                slot = &ring->slots[pos & ring->mask];
+                diff = (int)(g_atomic_int_get (&slot->sequence) - pos);
+                if (diff == 0) {
+                        if (g_atomic_int_compare_and_exchange ((int *)&ring->push_pos, pos, pos + 1))
+                                break;
+                        pos = (guint)g_atomic_int_get (&ring->push_pos);
+                } else if (diff < 0) {
+                        return FALSE;
+                } else {
+                        pos = (guint)g_atomic_int_get (&ring->push_pos);
+                }
+        }
+
+        slot->data = data;
+        g_atomic_int_set (&slot->sequence, pos + 1);
+
+        return TRUE;
+}
+
+/* Must only be called from one thread at a time. */
+gpointer
+soup_logger_ring_pop (SoupLoggerRing *ring)
+{
+        SoupLoggerRingSlot *slot;
+        gpointer data;
+
+        slot = &ring->slots[ring->pop_pos & ring->mask];
+        if ((guint)g_atomic_int_get (&slot->sequence) != ring->pop_pos + 1)
+                return NULL;
+
+        data = slot->data;
+        slot->data = NULL;
+        g_atomic_int_set (&slot->sequence, ring->pop_pos + ring->mask + 1);
+        ring->pop_pos++;
+
+        return data;
+}
@@ -0,0 +1,21 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SoupLoggerRing SoupLoggerRing;
+
+SoupLoggerRing *soup_logger_ring_new  (guint           size);
+void            soup_logger_ring_free (SoupLoggerRing *ring,
+                                       GDestroyNotify  free_func);
+gboolean        soup_logger_ring_push (SoupLoggerRing *ring,
+                                       gpointer        data);
+gpointer        soup_logger_ring_pop  (SoupLoggerRing *ring);
+
+G_END_DECLS
@@ -16,6 +16,7 @@
 
 #include "soup-logger-private.h"
 #include "soup-logger-input-stream.h"
+#include "soup-logger-ring.h"
 #include "soup-connection.h"
 #include "soup-message-private.h"
 #include "soup-misc.h"
@@ -83,6 +84,13 @@
  * cancellation before receiving the last byte of the response body, the
  * response will still be logged on the event of the [signal@Message::finished]
  * signal.
+ *
+ * Formatting and printing every line as messages are processed slows
+ * them down noticeably. With [method@Logger.set_structured], the
+ * logger only copies what it needs from each message into a record, and
+ * a separate thread formats the records as text or JSON lines. Use
+ * [method@Logger.set_sample_rate] and [method@Logger.set_hosts] to
+ * skip most messages before any work is done for them.
  **/
 
 struct _SoupLogger {
@@ -111,8 +119,70 @@ typedef struct {
 	SoupLoggerPrinter   printer;
 	gpointer            printer_data;
 	GDestroyNotify      printer_dnotify;
+
+        GQuark              skip_tag;
+        double              sample_rate;
+        guint               n_sampled;
+        char              **hosts;
+
+        /* Structured mode */
+        SoupLoggerFormat    format;
+        SoupLoggerRing     *ring;
+        GThread            *thread;
+        GMutex              thread_mutex;
+        GCond               thread_cond;
+        GCond               flush_cond;
+        gboolean            thread_waiting;
+        gboolean            thread_quit;
+        guint               pushed;
+        guint               written;
+        guint               dropped;
 } SoupLoggerPrivate;
 
+typedef enum {
+        SOUP_LOGGER_RECORD_REQUEST,
+        SOUP_LOGGER_RECORD_RESPONSE,
+        SOUP_LOGGER_RECORD_REQUEST_BODY
+} SoupLoggerRecordType;
+
+enum {
+        RECORD_METHOD,
+        RECORD_HOST,
+        RECORD_PATH,
+        RECORD_QUERY,
+        RECORD_REASON,
+
+        RECORD_N_STRINGS
+};
+
+/* Everything needed to format a request or response later, in a
+ * single allocation. data holds the RECORD_N_STRINGS strings, the
+ * header names and values and finally the body, each of them
+ * NUL-terminated.
+ */
+typedef struct {
+        SoupLoggerRecordType type;
+        SoupLoggerLogLevel   level;
+        gint64               timestamp;
+        GType                session_type;
+        guint                session_id;
+        guint                message_id;
+        GType                socket_type;
+        guint                socket_id;
+        gboolean             restarted;
+        SoupHTTPVersion      http_version;
+        guint                status;
+        guint                port;
+        guint64              fetch_start;
+        guint64              request_start;
+        guint64              response_start;
+        guint64              response_end;
+        guint                n_headers;
+        gboolean             has_body;
+        gsize                body_len;
+        char                 data[];
+} SoupLoggerRecord;
+
 enum {
 	PROP_0,
 
@@ -136,6 +206,8 @@ G_DEFINE_FINAL_TYPE_WITH_CODE (SoupLogger, soup_logger, G_TYPE_OBJECT,
                                G_IMPLEMENT_INTERFACE (SOUP_TYPE_CONTENT_PROCESSOR,
                                                       soup_logger_content_processor_init))
 
+static gboolean soup_logger_is_skipped (SoupLogger *logger, SoupMessage *msg);
+
 static void
 write_body (SoupLogger *logger, const char *buffer, gsize nread,
             gpointer key, GHashTable *bodies)
@@ -174,6 +246,9 @@ soup_logger_log_request_data (SoupLogger *logger, SoupMessage *msg, const char *
 {
         SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
 
+        if (soup_logger_is_skipped (logger, msg))
+                return;
+
         write_body (logger, buffer, len, msg, priv->request_bodies);
 }
 
@@ -198,6 +273,9 @@ soup_logger_content_processor_wrap_input (SoupContentProcessor *processor,
         SoupLoggerInputStream *stream;
         SoupLoggerLogLevel log_level;
 
+        if (soup_logger_is_skipped (logger, msg))
+                return NULL;
+
         if (priv->request_filter)
                 log_level = priv->request_filter (logger, msg,
                                                   priv->response_filter_data);
@@ -248,6 +326,15 @@ soup_logger_init (SoupLogger *logger)
 	priv->request_bodies = g_hash_table_new_full (NULL, NULL, NULL, body_free);
 	priv->response_bodies = g_hash_table_new_full (NULL, NULL, NULL, body_free);
         g_mutex_init (&priv->mutex);
+
+	id = g_strdup_printf ("SoupLogger-%p-skip", logger);
+	priv->skip_tag = g_quark_from_string (id);
+	g_free (id);
+        priv->sample_rate = 1.0;
+
+        g_mutex_init (&priv->thread_mutex);
+        g_cond_init (&priv->thread_cond);
+        g_cond_init (&priv->flush_cond);
 }
 
 static void
@@ -256,6 +343,16 @@ soup_logger_finalize (GObject *object)
 	SoupLogger *logger = SOUP_LOGGER (object);
 	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
 
+        if (priv->thread) {
+                g_mutex_lock (&priv->thread_mutex);
+                priv->thread_quit = TRUE;
+                g_cond_signal (&priv->thread_cond);
+                g_mutex_unlock (&priv->thread_mutex);
+                g_thread_join (priv->thread);
+        }
+        if (priv->ring)
+                soup_logger_ring_free (priv->ring, g_free);
+
 	g_hash_table_destroy (priv->ids);
 	g_hash_table_destroy (priv->request_bodies);
 	g_hash_table_destroy (priv->response_bodies);
@@ -267,7 +364,12 @@ soup_logger_finalize (GObject *object)
 	if (priv->printer_dnotify)
 		priv->printer_dnotify (priv->printer_data);
 
+        g_strfreev (priv->hosts);
+
         g_mutex_clear (&priv->mutex);
+        g_mutex_clear (&priv->thread_mutex);
+        g_cond_clear (&priv->thread_cond);
+        g_cond_clear (&priv->flush_cond);
 
 	G_OBJECT_CLASS (soup_logger_parent_class)->finalize (object);
 }
@@ -472,6 +574,12 @@ soup_logger_set_response_filter (SoupLogger       *logger,
  * @direction is either '<', '>', or ' ', and @data is the single line
  * to print; the printer is expected to add a terminating newline.
  *
+ * If [method@Logger.set_structured] was called, the printer is called
+ * from the thread formatting the records rather than from the thread
+ * the messages are processed in. With %SOUP_LOGGER_FORMAT_JSON, @data
+ * is a whole JSON object for a request or response, and @direction is
+ * '>' or '<' respectively.
+ *
  * To get the effect of the default printer, you would do:
  *
  * ```c
@@ -533,6 +641,215 @@ soup_logger_get_max_body_size (SoupLogger *logger)
         return priv->max_body_size;
 }
 
+static gpointer soup_logger_thread (gpointer user_data);
+
+/**
+ * soup_logger_set_structured:
+ * @logger: a #SoupLogger
+ * @format: the output format
+ * @max_records: the maximum number of records waiting to be printed
+ *
+ * Makes @logger copy the parts of each message to log into a record,
+ * that is formatted as @format and printed from a separate thread.
+ *
+ * Records are queued without locking, up to @max_records (rounded up
+ * to a power of two). When that many are already waiting, new records
+ * are dropped rather than slowing down the messages; see
+ * [method@Logger.get_dropped_records].
+ *
+ * This must be called before @logger is added to a session, and
+ * can't be undone.
+ *
+ * Since: 3.4
+ */
+void
+soup_logger_set_structured (SoupLogger      *logger,
+                            SoupLoggerFormat format,
+                            guint            max_records)
+{
+        SoupLoggerPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_LOGGER (logger));
+
+        priv = soup_logger_get_instance_private (logger);
+        g_return_if_fail (priv->ring == NULL);
+        g_return_if_fail (priv->session == NULL);
+
+        priv->format = format;
+        priv->ring = soup_logger_ring_new (MAX (max_records, 1));
+        priv->thread = g_thread_new ("SoupLogger", soup_logger_thread, logger);
+}
+
+/**
+ * soup_logger_flush:
+ * @logger: a #SoupLogger
+ *
+ * Waits until the records queued so far by @logger have been printed.
+ *
+ * This does nothing unless [method@Logger.set_structured] was called.
+ *
+ * Since: 3.4
+ */
+void
+soup_logger_flush (SoupLogger *logger)
+{
+        SoupLoggerPrivate *priv;
+        guint pushed;
+
+        g_return_if_fail (SOUP_IS_LOGGER (logger));
+
+        priv = soup_logger_get_instance_private (logger);
+        if (!priv->thread)
+                return;
+
+        pushed = g_atomic_int_get (&priv->pushed);
+        g_mutex_lock (&priv->thread_mutex);
+        g_cond_signal (&priv->thread_cond);
+        while ((int)(priv->written - pushed) < 0)
+                g_cond_wait (&priv->flush_cond, &priv->thread_mutex);
+        g_mutex_unlock (&priv->thread_mutex);
+}
+
+/**
+ * soup_logger_get_dropped_records:
+ * @logger: a #SoupLogger
+ *
+ * Gets the number of records dropped by @logger because too many were
+ * waiting to be printed.
+ *
+ * Returns: the number of dropped records
+ *
+ * Since: 3.4
+ */
+guint
+soup_logger_get_dropped_records (SoupLogger *logger)
+{
+        SoupLoggerPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_LOGGER (logger), 0);
+
+        priv = soup_logger_get_instance_private (logger);
+        return g_atomic_int_get (&priv->dropped);
+}
+
+/**
+ * soup_logger_set_sample_rate:
+ * @logger: a #SoupLogger
+ * @sample_rate: the fraction of messages to log, between 0 and 1
+ *
+ * Makes @logger log only a fraction of the messages. Messages are
+ * picked evenly: with a @sample_rate of 0.25, every fourth message is
+ * logged.
+ *
+ * Messages that are not picked are skipped when they are queued,
+ * before the filters set with [method@Logger.set_request_filter] or
+ * [method@Logger.set_response_filter] are called.
+ *
+ * This must be called before @logger is added to a session.
+ *
+ * Since: 3.4
+ */
+void
+soup_logger_set_sample_rate (SoupLogger *logger,
+                             double      sample_rate)
+{
+        SoupLoggerPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_LOGGER (logger));
+        g_return_if_fail (sample_rate >= 0.0 && sample_rate <= 1.0);
+
+        priv = soup_logger_get_instance_private (logger);
+        priv->sample_rate = sample_rate;
+}
+
+/**
+ * soup_logger_set_hosts:
+ * @logger: a #SoupLogger
+ * @hosts: (array zero-terminated=1) (nullable): the hosts to log
+ *   messages for, or %NULL for all of them
+ *
+ * Makes @logger log only the messages sent to one of @hosts. A host
+ * starting with a dot, like ".example.com", matches that domain and
+ * all of its subdomains.
+ *
+ * Like with [method@Logger.set_sample_rate], other messages are
+ * skipped before any work is done for them.
+ *
+ * This must be called before @logger is added to a session.
+ *
+ * Since: 3.4
+ */
+void
+soup_logger_set_hosts (SoupLogger         *logger,
+                       const char * const *hosts)
+{
+        SoupLoggerPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_LOGGER (logger));
+
+        priv = soup_logger_get_instance_private (logger);
+        g_strfreev (priv->hosts);
+        priv->hosts = g_strdupv ((char **)hosts);
+}
+
+static gboolean
+soup_logger_host_matches (SoupLogger *logger,
+                          const char *host)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+        gsize host_len;
+        guint i;
+
+        if (!host)
+                return FALSE;
+
+        host_len = strlen (host);
+        for (i = 0; priv->hosts[i]; i++) {
+                const char *pattern = priv->hosts[i];
+                gsize pattern_len;
+
+                if (*pattern != '.') {
+                        if (!g_ascii_strcasecmp (host, pattern))
+                                return TRUE;
+                        continue;
+                }
+
+                pattern_len = strlen (pattern);
+                if (!g_ascii_strcasecmp (host, pattern + 1) ||
+                    (host_len > pattern_len && !g_ascii_strcasecmp (host + host_len - pattern_len, pattern)))
+                        return TRUE;
+        }
+
+        return FALSE;
+}
+
+static gboolean
+soup_logger_should_skip (SoupLogger  *logger,
+                         SoupMessage *msg)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+        guint n;
+
+        if (priv->hosts && !soup_logger_host_matches (logger, g_uri_get_host (soup_message_get_uri (msg))))
+                return TRUE;
+
+        if (priv->sample_rate >= 1.0)
+                return FALSE;
+
+        /* Log message n when the accumulated rate crosses an integer */
+        n = g_atomic_int_add (&priv->n_sampled, 1);
+        return (guint64)((n + 1) * priv->sample_rate) == (guint64)(n * priv->sample_rate);
+}
+
+static gboolean
+soup_logger_is_skipped (SoupLogger  *logger,
+                        SoupMessage *msg)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+
+        return g_object_get_qdata (G_OBJECT (msg), priv->skip_tag) != NULL;
+}
+
 static guint
 soup_logger_get_id (SoupLogger *logger, gpointer object)
 {
@@ -561,17 +878,13 @@ soup_logger_set_id (SoupLogger *logger, gpointer object)
 static void soup_logger_print (SoupLogger *logger, SoupLoggerLogLevel level,
 			       char direction, const char *format, ...) G_GNUC_PRINTF (4, 5);
 
+/* Prints each line of @data, which is modified */
 static void
-soup_logger_print (SoupLogger *logger, SoupLoggerLogLevel level,
-		   char direction, const char *format, ...)
+soup_logger_print_lines (SoupLogger *logger, SoupLoggerLogLevel level,
+			 char direction, char *data)
 {
 	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
-	va_list args;
-	char *data, *line, *end;
-
-	va_start (args, format);
-	data = g_strdup_vprintf (format, args);
-	va_end (args);
+	char *line, *end;
 
 	line = data;
 	do {
@@ -586,14 +899,30 @@ soup_logger_print (SoupLogger *logger, SoupLoggerLogLevel level,
 
 		line = end + 1;
 	} while (end && *line);
+}
 
+static void
+soup_logger_print (SoupLogger *logger, SoupLoggerLogLevel level,
+		   char direction, const char *format, ...)
+{
+	va_list args;
+	char *data;
+
+	va_start (args, format);
+	data = g_strdup_vprintf (format, args);
+	va_end (args);
+
+	soup_logger_print_lines (logger, level, direction, data);
 	g_free (data);
 }
 
-static void
-soup_logger_print_basic_auth (SoupLogger *logger, const char *value)
+/* Returns the credentials in a Basic Authorization header, with the
+ * password masked.
+ */
+static char *
+soup_logger_mask_basic_auth (const char *value)
 {
-	char *decoded, *decoded_utf8, *p;
+	char *decoded, *decoded_utf8, *p, *masked;
 	gsize len;
 
 	decoded = (char *)g_base64_decode (value + 6, &len);
@@ -615,9 +944,388 @@ soup_logger_print_basic_auth (SoupLogger *logger, const char *value)
 		while (++p < decoded + len)
 			*p = '*';
 	}
-	soup_logger_print (logger, SOUP_LOGGER_LOG_HEADERS, '>',
-			   "Authorization: Basic [%.*s]", (int)len, decoded);
+	masked = g_strndup (decoded, len);
 	g_free (decoded);
+
+	return masked;
+}
+
+static void
+soup_logger_print_basic_auth (SoupLogger *logger, const char *value)
+{
+	char *masked;
+
+	masked = soup_logger_mask_basic_auth (value);
+	soup_logger_print (logger, SOUP_LOGGER_LOG_HEADERS, '>',
+			   "Authorization: Basic [%s]", masked);
+	g_free (masked);
+}
+
+static const char *
+record_next_string (const char *str)
+{
+        return str + strlen (str) + 1;
+}
+
+static SoupLoggerRecord *
+soup_logger_record_new (SoupLoggerRecordType type,
+                        SoupLoggerLogLevel   level,
+                        SoupMessage         *msg,
+                        GString             *body)
+{
+        SoupLoggerRecord *record;
+        SoupMessageHeaders *headers = NULL;
+        SoupMessageHeadersIter iter;
+        SoupMessageMetrics *metrics;
+        const char *strings[RECORD_N_STRINGS] = { NULL, };
+        const char *name, *value;
+        gsize size = 0;
+        char *p;
+        GUri *uri;
+        guint i;
+
+        uri = soup_message_get_uri (msg);
+        if (type == SOUP_LOGGER_RECORD_REQUEST) {
+                strings[RECORD_METHOD] = soup_message_get_method (msg);
+                strings[RECORD_HOST] = g_uri_get_host (uri);
+                strings[RECORD_PATH] = g_uri_get_path (uri);
+                strings[RECORD_QUERY] = g_uri_get_query (uri);
+                headers = soup_message_get_request_headers (msg);
+        } else if (type == SOUP_LOGGER_RECORD_RESPONSE) {
+                strings[RECORD_REASON] = soup_message_get_reason_phrase (msg);
+                headers = soup_message_get_response_headers (msg);
+        }
+
+        for (i = 0; i < RECORD_N_STRINGS; i++) {
+                if (!strings[i])
+                        strings[i] = "";
+                size += strlen (strings[i]) + 1;
+        }
+
+        if (level < SOUP_LOGGER_LOG_HEADERS)
+                headers = NULL;
+        if (headers) {
+                soup_message_headers_iter_init (&iter, headers);
+                while (soup_message_headers_iter_next (&iter, &name, &value))
+                        size += strlen (name) + strlen (value) + 2;
+        }
+
+        if (body)
+                size += body->len + 1;
+
+        record = g_malloc0 (sizeof (SoupLoggerRecord) + size);
+        record->type = type;
+        record->level = level;
+        record->timestamp = g_get_real_time ();
+        record->http_version = soup_message_get_http_version (msg);
+        record->status = soup_message_get_status (msg);
+        record->port = g_uri_get_port (uri);
+
+        metrics = soup_message_get_metrics (msg);
+        if (metrics) {
+                record->fetch_start = soup_message_metrics_get_fetch_start (metrics);
+                record->request_start = soup_message_metrics_get_request_start (metrics);
+                record->response_start = soup_message_metrics_get_response_start (metrics);
+                record->response_end = soup_message_metrics_get_response_end (metrics);
+        }
+
+        p = record->data;
+        for (i = 0; i < RECORD_N_STRINGS; i++)
+                p = g_stpcpy (p, strings[i]) + 1;
+
+        if (headers) {
+                soup_message_headers_iter_init (&iter, headers);
+                while (soup_message_headers_iter_next (&iter, &name, &value)) {
+                        p = g_stpcpy (p, name) + 1;
+                        p = g_stpcpy (p, value) + 1;
+                        record->n_headers++;
+                }
+        }
+
+        if (body) {
+                memcpy (p, body->str, body->len);
+                record->has_body = TRUE;
+                record->body_len = body->len;
+        }
+
+        return record;
+}
+
+static void
+soup_logger_queue_record (SoupLogger       *logger,
+                          SoupLoggerRecord *record)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+
+        if (!soup_logger_ring_push (priv->ring, record)) {
+                g_atomic_int_inc (&priv->dropped);
+                g_free (record);
+                return;
+        }
+
+        g_atomic_int_inc (&priv->pushed);
+
+        /* The thread sets thread_waiting before checking the ring
+         * one last time, so it either sees the record or is woken up.
+         */
+        if (g_atomic_int_get (&priv->thread_waiting)) {
+                g_mutex_lock (&priv->thread_mutex);
+                g_cond_signal (&priv->thread_cond);
+                g_mutex_unlock (&priv->thread_mutex);
+        }
+}
+
+static void
+append_json_timing (GString    *str,
+                    const char *name,
+                    guint64     start,
+                    guint64     end)
+{
+        if (!start || end < start)
+                return;
+
+        g_string_append_printf (str, ",\"%s\":%" G_GUINT64_FORMAT, name, end - start);
+}
+
+static void
+soup_logger_write_json (SoupLogger       *logger,
+                        SoupLoggerRecord *record,
+                        GString          *str)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+        const char *strings[RECORD_N_STRINGS];
+        const char *p = record->data;
+        GDateTime *date, *tmp;
+        char *time;
+        guint i;
+
+        for (i = 0; i < RECORD_N_STRINGS; i++) {
+                strings[i] = p;
+                p = record_next_string (p);
+        }
+
+        tmp = g_date_time_new_from_unix_utc (record->timestamp / G_USEC_PER_SEC);
+        date = g_date_time_add (tmp, record->timestamp % G_USEC_PER_SEC);
+        time = g_date_time_format_iso8601 (date);
+        g_date_time_unref (date);
+        g_date_time_unref (tmp);
+
+        g_string_truncate (str, 0);
+        g_string_append_printf (str, "{\"type\":\"%s\",\"time\":\"%s\",\"message\":%u",
+                                record->type == SOUP_LOGGER_RECORD_RESPONSE ? "response" :
+                                record->type == SOUP_LOGGER_RECORD_REQUEST ? "request" : "request-body",
+                                time, record->message_id);
+        g_free (time);
+
+        switch (record->type) {
+        case SOUP_LOGGER_RECORD_REQUEST:
+                g_string_append_printf (str, ",\"session\":%u", record->session_id);
+                if (record->socket_id)
+                        g_string_append_printf (str, ",\"socket\":%u", record->socket_id);
+                g_string_append_printf (str, ",\"restarted\":%s,\"method\":",
+                                        record->restarted ? "true" : "false");
+                soup_json_append_string (str, strings[RECORD_METHOD], -1);
+                g_string_append (str, ",\"host\":");
+                soup_json_append_string (str, strings[RECORD_HOST], -1);
+                g_string_append_printf (str, ",\"port\":%u,\"path\":", record->port);
+                soup_json_append_string (str, strings[RECORD_PATH], -1);
+                if (*strings[RECORD_QUERY]) {
+                        g_string_append (str, ",\"query\":");
+                        soup_json_append_string (str, strings[RECORD_QUERY], -1);
+                }
+                g_string_append_printf (str, ",\"http_version\":\"%s\"",
+                                        soup_http_version_to_string (record->http_version));
+                break;
+        case SOUP_LOGGER_RECORD_RESPONSE:
+                g_string_append_printf (str, ",\"status\":%u,\"reason\":", record->status);
+                soup_json_append_string (str, strings[RECORD_REASON], -1);
+                g_string_append_printf (str, ",\"http_version\":\"%s\"",
+                                        soup_http_version_to_string (record->http_version));
+                if (record->fetch_start) {
+                        /* Microseconds since the message was queued */
+                        g_string_append (str, ",\"timing\":{\"unit\":\"us\"");
+                        append_json_timing (str, "request_start", record->fetch_start, record->request_start);
+                        append_json_timing (str, "response_start", record->fetch_start, record->response_start);
+                        append_json_timing (str, "response_end", record->fetch_start, record->response_end);
+                        g_string_append_c (str, '}');
+                }
+                break;
+        case SOUP_LOGGER_RECORD_REQUEST_BODY:
+                break;
+        }
+
+        if (record->n_headers) {
+                g_string_append (str, ",\"headers\":[");
+                for (i = 0; i < record->n_headers; i++) {
+                        const char *name = p;
+                        const char *value = record_next_string (name);
+
+                        p = record_next_string (value);
+                        g_string_append (str, i ? ",[" : "[");
+                        soup_json_append_string (str, name, -1);
+                        g_string_append_c (str, ',');
+                        if (!g_ascii_strcasecmp (name, "Authorization") &&
+                            !g_ascii_strncasecmp (value, "Basic ", 6)) {
+                                char *masked = soup_logger_mask_basic_auth (value);
+                                char *header = g_strdup_printf ("Basic [%s]", masked);
+
+                                soup_json_append_string (str, header, -1);
+                                g_free (header);
+                                g_free (masked);
+                        } else
+                                soup_json_append_string (str, value, -1);
+                        g_string_append_c (str, ']');
+                }
+                g_string_append_c (str, ']');
+        }
+
+        if (record->has_body) {
+                g_string_append (str, ",\"body\":");
+                soup_json_append_string (str, p, record->body_len);
+        }
+
+        g_string_append_c (str, '}');
+
+        if (priv->printer) {
+                priv->printer (logger, record->level,
+                               record->type == SOUP_LOGGER_RECORD_RESPONSE ? '<' : '>',
+                               str->str, priv->printer_data);
+        } else
+                printf ("%s\n", str->str);
+}
+
+static void
+soup_logger_write_text (SoupLogger       *logger,
+                        SoupLoggerRecord *record,
+                        GString          *str)
+{
+        const char *strings[RECORD_N_STRINGS];
+        const char *p = record->data;
+        char direction;
+        guint i;
+
+        for (i = 0; i < RECORD_N_STRINGS; i++) {
+                strings[i] = p;
+                p = record_next_string (p);
+        }
+
+        direction = record->type == SOUP_LOGGER_RECORD_RESPONSE ? '<' : '>';
+        g_string_truncate (str, 0);
+
+        switch (record->type) {
+        case SOUP_LOGGER_RECORD_REQUEST:
+                if (!strcmp (strings[RECORD_METHOD], SOUP_METHOD_CONNECT)) {
+                        g_string_append_printf (str, "CONNECT %s:%u HTTP/%s\n",
+                                                strings[RECORD_HOST], record->port,
+                                                soup_http_version_to_string (record->http_version));
+                } else {
+                        g_string_append_printf (str, "%s %s%s%s HTTP/%s\n",
+                                                strings[RECORD_METHOD], strings[RECORD_PATH],
+                                                *strings[RECORD_QUERY] ? "?" : "",
+                                                strings[RECORD_QUERY],
+                                                soup_http_version_to_string (record->http_version));
+                }
+                g_string_append_printf (str, "Soup-Debug-Timestamp: %lu\n",
+                                        (unsigned long)(record->timestamp / G_USEC_PER_SEC));
+                g_string_append_printf (str, "Soup-Debug: %s %u, SoupMessage %u, ",
+                                        g_type_name (record->session_type), record->session_id,
+                                        record->message_id);
+                if (record->socket_id) {
+                        g_string_append_printf (str, "%s %u",
+                                                g_type_name (record->socket_type), record->socket_id);
+                } else
+                        g_string_append (str, "cached");
+                if (record->restarted)
+                        g_string_append (str, ", restarted");
+                break;
+        case SOUP_LOGGER_RECORD_RESPONSE:
+                g_string_append_printf (str, "HTTP/%s %u %s\n",
+                                        soup_http_version_to_string (record->http_version),
+                                        record->status, strings[RECORD_REASON]);
+                g_string_append_printf (str, "Soup-Debug-Timestamp: %lu\n",
+                                        (unsigned long)(record->timestamp / G_USEC_PER_SEC));
+                g_string_append_printf (str, "Soup-Debug: SoupMessage %u", record->message_id);
+                break;
+        case SOUP_LOGGER_RECORD_REQUEST_BODY:
+                g_string_append (str, "[Now sending request body...]");
+                break;
+        }
+        soup_logger_print_lines (logger, SOUP_LOGGER_LOG_MINIMAL, direction, str->str);
+
+        for (i = 0; i < record->n_headers; i++) {
+                const char *name = p;
+                const char *value = record_next_string (name);
+
+                p = record_next_string (value);
+                g_string_truncate (str, 0);
+                if (!g_ascii_strcasecmp (name, "Authorization") &&
+                    !g_ascii_strncasecmp (value, "Basic ", 6)) {
+                        char *masked = soup_logger_mask_basic_auth (value);
+
+                        g_string_append_printf (str, "Authorization: Basic [%s]", masked);
+                        g_free (masked);
+                } else
+                        g_string_append_printf (str, "%s: %s", name, value);
+                soup_logger_print_lines (logger, SOUP_LOGGER_LOG_HEADERS, direction, str->str);
+        }
+
+        if (record->has_body) {
+                g_string_truncate (str, 0);
+                g_string_append_c (str, '\n');
+                g_string_append_len (str, p, record->body_len);
+                soup_logger_print_lines (logger, SOUP_LOGGER_LOG_BODY, direction, str->str);
+        }
+
+        g_string_assign (str, "\n");
+        soup_logger_print_lines (logger, SOUP_LOGGER_LOG_MINIMAL, ' ', str->str);
+}
+
+static gpointer
+soup_logger_thread (gpointer user_data)
+{
+        SoupLogger *logger = user_data;
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+        SoupLoggerRecord *record = NULL;
+        GString *str = g_string_new (NULL);
+        guint written = 0;
+
+        for (;;) {
+                if (!record)
+                        record = soup_logger_ring_pop (priv->ring);
+                if (record) {
+                        if (priv->format == SOUP_LOGGER_FORMAT_JSON)
+                                soup_logger_write_json (logger, record, str);
+                        else
+                                soup_logger_write_text (logger, record, str);
+                        g_clear_pointer (&record, g_free);
+                        written++;
+                        continue;
+                }
+
+                if (!priv->printer)
+                        fflush (stdout);
+
+                g_mutex_lock (&priv->thread_mutex);
+                priv->written += written;
+                written = 0;
+                g_cond_broadcast (&priv->flush_cond);
+
+                if (priv->thread_quit) {
+                        g_mutex_unlock (&priv->thread_mutex);
+                        break;
+                }
+
+                g_atomic_int_set (&priv->thread_waiting, TRUE);
+                record = soup_logger_ring_pop (priv->ring);
+                if (!record)
+                        g_cond_wait (&priv->thread_cond, &priv->thread_mutex);
+                g_atomic_int_set (&priv->thread_waiting, FALSE);
+                g_mutex_unlock (&priv->thread_mutex);
+        }
+
+        g_string_free (str, TRUE);
+
+        return NULL;
 }
 
 static void
@@ -755,6 +1463,118 @@ print_response (SoupLogger *logger, SoupMessage *msg)
 	g_string_free (body, TRUE);
 }
 
+static SoupLoggerLogLevel
+soup_logger_get_response_level (SoupLogger  *logger,
+                                SoupMessage *msg)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+
+	if (priv->response_filter)
+		return priv->response_filter (logger, msg, priv->response_filter_data);
+	return priv->level;
+}
+
+static GString *
+soup_logger_steal_body (SoupLogger  *logger,
+                        GHashTable  *bodies,
+                        SoupMessage *msg)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+        GString *body = NULL;
+
+        g_mutex_lock (&priv->mutex);
+        g_hash_table_steal_extended (bodies, msg, NULL, (gpointer *)&body);
+        g_mutex_unlock (&priv->mutex);
+
+        return body;
+}
+
+static void
+queue_request (SoupLogger  *logger,
+               SoupMessage *msg,
+               GSocket     *socket,
+               gboolean     restarted)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+        SoupLoggerRecord *record;
+	SoupLoggerLogLevel log_level;
+        GString *body = NULL;
+
+	if (priv->request_filter) {
+		log_level = priv->request_filter (logger, msg,
+						  priv->request_filter_data);
+	} else
+		log_level = priv->level;
+
+	if (log_level == SOUP_LOGGER_LOG_NONE)
+		return;
+
+        /* will be logged in got_informational */
+        if (log_level == SOUP_LOGGER_LOG_BODY &&
+            soup_message_headers_get_expectations (soup_message_get_request_headers (msg)) != SOUP_EXPECTATION_CONTINUE)
+                body = soup_logger_steal_body (logger, priv->request_bodies, msg);
+
+        record = soup_logger_record_new (SOUP_LOGGER_RECORD_REQUEST, log_level, msg, body);
+        record->session_type = G_OBJECT_TYPE (priv->session);
+        record->session_id = soup_logger_get_id (logger, priv->session);
+        record->message_id = soup_logger_get_id (logger, msg);
+        if (socket) {
+                record->socket_type = G_OBJECT_TYPE (socket);
+                record->socket_id = soup_logger_get_id (logger, socket);
+        }
+        record->restarted = restarted;
+        if (body)
+                g_string_free (body, TRUE);
+
+        soup_logger_queue_record (logger, record);
+}
+
+static SoupLoggerLogLevel
+queue_response (SoupLogger  *logger,
+                SoupMessage *msg)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+        SoupLoggerRecord *record;
+	SoupLoggerLogLevel log_level;
+        GString *body = NULL;
+
+        log_level = soup_logger_get_response_level (logger, msg);
+	if (log_level == SOUP_LOGGER_LOG_NONE)
+		return log_level;
+
+        if (log_level == SOUP_LOGGER_LOG_BODY)
+                body = soup_logger_steal_body (logger, priv->response_bodies, msg);
+
+        record = soup_logger_record_new (SOUP_LOGGER_RECORD_RESPONSE, log_level, msg, body);
+        record->message_id = soup_logger_get_id (logger, msg);
+        if (body)
+                g_string_free (body, TRUE);
+
+        soup_logger_queue_record (logger, record);
+
+        return log_level;
+}
+
+static void
+queue_request_body (SoupLogger         *logger,
+                    SoupMessage        *msg,
+                    SoupLoggerLogLevel  log_level)
+{
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
+        SoupLoggerRecord *record;
+        GString *body = NULL;
+
+        if (log_level == SOUP_LOGGER_LOG_BODY)
+                body = soup_logger_steal_body (logger, priv->request_bodies, msg);
+
+        record = soup_logger_record_new (SOUP_LOGGER_RECORD_REQUEST_BODY, log_level, msg, body);
+        record->message_id = soup_logger_get_id (logger, msg);
+        if (body)
+                g_string_free (body, TRUE);
+
+        soup_logger_queue_record (logger, record);
+}
+
 static void
 finished (SoupMessage *msg, gpointer user_data)
 {
@@ -767,6 +1587,11 @@ finished (SoupMessage *msg, gpointer user_data)
         if (!soup_logger_get_id (logger, msg))
                 return;
 
+        if (priv->ring) {
+                queue_response (logger, msg);
+                return;
+        }
+
         g_mutex_lock (&priv->mutex);
 	print_response (logger, msg);
 	soup_logger_print (logger, SOUP_LOGGER_LOG_MINIMAL, ' ', "\n");
@@ -781,6 +1606,15 @@ got_informational (SoupMessage *msg, gpointer user_data)
         SoupLoggerLogLevel log_level;
         GString *body = NULL;
 
+        if (priv->ring) {
+                g_signal_handlers_disconnect_by_func (msg, finished, logger);
+                log_level = queue_response (logger, msg);
+                if (log_level != SOUP_LOGGER_LOG_NONE &&
+                    soup_message_get_status (msg) == SOUP_STATUS_CONTINUE)
+                        queue_request_body (logger, msg, log_level);
+                return;
+        }
+
         g_mutex_lock (&priv->mutex);
 
         if (priv->response_filter)
@@ -821,6 +1655,12 @@ got_body (SoupMessage *msg, gpointer user_data)
 	SoupLogger *logger = user_data;
         SoupLoggerPrivate *priv = soup_logger_get_instance_private (logger);
 
+        if (priv->ring) {
+                g_signal_handlers_disconnect_by_func (msg, finished, logger);
+                queue_response (logger, msg);
+                return;
+        }
+
         g_mutex_lock (&priv->mutex);
 
 	g_signal_handlers_disconnect_by_func (msg, finished, logger);
@@ -860,6 +1700,11 @@ wrote_body (SoupMessage *msg, gpointer user_data)
 	if (socket && !soup_logger_get_id (logger, socket))
 		soup_logger_set_id (logger, socket);
 
+        if (priv->ring) {
+                queue_request (logger, msg, socket, restarted);
+                return;
+        }
+
         g_mutex_lock (&priv->mutex);
 	print_request (logger, msg, socket, restarted);
 	soup_logger_print (logger, SOUP_LOGGER_LOG_MINIMAL, ' ', "\n");
@@ -870,8 +1715,16 @@ static void
 soup_logger_request_queued (SoupSessionFeature *logger,
 			    SoupMessage        *msg)
 {
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (SOUP_LOGGER (logger));
+
 	g_return_if_fail (SOUP_IS_MESSAGE (msg));
 
+        /* Sampling and host filtering happen before any other work */
+        if (soup_logger_should_skip (SOUP_LOGGER (logger), msg)) {
+                g_object_set_qdata (G_OBJECT (msg), priv->skip_tag, GINT_TO_POINTER (TRUE));
+                return;
+        }
+
 	g_signal_connect (msg, "wrote-body",
 				G_CALLBACK (wrote_body),
 				logger);
@@ -890,8 +1743,12 @@ static void
 soup_logger_request_unqueued (SoupSessionFeature *logger,
 			      SoupMessage        *msg)
 {
+	SoupLoggerPrivate *priv = soup_logger_get_instance_private (SOUP_LOGGER (logger));
+
 	g_return_if_fail (SOUP_IS_MESSAGE (msg));
 
+        g_object_set_qdata (G_OBJECT (msg), priv->skip_tag, NULL);
+
 	g_signal_handlers_disconnect_by_data (msg, logger);
 }
 
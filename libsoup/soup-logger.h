@@ -20,6 +20,11 @@ typedef enum {
 	SOUP_LOGGER_LOG_BODY
 } SoupLoggerLogLevel;
 
+typedef enum {
+	SOUP_LOGGER_FORMAT_TEXT,
+	SOUP_LOGGER_FORMAT_JSON
+} SoupLoggerFormat;
+
 typedef SoupLoggerLogLevel (*SoupLoggerFilter)  (SoupLogger         *logger,
 						 SoupMessage        *msg,
 						 gpointer            user_data);
@@ -58,4 +63,23 @@ void        soup_logger_set_max_body_size  (SoupLogger        *logger,
 SOUP_AVAILABLE_IN_ALL
 int         soup_logger_get_max_body_size  (SoupLogger        *logger);
 
+SOUP_AVAILABLE_IN_3_4
+void        soup_logger_set_structured     (SoupLogger        *logger,
+					     SoupLoggerFormat   format,
+					     guint              max_records);
+
+SOUP_AVAILABLE_IN_3_4
+void        soup_logger_flush              (SoupLogger        *logger);
+
+SOUP_AVAILABLE_IN_3_4
+guint       soup_logger_get_dropped_records (SoupLogger       *logger);
+
+SOUP_AVAILABLE_IN_3_4
+void        soup_logger_set_sample_rate    (SoupLogger        *logger,
+					     double             sample_rate);
+
+SOUP_AVAILABLE_IN_3_4
+void        soup_logger_set_hosts          (SoupLogger        *logger,
+					     const char * const *hosts);
+
 G_END_DECLS
@@ -16,6 +16,7 @@ struct _SoupMessageMetrics {
         guint64 connect_start;
         guint64 connect_end;
         guint64 tls_start;
+        guint64 tls_end;
         guint64 request_start;
         guint64 response_start;
         guint64 response_end;
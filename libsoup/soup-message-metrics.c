@@ -196,6 +196,29 @@ soup_message_metrics_get_tls_start (SoupMessageMetrics *metrics)
         return metrics->tls_start;
 }
 
+/**
+ * soup_message_metrics_get_tls_end:
+ * @metrics: a #SoupMessageMetrics
+ *
+ * Get the time immediately after the [class@Message] completed the
+ * TLS handshake.
+ *
+ * It will be 0 if no TLS handshake was required to fetch the resource
+ * (connection was not secure, a persistent connection was used or resource was
+ * loaded from the local disk cache).
+ *
+ * Returns: the tls end time
+ *
+ * Since: 3.4
+ */
+guint64
+soup_message_metrics_get_tls_end (SoupMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->tls_end;
+}
+
 /**
  * soup_message_metrics_get_request_start:
  * @metrics: a #SoupMessageMetrics
@@ -39,6 +39,9 @@ guint64             soup_message_metrics_get_connect_end    (SoupMessageMetrics
 SOUP_AVAILABLE_IN_ALL
 guint64             soup_message_metrics_get_tls_start      (SoupMessageMetrics *metrics);
 
+SOUP_AVAILABLE_IN_3_4
+guint64             soup_message_metrics_get_tls_end        (SoupMessageMetrics *metrics);
+
 SOUP_AVAILABLE_IN_ALL
 guint64             soup_message_metrics_get_request_start  (SoupMessageMetrics *metrics);
 
@@ -134,6 +134,7 @@ typedef enum {
         SOUP_MESSAGE_METRICS_CONNECT_START,
         SOUP_MESSAGE_METRICS_CONNECT_END,
         SOUP_MESSAGE_METRICS_TLS_START,
+        SOUP_MESSAGE_METRICS_TLS_END,
         SOUP_MESSAGE_METRICS_REQUEST_START,
         SOUP_MESSAGE_METRICS_RESPONSE_START,
         SOUP_MESSAGE_METRICS_RESPONSE_END
@@ -141,6 +142,11 @@ typedef enum {
 
 void soup_message_set_metrics_timestamp (SoupMessage           *msg,
                                          SoupMessageMetricsType type);
+void soup_message_enable_metrics        (SoupMessage           *msg);
+
+void         soup_message_set_error (SoupMessage  *msg,
+                                     const GError *error);
+const GError *soup_message_get_error (SoupMessage *msg);
 
 void soup_message_set_request_host_from_uri     (SoupMessage *msg,
                                                  GUri        *uri);
@@ -158,4 +164,8 @@ void     soup_message_set_is_misdirected_retry  (SoupMessage *msg,
                                                  gboolean     is_misdirected_retry);
 gboolean soup_message_is_misdirected_retry      (SoupMessage *msg);
 
+void        soup_message_set_connect_protocol   (SoupMessage *msg,
+                                                 const char  *protocol);
+const char *soup_message_get_connect_protocol   (SoupMessage *msg);
+
 #endif /* __SOUP_MESSAGE_PRIVATE_H__ */
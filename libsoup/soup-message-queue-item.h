@@ -42,6 +42,7 @@ struct _SoupMessageQueueItem {
         guint connect_only : 1;
         guint resend_count : 5;
         int io_priority;
+        gint64 queued_time;
 
         SoupMessageQueueItemState state;
         SoupMessageQueueItem *related;
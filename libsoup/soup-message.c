@@ -97,9 +97,11 @@ typedef struct {
         gboolean is_misdirected_retry;
         guint    last_connection_id;
         guint8   force_http_version;
+        char *connect_protocol;
         GSocketAddress *remote_address;
 
         SoupMessageMetrics *metrics;
+        GError *error;
 } SoupMessagePrivate;
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupMessage, soup_message, G_TYPE_OBJECT)
@@ -199,6 +201,8 @@ soup_message_finalize (GObject *object)
 	g_clear_pointer (&priv->site_for_cookies, g_uri_unref);
         g_clear_pointer (&priv->metrics, soup_message_metrics_free);
         g_clear_pointer (&priv->tls_ciphersuite_name, g_free);
+        g_clear_pointer (&priv->connect_protocol, g_free);
+        g_clear_error (&priv->error);
 
 	g_clear_object (&priv->auth);
 	g_clear_object (&priv->proxy_auth);
@@ -1586,6 +1590,7 @@ soup_message_set_metrics_timestamp_for_network_event (SoupMessage       *msg,
                 soup_message_set_metrics_timestamp (msg, SOUP_MESSAGE_METRICS_TLS_START);
                 break;
         case G_SOCKET_CLIENT_TLS_HANDSHAKED:
+                soup_message_set_metrics_timestamp (msg, SOUP_MESSAGE_METRICS_TLS_END);
                 break;
         case G_SOCKET_CLIENT_COMPLETE:
                 soup_message_set_metrics_timestamp (msg, SOUP_MESSAGE_METRICS_CONNECT_END);
@@ -1872,6 +1877,7 @@ soup_message_cleanup_response (SoupMessage *msg)
 
         soup_message_set_status (msg, SOUP_STATUS_NONE, NULL);
         soup_message_set_http_version (msg, priv->orig_http_version);
+        g_clear_error (&priv->error);
 
         connection = g_weak_ref_get (&priv->connection);
         if (!connection) {
@@ -3206,6 +3212,9 @@ soup_message_set_metrics_timestamp (SoupMessage           *msg,
         case SOUP_MESSAGE_METRICS_TLS_START:
                 metrics->tls_start = timestamp;
                 break;
+        case SOUP_MESSAGE_METRICS_TLS_END:
+                metrics->tls_end = timestamp;
+                break;
         case SOUP_MESSAGE_METRICS_REQUEST_START:
                 metrics->request_start = timestamp;
                 break;
@@ -3222,6 +3231,22 @@ soup_message_set_metrics_timestamp (SoupMessage           *msg,
         }
 }
 
+/* Makes metrics be collected for @msg, for features that need them
+ * from a request_queued() implementation.
+ */
+void
+soup_message_enable_metrics (SoupMessage *msg)
+{
+        if (soup_message_query_flags (msg, SOUP_MESSAGE_COLLECT_METRICS))
+                return;
+
+        /* The fetch start was already set by the session, if metrics
+         * were being collected.
+         */
+        soup_message_add_flags (msg, SOUP_MESSAGE_COLLECT_METRICS);
+        soup_message_set_metrics_timestamp (msg, SOUP_MESSAGE_METRICS_FETCH_START);
+}
+
 void
 soup_message_set_request_host_from_uri (SoupMessage *msg,
                                         GUri        *uri)
@@ -3317,6 +3342,24 @@ soup_message_is_misdirected_retry (SoupMessage *msg)
         return priv->is_misdirected_retry;
 }
 
+void
+soup_message_set_connect_protocol (SoupMessage *msg,
+                                   const char  *protocol)
+{
+        SoupMessagePrivate *priv = soup_message_get_instance_private (msg);
+
+        g_free (priv->connect_protocol);
+        priv->connect_protocol = g_strdup (protocol);
+}
+
+const char *
+soup_message_get_connect_protocol (SoupMessage *msg)
+{
+        SoupMessagePrivate *priv = soup_message_get_instance_private (msg);
+
+        return priv->connect_protocol;
+}
+
 /**
  * soup_message_set_force_http1:
  * @msg: The #SoupMessage
@@ -3355,3 +3398,25 @@ soup_message_get_force_http1 (SoupMessage *msg)
 
 	return soup_message_get_force_http_version (msg) == SOUP_HTTP_1_1;
 }
+
+/* The error the session finished @msg with, if any. It's set just
+ * before the message is unqueued, for session features to see it.
+ */
+void
+soup_message_set_error (SoupMessage  *msg,
+                        const GError *error)
+{
+        SoupMessagePrivate *priv = soup_message_get_instance_private (msg);
+
+        g_clear_error (&priv->error);
+        if (error)
+                priv->error = g_error_copy (error);
+}
+
+const GError *
+soup_message_get_error (SoupMessage *msg)
+{
+        SoupMessagePrivate *priv = soup_message_get_instance_private (msg);
+
+        return priv->error;
+}
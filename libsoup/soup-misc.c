@@ -305,3 +305,53 @@ soup_http_version_to_string (SoupHTTPVersion version)
         g_assert_not_reached ();
         return NULL;
 }
+
+/* Appends @value, of @len bytes or NUL-terminated if @len is -1, to
+ * @str as a JSON string. Invalid UTF-8 is replaced.
+ */
+void
+soup_json_append_string (GString    *str,
+                         const char *value,
+                         gssize      len)
+{
+        char *valid = NULL;
+        const char *p, *end;
+
+        if (len < 0)
+                len = strlen (value);
+        if (!g_utf8_validate_len (value, len, NULL)) {
+                valid = g_utf8_make_valid (value, len);
+                value = valid;
+                len = strlen (valid);
+        }
+
+        g_string_append_c (str, '"');
+        for (p = value, end = value + len; p < end; p++) {
+                switch (*p) {
+                case '"':
+                        g_string_append (str, "\\\"");
+                        break;
+                case '\\':
+                        g_string_append (str, "\\\\");
+                        break;
+                case '\n':
+                        g_string_append (str, "\\n");
+                        break;
+                case '\r':
+                        g_string_append (str, "\\r");
+                        break;
+                case '\t':
+                        g_string_append (str, "\\t");
+                        break;
+                default:
+                        if ((guchar)*p < 0x20)
+                                g_string_append_printf (str, "\\u%04x", (guchar)*p);
+                        else
+                                g_string_append_c (str, *p);
+                        break;
+                }
+        }
+        g_string_append_c (str, '"');
+
+        g_free (valid);
+}
@@ -77,6 +77,10 @@ gchar *soup_get_accept_languages_from_system (void);
 
 const char *soup_http_version_to_string (SoupHTTPVersion version);
 
+void soup_json_append_string (GString    *str,
+                              const char *value,
+                              gssize      len);
+
 G_END_DECLS
 
 #endif /* __SOUP_MISC_H__ */
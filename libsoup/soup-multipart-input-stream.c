@@ -58,6 +58,10 @@ typedef struct {
 	GByteArray	        *meta_buf;
 	SoupMessageHeaders      *current_headers;
 
+	/* Part headers can be read over several non-blocking calls */
+	gboolean                 reading_headers;
+	gboolean                 got_part_boundary;
+
 	SoupFilterInputStream   *base_stream;
 
 	char		        *boundary;
@@ -357,37 +361,50 @@ soup_multipart_input_stream_parse_headers (SoupMultipartInputStream *multipart)
 
 static gboolean
 soup_multipart_input_stream_read_headers (SoupMultipartInputStream  *multipart,
+					  gboolean                   blocking,
 					  GCancellable		    *cancellable,
 					  GError		   **error)
 {
 	SoupMultipartInputStreamPrivate *priv = soup_multipart_input_stream_get_instance_private (multipart);
 	guchar read_buf[RESPONSE_BLOCK_SIZE];
 	guchar *buf;
-	gboolean got_boundary = FALSE;
 	gboolean got_lf = FALSE;
 	gssize nread = 0;
+	GError *my_error = NULL;
 
 	g_return_val_if_fail (priv->boundary != NULL, TRUE);
 
-	g_clear_pointer (&priv->current_headers, soup_message_headers_unref);
+	/* Resume where a previous non-blocking call left off */
+	if (!priv->reading_headers) {
+		g_clear_pointer (&priv->current_headers, soup_message_headers_unref);
+		priv->got_part_boundary = FALSE;
+		priv->reading_headers = TRUE;
+	}
 
 	while (1) {
 		nread = soup_filter_input_stream_read_line (priv->base_stream, read_buf, sizeof (read_buf),
-							    /* blocking */ TRUE, &got_lf, cancellable, error);
+							    blocking, &got_lf, cancellable, &my_error);
 
-		if (nread <= 0)
+		if (nread <= 0) {
+			if (g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+				g_propagate_error (error, my_error);
+				return FALSE;
+			}
+			if (my_error)
+				g_propagate_error (error, my_error);
 			break;
+		}
 
 		g_byte_array_append (priv->meta_buf, read_buf, nread);
 
 		/* Need to do this boundary check before checking for the line feed, since we
 		 * may get the multipart end indicator without getting a new line.
 		 */
-		if (!got_boundary &&
+		if (!priv->got_part_boundary &&
 		    !strncmp ((char *)priv->meta_buf->data,
 			      priv->boundary,
 			      priv->boundary_size)) {
-			got_boundary = TRUE;
+			priv->got_part_boundary = TRUE;
 
 			/* Now check for possible multipart termination. */
 			buf = &read_buf[nread - 4];
@@ -395,6 +412,7 @@ soup_multipart_input_stream_read_headers (SoupMultipartInputStream  *multipart,
 			    (nread >= 3 && !memcmp (buf + 1, "--\n", 3)) ||
 			    (nread >= 3 && !memcmp (buf + 2, "--", 2))) {
 				g_byte_array_set_size (priv->meta_buf, 0);
+				priv->reading_headers = FALSE;
 				return FALSE;
 			}
 		}
@@ -402,7 +420,7 @@ soup_multipart_input_stream_read_headers (SoupMultipartInputStream  *multipart,
 		g_return_val_if_fail (got_lf, FALSE);
 
 		/* Discard pre-boundary lines. */
-		if (!got_boundary) {
+		if (!priv->got_part_boundary) {
 			g_byte_array_set_size (priv->meta_buf, 0);
 			continue;
 		}
@@ -421,9 +439,33 @@ soup_multipart_input_stream_read_headers (SoupMultipartInputStream  *multipart,
 			break;
 	}
 
+	priv->reading_headers = FALSE;
+
 	return TRUE;
 }
 
+static GInputStream *
+soup_multipart_input_stream_next_part_internal (SoupMultipartInputStream  *multipart,
+						gboolean                   blocking,
+						GCancellable              *cancellable,
+						GError                   **error)
+{
+        SoupMultipartInputStreamPrivate *priv = soup_multipart_input_stream_get_instance_private (multipart);
+
+	if (!soup_multipart_input_stream_read_headers (multipart, blocking, cancellable, error))
+		return NULL;
+
+	soup_multipart_input_stream_parse_headers (multipart);
+
+	priv->done_with_part = FALSE;
+
+	return G_INPUT_STREAM (g_object_new (SOUP_TYPE_BODY_INPUT_STREAM,
+					     "base-stream", G_INPUT_STREAM (multipart),
+					     "close-base-stream", FALSE,
+					     "encoding", SOUP_ENCODING_EOF,
+					     NULL));
+}
+
 /* Public APIs */
 
 /**
@@ -476,21 +518,16 @@ soup_multipart_input_stream_next_part (SoupMultipartInputStream  *multipart,
 				       GCancellable	         *cancellable,
 				       GError                   **error)
 {
-        SoupMultipartInputStreamPrivate *priv = soup_multipart_input_stream_get_instance_private (multipart);
-
-	if (!soup_multipart_input_stream_read_headers (multipart, cancellable, error))
-		return NULL;
-
-	soup_multipart_input_stream_parse_headers (multipart);
-
-	priv->done_with_part = FALSE;
+	return soup_multipart_input_stream_next_part_internal (multipart, TRUE, cancellable, error);
+}
 
-	return G_INPUT_STREAM (g_object_new (SOUP_TYPE_BODY_INPUT_STREAM,
-					     "base-stream", G_INPUT_STREAM (multipart),
-					     "close-base-stream", FALSE,
-					     "encoding", SOUP_ENCODING_EOF,
-					     NULL));
+static gboolean
+soup_multipart_input_stream_can_poll (SoupMultipartInputStream *multipart)
+{
+	GInputStream *base_stream = G_FILTER_INPUT_STREAM (multipart)->base_stream;
 
+	return G_IS_POLLABLE_INPUT_STREAM (base_stream) &&
+		g_pollable_input_stream_can_poll (G_POLLABLE_INPUT_STREAM (base_stream));
 }
 
 static void
@@ -513,6 +550,49 @@ soup_multipart_input_stream_next_part_thread (GTask        *task,
 		g_task_return_pointer (task, new_stream, g_object_unref);
 }
 
+static void next_part_async_read (GTask *task);
+
+static gboolean
+next_part_async_ready (GObject *pollable,
+		       gpointer user_data)
+{
+	next_part_async_read (G_TASK (user_data));
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+next_part_async_read (GTask *task)
+{
+	SoupMultipartInputStream *multipart = g_task_get_source_object (task);
+	SoupMultipartInputStreamPrivate *priv = soup_multipart_input_stream_get_instance_private (multipart);
+	GInputStream *new_stream;
+	GError *error = NULL;
+
+	new_stream = soup_multipart_input_stream_next_part_internal (multipart, FALSE,
+								     g_task_get_cancellable (task),
+								     &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+		GSource *source;
+
+		g_error_free (error);
+		source = g_pollable_input_stream_create_source (G_POLLABLE_INPUT_STREAM (priv->base_stream),
+								g_task_get_cancellable (task));
+		g_task_attach_source (task, source, (GSourceFunc)next_part_async_ready);
+		g_source_unref (source);
+		return;
+	}
+
+	g_input_stream_clear_pending (G_INPUT_STREAM (multipart));
+
+	if (error) {
+		g_clear_object (&new_stream);
+		g_task_return_error (task, error);
+	} else
+		g_task_return_pointer (task, new_stream, g_object_unref);
+	g_object_unref (task);
+}
+
 /**
  * soup_multipart_input_stream_next_part_async:
  * @multipart: the #SoupMultipartInputStream.
@@ -539,6 +619,7 @@ soup_multipart_input_stream_next_part_async (SoupMultipartInputStream *multipart
 	g_return_if_fail (SOUP_IS_MULTIPART_INPUT_STREAM (multipart));
 
 	task = g_task_new (multipart, cancellable, callback, data);
+	g_task_set_source_tag (task, soup_multipart_input_stream_next_part_async);
 	g_task_set_priority (task, io_priority);
 
 	if (!g_input_stream_set_pending (stream, &error)) {
@@ -547,8 +628,16 @@ soup_multipart_input_stream_next_part_async (SoupMultipartInputStream *multipart
 		return;
 	}
 
-	g_task_run_in_thread (task, soup_multipart_input_stream_next_part_thread);
-	g_object_unref (task);
+	/* Read the boundary and part headers as they arrive, without
+	 * blocking a thread, unless the base stream can't be polled.
+	 */
+	if (!soup_multipart_input_stream_can_poll (multipart)) {
+		g_task_run_in_thread (task, soup_multipart_input_stream_next_part_thread);
+		g_object_unref (task);
+		return;
+	}
+
+	next_part_async_read (task);
 }
 
 /**
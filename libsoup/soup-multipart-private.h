@@ -0,0 +1,14 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-multipart.h"
+
+G_BEGIN_DECLS
+
+char *soup_multipart_generate_boundary (void);
+
+G_END_DECLS
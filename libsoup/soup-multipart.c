@@ -11,7 +11,7 @@
 
 #include <string.h>
 
-#include "soup-multipart.h"
+#include "soup-multipart-private.h"
 #include "soup-headers.h"
 #include "soup-message-headers-private.h"
 #include "soup.h"
@@ -53,8 +53,8 @@ soup_multipart_new_internal (char *mime_type, char *boundary)
 	return multipart;
 }
 
-static char *
-generate_boundary (void)
+char *
+soup_multipart_generate_boundary (void)
 {
 	guint32 data[2];
 
@@ -86,7 +86,7 @@ SoupMultipart *
 soup_multipart_new (const char *mime_type)
 {
 	return soup_multipart_new_internal (g_strdup (mime_type),
-					    generate_boundary ());
+					    soup_multipart_generate_boundary ());
 }
 
 static const char *
@@ -0,0 +1,175 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-profiler.c: sysprof marks and counters
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <sysprof-capture.h>
+
+#include "soup-profiler.h"
+
+#define GROUP "libsoup"
+
+/* Counters are process wide, so that several sessions or servers
+ * add up instead of overwriting each other. Byte counters are
+ * published as a rate, computed over windows of at least a second.
+ */
+static const struct {
+        const char *category;
+        const char *name;
+        const char *description;
+} counter_info[SOUP_PROFILER_N_COUNTERS] = {
+        { "Session", "Connections", "Open client connections" },
+        { "Session", "Received", "Bytes per second received" },
+        { "Session", "Sent", "Bytes per second sent" },
+        { "Cache", "Hits", "Cache lookups with a fresh response" },
+        { "Cache", "Misses", "Cache lookups without a fresh response" },
+        { "Server", "Connections", "Open server connections" },
+        { "Server", "Requests", "Requests being processed" },
+        { "Server", "Received", "Bytes per second received" },
+        { "Server", "Sent", "Bytes per second sent" }
+};
+
+typedef struct {
+        gint64 window_start;
+        guint64 bytes;
+} SoupProfilerRate;
+
+static gssize counter_values[SOUP_PROFILER_N_COUNTERS];
+static guint counter_base_id;
+static GMutex rates_mutex;
+static SoupProfilerRate rates[SOUP_PROFILER_N_COUNTERS];
+
+gboolean
+soup_profiler_is_active (void)
+{
+        return sysprof_collector_is_active ();
+}
+
+gint64
+soup_profiler_get_time (void)
+{
+        return SYSPROF_CAPTURE_CURRENT_TIME;
+}
+
+void
+soup_profiler_mark (gint64      begin_time,
+                    const char *name,
+                    const char *format,
+                    ...)
+{
+        va_list args;
+
+        if (!sysprof_collector_is_active ())
+                return;
+
+        va_start (args, format);
+        sysprof_collector_mark_vprintf (begin_time, SYSPROF_CAPTURE_CURRENT_TIME - begin_time,
+                                        GROUP, name, format, args);
+        va_end (args);
+}
+
+/* Marks a span between two g_get_monotonic_time() values, which are
+ * not necessarily on the sysprof clock.
+ */
+void
+soup_profiler_mark_usec (guint64     start,
+                         guint64     end,
+                         const char *name,
+                         const char *format,
+                         ...)
+{
+        va_list args;
+        gint64 begin;
+
+        if (!sysprof_collector_is_active () || !start || end < start)
+                return;
+
+        begin = SYSPROF_CAPTURE_CURRENT_TIME - (g_get_monotonic_time () - (gint64)start) * 1000;
+        va_start (args, format);
+        sysprof_collector_mark_vprintf (begin, (end - start) * 1000, GROUP, name, format, args);
+        va_end (args);
+}
+
+static void
+define_counters (void)
+{
+        static gsize initialized = 0;
+
+        if (g_once_init_enter (&initialized)) {
+                SysprofCaptureCounter counters[SOUP_PROFILER_N_COUNTERS];
+                guint i;
+
+                counter_base_id = sysprof_collector_request_counters (SOUP_PROFILER_N_COUNTERS);
+                memset (counters, 0, sizeof (counters));
+                for (i = 0; i < SOUP_PROFILER_N_COUNTERS; i++) {
+                        g_strlcpy (counters[i].category, counter_info[i].category, sizeof (counters[i].category));
+                        g_strlcpy (counters[i].name, counter_info[i].name, sizeof (counters[i].name));
+                        g_strlcpy (counters[i].description, counter_info[i].description, sizeof (counters[i].description));
+                        counters[i].id = counter_base_id + i;
+                        counters[i].type = SYSPROF_CAPTURE_COUNTER_INT64;
+                        counters[i].value.v64 = (gssize)g_atomic_pointer_get (&counter_values[i]);
+                }
+                sysprof_collector_define_counters (counters, SOUP_PROFILER_N_COUNTERS);
+
+                g_once_init_leave (&initialized, 1);
+        }
+}
+
+static void
+set_counter (SoupProfilerCounter counter,
+             gint64              value)
+{
+        unsigned int id;
+        SysprofCaptureCounterValue counter_value;
+
+        define_counters ();
+
+        id = counter_base_id + counter;
+        counter_value.v64 = value;
+        sysprof_collector_set_counters (&id, &counter_value, 1);
+}
+
+void
+soup_profiler_counter_add (SoupProfilerCounter counter,
+                           gint64              delta)
+{
+        gint64 value;
+
+        value = g_atomic_pointer_add (&counter_values[counter], delta) + delta;
+        if (sysprof_collector_is_active ())
+                set_counter (counter, value);
+}
+
+void
+soup_profiler_bytes_add (SoupProfilerCounter counter,
+                         gsize               bytes)
+{
+        SoupProfilerRate *rate = &rates[counter];
+        gint64 now, elapsed, value = -1;
+
+        if (!sysprof_collector_is_active ())
+                return;
+
+        now = g_get_monotonic_time ();
+        g_mutex_lock (&rates_mutex);
+        if (!rate->window_start)
+                rate->window_start = now;
+        rate->bytes += bytes;
+        elapsed = now - rate->window_start;
+        if (elapsed >= G_USEC_PER_SEC) {
+                value = rate->bytes * G_USEC_PER_SEC / elapsed;
+                rate->bytes = 0;
+                rate->window_start = now;
+        }
+        g_mutex_unlock (&rates_mutex);
+
+        if (value >= 0)
+                set_counter (counter, value);
+}
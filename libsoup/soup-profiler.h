@@ -0,0 +1,95 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifndef __SOUP_PROFILER_H__
+#define __SOUP_PROFILER_H__ 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+        SOUP_PROFILER_COUNTER_CONNECTIONS,
+        SOUP_PROFILER_COUNTER_BYTES_RECEIVED,
+        SOUP_PROFILER_COUNTER_BYTES_SENT,
+        SOUP_PROFILER_COUNTER_CACHE_HITS,
+        SOUP_PROFILER_COUNTER_CACHE_MISSES,
+        SOUP_PROFILER_COUNTER_SERVER_CONNECTIONS,
+        SOUP_PROFILER_COUNTER_SERVER_REQUESTS,
+        SOUP_PROFILER_COUNTER_SERVER_BYTES_RECEIVED,
+        SOUP_PROFILER_COUNTER_SERVER_BYTES_SENT,
+
+        SOUP_PROFILER_N_COUNTERS
+} SoupProfilerCounter;
+
+#ifdef HAVE_SYSPROF
+
+gboolean soup_profiler_is_active     (void);
+gint64   soup_profiler_get_time      (void);
+void     soup_profiler_mark          (gint64               begin_time,
+                                      const char          *name,
+                                      const char          *format,
+                                      ...) G_GNUC_PRINTF (3, 4);
+void     soup_profiler_mark_usec     (guint64              start,
+                                      guint64              end,
+                                      const char          *name,
+                                      const char          *format,
+                                      ...) G_GNUC_PRINTF (4, 5);
+void     soup_profiler_counter_add   (SoupProfilerCounter  counter,
+                                      gint64               delta);
+void     soup_profiler_bytes_add     (SoupProfilerCounter  counter,
+                                      gsize                bytes);
+
+#else
+
+/* Without sysprof everything is optimized away, callers don't need
+ * to check HAVE_SYSPROF.
+ */
+static inline gboolean
+soup_profiler_is_active (void)
+{
+        return FALSE;
+}
+
+static inline gint64
+soup_profiler_get_time (void)
+{
+        return 0;
+}
+
+static inline void G_GNUC_PRINTF (3, 4)
+soup_profiler_mark (gint64      begin_time,
+                    const char *name,
+                    const char *format,
+                    ...)
+{
+}
+
+static inline void G_GNUC_PRINTF (4, 5)
+soup_profiler_mark_usec (guint64     start,
+                         guint64     end,
+                         const char *name,
+                         const char *format,
+                         ...)
+{
+}
+
+static inline void
+soup_profiler_counter_add (SoupProfilerCounter counter,
+                           gint64              delta)
+{
+}
+
+static inline void
+soup_profiler_bytes_add (SoupProfilerCounter counter,
+                         gsize               bytes)
+{
+}
+
+#endif /* HAVE_SYSPROF */
+
+G_END_DECLS
+
+#endif /* __SOUP_PROFILER_H__ */
@@ -0,0 +1,635 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-session-stats.c: Session-wide message timing statistics
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "soup-session-stats.h"
+#include "soup.h"
+#include "soup-histogram.h"
+#include "soup-message-private.h"
+#include "soup-message-metrics-private.h"
+#include "soup-session-feature-private.h"
+#include "soup-uri-utils-private.h"
+
+/**
+ * SoupSessionStats:
+ *
+ * Aggregates the [struct@MessageMetrics] of every message sent by a
+ * [class@Session] into histograms.
+ *
+ * #SoupSessionStats is a [iface@SessionFeature] that collects metrics for all
+ * the messages of the session it's added to, and records how long each
+ * [enum@SessionStatsPhase] took, per origin, in log-linear histograms with a
+ * precision of about 6%. Recording is cheap enough to be left enabled in
+ * production.
+ *
+ * Use [method@SessionStats.get_snapshot] to read the histograms, for
+ * example to get percentiles with [method@SessionStatsSnapshot.get_percentile]
+ * or to expose them with [method@SessionStatsSnapshot.to_openmetrics].
+ *
+ * Since: 3.4
+ */
+
+/**
+ * SoupSessionStatsPhase:
+ * @SOUP_SESSION_STATS_PHASE_DNS: time to resolve the host name
+ * @SOUP_SESSION_STATS_PHASE_CONNECT: time to connect, including proxy
+ *   negotiation and TLS handshake
+ * @SOUP_SESSION_STATS_PHASE_TLS: time of the TLS handshake
+ * @SOUP_SESSION_STATS_PHASE_TTFB: time from sending the request to receiving
+ *   the first byte of the response
+ * @SOUP_SESSION_STATS_PHASE_TOTAL: time from queueing the message until the
+ *   response was completely received
+ * @SOUP_SESSION_STATS_PHASE_THROUGHPUT: bytes per second received while
+ *   reading the response body
+ *
+ * The values recorded for every message by [class@SessionStats]. They are in
+ * microseconds, except for %SOUP_SESSION_STATS_PHASE_THROUGHPUT.
+ *
+ * Messages that didn't need a new connection don't record the
+ * %SOUP_SESSION_STATS_PHASE_DNS, %SOUP_SESSION_STATS_PHASE_CONNECT and
+ * %SOUP_SESSION_STATS_PHASE_TLS phases.
+ *
+ * Since: 3.4
+ */
+
+#define N_PHASES (SOUP_SESSION_STATS_PHASE_THROUGHPUT + 1)
+
+/* Messages to more origins than this are recorded together, so that a
+ * session crawling many hosts doesn't grow without bounds.
+ */
+#define MAX_ORIGINS 1024
+#define OTHER_ORIGIN "other"
+
+typedef struct {
+        /* Only set for the origins of a #SoupSessionStats */
+        GUri *uri;
+        char *name;
+
+        SoupHistogram phases[N_PHASES];
+} SoupSessionStatsOrigin;
+
+struct _SoupSessionStats {
+        GObject parent_instance;
+
+        GMutex mutex;
+        GHashTable *origins;
+        SoupSessionStatsOrigin *other;
+
+        /* The origin of the last message, read without the lock */
+        SoupSessionStatsOrigin *last_origin;
+};
+
+/**
+ * SoupSessionStatsSnapshot:
+ *
+ * A copy of the histograms of a [class@SessionStats] at some point in time.
+ *
+ * Since: 3.4
+ */
+struct _SoupSessionStatsSnapshot {
+        GHashTable *origins;
+};
+
+static void soup_session_stats_session_feature_init (SoupSessionFeatureInterface *feature_interface, gpointer interface_data);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (SoupSessionStats, soup_session_stats, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (SOUP_TYPE_SESSION_FEATURE,
+                                                      soup_session_stats_session_feature_init))
+
+G_DEFINE_BOXED_TYPE (SoupSessionStatsSnapshot, soup_session_stats_snapshot, soup_session_stats_snapshot_ref, soup_session_stats_snapshot_unref)
+
+static void
+soup_session_stats_origin_free (SoupSessionStatsOrigin *origin)
+{
+        g_clear_pointer (&origin->uri, g_uri_unref);
+        g_free (origin->name);
+        g_free (origin);
+}
+
+static void
+soup_session_stats_init (SoupSessionStats *stats)
+{
+        g_mutex_init (&stats->mutex);
+        stats->origins = g_hash_table_new_full (soup_uri_host_hash, soup_uri_host_equal, NULL,
+                                                (GDestroyNotify)soup_session_stats_origin_free);
+}
+
+static void
+soup_session_stats_finalize (GObject *object)
+{
+        SoupSessionStats *stats = SOUP_SESSION_STATS (object);
+
+        g_hash_table_destroy (stats->origins);
+        g_clear_pointer (&stats->other, soup_session_stats_origin_free);
+        g_mutex_clear (&stats->mutex);
+
+        G_OBJECT_CLASS (soup_session_stats_parent_class)->finalize (object);
+}
+
+static void
+soup_session_stats_class_init (SoupSessionStatsClass *stats_class)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (stats_class);
+
+        object_class->finalize = soup_session_stats_finalize;
+}
+
+static char *
+origin_for_uri (GUri *uri)
+{
+        char *host, *origin;
+
+        host = soup_uri_get_host_for_headers (uri);
+        if (soup_uri_uses_default_port (uri))
+                origin = g_strdup_printf ("%s://%s", g_uri_get_scheme (uri), host);
+        else
+                origin = g_strdup_printf ("%s://%s:%d", g_uri_get_scheme (uri), host, g_uri_get_port (uri));
+        g_free (host);
+
+        return origin;
+}
+
+/* Origins are never removed while @stats is alive, so the histograms
+ * can be recorded to without holding the lock. Messages usually go to
+ * the same origin as the previous one, which is then found without
+ * formatting the origin or taking the lock.
+ */
+static SoupSessionStatsOrigin *
+soup_session_stats_lookup_origin (SoupSessionStats *stats,
+                                  GUri             *uri)
+{
+        SoupSessionStatsOrigin *origin;
+
+        origin = g_atomic_pointer_get (&stats->last_origin);
+        if (origin && soup_uri_host_equal (origin->uri, uri))
+                return origin;
+
+        g_mutex_lock (&stats->mutex);
+        origin = g_hash_table_lookup (stats->origins, uri);
+        if (!origin && g_hash_table_size (stats->origins) >= MAX_ORIGINS) {
+                if (!stats->other) {
+                        stats->other = g_new0 (SoupSessionStatsOrigin, 1);
+                        stats->other->name = g_strdup (OTHER_ORIGIN);
+                }
+                origin = stats->other;
+        } else if (!origin) {
+                origin = g_new0 (SoupSessionStatsOrigin, 1);
+                origin->uri = soup_uri_copy_host (uri);
+                origin->name = origin_for_uri (uri);
+                g_hash_table_insert (stats->origins, origin->uri, origin);
+        }
+        g_mutex_unlock (&stats->mutex);
+
+        if (origin->uri)
+                g_atomic_pointer_set (&stats->last_origin, origin);
+
+        return origin;
+}
+
+static void
+record_interval (SoupSessionStatsOrigin *origin,
+                 SoupSessionStatsPhase   phase,
+                 guint64                 start,
+                 guint64                 end)
+{
+        if (start == 0 || end < start)
+                return;
+
+        soup_histogram_record (&origin->phases[phase], end - start);
+}
+
+static void
+soup_session_stats_request_queued (SoupSessionFeature *feature,
+                                   SoupMessage        *msg)
+{
+        soup_message_enable_metrics (msg);
+}
+
+static void
+soup_session_stats_request_unqueued (SoupSessionFeature *feature,
+                                     SoupMessage        *msg)
+{
+        SoupSessionStats *stats = SOUP_SESSION_STATS (feature);
+        SoupMessageMetrics *metrics;
+        SoupSessionStatsOrigin *origin;
+
+        metrics = soup_message_get_metrics (msg);
+        if (!metrics || metrics->response_end == 0 || soup_message_get_status (msg) == SOUP_STATUS_NONE)
+                return;
+
+        origin = soup_session_stats_lookup_origin (stats, soup_message_get_uri (msg));
+
+        record_interval (origin, SOUP_SESSION_STATS_PHASE_DNS, metrics->dns_start, metrics->dns_end);
+        record_interval (origin, SOUP_SESSION_STATS_PHASE_CONNECT, metrics->connect_start, metrics->connect_end);
+        record_interval (origin, SOUP_SESSION_STATS_PHASE_TLS, metrics->tls_start, metrics->tls_end);
+        record_interval (origin, SOUP_SESSION_STATS_PHASE_TTFB, metrics->request_start, metrics->response_start);
+        record_interval (origin, SOUP_SESSION_STATS_PHASE_TOTAL, metrics->fetch_start, metrics->response_end);
+
+        if (metrics->response_body_bytes_received > 0 &&
+            metrics->response_start > 0 && metrics->response_end > metrics->response_start) {
+                soup_histogram_record (&origin->phases[SOUP_SESSION_STATS_PHASE_THROUGHPUT],
+                                       metrics->response_body_bytes_received * G_USEC_PER_SEC / (metrics->response_end - metrics->response_start));
+        }
+}
+
+static void
+soup_session_stats_session_feature_init (SoupSessionFeatureInterface *feature_interface,
+                                         gpointer                     interface_data)
+{
+        feature_interface->request_queued = soup_session_stats_request_queued;
+        feature_interface->request_unqueued = soup_session_stats_request_unqueued;
+}
+
+/**
+ * soup_session_stats_new:
+ *
+ * Creates a new #SoupSessionStats.
+ *
+ * Add it to a [class@Session] with [method@Session.add_feature] to
+ * start recording.
+ *
+ * Returns: (transfer full): a new #SoupSessionStats
+ *
+ * Since: 3.4
+ */
+SoupSessionStats *
+soup_session_stats_new (void)
+{
+        return g_object_new (SOUP_TYPE_SESSION_STATS, NULL);
+}
+
+static SoupSessionStatsSnapshot *
+soup_session_stats_snapshot_new (void)
+{
+        SoupSessionStatsSnapshot *snapshot;
+
+        snapshot = g_atomic_rc_box_new0 (SoupSessionStatsSnapshot);
+        snapshot->origins = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                   (GDestroyNotify)soup_session_stats_origin_free);
+
+        return snapshot;
+}
+
+static void
+soup_session_stats_snapshot_add (SoupSessionStatsSnapshot     *snapshot,
+                                 const char                   *key,
+                                 const SoupSessionStatsOrigin *origin)
+{
+        SoupSessionStatsOrigin *copy;
+        guint i;
+
+        copy = g_hash_table_lookup (snapshot->origins, key);
+        if (!copy) {
+                copy = g_new0 (SoupSessionStatsOrigin, 1);
+                g_hash_table_insert (snapshot->origins, g_strdup (key), copy);
+        }
+
+        for (i = 0; i < N_PHASES; i++)
+                soup_histogram_merge (&copy->phases[i], &origin->phases[i]);
+}
+
+/**
+ * soup_session_stats_get_snapshot:
+ * @stats: a #SoupSessionStats
+ *
+ * Copies the histograms recorded so far by @stats.
+ *
+ * Messages finishing while the snapshot is taken may be partially
+ * included in it.
+ *
+ * Returns: (transfer full): a new #SoupSessionStatsSnapshot
+ *
+ * Since: 3.4
+ */
+SoupSessionStatsSnapshot *
+soup_session_stats_get_snapshot (SoupSessionStats *stats)
+{
+        SoupSessionStatsSnapshot *snapshot;
+        SoupSessionStatsOrigin *origin;
+        GHashTableIter iter;
+
+        g_return_val_if_fail (SOUP_IS_SESSION_STATS (stats), NULL);
+
+        snapshot = soup_session_stats_snapshot_new ();
+
+        g_mutex_lock (&stats->mutex);
+        g_hash_table_iter_init (&iter, stats->origins);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&origin))
+                soup_session_stats_snapshot_add (snapshot, origin->name, origin);
+        if (stats->other)
+                soup_session_stats_snapshot_add (snapshot, stats->other->name, stats->other);
+        g_mutex_unlock (&stats->mutex);
+
+        return snapshot;
+}
+
+/**
+ * soup_session_stats_reset:
+ * @stats: a #SoupSessionStats
+ *
+ * Clears the histograms recorded so far by @stats.
+ *
+ * Since: 3.4
+ */
+void
+soup_session_stats_reset (SoupSessionStats *stats)
+{
+        SoupSessionStatsOrigin *origin;
+        GHashTableIter iter;
+        guint i;
+
+        g_return_if_fail (SOUP_IS_SESSION_STATS (stats));
+
+        g_mutex_lock (&stats->mutex);
+        g_hash_table_iter_init (&iter, stats->origins);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&origin)) {
+                for (i = 0; i < N_PHASES; i++)
+                        soup_histogram_reset (&origin->phases[i]);
+        }
+        if (stats->other) {
+                for (i = 0; i < N_PHASES; i++)
+                        soup_histogram_reset (&stats->other->phases[i]);
+        }
+        g_mutex_unlock (&stats->mutex);
+}
+
+/**
+ * soup_session_stats_snapshot_ref:
+ * @snapshot: a #SoupSessionStatsSnapshot
+ *
+ * Increases the reference count of @snapshot by one.
+ *
+ * Returns: (transfer full): the passed in #SoupSessionStatsSnapshot
+ *
+ * Since: 3.4
+ */
+SoupSessionStatsSnapshot *
+soup_session_stats_snapshot_ref (SoupSessionStatsSnapshot *snapshot)
+{
+        g_return_val_if_fail (snapshot != NULL, NULL);
+
+        return g_atomic_rc_box_acquire (snapshot);
+}
+
+static void
+soup_session_stats_snapshot_clear (SoupSessionStatsSnapshot *snapshot)
+{
+        g_hash_table_destroy (snapshot->origins);
+}
+
+/**
+ * soup_session_stats_snapshot_unref:
+ * @snapshot: a #SoupSessionStatsSnapshot
+ *
+ * Decreases the reference count of @snapshot by one, freeing it when
+ * it reaches zero.
+ *
+ * Since: 3.4
+ */
+void
+soup_session_stats_snapshot_unref (SoupSessionStatsSnapshot *snapshot)
+{
+        g_return_if_fail (snapshot != NULL);
+
+        g_atomic_rc_box_release_full (snapshot, (GDestroyNotify)soup_session_stats_snapshot_clear);
+}
+
+/**
+ * soup_session_stats_snapshot_merge:
+ * @snapshot: a #SoupSessionStatsSnapshot
+ * @other: another #SoupSessionStatsSnapshot
+ *
+ * Adds the values recorded in @other to @snapshot, for example to
+ * aggregate the statistics of several sessions.
+ *
+ * Since: 3.4
+ */
+void
+soup_session_stats_snapshot_merge (SoupSessionStatsSnapshot *snapshot,
+                                   SoupSessionStatsSnapshot *other)
+{
+        GHashTableIter iter;
+        gpointer key, value;
+
+        g_return_if_fail (snapshot != NULL);
+        g_return_if_fail (other != NULL);
+        g_return_if_fail (snapshot != other);
+
+        g_hash_table_iter_init (&iter, other->origins);
+        while (g_hash_table_iter_next (&iter, &key, &value))
+                soup_session_stats_snapshot_add (snapshot, key, value);
+}
+
+static int
+compare_origins (gconstpointer a,
+                 gconstpointer b)
+{
+        return strcmp (*(const char **)a, *(const char **)b);
+}
+
+/**
+ * soup_session_stats_snapshot_get_origins:
+ * @snapshot: a #SoupSessionStatsSnapshot
+ *
+ * Gets the origins, like `https://example.com`, that messages were
+ * recorded for.
+ *
+ * Once too many origins have been seen, messages to new ones are
+ * recorded under the `other` origin.
+ *
+ * Returns: (transfer full): a sorted %NULL-terminated array of origins
+ *
+ * Since: 3.4
+ */
+char **
+soup_session_stats_snapshot_get_origins (SoupSessionStatsSnapshot *snapshot)
+{
+        GPtrArray *origins;
+        GHashTableIter iter;
+        gpointer key;
+
+        g_return_val_if_fail (snapshot != NULL, NULL);
+
+        origins = g_ptr_array_new ();
+        g_hash_table_iter_init (&iter, snapshot->origins);
+        while (g_hash_table_iter_next (&iter, &key, NULL))
+                g_ptr_array_add (origins, g_strdup (key));
+        g_ptr_array_sort (origins, compare_origins);
+        g_ptr_array_add (origins, NULL);
+
+        return (char **)g_ptr_array_free (origins, FALSE);
+}
+
+/* Gets the histogram of @phase for @origin, or for all the origins
+ * if it's %NULL.
+ */
+static void
+soup_session_stats_snapshot_get_histogram (SoupSessionStatsSnapshot *snapshot,
+                                           const char               *origin,
+                                           SoupSessionStatsPhase     phase,
+                                           SoupHistogram            *histogram)
+{
+        SoupSessionStatsOrigin *value;
+        GHashTableIter iter;
+
+        memset (histogram, 0, sizeof (SoupHistogram));
+
+        if (origin) {
+                value = g_hash_table_lookup (snapshot->origins, origin);
+                if (value)
+                        soup_histogram_merge (histogram, &value->phases[phase]);
+                return;
+        }
+
+        g_hash_table_iter_init (&iter, snapshot->origins);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&value))
+                soup_histogram_merge (histogram, &value->phases[phase]);
+}
+
+/**
+ * soup_session_stats_snapshot_get_count:
+ * @snapshot: a #SoupSessionStatsSnapshot
+ * @origin: (nullable): an origin, or %NULL for all of them
+ * @phase: a #SoupSessionStatsPhase
+ *
+ * Gets the number of messages to @origin that recorded @phase.
+ *
+ * Returns: the number of values recorded
+ *
+ * Since: 3.4
+ */
+guint64
+soup_session_stats_snapshot_get_count (SoupSessionStatsSnapshot *snapshot,
+                                       const char               *origin,
+                                       SoupSessionStatsPhase     phase)
+{
+        SoupHistogram histogram;
+
+        g_return_val_if_fail (snapshot != NULL, 0);
+        g_return_val_if_fail (phase < N_PHASES, 0);
+
+        soup_session_stats_snapshot_get_histogram (snapshot, origin, phase, &histogram);
+
+        return soup_histogram_get_count (&histogram);
+}
+
+/**
+ * soup_session_stats_snapshot_get_percentile:
+ * @snapshot: a #SoupSessionStatsSnapshot
+ * @origin: (nullable): an origin, or %NULL for all of them
+ * @phase: a #SoupSessionStatsPhase
+ * @percentile: the percentile, between 0 and 100
+ *
+ * Gets the value of @phase that @percentile percent of the messages
+ * to @origin didn't exceed, for example the median with a @percentile
+ * of 50 or the p99 with 99.
+ *
+ * Returns: the value, in the units of @phase, or 0 if no values were
+ *   recorded
+ *
+ * Since: 3.4
+ */
+guint64
+soup_session_stats_snapshot_get_percentile (SoupSessionStatsSnapshot *snapshot,
+                                            const char               *origin,
+                                            SoupSessionStatsPhase     phase,
+                                            double                    percentile)
+{
+        SoupHistogram histogram;
+
+        g_return_val_if_fail (snapshot != NULL, 0);
+        g_return_val_if_fail (phase < N_PHASES, 0);
+
+        soup_session_stats_snapshot_get_histogram (snapshot, origin, phase, &histogram);
+
+        return soup_histogram_get_percentile (&histogram, percentile);
+}
+
+static const struct {
+        const char *name;
+        const char *unit;
+        const char *help;
+        double scale;
+} phase_metrics[N_PHASES] = {
+        { "soup_session_dns_seconds", "seconds", "Time to resolve host names", G_USEC_PER_SEC },
+        { "soup_session_connect_seconds", "seconds", "Time to connect, including the TLS handshake", G_USEC_PER_SEC },
+        { "soup_session_tls_handshake_seconds", "seconds", "Time of TLS handshakes", G_USEC_PER_SEC },
+        { "soup_session_time_to_first_byte_seconds", "seconds", "Time from sending the request to the first response byte", G_USEC_PER_SEC },
+        { "soup_session_request_duration_seconds", "seconds", "Time from queueing to the end of the response", G_USEC_PER_SEC },
+        { "soup_session_response_body_throughput_bytes_per_second", "bytes_per_second", "Rate at which response bodies were received", 1 }
+};
+
+static void
+append_label_value (GString    *str,
+                    const char *value)
+{
+        for (; *value; value++) {
+                if (*value == '\\' || *value == '"')
+                        g_string_append_c (str, '\\');
+                if (*value == '\n')
+                        g_string_append (str, "\\n");
+                else
+                        g_string_append_c (str, *value);
+        }
+}
+
+/**
+ * soup_session_stats_snapshot_to_openmetrics:
+ * @snapshot: a #SoupSessionStatsSnapshot
+ *
+ * Formats @snapshot in the OpenMetrics text format, with a summary
+ * metric for every [enum@SessionStatsPhase] that includes the 0.5, 0.9,
+ * 0.99 and 0.999 quantiles of every origin.
+ *
+ * Returns: (transfer full): the OpenMetrics exposition of @snapshot
+ *
+ * Since: 3.4
+ */
+char *
+soup_session_stats_snapshot_to_openmetrics (SoupSessionStatsSnapshot *snapshot)
+{
+        GString *str;
+        char **origins;
+        guint phase, i;
+
+        g_return_val_if_fail (snapshot != NULL, NULL);
+
+        str = g_string_new (NULL);
+        origins = soup_session_stats_snapshot_get_origins (snapshot);
+        for (phase = 0; phase < N_PHASES; phase++) {
+                const char *name = phase_metrics[phase].name;
+                double scale = phase_metrics[phase].scale;
+
+                g_string_append_printf (str, "# TYPE %s summary\n", name);
+                g_string_append_printf (str, "# UNIT %s %s\n", name, phase_metrics[phase].unit);
+                g_string_append_printf (str, "# HELP %s %s.\n", name, phase_metrics[phase].help);
+
+                for (i = 0; origins[i]; i++) {
+                        SoupHistogram histogram;
+                        GString *labels;
+
+                        soup_session_stats_snapshot_get_histogram (snapshot, origins[i], phase, &histogram);
+                        if (soup_histogram_get_count (&histogram) == 0)
+                                continue;
+
+                        labels = g_string_new ("origin=\"");
+                        append_label_value (labels, origins[i]);
+                        g_string_append_c (labels, '"');
+                        soup_histogram_append_openmetrics (&histogram, str, name, labels->str, scale);
+                        g_string_free (labels, TRUE);
+                }
+        }
+        g_string_append (str, "# EOF\n");
+        g_strfreev (origins);
+
+        return g_string_free (str, FALSE);
+}
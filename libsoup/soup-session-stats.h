@@ -0,0 +1,69 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-types.h"
+
+G_BEGIN_DECLS
+
+#define SOUP_TYPE_SESSION_STATS (soup_session_stats_get_type ())
+SOUP_AVAILABLE_IN_3_4
+G_DECLARE_FINAL_TYPE (SoupSessionStats, soup_session_stats, SOUP, SESSION_STATS, GObject)
+
+typedef enum {
+        SOUP_SESSION_STATS_PHASE_DNS,
+        SOUP_SESSION_STATS_PHASE_CONNECT,
+        SOUP_SESSION_STATS_PHASE_TLS,
+        SOUP_SESSION_STATS_PHASE_TTFB,
+        SOUP_SESSION_STATS_PHASE_TOTAL,
+        SOUP_SESSION_STATS_PHASE_THROUGHPUT
+} SoupSessionStatsPhase;
+
+typedef struct _SoupSessionStatsSnapshot SoupSessionStatsSnapshot;
+
+SOUP_AVAILABLE_IN_3_4
+GType soup_session_stats_snapshot_get_type (void);
+#define SOUP_TYPE_SESSION_STATS_SNAPSHOT (soup_session_stats_snapshot_get_type ())
+
+SOUP_AVAILABLE_IN_3_4
+SoupSessionStats         *soup_session_stats_new                      (void);
+
+SOUP_AVAILABLE_IN_3_4
+SoupSessionStatsSnapshot *soup_session_stats_get_snapshot             (SoupSessionStats         *stats);
+
+SOUP_AVAILABLE_IN_3_4
+void                      soup_session_stats_reset                    (SoupSessionStats         *stats);
+
+SOUP_AVAILABLE_IN_3_4
+SoupSessionStatsSnapshot *soup_session_stats_snapshot_ref             (SoupSessionStatsSnapshot *snapshot);
+
+SOUP_AVAILABLE_IN_3_4
+void                      soup_session_stats_snapshot_unref           (SoupSessionStatsSnapshot *snapshot);
+
+SOUP_AVAILABLE_IN_3_4
+void                      soup_session_stats_snapshot_merge           (SoupSessionStatsSnapshot *snapshot,
+                                                                       SoupSessionStatsSnapshot *other);
+
+SOUP_AVAILABLE_IN_3_4
+char                    **soup_session_stats_snapshot_get_origins     (SoupSessionStatsSnapshot *snapshot);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_session_stats_snapshot_get_count       (SoupSessionStatsSnapshot *snapshot,
+                                                                       const char               *origin,
+                                                                       SoupSessionStatsPhase     phase);
+
+SOUP_AVAILABLE_IN_3_4
+guint64                   soup_session_stats_snapshot_get_percentile  (SoupSessionStatsSnapshot *snapshot,
+                                                                       const char               *origin,
+                                                                       SoupSessionStatsPhase     phase,
+                                                                       double                    percentile);
+
+SOUP_AVAILABLE_IN_3_4
+char                     *soup_session_stats_snapshot_to_openmetrics  (SoupSessionStatsSnapshot *snapshot);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SoupSessionStatsSnapshot, soup_session_stats_snapshot_unref)
+
+G_END_DECLS
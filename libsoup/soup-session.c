@@ -21,6 +21,7 @@
 #include "soup-message-headers-private.h"
 #include "soup-misc.h"
 #include "soup-message-queue-item.h"
+#include "soup-profiler.h"
 #include "soup-session-private.h"
 #include "soup-session-feature-private.h"
 #include "soup-socket-properties.h"
@@ -1331,6 +1332,7 @@ soup_session_append_queue_item (SoupSession        *session,
         soup_message_set_is_preconnect (msg, FALSE);
 
 	item = soup_message_queue_item_new (session, msg, async, cancellable);
+        item->queued_time = soup_profiler_get_time ();
         g_mutex_lock (&priv->queue_mutex);
 	g_queue_insert_sorted (priv->queue,
 			       soup_message_queue_item_ref (item),
@@ -1440,6 +1442,7 @@ soup_session_unqueue_item (SoupSession          *session,
 	g_signal_handlers_disconnect_matched (item->msg, G_SIGNAL_MATCH_DATA,
 					      0, 0, NULL, NULL, item);
 
+        soup_message_set_error (item->msg, item->error);
 	for (f = priv->features; f; f = g_slist_next (f)) {
 		SoupSessionFeature *feature = SOUP_SESSION_FEATURE (f->data);
 
@@ -1772,6 +1775,13 @@ soup_session_process_queue_item (SoupSession          *session,
 			item->state = SOUP_MESSAGE_RUNNING;
 
                         soup_message_set_metrics_timestamp (item->msg, SOUP_MESSAGE_METRICS_REQUEST_START);
+                        if (soup_profiler_is_active ()) {
+                                GUri *uri = soup_message_get_uri (item->msg);
+
+                                soup_profiler_mark (item->queued_time, "Queued", "%s %s%s",
+                                                    soup_message_get_method (item->msg),
+                                                    g_uri_get_host (uri), g_uri_get_path (uri));
+                        }
 
 			soup_session_send_queue_item (session, item,
 						      (SoupMessageIOCompletionFn)message_completed);
@@ -1796,6 +1806,7 @@ soup_session_process_queue_item (SoupSession          *session,
 		case SOUP_MESSAGE_RESTARTING:
 			item->state = SOUP_MESSAGE_STARTING;
                         soup_message_set_metrics_timestamp (item->msg, SOUP_MESSAGE_METRICS_FETCH_START);
+                        item->queued_time = soup_profiler_get_time ();
 			soup_message_restarted (item->msg);
 
 			break;
@@ -3701,6 +3712,19 @@ websocket_connect_async_stop (SoupMessage *msg, gpointer user_data)
 	g_object_unref (task);
 }
 
+static void
+websocket_connect_async_got_headers (SoupMessage *msg, gpointer user_data)
+{
+        /* Over HTTP/2 the handshake is accepted with a 2xx response to the
+         * extended CONNECT request (RFC 8441).
+         */
+        if (soup_message_get_http_version (msg) != SOUP_HTTP_2_0 ||
+            !SOUP_STATUS_IS_SUCCESSFUL (soup_message_get_status (msg)))
+                return;
+
+        websocket_connect_async_stop (msg, user_data);
+}
+
 /**
  * soup_session_websocket_connect_async:
  * @session: a #SoupSession
@@ -3730,6 +3754,13 @@ websocket_connect_async_stop (SoupMessage *msg, gpointer user_data)
  * @msg will contain the complete response headers and body from the server's
  * response, and [method@Session.websocket_connect_finish] will return
  * %SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET.
+ *
+ * When an HTTP/2 connection to the server is available, or is negotiated
+ * for the handshake, and the server supports it, the WebSocket is
+ * bootstrapped with an extended CONNECT request (RFC 8441) and runs over
+ * an HTTP/2 stream, sharing the connection with other requests. In that
+ * case the server accepts the handshake with a 2xx status instead of
+ * "101 Switching Protocols". Otherwise a new HTTP/1.1 connection is used.
  */
 void
 soup_session_websocket_connect_async (SoupSession          *session,
@@ -3759,13 +3790,13 @@ soup_session_websocket_connect_async (SoupSession          *session,
 	 * list of /protocols/ and /extensions/ to be used, and an /origin/ in
 	 * the case of web browsers, it MUST open a connection, send an opening
 	 * handshake, and read the server's handshake in response.
+	 *
+	 * The connection manager never reuses idle HTTP/1 connections for
+	 * extended CONNECT messages, but HTTP/2 connections are shared and
+	 * the WebSocket runs over its own stream (RFC 8441). If the server
+	 * doesn't support it the message is restarted over HTTP/1.1.
 	 */
-	soup_message_add_flags (msg, SOUP_MESSAGE_NEW_CONNECTION);
-
-        /* WebSocket negotiation over HTTP/2 is not currently supported
-         * and in practice all websocket servers support HTTP1.x with
-         * HTTP/2 not providing a tangible benefit */
-        soup_message_set_force_http_version (msg, SOUP_HTTP_1_1);
+        soup_message_set_connect_protocol (msg, "websocket");
 
 	item = soup_session_append_queue_item (session, msg, TRUE, cancellable);
 	item->io_priority = io_priority;
@@ -3776,6 +3807,8 @@ soup_session_websocket_connect_async (SoupSession          *session,
 	soup_message_add_status_code_handler (msg, "got-informational",
 					      SOUP_STATUS_SWITCHING_PROTOCOLS,
 					      G_CALLBACK (websocket_connect_async_stop), task);
+        g_signal_connect (msg, "got-headers",
+                          G_CALLBACK (websocket_connect_async_got_headers), task);
         g_signal_connect_object (msg, "finished",
                                  G_CALLBACK (websocket_connect_async_complete),
                                  task, 0);
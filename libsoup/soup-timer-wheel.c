@@ -0,0 +1,427 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-timer-wheel.c: shared timers
+ *
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "soup-timer-wheel.h"
+
+/* A hierarchical timer wheel with a resolution of one millisecond.
+ *
+ * Every GMainContext has a single wheel, driven by one GSource whose
+ * ready time is the next tick where something has to happen, instead
+ * of every timer having its own GSource. Level 0 has one slot per
+ * tick; each slot of level N covers as many ticks as the whole level
+ * N - 1, and its timers are moved ("cascaded") to the lower levels
+ * when the wheel reaches it. Arming, rearming and cancelling a timer
+ * are O(1).
+ *
+ * Timers further away than the top level can hold are put in its
+ * last slot, and moved again when they get there.
+ */
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 5
+
+/* The level of the timers that are waiting to be dispatched */
+#define EXPIRED_LEVEL WHEEL_LEVELS
+
+#define LEVEL_SHIFT(level) (WHEEL_BITS * (level))
+#define LEVEL_SPAN(level) (G_GUINT64_CONSTANT (1) << LEVEL_SHIFT (level))
+
+typedef struct {
+        int ref_count;
+        GMainContext *context;
+        GSource *source;
+
+        GMutex mutex;
+        gint64 start_time;
+        guint64 now;
+        gint64 ready_time;
+
+        guint64 occupied[WHEEL_LEVELS];
+        GQueue slots[WHEEL_LEVELS][WHEEL_SIZE];
+        GQueue expired;
+} SoupTimerWheel;
+
+struct _SoupTimer {
+        GList link;
+        GQueue *queue;
+        guint level;
+        guint slot;
+        guint64 expires;
+
+        SoupTimerWheel *wheel;
+        SoupTimerFunc func;
+        gpointer user_data;
+};
+
+static GMutex wheels_mutex;
+static GHashTable *wheels;
+
+static guint
+lowest_bit (guint64 bits)
+{
+        if ((guint32)bits)
+                return g_bit_nth_lsf ((guint32)bits, -1);
+        return 32 + g_bit_nth_lsf ((guint32)(bits >> 32), -1);
+}
+
+static guint64
+current_tick (SoupTimerWheel *wheel)
+{
+        return (g_get_monotonic_time () - wheel->start_time) / 1000;
+}
+
+static void
+wheel_unlink (SoupTimerWheel *wheel,
+              SoupTimer      *timer)
+{
+        g_queue_unlink (timer->queue, &timer->link);
+        if (timer->level < WHEEL_LEVELS && g_queue_is_empty (timer->queue))
+                wheel->occupied[timer->level] &= ~(G_GUINT64_CONSTANT (1) << timer->slot);
+        timer->queue = NULL;
+}
+
+static void
+wheel_insert (SoupTimerWheel *wheel,
+              SoupTimer      *timer)
+{
+        guint64 expires = MAX (timer->expires, wheel->now + 1);
+        guint64 delta = expires - wheel->now;
+        guint level;
+
+        for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+                if (delta < LEVEL_SPAN (level + 1))
+                        break;
+        }
+        if (delta >= LEVEL_SPAN (WHEEL_LEVELS))
+                expires = wheel->now + LEVEL_SPAN (WHEEL_LEVELS) - 1;
+
+        timer->level = level;
+        timer->slot = (expires >> LEVEL_SHIFT (level)) & WHEEL_MASK;
+        timer->queue = &wheel->slots[level][timer->slot];
+        g_queue_push_tail_link (timer->queue, &timer->link);
+        wheel->occupied[level] |= G_GUINT64_CONSTANT (1) << timer->slot;
+}
+
+/* Returns the next tick where a slot has to be expired or cascaded */
+static guint64
+wheel_next_event (SoupTimerWheel *wheel)
+{
+        guint64 next = G_MAXUINT64;
+        guint level;
+
+        for (level = 0; level < WHEEL_LEVELS; level++) {
+                guint64 bits = wheel->occupied[level];
+                guint64 position = wheel->now >> LEVEL_SHIFT (level);
+                guint first, distance;
+
+                if (!bits)
+                        continue;
+
+                /* Rotate so that bit 0 is the slot right after the current one */
+                first = (position + 1) & WHEEL_MASK;
+                if (first)
+                        bits = (bits >> first) | (bits << (WHEEL_SIZE - first));
+                distance = lowest_bit (bits) + 1;
+
+                next = MIN (next, (position + distance) << LEVEL_SHIFT (level));
+        }
+
+        return next;
+}
+
+static void
+wheel_cascade (SoupTimerWheel *wheel,
+               guint           level,
+               guint           slot)
+{
+        GQueue *queue = &wheel->slots[level][slot];
+        GQueue timers;
+        GList *link;
+
+        if (g_queue_is_empty (queue))
+                return;
+
+        timers = *queue;
+        g_queue_init (queue);
+        wheel->occupied[level] &= ~(G_GUINT64_CONSTANT (1) << slot);
+
+        while ((link = g_queue_pop_head_link (&timers))) {
+                SoupTimer *timer = link->data;
+
+                if (timer->expires <= wheel->now) {
+                        timer->level = EXPIRED_LEVEL;
+                        timer->queue = &wheel->expired;
+                        g_queue_push_tail_link (timer->queue, link);
+                } else
+                        wheel_insert (wheel, timer);
+        }
+}
+
+static void
+wheel_advance (SoupTimerWheel *wheel,
+               guint64         target)
+{
+        while (TRUE) {
+                guint64 next = wheel_next_event (wheel);
+                guint level;
+
+                if (next > target) {
+                        wheel->now = MAX (wheel->now, target);
+                        return;
+                }
+
+                wheel->now = next;
+                for (level = 1; level < WHEEL_LEVELS; level++) {
+                        if (next & (LEVEL_SPAN (level) - 1))
+                                break;
+                        wheel_cascade (wheel, level, (next >> LEVEL_SHIFT (level)) & WHEEL_MASK);
+                }
+                wheel_cascade (wheel, 0, next & WHEEL_MASK);
+        }
+}
+
+static void
+wheel_update_ready_time (SoupTimerWheel *wheel,
+                         gboolean        force)
+{
+        guint64 next = g_queue_is_empty (&wheel->expired) ? wheel_next_event (wheel) : wheel->now;
+        gint64 ready_time = next == G_MAXUINT64 ? -1 : wheel->start_time + (gint64)next * 1000;
+
+        if (!force && ready_time == wheel->ready_time)
+                return;
+
+        wheel->ready_time = ready_time;
+        g_source_set_ready_time (wheel->source, ready_time);
+}
+
+static SoupTimerWheel *
+soup_timer_wheel_ref (SoupTimerWheel *wheel)
+{
+        g_mutex_lock (&wheels_mutex);
+        wheel->ref_count++;
+        g_mutex_unlock (&wheels_mutex);
+
+        return wheel;
+}
+
+static void
+soup_timer_wheel_unref (SoupTimerWheel *wheel)
+{
+        gboolean last_ref;
+
+        g_mutex_lock (&wheels_mutex);
+        last_ref = --wheel->ref_count == 0;
+        if (last_ref)
+                g_hash_table_remove (wheels, wheel->context);
+        g_mutex_unlock (&wheels_mutex);
+
+        if (!last_ref)
+                return;
+
+        g_source_destroy (wheel->source);
+        g_source_unref (wheel->source);
+        g_main_context_unref (wheel->context);
+        g_mutex_clear (&wheel->mutex);
+        g_free (wheel);
+}
+
+static gboolean
+soup_timer_wheel_dispatch (gpointer user_data)
+{
+        SoupTimerWheel *wheel = soup_timer_wheel_ref (user_data);
+        GList *link;
+
+        g_mutex_lock (&wheel->mutex);
+        wheel_advance (wheel, current_tick (wheel));
+
+        /* Callbacks run unlocked, so that they can arm timers and
+         * take their own locks.
+         */
+        while ((link = g_queue_pop_head_link (&wheel->expired))) {
+                SoupTimer *timer = link->data;
+                SoupTimerFunc func = timer->func;
+                gpointer data = timer->user_data;
+
+                timer->queue = NULL;
+                g_mutex_unlock (&wheel->mutex);
+                func (data);
+                g_mutex_lock (&wheel->mutex);
+        }
+
+        wheel_update_ready_time (wheel, TRUE);
+        g_mutex_unlock (&wheel->mutex);
+
+        soup_timer_wheel_unref (wheel);
+
+        return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+soup_timer_wheel_source_dispatch (GSource     *source,
+                                  GSourceFunc  callback,
+                                  gpointer     user_data)
+{
+        return callback (user_data);
+}
+
+static GSourceFuncs soup_timer_wheel_source_funcs = {
+        NULL,
+        NULL,
+        soup_timer_wheel_source_dispatch,
+        NULL,
+        NULL,
+        NULL
+};
+
+static SoupTimerWheel *
+soup_timer_wheel_get (GMainContext *context)
+{
+        SoupTimerWheel *wheel;
+        guint level, slot;
+
+        g_mutex_lock (&wheels_mutex);
+        if (!wheels)
+                wheels = g_hash_table_new (NULL, NULL);
+
+        wheel = g_hash_table_lookup (wheels, context);
+        if (wheel) {
+                wheel->ref_count++;
+                g_mutex_unlock (&wheels_mutex);
+                return wheel;
+        }
+
+        wheel = g_new0 (SoupTimerWheel, 1);
+        wheel->ref_count = 1;
+        wheel->context = g_main_context_ref (context);
+        g_mutex_init (&wheel->mutex);
+        wheel->start_time = g_get_monotonic_time ();
+        wheel->ready_time = -1;
+        for (level = 0; level < WHEEL_LEVELS; level++) {
+                for (slot = 0; slot < WHEEL_SIZE; slot++)
+                        g_queue_init (&wheel->slots[level][slot]);
+        }
+        g_queue_init (&wheel->expired);
+
+        wheel->source = g_source_new (&soup_timer_wheel_source_funcs, sizeof (GSource));
+        g_source_set_name (wheel->source, "Soup timer wheel");
+        g_source_set_ready_time (wheel->source, -1);
+        g_source_set_callback (wheel->source, soup_timer_wheel_dispatch, wheel, NULL);
+        g_source_attach (wheel->source, context);
+
+        g_hash_table_insert (wheels, context, wheel);
+        g_mutex_unlock (&wheels_mutex);
+
+        return wheel;
+}
+
+/**
+ * soup_timer_new: (skip)
+ * @context: (nullable): the #GMainContext to dispatch the timer in
+ * @func: the function to call when the timer expires
+ * @user_data: data for @func
+ *
+ * Creates a new timer in the timer wheel of @context, or of the global
+ * default context if %NULL. The timer is not armed.
+ *
+ * Returns: a new #SoupTimer
+ */
+SoupTimer *
+soup_timer_new (GMainContext  *context,
+                SoupTimerFunc  func,
+                gpointer       user_data)
+{
+        SoupTimer *timer;
+
+        timer = g_new0 (SoupTimer, 1);
+        timer->link.data = timer;
+        timer->wheel = soup_timer_wheel_get (context ? context : g_main_context_default ());
+        timer->func = func;
+        timer->user_data = user_data;
+
+        return timer;
+}
+
+/**
+ * soup_timer_free: (skip)
+ * @timer: a #SoupTimer
+ *
+ * Cancels and frees @timer.
+ */
+void
+soup_timer_free (SoupTimer *timer)
+{
+        soup_timer_cancel (timer);
+        soup_timer_wheel_unref (timer->wheel);
+        g_free (timer);
+}
+
+/**
+ * soup_timer_arm: (skip)
+ * @timer: a #SoupTimer
+ * @timeout_ms: the timeout in milliseconds
+ *
+ * Arms @timer to expire once after @timeout_ms, replacing its previous
+ * expiration time if it was already armed. The timer function is called
+ * at most once per arming; rearm it from the function to make it
+ * periodic.
+ */
+void
+soup_timer_arm (SoupTimer *timer,
+                guint64    timeout_ms)
+{
+        SoupTimerWheel *wheel = timer->wheel;
+
+        g_mutex_lock (&wheel->mutex);
+        if (timer->queue)
+                wheel_unlink (wheel, timer);
+        timer->expires = current_tick (wheel) + MAX (timeout_ms, 1);
+        wheel_insert (wheel, timer);
+        wheel_update_ready_time (wheel, FALSE);
+        g_mutex_unlock (&wheel->mutex);
+}
+
+/**
+ * soup_timer_cancel: (skip)
+ * @timer: a #SoupTimer
+ *
+ * Disarms @timer, if it was armed.
+ */
+void
+soup_timer_cancel (SoupTimer *timer)
+{
+        SoupTimerWheel *wheel = timer->wheel;
+
+        g_mutex_lock (&wheel->mutex);
+        if (timer->queue)
+                wheel_unlink (wheel, timer);
+        g_mutex_unlock (&wheel->mutex);
+}
+
+/**
+ * soup_timer_is_armed: (skip)
+ * @timer: a #SoupTimer
+ *
+ * Returns: whether @timer is armed and has not expired yet
+ */
+gboolean
+soup_timer_is_armed (SoupTimer *timer)
+{
+        SoupTimerWheel *wheel = timer->wheel;
+        gboolean armed;
+
+        g_mutex_lock (&wheel->mutex);
+        armed = timer->queue != NULL;
+        g_mutex_unlock (&wheel->mutex);
+
+        return armed;
+}
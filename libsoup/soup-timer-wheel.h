@@ -0,0 +1,28 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * Copyright 2026 The libsoup authors
+ */
+
+#ifndef __SOUP_TIMER_WHEEL_H__
+#define __SOUP_TIMER_WHEEL_H__ 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SoupTimer SoupTimer;
+
+typedef void (*SoupTimerFunc) (gpointer user_data);
+
+SoupTimer *soup_timer_new      (GMainContext  *context,
+                                SoupTimerFunc  func,
+                                gpointer       user_data);
+void       soup_timer_free     (SoupTimer     *timer);
+void       soup_timer_arm      (SoupTimer     *timer,
+                                guint64        timeout_ms);
+void       soup_timer_cancel   (SoupTimer     *timer);
+gboolean   soup_timer_is_armed (SoupTimer     *timer);
+
+G_END_DECLS
+
+#endif /* __SOUP_TIMER_WHEEL_H__ */
@@ -19,6 +19,7 @@
 #include "cookies/soup-cookie-jar-text.h"
 #include "soup-date-utils.h"
 #include "soup-enum-types.h"
+#include "soup-flight-recorder.h"
 #include "soup-form.h"
 #include "soup-headers.h"
 #include "hsts/soup-hsts-enforcer.h"
@@ -33,10 +34,14 @@
 #include "server/soup-auth-domain.h"
 #include "server/soup-auth-domain-basic.h"
 #include "server/soup-auth-domain-digest.h"
+#include "server/soup-content-encoder.h"
+#include "server/soup-form-data-parser.h"
 #include "server/soup-server.h"
 #include "server/soup-server-message.h"
+#include "server/soup-server-message-metrics.h"
 #include "soup-session.h"
 #include "soup-session-feature.h"
+#include "soup-session-stats.h"
 #include "soup-status.h"
 #include "soup-tld.h"
 #include "soup-uri-utils.h"
@@ -46,6 +51,7 @@
 #include "websocket/soup-websocket-extension.h"
 #include "websocket/soup-websocket-extension-deflate.h"
 #include "websocket/soup-websocket-extension-manager.h"
+#include "websocket/soup-websocket-prepared-message.h"
 
 #undef __SOUP_H_INSIDE__
 
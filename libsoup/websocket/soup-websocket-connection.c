@@ -25,8 +25,11 @@
 #include "soup-websocket-connection.h"
 #include "soup-enum-types.h"
 #include "soup-io-stream.h"
+#include "soup-timer-wheel.h"
 #include "soup-uri-utils-private.h"
 #include "soup-websocket-extension.h"
+#include "soup-websocket-extension-deflate-private.h"
+#include "soup-websocket-prepared-message-private.h"
 
 /*
  * SoupWebsocketConnection:
@@ -76,6 +79,7 @@ enum {
 	PROP_MAX_INCOMING_PAYLOAD_SIZE,
 	PROP_KEEPALIVE_INTERVAL,
 	PROP_EXTENSIONS,
+	PROP_STREAM_MESSAGES,
 
         LAST_PROPERTY
 };
@@ -88,6 +92,7 @@ enum {
 	CLOSING,
 	CLOSED,
 	PONG,
+	MESSAGE_CHUNK,
 	NUM_SIGNALS
 };
 
@@ -100,7 +105,14 @@ typedef enum {
 } SoupWebsocketQueueFlags;
 
 typedef struct {
-	GBytes *data;
+	guint8 header[SOUP_WEBSOCKET_FRAME_HEADER_MAX_LENGTH];
+	gsize header_len;
+	/* Payload as given by the caller (or the extensions), only
+	 * referenced. Client frames are masked into a pooled buffer
+	 * instead and the original payload is released.
+	 */
+	GBytes *payload;
+	GByteArray *masked;
 	gsize sent;
 	gsize amount;
 	SoupWebsocketQueueFlags flags;
@@ -125,7 +137,7 @@ typedef struct {
 	gboolean close_sent;
 	gboolean close_received;
 	gboolean dirty_close;
-	GSource *close_timeout;
+	SoupTimer *close_timeout;
 
 	gboolean io_closing;
 	gboolean io_closed;
@@ -137,12 +149,18 @@ typedef struct {
 	GPollableOutputStream *output;
 	GSource *output_source;
 	GQueue outgoing;
+	GQueue mask_pool;
 
 	/* Current message being assembled */
 	guint8 message_opcode;
 	GByteArray *message_data;
 
-	GSource *keepalive_timeout;
+	/* Current message being streamed */
+	gboolean stream_messages;
+	guint8 utf8_pending[4];
+	gsize utf8_pending_len;
+
+	SoupTimer *keepalive_timeout;
 
 	GList *extensions;
 } SoupWebsocketConnectionPrivate;
@@ -150,11 +168,13 @@ typedef struct {
 #define MAX_INCOMING_PAYLOAD_SIZE_DEFAULT   128 * 1024
 #define READ_BUFFER_SIZE 1024
 #define MASK_LENGTH 4
+#define MAX_OUTPUT_VECTORS 32
+#define MASK_POOL_MAX_BUFFERS 4
+#define MASK_POOL_MAX_BUFFER_SIZE 64 * 1024
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupWebsocketConnection, soup_websocket_connection, G_TYPE_OBJECT)
 
-static void queue_frame (SoupWebsocketConnection *self, SoupWebsocketQueueFlags flags,
-			 gpointer data, gsize len, gsize amount);
+static void queue_frame (SoupWebsocketConnection *self, Frame *frame);
 
 static void emit_error_and_close (SoupWebsocketConnection *self,
 				  GError *error, gboolean prejudice);
@@ -177,9 +197,9 @@ static gboolean on_web_socket_output (GObject *pollable_stream,
         } G_STMT_END
 
 /* see IETF RFC 3629 Section 4 */
-static gboolean
-utf8_validate (const char *str,
-               gsize max_len)
+gboolean
+soup_websocket_utf8_validate (const char *str,
+                              gsize       max_len)
 
 {
         const gchar *p;
@@ -242,17 +262,130 @@ utf8_validate (const char *str,
 
 #undef VALIDATE_BYTE
 
+static gsize
+utf8_sequence_length (guint8 c)
+{
+        if (c < 0x80)
+                return 1;
+        if (c < 0xc2) /* continuation byte or overlong lead byte */
+                return 0;
+        if (c < 0xe0)
+                return 2;
+        if (c < 0xf0)
+                return 3;
+        if (c < 0xf5)
+                return 4;
+        return 0;
+}
+
 static void
 frame_free (gpointer data)
 {
 	Frame *frame = data;
 
 	if (frame) {
-		g_bytes_unref (frame->data);
+		g_clear_pointer (&frame->payload, g_bytes_unref);
+		g_clear_pointer (&frame->masked, g_byte_array_unref);
 		g_slice_free (Frame, frame);
 	}
 }
 
+static GByteArray *
+mask_pool_acquire (SoupWebsocketConnection *self,
+		   gsize                    length)
+{
+	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
+	GByteArray *buffer;
+
+	buffer = g_queue_pop_head (&priv->mask_pool);
+	if (!buffer)
+		buffer = g_byte_array_sized_new (length);
+	g_byte_array_set_size (buffer, length);
+
+	return buffer;
+}
+
+static void
+mask_pool_release (SoupWebsocketConnection *self,
+		   GByteArray              *buffer)
+{
+	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
+
+	/* Don't keep big buffers around, they are rare */
+	if (buffer->len > MASK_POOL_MAX_BUFFER_SIZE ||
+	    g_queue_get_length (&priv->mask_pool) >= MASK_POOL_MAX_BUFFERS) {
+		g_byte_array_unref (buffer);
+		return;
+	}
+
+	g_byte_array_set_size (buffer, 0);
+	g_queue_push_head (&priv->mask_pool, buffer);
+}
+
+static void
+frame_recycle (SoupWebsocketConnection *self,
+	       Frame                   *frame)
+{
+	if (frame->masked) {
+		mask_pool_release (self, frame->masked);
+		frame->masked = NULL;
+	}
+	frame_free (frame);
+}
+
+static const guint8 *
+frame_get_payload (Frame *frame,
+		   gsize *length)
+{
+	if (frame->masked) {
+		*length = frame->masked->len;
+		return frame->masked->data;
+	}
+
+	if (frame->payload)
+		return g_bytes_get_data (frame->payload, length);
+
+	*length = 0;
+	return NULL;
+}
+
+static gsize
+frame_get_size (Frame *frame)
+{
+	gsize payload_len;
+
+	frame_get_payload (frame, &payload_len);
+	return frame->header_len + payload_len;
+}
+
+/* Fills at most two vectors with the parts of @frame that haven't been written yet */
+static guint
+frame_fill_vectors (Frame         *frame,
+		    GOutputVector *vectors)
+{
+	const guint8 *payload;
+	gsize payload_len;
+	guint n_vectors = 0;
+
+	payload = frame_get_payload (frame, &payload_len);
+
+	if (frame->sent < frame->header_len) {
+		vectors[n_vectors].buffer = frame->header + frame->sent;
+		vectors[n_vectors].size = frame->header_len - frame->sent;
+		n_vectors++;
+	}
+
+	if (payload_len > 0) {
+		gsize offset = frame->sent > frame->header_len ? frame->sent - frame->header_len : 0;
+
+		vectors[n_vectors].buffer = payload + offset;
+		vectors[n_vectors].size = payload_len - offset;
+		n_vectors++;
+	}
+
+	return n_vectors;
+}
+
 static void
 soup_websocket_connection_init (SoupWebsocketConnection *self)
 {
@@ -260,6 +393,7 @@ soup_websocket_connection_init (SoupWebsocketConnection *self)
 
 	priv->incoming = g_byte_array_sized_new (1024);
 	g_queue_init (&priv->outgoing);
+	g_queue_init (&priv->mask_pool);
 }
 
 static void
@@ -347,11 +481,7 @@ keepalive_stop_timeout (SoupWebsocketConnection *self)
 {
 	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
 
-	if (priv->keepalive_timeout) {
-		g_source_destroy (priv->keepalive_timeout);
-		g_source_unref (priv->keepalive_timeout);
-		priv->keepalive_timeout = NULL;
-	}
+	g_clear_pointer (&priv->keepalive_timeout, soup_timer_free);
 }
 
 static void
@@ -359,11 +489,7 @@ close_io_stop_timeout (SoupWebsocketConnection *self)
 {
 	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
 
-	if (priv->close_timeout) {
-		g_source_destroy (priv->close_timeout);
-		g_source_unref (priv->close_timeout);
-		priv->close_timeout = NULL;
-	}
+	g_clear_pointer (&priv->close_timeout, soup_timer_free);
 }
 
 static void
@@ -412,18 +538,16 @@ shutdown_wr_io_stream (SoupWebsocketConnection *self)
 	g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_STATE]);
 }
 
-static gboolean
+static void
 on_timeout_close_io (gpointer user_data)
 {
 	SoupWebsocketConnection *self = SOUP_WEBSOCKET_CONNECTION (user_data);
 	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
 
-	priv->close_timeout = 0;
+	g_clear_pointer (&priv->close_timeout, soup_timer_free);
 
 	g_debug ("peer did not close io when expected");
 	close_io_stream (self);
-
-	return FALSE;
 }
 
 static void
@@ -436,9 +560,8 @@ close_io_after_timeout (SoupWebsocketConnection *self)
 		return;
 
 	g_debug ("waiting %d seconds for peer to close io", timeout);
-	priv->close_timeout = g_timeout_source_new_seconds (timeout);
-	g_source_set_callback (priv->close_timeout, on_timeout_close_io, self, NULL);
-	g_source_attach (priv->close_timeout, g_main_context_get_thread_default ());
+	priv->close_timeout = soup_timer_new (g_main_context_get_thread_default (), on_timeout_close_io, self);
+	soup_timer_arm (priv->close_timeout, timeout * 1000);
 }
 
 static void
@@ -457,42 +580,40 @@ static void
 send_message (SoupWebsocketConnection *self,
 	      SoupWebsocketQueueFlags flags,
 	      guint8 opcode,
-	      const guint8 *data,
-	      gsize length)
+	      GBytes *payload)
 {
         SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
 	gsize buffered_amount;
-	GByteArray *bytes;
-	gsize frame_len;
+	const guint8 *data;
+	gsize length;
+	Frame *frame;
 	guint8 *outer;
-	guint8 mask_offset = 0;
-	GBytes *filtered_bytes;
 	GList *l;
 	GError *error = NULL;
 
 	if (!(soup_websocket_connection_get_state (self) == SOUP_WEBSOCKET_STATE_OPEN)) {
 		g_debug ("Ignoring message since the connection is closed or is closing");
+		g_bytes_unref (payload);
 		return;
 	}
 
-	bytes = g_byte_array_sized_new (14 + length);
-	outer = bytes->data;
+	frame = g_slice_new0 (Frame);
+	outer = frame->header;
 	outer[0] = 0x80 | opcode;
 
-	filtered_bytes = g_bytes_new_static (data, length);
 	for (l = priv->extensions; l != NULL; l = g_list_next (l)) {
 		SoupWebsocketExtension *extension;
 
 		extension = (SoupWebsocketExtension *)l->data;
-		filtered_bytes = soup_websocket_extension_process_outgoing_message (extension, outer, filtered_bytes, &error);
+		payload = soup_websocket_extension_process_outgoing_message (extension, outer, payload, &error);
 		if (error) {
-			g_byte_array_free (bytes, TRUE);
+			frame_free (frame);
 			emit_error_and_close (self, error, FALSE);
 			return;
 		}
 	}
 
-	data = g_bytes_get_data (filtered_bytes, &length);
+	data = g_bytes_get_data (payload, &length);
 	buffered_amount = length;
 
 	/* If control message, check payload size */
@@ -500,60 +621,41 @@ send_message (SoupWebsocketConnection *self,
 		if (length > 125) {
 			g_debug ("WebSocket control message payload exceeds size limit");
 			protocol_error_and_close (self);
-			g_byte_array_free (bytes, TRUE);
-			g_bytes_unref (filtered_bytes);
+			frame_free (frame);
+			g_bytes_unref (payload);
 			return;
 		}
 
 		buffered_amount = 0;
 	}
 
-	if (length < 126) {
-		outer[1] = (0xFF & length); /* mask | 7-bit-len */
-		bytes->len = 2;
-	} else if (length < 65536) {
-		outer[1] = 126; /* mask | 16-bit-len */
-		outer[2] = (length >> 8) & 0xFF;
-		outer[3] = (length >> 0) & 0xFF;
-		bytes->len = 4;
-	} else {
-		outer[1] = 127; /* mask | 64-bit-len */
-#if GLIB_SIZEOF_SIZE_T > 4
-		outer[2] = (length >> 56) & 0xFF;
-		outer[3] = (length >> 48) & 0xFF;
-		outer[4] = (length >> 40) & 0xFF;
-		outer[5] = (length >> 32) & 0xFF;
-#else
-		outer[2] = outer[3] = outer[4] = outer[5] = 0;
-#endif
-		outer[6] = (length >> 24) & 0xFF;
-		outer[7] = (length >> 16) & 0xFF;
-		outer[8] = (length >> 8) & 0xFF;
-		outer[9] = (length >> 0) & 0xFF;
-		bytes->len = 10;
-	}
+	frame->header_len = soup_websocket_frame_header_set_length (outer, length);
 
 	/* The server side doesn't need to mask, so we don't. There's
 	 * probably a client somewhere that's not expecting it.
 	 */
 	if (priv->connection_type == SOUP_WEBSOCKET_CONNECTION_CLIENT) {
 		guint32 rnd = g_random_int ();
+		guint8 *mask;
+
 		outer[1] |= 0x80;
-		mask_offset = bytes->len;
-		memcpy (outer + mask_offset, &rnd, sizeof (rnd));
-		bytes->len += MASK_LENGTH;
+		mask = outer + frame->header_len;
+		memcpy (mask, &rnd, sizeof (rnd));
+		frame->header_len += MASK_LENGTH;
+
+		frame->masked = mask_pool_acquire (self, length);
+		memcpy (frame->masked->data, data, length);
+		xor_with_mask (mask, frame->masked->data, length);
+		g_bytes_unref (payload);
+	} else {
+		frame->payload = payload;
 	}
 
-	g_byte_array_append (bytes, data, length);
-
-	if (priv->connection_type == SOUP_WEBSOCKET_CONNECTION_CLIENT)
-		xor_with_mask (bytes->data + mask_offset, bytes->data + mask_offset + MASK_LENGTH, length);
+	frame->amount = buffered_amount;
+	frame->flags = flags;
 
-	frame_len = bytes->len;
-	queue_frame (self, flags, g_byte_array_free (bytes, FALSE),
-		     frame_len, buffered_amount);
-	g_bytes_unref (filtered_bytes);
-	g_debug ("queued %d frame of len %u", (int)opcode, (guint)frame_len);
+	g_debug ("queued %d frame of len %u", (int)opcode, (guint)frame_get_size (frame));
+	queue_frame (self, frame);
 }
 
 static void
@@ -574,7 +676,7 @@ send_close (SoupWebsocketConnection *self,
 			len += g_strlcpy (buffer + len, reason, sizeof (buffer) - len);
 	}
 
-	send_message (self, flags, 0x08, (guint8 *)buffer, len);
+	send_message (self, flags, 0x08, g_bytes_new (buffer, len));
 	priv->close_sent = TRUE;
 
 	keepalive_stop_timeout (self);
@@ -782,7 +884,7 @@ receive_close (SoupWebsocketConnection *self,
 		data += 2;
 		len -= 2;
 		
-		if (!utf8_validate ((const char *)data, len)) {
+		if (!soup_websocket_utf8_validate ((const char *)data, len)) {
 			g_debug ("received non-UTF8 close data: %d '%.*s' %d", (int)len, (int)len, (char *)data, (int)data[0]);
 			protocol_error_and_close (self);
 			return;
@@ -808,7 +910,7 @@ receive_ping (SoupWebsocketConnection *self,
 {
 	/* Send back a pong with same data */
 	g_debug ("received ping, responding");
-	send_message (self, SOUP_WEBSOCKET_QUEUE_URGENT, 0x0A, data, len);
+	send_message (self, SOUP_WEBSOCKET_QUEUE_URGENT, 0x0A, g_bytes_new (data, len));
 }
 
 static void
@@ -832,6 +934,90 @@ receive_pong (SoupWebsocketConnection *self,
 
 }
 
+/* Validates a chunk of a streamed text message. Sequences split
+ * between chunks are kept in utf8_pending until the next chunk.
+ */
+static gboolean
+utf8_validate_chunk (SoupWebsocketConnection *self,
+                     const guint8            *data,
+                     gsize                    len,
+                     gboolean                 fin)
+{
+	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
+
+	if (priv->utf8_pending_len > 0) {
+		gsize needed = utf8_sequence_length (priv->utf8_pending[0]);
+		gsize n = MIN (needed - priv->utf8_pending_len, len);
+
+		memcpy (priv->utf8_pending + priv->utf8_pending_len, data, n);
+		priv->utf8_pending_len += n;
+		data += n;
+		len -= n;
+
+		if (priv->utf8_pending_len < needed)
+			return !fin;
+
+		if (!soup_websocket_utf8_validate ((const char *)priv->utf8_pending, needed))
+			return FALSE;
+		priv->utf8_pending_len = 0;
+	}
+
+	if (!fin) {
+		gsize i;
+
+		for (i = 1; i <= MIN (len, 3); i++) {
+			guint8 c = data[len - i];
+
+			if (c < 0x80)
+				break;
+
+			if (c >= 0xc0) {
+				if (utf8_sequence_length (c) > i) {
+					memcpy (priv->utf8_pending, data + len - i, i);
+					priv->utf8_pending_len = i;
+					len -= i;
+				}
+				break;
+			}
+		}
+	}
+
+	return soup_websocket_utf8_validate ((const char *)data, len);
+}
+
+static void
+deliver_message_chunk (SoupWebsocketConnection *self,
+		       gboolean fin,
+		       const guint8 *payload,
+		       gsize payload_len)
+{
+	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
+	GBytes *chunk;
+	guint8 opcode;
+
+	opcode = priv->message_opcode;
+	if (opcode == 0x01 && !utf8_validate_chunk (self, payload, payload_len, fin)) {
+		g_debug ("received invalid non-UTF8 text data");
+
+		/* Discard the rest of the message */
+		priv->message_opcode = 0;
+		priv->utf8_pending_len = 0;
+
+		bad_data_error_and_close (self);
+		return;
+	}
+
+	if (fin)
+		priv->message_opcode = 0;
+
+	/* The payload might point to the incoming buffer, so copy it */
+	chunk = g_bytes_new (payload, payload_len);
+	g_debug ("message: delivering chunk of %d with %d length%s",
+		 (int)opcode, (int)payload_len, fin ? " (last)" : "");
+	g_signal_emit (self, signals[MESSAGE_CHUNK], 0, (int)opcode, chunk, fin);
+	g_bytes_unref (chunk);
+}
+
 static void
 process_contents (SoupWebsocketConnection *self,
 		  gboolean control,
@@ -881,7 +1067,7 @@ process_contents (SoupWebsocketConnection *self,
 
 		if (!fin && opcode) {
 			/* Initial fragment of a message */
-			if (priv->message_data) {
+			if (priv->message_opcode) {
 				g_debug ("received out of order initial message fragment");
 				protocol_error_and_close (self);
 				return;
@@ -889,7 +1075,7 @@ process_contents (SoupWebsocketConnection *self,
 			g_debug ("received initial fragment frame %d with %d payload", (int)opcode, (int)payload_len);
 		} else if (!fin && !opcode) {
 			/* Middle fragment of a message */
-			if (!priv->message_data) {
+			if (!priv->message_opcode) {
 				g_debug ("received out of order middle message fragment");
 				protocol_error_and_close (self);
 				return;
@@ -897,7 +1083,7 @@ process_contents (SoupWebsocketConnection *self,
 			g_debug ("received middle fragment frame with %d payload", (int)payload_len);
 		} else if (fin && !opcode) {
 			/* Last fragment of a message */
-			if (!priv->message_data) {
+			if (!priv->message_opcode) {
 				g_debug ("received out of order ending message fragment");
 				protocol_error_and_close (self);
 				return;
@@ -906,7 +1092,7 @@ process_contents (SoupWebsocketConnection *self,
 		} else {
 			/* An unfragmented message */
 			g_assert (opcode != 0);
-			if (priv->message_data) {
+			if (priv->message_opcode) {
 				g_debug ("received unfragmented message when fragment was expected");
 				protocol_error_and_close (self);
 				return;
@@ -916,13 +1102,15 @@ process_contents (SoupWebsocketConnection *self,
 
 		if (opcode) {
 			priv->message_opcode = opcode;
-			priv->message_data = g_byte_array_sized_new (payload_len + 1);
+			if (priv->stream_messages)
+				priv->utf8_pending_len = 0;
+			else
+				priv->message_data = g_byte_array_sized_new (payload_len + 1);
 		}
 
 		switch (priv->message_opcode) {
 		case 0x01:
 		case 0x02:
-			g_byte_array_append (priv->message_data, payload, payload_len);
 			break;
 		default:
 			g_debug ("received unknown data frame: %d", (int)opcode);
@@ -930,11 +1118,21 @@ process_contents (SoupWebsocketConnection *self,
 			return;
 		}
 
+		/* The mode is chosen when the message starts, changing
+		 * it only affects the next messages.
+		 */
+		if (!priv->message_data) {
+			deliver_message_chunk (self, fin, payload, payload_len);
+			return;
+		}
+
+		g_byte_array_append (priv->message_data, payload, payload_len);
+
 		/* Actually deliver the message? */
 		if (fin) {
 			if (priv->message_opcode == 0x01 &&
-			    !utf8_validate((const char *)priv->message_data->data,
-					   priv->message_data->len)) {
+			    !soup_websocket_utf8_validate ((const char *)priv->message_data->data,
+							   priv->message_data->len)) {
 
 				g_debug ("received invalid non-UTF8 text data");
 
@@ -1183,11 +1381,13 @@ static void
 soup_websocket_connection_write (SoupWebsocketConnection *self)
 {
 	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
-	const guint8 *data;
+	GOutputVector vectors[MAX_OUTPUT_VECTORS];
+	gsize n_vectors = 0;
+	gsize bytes_written = 0;
+	GPollableReturn result;
 	GError *error = NULL;
 	Frame *frame;
-	gssize count;
-	gsize len;
+	GList *l;
 
 	soup_websocket_connection_stop_output_source (self);
 
@@ -1196,36 +1396,49 @@ soup_websocket_connection_write (SoupWebsocketConnection *self)
 		return;
 	}
 
-	frame = g_queue_peek_head (&priv->outgoing);
-
 	/* No more frames to send */
-	if (frame == NULL)
+	if (g_queue_is_empty (&priv->outgoing))
 		return;
 
-	data = g_bytes_get_data (frame->data, &len);
-	g_assert (len > 0);
-	g_assert (len > frame->sent);
+	/* Flush as many queued frames as possible with a single write,
+	 * but never anything queued after the last frame.
+	 */
+	for (l = g_queue_peek_head_link (&priv->outgoing); l && n_vectors + 2 <= MAX_OUTPUT_VECTORS; l = l->next) {
+		frame = l->data;
 
-	count = g_pollable_output_stream_write_nonblocking (priv->output,
-							    data + frame->sent,
-							    len - frame->sent,
-							    NULL, &error);
+		n_vectors += frame_fill_vectors (frame, vectors + n_vectors);
+		if (frame->flags & SOUP_WEBSOCKET_QUEUE_LAST)
+			break;
+	}
+	g_assert (n_vectors > 0);
+
+	result = g_pollable_output_stream_writev_nonblocking (priv->output,
+							      vectors, n_vectors,
+							      &bytes_written,
+							      NULL, &error);
+	switch (result) {
+	case G_POLLABLE_RETURN_FAILED:
+		emit_error_and_close (self, error, TRUE);
+		return;
+	case G_POLLABLE_RETURN_WOULD_BLOCK:
+		g_debug ("failed to send frame because it would block, marking as pending");
+		frame = g_queue_peek_head (&priv->outgoing);
+		frame->pending = TRUE;
+		bytes_written = 0;
+		break;
+	case G_POLLABLE_RETURN_OK:
+		break;
+	}
 
-	if (count < 0) {
-		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
-			g_clear_error (&error);
-			count = 0;
+	while ((frame = g_queue_peek_head (&priv->outgoing))) {
+		gsize remaining = frame_get_size (frame) - frame->sent;
 
-			g_debug ("failed to send frame because it would block, marking as pending");
-			frame->pending = TRUE;
-		} else {
-			emit_error_and_close (self, error, TRUE);
-			return;
+		if (bytes_written < remaining) {
+			frame->sent += bytes_written;
+			break;
 		}
-	}
 
-	frame->sent += count;
-	if (frame->sent >= len) {
+		bytes_written -= remaining;
 		g_debug ("sent frame");
 		g_queue_pop_head (&priv->outgoing);
 
@@ -1236,13 +1449,15 @@ soup_websocket_connection_write (SoupWebsocketConnection *self)
 				shutdown_wr_io_stream (self);
 				close_io_after_timeout (self);
 			}
+			frame_recycle (self, frame);
+			break;
 		}
-		frame_free (frame);
-
-		if (g_queue_is_empty (&priv->outgoing))
-			return;
+		frame_recycle (self, frame);
 	}
 
+	if (g_queue_is_empty (&priv->outgoing))
+		return;
+
 	soup_websocket_connection_start_output_source (self);
 }
 
@@ -1257,26 +1472,16 @@ on_web_socket_output (GObject *pollable_stream,
 
 static void
 queue_frame (SoupWebsocketConnection *self,
-	     SoupWebsocketQueueFlags flags,
-	     gpointer data,
-	     gsize len,
-	     gsize amount)
+	     Frame *frame)
 {
         SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
-	Frame *frame;
 
 	g_return_if_fail (SOUP_IS_WEBSOCKET_CONNECTION (self));
 	g_return_if_fail (priv->close_sent == FALSE);
-	g_return_if_fail (data != NULL);
-	g_return_if_fail (len > 0);
-
-	frame = g_slice_new0 (Frame);
-	frame->data = g_bytes_new_take (data, len);
-	frame->amount = amount;
-	frame->flags = flags;
+	g_return_if_fail (frame->header_len > 0);
 
 	/* If urgent put at front of queue */
-	if (flags & SOUP_WEBSOCKET_QUEUE_URGENT) {
+	if (frame->flags & SOUP_WEBSOCKET_QUEUE_URGENT) {
 		GList *l;
 
 		/* Find out the first frame that is not urgent or partially sent or pending */
@@ -1367,6 +1572,10 @@ soup_websocket_connection_get_property (GObject *object,
 		g_value_set_pointer (value, priv->extensions);
 		break;
 
+	case PROP_STREAM_MESSAGES:
+		g_value_set_boolean (value, priv->stream_messages);
+		break;
+
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -1420,6 +1629,10 @@ soup_websocket_connection_set_property (GObject *object,
 		priv->extensions = g_value_get_pointer (value);
 		break;
 
+	case PROP_STREAM_MESSAGES:
+		soup_websocket_connection_set_stream_messages (self, g_value_get_boolean (value));
+		break;
+
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -1450,6 +1663,8 @@ soup_websocket_connection_finalize (GObject *object)
 		g_byte_array_free (priv->incoming, TRUE);
 	while (!g_queue_is_empty (&priv->outgoing))
 		frame_free (g_queue_pop_head (&priv->outgoing));
+	while (!g_queue_is_empty (&priv->mask_pool))
+		g_byte_array_unref (g_queue_pop_head (&priv->mask_pool));
 
 	g_clear_object (&priv->io_stream);
 	g_assert (!priv->input_source);
@@ -1625,6 +1840,29 @@ soup_websocket_connection_class_init (SoupWebsocketConnectionClass *klass)
                                       G_PARAM_CONSTRUCT_ONLY |
                                       G_PARAM_STATIC_STRINGS);
 
+        /**
+         * SoupWebsocketConnection:stream-messages:
+         *
+         * Whether to deliver incoming messages in chunks as they arrive.
+         *
+         * When %TRUE, data messages are delivered with the
+         * [signal@WebsocketConnection::message-chunk] signal as every frame
+         * is received, instead of being assembled in memory and delivered
+         * with [signal@WebsocketConnection::message]. Memory used by incoming
+         * messages is then bounded by the frame size, limited by
+         * [property@WebsocketConnection:max-incoming-payload-size], rather
+         * than by the message size.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_STREAM_MESSAGES] =
+                g_param_spec_boolean ("stream-messages",
+                                      "Stream messages",
+                                      "Whether to deliver incoming messages in chunks",
+                                      FALSE,
+                                      G_PARAM_READWRITE |
+                                      G_PARAM_STATIC_STRINGS);
+
         g_object_class_install_properties (gobject_class, LAST_PROPERTY, properties);
 
 	/**
@@ -1713,6 +1951,31 @@ soup_websocket_connection_class_init (SoupWebsocketConnectionClass *klass)
 				      0,
 				      NULL, NULL, g_cclosure_marshal_generic,
 				      G_TYPE_NONE, 1, G_TYPE_BYTES);
+
+	/**
+	 * SoupWebsocketConnection::message-chunk:
+	 * @self: the WebSocket
+	 * @type: the type of message contents
+	 * @chunk: the chunk data
+	 * @is_last: whether @chunk is the last one of the message
+	 *
+	 * Emitted when we receive part of a message from the peer and
+	 * [property@WebsocketConnection:stream-messages] is enabled.
+	 *
+	 * Chunks are delivered in order as frames arrive, already
+	 * decompressed. Text messages are validated incrementally, but
+	 * a chunk might end in the middle of a UTF-8 sequence. Unlike
+	 * [signal@WebsocketConnection::message], @chunk is not
+	 * %NULL-terminated.
+	 *
+	 * Since: 3.4
+	 */
+	signals[MESSAGE_CHUNK] = g_signal_new ("message-chunk",
+					       SOUP_TYPE_WEBSOCKET_CONNECTION,
+					       G_SIGNAL_RUN_FIRST,
+					       0,
+					       NULL, NULL, g_cclosure_marshal_generic,
+					       G_TYPE_NONE, 3, G_TYPE_INT, G_TYPE_BYTES, G_TYPE_BOOLEAN);
 }
 
 /**
@@ -1956,9 +2219,9 @@ soup_websocket_connection_send_text (SoupWebsocketConnection *self,
 	g_return_if_fail (text != NULL);
 
 	length = strlen (text);
-        g_return_if_fail (utf8_validate (text, length));
+        g_return_if_fail (soup_websocket_utf8_validate (text, length));
 
-	send_message (self, SOUP_WEBSOCKET_QUEUE_NORMAL, 0x01, (const guint8 *) text, length);
+	send_message (self, SOUP_WEBSOCKET_QUEUE_NORMAL, 0x01, g_bytes_new (text, length));
 }
 
 /**
@@ -1983,7 +2246,7 @@ soup_websocket_connection_send_binary (SoupWebsocketConnection *self,
 	g_return_if_fail (soup_websocket_connection_get_state (self) == SOUP_WEBSOCKET_STATE_OPEN);
 	g_return_if_fail (data != NULL || length == 0);
 
-	send_message (self, SOUP_WEBSOCKET_QUEUE_NORMAL, 0x02, data, length);
+	send_message (self, SOUP_WEBSOCKET_QUEUE_NORMAL, 0x02, g_bytes_new (data, length));
 }
 
 /**
@@ -1996,24 +2259,145 @@ soup_websocket_connection_send_binary (SoupWebsocketConnection *self,
  * allows to send text messages containing %NULL characters.
  *
  * The message is queued to be sent and will be sent when the main loop
- * is run.
+ * is run. The contents of @message are not copied, a reference is kept
+ * until the message has been sent.
  */
 void
 soup_websocket_connection_send_message (SoupWebsocketConnection *self,
                                         SoupWebsocketDataType type,
                                         GBytes *message)
+{
+        g_return_if_fail (message != NULL);
+
+        soup_websocket_connection_send_bytes (self, type, g_bytes_ref (message));
+}
+
+/**
+ * soup_websocket_connection_send_bytes:
+ * @self: the WebSocket
+ * @type: the type of message contents
+ * @message: (transfer full): the message data as #GBytes
+ *
+ * Send a message of the given @type to the peer taking ownership of @message.
+ *
+ * This is like [method@WebsocketConnection.send_message], but the reference
+ * to @message is transferred to the connection, so callers producing a
+ * message just to send it don't need to keep or release it. The contents of
+ * @message are never copied on the server side.
+ *
+ * The message is queued to be sent and will be sent when the main loop
+ * is run.
+ *
+ * Since: 3.4
+ */
+void
+soup_websocket_connection_send_bytes (SoupWebsocketConnection *self,
+                                      SoupWebsocketDataType    type,
+                                      GBytes                  *message)
 {
         gconstpointer data;
         gsize length;
+        gboolean valid_utf8;
+
+        g_return_if_fail (message != NULL);
+
+        /* @message is owned from here on, so it's released before
+         * failing any of the checks.
+         */
+        data = g_bytes_get_data (message, &length);
+        valid_utf8 = type != SOUP_WEBSOCKET_DATA_TEXT || soup_websocket_utf8_validate ((const char *)data, length);
+        if (!SOUP_IS_WEBSOCKET_CONNECTION (self) ||
+            soup_websocket_connection_get_state (self) != SOUP_WEBSOCKET_STATE_OPEN ||
+            !valid_utf8) {
+                g_bytes_unref (message);
+                g_return_if_fail (SOUP_IS_WEBSOCKET_CONNECTION (self));
+                g_return_if_fail (soup_websocket_connection_get_state (self) == SOUP_WEBSOCKET_STATE_OPEN);
+                g_return_if_fail (valid_utf8);
+                return;
+        }
+
+        send_message (self, SOUP_WEBSOCKET_QUEUE_NORMAL, (int)type, message);
+}
+
+static gboolean
+get_prepared_message_params (SoupWebsocketConnection      *self,
+                             SoupWebsocketPreparedMessage *message,
+                             SoupWebsocketDeflateParams   *params)
+{
+        SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
+        GList *l;
+
+        /* Client frames are masked with a different key every time */
+        if (priv->connection_type != SOUP_WEBSOCKET_CONNECTION_SERVER)
+                return FALSE;
+
+        params->window_bits = 0;
+        for (l = priv->extensions; l != NULL; l = g_list_next (l)) {
+                /* Other extensions might change the payload in ways we can't cache */
+                if (!SOUP_IS_WEBSOCKET_EXTENSION_DEFLATE (l->data))
+                        return FALSE;
+
+                if (!soup_websocket_extension_deflate_get_outgoing_params (l->data,
+                                                                           g_bytes_get_size (soup_websocket_prepared_message_get_data (message)),
+                                                                           params))
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * soup_websocket_connection_send_prepared_message:
+ * @self: the WebSocket
+ * @message: a #SoupWebsocketPreparedMessage
+ *
+ * Send a prepared message to the peer.
+ *
+ * Server connections without extensions, or with permessage-deflate
+ * negotiated without context takeover, queue the frame cached in @message
+ * by reference, so that it's only framed and compressed once no matter how
+ * many connections it's sent to. Other connections send the message data
+ * as [method@WebsocketConnection.send_message] would do.
+ *
+ * The message is queued to be sent and will be sent when the main loop
+ * is run.
+ *
+ * Since: 3.4
+ */
+void
+soup_websocket_connection_send_prepared_message (SoupWebsocketConnection      *self,
+                                                 SoupWebsocketPreparedMessage *message)
+{
+        SoupWebsocketDeflateParams params;
+        Frame *frame;
+        GError *error = NULL;
 
         g_return_if_fail (SOUP_IS_WEBSOCKET_CONNECTION (self));
         g_return_if_fail (soup_websocket_connection_get_state (self) == SOUP_WEBSOCKET_STATE_OPEN);
         g_return_if_fail (message != NULL);
 
-        data = g_bytes_get_data (message, &length);
-        g_return_if_fail (type != SOUP_WEBSOCKET_DATA_TEXT || utf8_validate ((const char *)data, length));
+        if (!get_prepared_message_params (self, message, &params)) {
+                send_message (self, SOUP_WEBSOCKET_QUEUE_NORMAL,
+                              (int)soup_websocket_prepared_message_get_data_type (message),
+                              g_bytes_ref (soup_websocket_prepared_message_get_data (message)));
+                return;
+        }
+
+        frame = g_slice_new0 (Frame);
+        frame->payload = soup_websocket_prepared_message_get_frame (message, &params,
+                                                                    frame->header, &frame->header_len,
+                                                                    &error);
+        if (!frame->payload) {
+                frame_free (frame);
+                emit_error_and_close (self, error, FALSE);
+                return;
+        }
 
-        send_message (self, SOUP_WEBSOCKET_QUEUE_NORMAL, (int)type, data, length);
+        frame->amount = g_bytes_get_size (frame->payload);
+        frame->flags = SOUP_WEBSOCKET_QUEUE_NORMAL;
+
+        g_debug ("queued prepared frame of len %u", (guint)frame_get_size (frame));
+        queue_frame (self, frame);
 }
 
 /**
@@ -2113,18 +2497,18 @@ soup_websocket_connection_get_keepalive_interval (SoupWebsocketConnection *self)
 	return priv->keepalive_interval;
 }
 
-static gboolean
+static void
 on_queue_ping (gpointer user_data)
 {
 	SoupWebsocketConnection *self = SOUP_WEBSOCKET_CONNECTION (user_data);
+	SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
 	static const char ping_payload[] = "libsoup";
 
 	g_debug ("sending ping message");
 
+	soup_timer_arm (priv->keepalive_timeout, (guint64)priv->keepalive_interval * 1000);
 	send_message (self, SOUP_WEBSOCKET_QUEUE_NORMAL, 0x09,
-		      (guint8 *) ping_payload, strlen(ping_payload));
-
-	return G_SOURCE_CONTINUE;
+		      g_bytes_new_static (ping_payload, strlen (ping_payload)));
 }
 
 /**
@@ -2152,9 +2536,56 @@ soup_websocket_connection_set_keepalive_interval (SoupWebsocketConnection *self,
 		keepalive_stop_timeout (self);
 
 		if (interval > 0) {
-			priv->keepalive_timeout = g_timeout_source_new_seconds (interval);
-			g_source_set_callback (priv->keepalive_timeout, on_queue_ping, self, NULL);
-			g_source_attach (priv->keepalive_timeout, g_main_context_get_thread_default ());
+			priv->keepalive_timeout = soup_timer_new (g_main_context_get_thread_default (), on_queue_ping, self);
+			soup_timer_arm (priv->keepalive_timeout, (guint64)interval * 1000);
 		}
 	}
 }
+
+/**
+ * soup_websocket_connection_get_stream_messages:
+ * @self: the WebSocket
+ *
+ * Gets whether incoming messages are delivered in chunks.
+ *
+ * Returns: %TRUE if messages are delivered with
+ *   [signal@WebsocketConnection::message-chunk]
+ *
+ * Since: 3.4
+ */
+gboolean
+soup_websocket_connection_get_stream_messages (SoupWebsocketConnection *self)
+{
+        SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
+
+	g_return_val_if_fail (SOUP_IS_WEBSOCKET_CONNECTION (self), FALSE);
+
+	return priv->stream_messages;
+}
+
+/**
+ * soup_websocket_connection_set_stream_messages:
+ * @self: the WebSocket
+ * @stream_messages: whether to deliver incoming messages in chunks
+ *
+ * Sets whether incoming messages are delivered in chunks with
+ * [signal@WebsocketConnection::message-chunk] as they arrive,
+ * instead of being assembled in memory.
+ *
+ * The change only affects messages started after this call.
+ *
+ * Since: 3.4
+ */
+void
+soup_websocket_connection_set_stream_messages (SoupWebsocketConnection *self,
+                                               gboolean                 stream_messages)
+{
+        SoupWebsocketConnectionPrivate *priv = soup_websocket_connection_get_instance_private (self);
+
+	g_return_if_fail (SOUP_IS_WEBSOCKET_CONNECTION (self));
+
+	if (priv->stream_messages != stream_messages) {
+		priv->stream_messages = stream_messages;
+		g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_STREAM_MESSAGES]);
+	}
+}
@@ -22,6 +22,7 @@
 
 #include "soup-types.h"
 #include "soup-websocket.h"
+#include "soup-websocket-prepared-message.h"
 
 G_BEGIN_DECLS
 
@@ -75,6 +76,13 @@ SOUP_AVAILABLE_IN_ALL
 void                soup_websocket_connection_send_message   (SoupWebsocketConnection *self,
 							      SoupWebsocketDataType type,
 							      GBytes *message);
+SOUP_AVAILABLE_IN_3_4
+void                soup_websocket_connection_send_bytes     (SoupWebsocketConnection *self,
+							      SoupWebsocketDataType type,
+							      GBytes *message);
+SOUP_AVAILABLE_IN_3_4
+void                soup_websocket_connection_send_prepared_message (SoupWebsocketConnection      *self,
+                                                                     SoupWebsocketPreparedMessage *message);
 
 SOUP_AVAILABLE_IN_ALL
 void                soup_websocket_connection_close          (SoupWebsocketConnection *self,
@@ -95,4 +103,11 @@ SOUP_AVAILABLE_IN_ALL
 void                soup_websocket_connection_set_keepalive_interval (SoupWebsocketConnection *self,
                                                                       guint                    interval);
 
+SOUP_AVAILABLE_IN_3_4
+gboolean            soup_websocket_connection_get_stream_messages (SoupWebsocketConnection *self);
+
+SOUP_AVAILABLE_IN_3_4
+void                soup_websocket_connection_set_stream_messages (SoupWebsocketConnection *self,
+                                                                   gboolean                 stream_messages);
+
 G_END_DECLS
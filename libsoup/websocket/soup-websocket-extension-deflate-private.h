@@ -0,0 +1,27 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-websocket-extension-deflate-private.h
+ *
+ * Copyright (C) 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-websocket-extension-deflate.h"
+
+G_BEGIN_DECLS
+
+typedef struct {
+        int window_bits;
+        int compression_level;
+        int mem_level;
+} SoupWebsocketDeflateParams;
+
+gboolean soup_websocket_extension_deflate_get_outgoing_params (SoupWebsocketExtensionDeflate    *extension,
+                                                               gsize                             payload_length,
+                                                               SoupWebsocketDeflateParams       *params);
+GBytes  *soup_websocket_extension_deflate_compress            (GBytes                           *payload,
+                                                               const SoupWebsocketDeflateParams *params,
+                                                               GError                          **error);
+
+G_END_DECLS
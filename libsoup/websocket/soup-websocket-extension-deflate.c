@@ -25,20 +25,47 @@
 #include <config.h>
 #endif
 
-#include "soup-websocket-extension-deflate.h"
+#include "soup-websocket-extension-deflate-private.h"
 #include <zlib.h>
 
 typedef struct {
-        z_stream zstream;
+        /* Created on demand and, with no context takeover,
+         * given back to the pool after every message.
+         */
+        z_stream *zstream;
+        guint pool_key;
         gboolean no_context_takeover;
+        int window_bits;
 } Deflater;
 
 typedef struct {
-        z_stream zstream;
+        z_stream *zstream;
+        guint pool_key;
+        gboolean no_context_takeover;
+        int window_bits;
         gboolean uncompress_ongoing;
 } Inflater;
 
 #define BUFFER_SIZE 4096
+#define ZSTREAM_POOL_MAX_SIZE 16
+#define OUTPUT_BUFFER_MAX_SIZE 256 * 1024
+
+#define DEFAULT_COMPRESSION_LEVEL Z_DEFAULT_COMPRESSION
+#define DEFAULT_MEM_LEVEL 8
+#define DEFAULT_MAX_WINDOW_BITS 15
+
+enum {
+        PROP_0,
+
+        PROP_COMPRESSION_THRESHOLD,
+        PROP_COMPRESSION_LEVEL,
+        PROP_MEM_LEVEL,
+        PROP_MAX_WINDOW_BITS,
+
+        LAST_PROPERTY
+};
+
+static GParamSpec *properties[LAST_PROPERTY] = { NULL, };
 
 typedef enum {
         PARAM_SERVER_NO_CONTEXT_TAKEOVER   = 1 << 0,
@@ -62,10 +89,27 @@ typedef struct {
 
         gboolean enabled;
 
+        guint compression_threshold;
+        int compression_level;
+        int mem_level;
+        int max_window_bits;
+
         Deflater deflater;
         Inflater inflater;
 } SoupWebsocketExtensionDeflatePrivate;
 
+/* Idle zlib streams shared by all connections, keyed by their configuration */
+typedef struct {
+        GMutex mutex;
+        GHashTable *streams;
+} ZStreamPool;
+
+static ZStreamPool deflater_pool;
+static ZStreamPool inflater_pool;
+
+/* Scratch buffer to compress into before copying the result out */
+static GPrivate output_buffer = G_PRIVATE_INIT ((GDestroyNotify)g_byte_array_unref);
+
 /**
  * SoupWebsocketExtensionDeflate:
  *
@@ -74,13 +118,199 @@ typedef struct {
  *
  * This extension is used by default in a [class@Session] when [class@WebsocketExtensionManager]
  * feature is present, and always used by [class@Server].
+ *
+ * The compression can be tuned with the
+ * [property@WebsocketExtensionDeflate:compression-threshold],
+ * [property@WebsocketExtensionDeflate:compression-level],
+ * [property@WebsocketExtensionDeflate:mem-level] and
+ * [property@WebsocketExtensionDeflate:max-window-bits] properties of the
+ * extensions returned by [method@WebsocketConnection.get_extensions].
+ *
+ * zlib streams are only allocated while they are needed. When no context
+ * takeover has been negotiated they are returned to a pool shared by all
+ * connections after every message, so idle connections don't hold any
+ * compression state.
  */
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupWebsocketExtensionDeflate, soup_websocket_extension_deflate, SOUP_TYPE_WEBSOCKET_EXTENSION)
 
+static guint
+zstream_pool_key (int level,
+                  int mem_level,
+                  int window_bits)
+{
+        /* level is in the range [-1, 9] */
+        return ((level + 1) << 8) | (mem_level << 4) | window_bits;
+}
+
+static z_stream *
+zstream_pool_take (ZStreamPool *pool,
+                   guint        key)
+{
+        z_stream *zstream = NULL;
+        GQueue *queue;
+
+        g_mutex_lock (&pool->mutex);
+        if (pool->streams) {
+                queue = g_hash_table_lookup (pool->streams, GUINT_TO_POINTER (key));
+                if (queue)
+                        zstream = g_queue_pop_head (queue);
+        }
+        g_mutex_unlock (&pool->mutex);
+
+        return zstream;
+}
+
+static gboolean
+zstream_pool_give (ZStreamPool *pool,
+                   guint        key,
+                   z_stream    *zstream)
+{
+        GQueue *queue;
+        gboolean pooled = FALSE;
+
+        g_mutex_lock (&pool->mutex);
+        if (!pool->streams)
+                pool->streams = g_hash_table_new (NULL, NULL);
+        queue = g_hash_table_lookup (pool->streams, GUINT_TO_POINTER (key));
+        if (!queue) {
+                queue = g_queue_new ();
+                g_hash_table_insert (pool->streams, GUINT_TO_POINTER (key), queue);
+        }
+        if (g_queue_get_length (queue) < ZSTREAM_POOL_MAX_SIZE) {
+                g_queue_push_head (queue, zstream);
+                pooled = TRUE;
+        }
+        g_mutex_unlock (&pool->mutex);
+
+        return pooled;
+}
+
+static z_stream *
+deflater_stream_new (int      level,
+                     int      mem_level,
+                     int      window_bits,
+                     GError **error)
+{
+        z_stream *zstream;
+
+        zstream = zstream_pool_take (&deflater_pool, zstream_pool_key (level, mem_level, window_bits));
+        if (zstream)
+                return zstream;
+
+        zstream = g_new0 (z_stream, 1);
+        if (deflateInit2 (zstream, level, Z_DEFLATED, -window_bits, mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+                g_free (zstream);
+                g_set_error_literal (error,
+                                     SOUP_WEBSOCKET_ERROR,
+                                     SOUP_WEBSOCKET_CLOSE_PROTOCOL_ERROR,
+                                     "Failed to initialize compression");
+                return NULL;
+        }
+
+        return zstream;
+}
+
+static void
+deflater_stream_free (z_stream *zstream,
+                      guint     key)
+{
+        deflateReset (zstream);
+        if (zstream_pool_give (&deflater_pool, key, zstream))
+                return;
+
+        deflateEnd (zstream);
+        g_free (zstream);
+}
+
+static int
+deflater_get_window_bits (SoupWebsocketExtensionDeflatePrivate *priv)
+{
+        return MIN (priv->max_window_bits, priv->deflater.window_bits);
+}
+
+static z_stream *
+deflater_acquire (SoupWebsocketExtensionDeflatePrivate *priv,
+                  GError                              **error)
+{
+        Deflater *deflater = &priv->deflater;
+
+        if (deflater->zstream)
+                return deflater->zstream;
+
+        deflater->zstream = deflater_stream_new (priv->compression_level, priv->mem_level,
+                                                 deflater_get_window_bits (priv), error);
+        deflater->pool_key = zstream_pool_key (priv->compression_level, priv->mem_level,
+                                               deflater_get_window_bits (priv));
+
+        return deflater->zstream;
+}
+
+static void
+deflater_release (Deflater *deflater,
+                  gboolean  force)
+{
+        if (!deflater->zstream)
+                return;
+
+        if (!force && !deflater->no_context_takeover)
+                return;
+
+        deflater_stream_free (deflater->zstream, deflater->pool_key);
+        deflater->zstream = NULL;
+}
+
+static z_stream *
+inflater_acquire (Inflater *inflater,
+                  GError  **error)
+{
+        if (inflater->zstream)
+                return inflater->zstream;
+
+        inflater->pool_key = zstream_pool_key (-1, 0, inflater->window_bits);
+        inflater->zstream = zstream_pool_take (&inflater_pool, inflater->pool_key);
+        if (inflater->zstream)
+                return inflater->zstream;
+
+        inflater->zstream = g_new0 (z_stream, 1);
+        if (inflateInit2 (inflater->zstream, -inflater->window_bits) != Z_OK) {
+                g_clear_pointer (&inflater->zstream, g_free);
+                g_set_error_literal (error,
+                                     SOUP_WEBSOCKET_ERROR,
+                                     SOUP_WEBSOCKET_CLOSE_PROTOCOL_ERROR,
+                                     "Failed to initialize decompression");
+                return NULL;
+        }
+
+        return inflater->zstream;
+}
+
+static void
+inflater_release (Inflater *inflater,
+                  gboolean  force)
+{
+        if (!inflater->zstream)
+                return;
+
+        if (!force && !inflater->no_context_takeover)
+                return;
+
+        inflateReset (inflater->zstream);
+        if (!zstream_pool_give (&inflater_pool, inflater->pool_key, inflater->zstream)) {
+                inflateEnd (inflater->zstream);
+                g_free (inflater->zstream);
+        }
+        inflater->zstream = NULL;
+}
+
 static void
-soup_websocket_extension_deflate_init (SoupWebsocketExtensionDeflate *basic)
+soup_websocket_extension_deflate_init (SoupWebsocketExtensionDeflate *deflate)
 {
+        SoupWebsocketExtensionDeflatePrivate *priv = soup_websocket_extension_deflate_get_instance_private (deflate);
+
+        priv->compression_level = DEFAULT_COMPRESSION_LEVEL;
+        priv->mem_level = DEFAULT_MEM_LEVEL;
+        priv->max_window_bits = DEFAULT_MAX_WINDOW_BITS;
 }
 
 static void
@@ -88,14 +318,66 @@ soup_websocket_extension_deflate_finalize (GObject *object)
 {
         SoupWebsocketExtensionDeflatePrivate *priv = soup_websocket_extension_deflate_get_instance_private (SOUP_WEBSOCKET_EXTENSION_DEFLATE (object));
 
-	if (priv->enabled) {
-		deflateEnd (&priv->deflater.zstream);
-		inflateEnd (&priv->inflater.zstream);
-	}
+        deflater_release (&priv->deflater, TRUE);
+        inflater_release (&priv->inflater, TRUE);
 
         G_OBJECT_CLASS (soup_websocket_extension_deflate_parent_class)->finalize (object);
 }
 
+static void
+soup_websocket_extension_deflate_get_property (GObject    *object,
+                                               guint       prop_id,
+                                               GValue     *value,
+                                               GParamSpec *pspec)
+{
+        SoupWebsocketExtensionDeflatePrivate *priv = soup_websocket_extension_deflate_get_instance_private (SOUP_WEBSOCKET_EXTENSION_DEFLATE (object));
+
+        switch (prop_id) {
+        case PROP_COMPRESSION_THRESHOLD:
+                g_value_set_uint (value, priv->compression_threshold);
+                break;
+        case PROP_COMPRESSION_LEVEL:
+                g_value_set_int (value, priv->compression_level);
+                break;
+        case PROP_MEM_LEVEL:
+                g_value_set_int (value, priv->mem_level);
+                break;
+        case PROP_MAX_WINDOW_BITS:
+                g_value_set_int (value, priv->max_window_bits);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+soup_websocket_extension_deflate_set_property (GObject      *object,
+                                               guint         prop_id,
+                                               const GValue *value,
+                                               GParamSpec   *pspec)
+{
+        SoupWebsocketExtensionDeflatePrivate *priv = soup_websocket_extension_deflate_get_instance_private (SOUP_WEBSOCKET_EXTENSION_DEFLATE (object));
+
+        switch (prop_id) {
+        case PROP_COMPRESSION_THRESHOLD:
+                priv->compression_threshold = g_value_get_uint (value);
+                break;
+        case PROP_COMPRESSION_LEVEL:
+                priv->compression_level = g_value_get_int (value);
+                break;
+        case PROP_MEM_LEVEL:
+                priv->mem_level = g_value_get_int (value);
+                break;
+        case PROP_MAX_WINDOW_BITS:
+                priv->max_window_bits = g_value_get_int (value);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
 static gboolean
 parse_window_bits (const char *value,
                    gushort    *out)
@@ -200,11 +482,13 @@ soup_websocket_extension_deflate_configure (SoupWebsocketExtension     *extensio
         switch (connection_type) {
         case SOUP_WEBSOCKET_CONNECTION_CLIENT:
                 priv->deflater.no_context_takeover = priv->params.flags & PARAM_CLIENT_NO_CONTEXT_TAKEOVER;
+                priv->inflater.no_context_takeover = priv->params.flags & PARAM_SERVER_NO_CONTEXT_TAKEOVER;
                 deflater_max_window_bits = priv->params.flags & PARAM_CLIENT_MAX_WINDOW_BITS ? priv->params.client_max_window_bits : 15;
                 inflater_max_window_bits = priv->params.flags & PARAM_SERVER_MAX_WINDOW_BITS ? priv->params.server_max_window_bits : 15;
                 break;
         case SOUP_WEBSOCKET_CONNECTION_SERVER:
                 priv->deflater.no_context_takeover = priv->params.flags & PARAM_SERVER_NO_CONTEXT_TAKEOVER;
+                priv->inflater.no_context_takeover = priv->params.flags & PARAM_CLIENT_NO_CONTEXT_TAKEOVER;
                 deflater_max_window_bits = priv->params.flags & PARAM_SERVER_MAX_WINDOW_BITS ? priv->params.server_max_window_bits : 15;
                 inflater_max_window_bits = priv->params.flags & PARAM_CLIENT_MAX_WINDOW_BITS ? priv->params.client_max_window_bits : 15;
                 break;
@@ -218,17 +502,13 @@ soup_websocket_extension_deflate_configure (SoupWebsocketExtension     *extensio
          */
         deflater_max_window_bits = MAX (deflater_max_window_bits, 9);
 
-        /* In case of failing to initialize zlib deflater/inflater,
-         * we return TRUE without setting enabled = TRUE, so that the
-         * hanshake doesn't fail.
+        /* zlib streams are created when the first message is
+         * compressed or decompressed. The peer can handle any window
+         * smaller than the negotiated one, so honor the configured
+         * maximum when compressing.
          */
-        if (deflateInit2 (&priv->deflater.zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -deflater_max_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
-                return TRUE;
-
-        if (inflateInit2 (&priv->inflater.zstream, -inflater_max_window_bits) != Z_OK) {
-		deflateEnd (&priv->deflater.zstream);
-                return TRUE;
-	}
+        priv->deflater.window_bits = deflater_max_window_bits;
+        priv->inflater.window_bits = inflater_max_window_bits;
 
         priv->enabled = TRUE;
 
@@ -268,11 +548,72 @@ soup_websocket_extension_deflate_get_response_params (SoupWebsocketExtension *ex
         return g_string_free (params, FALSE);
 }
 
-static void
-deflater_reset (Deflater *deflater)
+static GBytes *
+compress_payload (z_stream     *zstream,
+                  const guint8 *payload_data,
+                  gsize         payload_length,
+                  GError      **error)
 {
-        if (deflater->no_context_takeover)
-                deflateReset (&deflater->zstream);
+        guint max_length;
+        GByteArray *buffer;
+        GBytes *compressed;
+        gsize bytes_written;
+        int result;
+        gboolean in_sync_flush;
+
+        buffer = g_private_get (&output_buffer);
+        if (!buffer) {
+                buffer = g_byte_array_new ();
+                g_private_set (&output_buffer, buffer);
+        }
+        g_byte_array_set_size (buffer, 0);
+        max_length = deflateBound (zstream, payload_length);
+
+        zstream->next_in = (void *)payload_data;
+        zstream->avail_in = payload_length;
+
+        bytes_written = 0;
+        zstream->avail_out = 0;
+
+        do {
+                gsize write_remaining;
+
+                if (zstream->avail_out == 0) {
+                        guint write_position;
+
+                        zstream->avail_out = max_length;
+                        write_position = buffer->len;
+                        g_byte_array_set_size (buffer, buffer->len + max_length);
+                        zstream->next_out = buffer->data + write_position;
+
+                        /* Use a fixed value for buffer increments */
+                        max_length = BUFFER_SIZE;
+                }
+
+                write_remaining = buffer->len - bytes_written;
+                in_sync_flush = zstream->avail_in == 0;
+                result = deflate (zstream, in_sync_flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+                bytes_written += write_remaining - zstream->avail_out;
+        } while (result == Z_OK);
+
+        if (result != Z_BUF_ERROR || bytes_written < 4) {
+                g_set_error_literal (error,
+                                     SOUP_WEBSOCKET_ERROR,
+                                     SOUP_WEBSOCKET_CLOSE_PROTOCOL_ERROR,
+                                     "Failed to compress outgoing frame");
+                compressed = NULL;
+        } else {
+                /* Remove 4 octets (that are 0x00 0x00 0xff 0xff) from the tail end,
+                 * and copy out so that queued frames don't waste the extra space.
+                 */
+                compressed = g_bytes_new (buffer->data, bytes_written - 4);
+        }
+
+        /* Don't keep the memory used by big messages */
+        if (buffer->len > OUTPUT_BUFFER_MAX_SIZE)
+                g_private_replace (&output_buffer, g_byte_array_new ());
+
+        return compressed;
 }
 
 static GBytes *
@@ -283,12 +624,9 @@ soup_websocket_extension_deflate_process_outgoing_message (SoupWebsocketExtensio
 {
         const guint8 *payload_data;
         gsize payload_length;
-        guint max_length;
         gboolean control;
-        GByteArray *buffer;
-        gsize bytes_written;
-        int result;
-        gboolean in_sync_flush;
+        GBytes *compressed;
+        z_stream *zstream;
         SoupWebsocketExtensionDeflatePrivate *priv;
 
         priv = soup_websocket_extension_deflate_get_instance_private (SOUP_WEBSOCKET_EXTENSION_DEFLATE (extension));
@@ -306,57 +644,97 @@ soup_websocket_extension_deflate_process_outgoing_message (SoupWebsocketExtensio
         if (payload_length == 0)
                 return payload;
 
+        /* Small messages are not worth compressing */
+        if (payload_length < priv->compression_threshold)
+                return payload;
+
+        zstream = deflater_acquire (priv, error);
+        if (!zstream) {
+                g_bytes_unref (payload);
+                return NULL;
+        }
+
         /* Mark the frame as compressed using reserved bit 1 (0x40) */
         header[0] |= 0x40;
 
-        buffer = g_byte_array_new ();
-        max_length = deflateBound(&priv->deflater.zstream, payload_length);
-
-        priv->deflater.zstream.next_in = (void *)payload_data;
-        priv->deflater.zstream.avail_in = payload_length;
+        compressed = compress_payload (zstream, payload_data, payload_length, error);
+        g_bytes_unref (payload);
+        if (!compressed)
+                deflateReset (zstream);
+        deflater_release (&priv->deflater, FALSE);
 
-        bytes_written = 0;
-        priv->deflater.zstream.avail_out = 0;
+        return compressed;
+}
 
-        do {
-                gsize write_remaining;
+/*
+ * soup_websocket_extension_deflate_get_outgoing_params:
+ * @extension: a #SoupWebsocketExtensionDeflate
+ * @payload_length: the length of the message to send
+ * @params: (out): return location for the compression parameters
+ *
+ * Checks whether outgoing messages are compressed independently of the
+ * previous ones (no context takeover), in which case the compressed payload
+ * can be shared with other connections using the same @params. If the
+ * message of @payload_length wouldn't be compressed the window bits of
+ * @params are set to 0.
+ *
+ * Returns: %TRUE if the outgoing messages don't depend on the compression
+ *    context, or %FALSE otherwise
+ */
+gboolean
+soup_websocket_extension_deflate_get_outgoing_params (SoupWebsocketExtensionDeflate *extension,
+                                                      gsize                          payload_length,
+                                                      SoupWebsocketDeflateParams    *params)
+{
+        SoupWebsocketExtensionDeflatePrivate *priv;
 
-                if (priv->deflater.zstream.avail_out == 0) {
-                        guint write_position;
+        priv = soup_websocket_extension_deflate_get_instance_private (extension);
 
-                        priv->deflater.zstream.avail_out = max_length;
-                        write_position = buffer->len;
-                        g_byte_array_set_size (buffer, buffer->len + max_length);
-                        priv->deflater.zstream.next_out = buffer->data + write_position;
+        if (!priv->enabled || payload_length == 0 || payload_length < priv->compression_threshold) {
+                params->window_bits = 0;
+                params->compression_level = 0;
+                params->mem_level = 0;
+                return TRUE;
+        }
 
-                        /* Use a fixed value for buffer increments */
-                        max_length = BUFFER_SIZE;
-                }
+        params->window_bits = deflater_get_window_bits (priv);
+        params->compression_level = priv->compression_level;
+        params->mem_level = priv->mem_level;
+        return priv->deflater.no_context_takeover;
+}
 
-                write_remaining = buffer->len - bytes_written;
-                in_sync_flush = priv->deflater.zstream.avail_in == 0;
-                result = deflate (&priv->deflater.zstream, in_sync_flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
-                bytes_written += write_remaining - priv->deflater.zstream.avail_out;
-        } while (result == Z_OK);
+/*
+ * soup_websocket_extension_deflate_compress:
+ * @payload: the payload to compress
+ * @params: the compression parameters
+ * @error: return location for a #GError
+ *
+ * Compresses @payload with a new compression context as
+ * permessage-deflate would do with no context takeover.
+ *
+ * Returns: (transfer full): the compressed payload or %NULL in case of error
+ */
+GBytes *
+soup_websocket_extension_deflate_compress (GBytes                           *payload,
+                                           const SoupWebsocketDeflateParams *params,
+                                           GError                          **error)
+{
+        z_stream *zstream;
+        const guint8 *payload_data;
+        gsize payload_length;
+        GBytes *compressed;
 
-        g_bytes_unref (payload);
+        g_return_val_if_fail (params->window_bits >= 9 && params->window_bits <= 15, NULL);
 
-        if (result != Z_BUF_ERROR || bytes_written < 4) {
-                g_set_error_literal (error,
-                                     SOUP_WEBSOCKET_ERROR,
-                                     SOUP_WEBSOCKET_CLOSE_PROTOCOL_ERROR,
-                                     "Failed to compress outgoing frame");
-                g_byte_array_unref (buffer);
-                deflater_reset (&priv->deflater);
+        zstream = deflater_stream_new (params->compression_level, params->mem_level, params->window_bits, error);
+        if (!zstream)
                 return NULL;
-        }
 
-        /* Remove 4 octets (that are 0x00 0x00 0xff 0xff) from the tail end. */
-        g_byte_array_set_size (buffer, bytes_written - 4);
-
-        deflater_reset (&priv->deflater);
+        payload_data = g_bytes_get_data (payload, &payload_length);
+        compressed = compress_payload (zstream, payload_data, payload_length, error);
+        deflater_stream_free (zstream, zstream_pool_key (params->compression_level, params->mem_level, params->window_bits));
 
-        return g_byte_array_free_to_bytes (buffer);
+        return compressed;
 }
 
 static GBytes *
@@ -372,6 +750,7 @@ soup_websocket_extension_deflate_process_incoming_message (SoupWebsocketExtensio
         gsize bytes_read, bytes_written;
         int result;
         gboolean tail_added = FALSE;
+        z_stream *zstream;
         SoupWebsocketExtensionDeflatePrivate *priv;
 
         priv = soup_websocket_extension_deflate_get_instance_private (SOUP_WEBSOCKET_EXTENSION_DEFLATE (extension));
@@ -406,46 +785,52 @@ soup_websocket_extension_deflate_process_incoming_message (SoupWebsocketExtensio
         if (payload_length == 0 && ((!priv->inflater.uncompress_ongoing && fin) || (priv->inflater.uncompress_ongoing && !fin)))
                 return payload;
 
+        zstream = inflater_acquire (&priv->inflater, error);
+        if (!zstream) {
+                g_bytes_unref (payload);
+                return NULL;
+        }
+
         priv->inflater.uncompress_ongoing = !fin;
 
         buffer = g_byte_array_new ();
 
         bytes_read = 0;
-        priv->inflater.zstream.next_in = (void *)payload_data;
-        priv->inflater.zstream.avail_in = payload_length;
+        zstream->next_in = (void *)payload_data;
+        zstream->avail_in = payload_length;
 
         bytes_written = 0;
-        priv->inflater.zstream.avail_out = 0;
+        zstream->avail_out = 0;
 
         do {
                 gsize read_remaining;
                 gsize write_remaining;
 
-                if (priv->inflater.zstream.avail_out == 0) {
+                if (zstream->avail_out == 0) {
                         guint current_position;
 
-                        priv->inflater.zstream.avail_out = BUFFER_SIZE;
+                        zstream->avail_out = BUFFER_SIZE;
                         current_position = buffer->len;
                         g_byte_array_set_size (buffer, buffer->len + BUFFER_SIZE);
-                        priv->inflater.zstream.next_out = buffer->data + current_position;
+                        zstream->next_out = buffer->data + current_position;
                 }
 
-                if (priv->inflater.zstream.avail_in == 0 && !tail_added && fin) {
+                if (zstream->avail_in == 0 && !tail_added && fin) {
                         /* Append 4 octets of 0x00 0x00 0xff 0xff to the tail end */
-                        priv->inflater.zstream.next_in = (void *)"\x00\x00\xff\xff";
-                        priv->inflater.zstream.avail_in = 4;
+                        zstream->next_in = (void *)"\x00\x00\xff\xff";
+                        zstream->avail_in = 4;
                         bytes_read = 0;
                         tail_added = TRUE;
                 }
 
                 read_remaining = tail_added ? 4 : payload_length - bytes_read;
                 write_remaining = buffer->len - bytes_written;
-                result = inflate (&priv->inflater.zstream, tail_added ? Z_FINISH : Z_NO_FLUSH);
-                bytes_read += read_remaining - priv->inflater.zstream.avail_in;
-                bytes_written += write_remaining - priv->inflater.zstream.avail_out;
+                result = inflate (zstream, tail_added ? Z_FINISH : Z_NO_FLUSH);
+                bytes_read += read_remaining - zstream->avail_in;
+                bytes_written += write_remaining - zstream->avail_out;
                 if (!tail_added && result == Z_STREAM_END) {
                         /* Received a block with BFINAL set to 1. Reset decompression state. */
-                        result = inflateReset (&priv->inflater.zstream);
+                        result = inflateReset (zstream);
                 }
 
                 if ((!fin && bytes_read == payload_length) || (fin && tail_added && bytes_read == 4))
@@ -456,6 +841,7 @@ soup_websocket_extension_deflate_process_incoming_message (SoupWebsocketExtensio
 
         if (result != Z_OK && result != Z_BUF_ERROR) {
                 priv->inflater.uncompress_ongoing = FALSE;
+                inflater_release (&priv->inflater, TRUE);
                 g_set_error_literal (error,
                                      SOUP_WEBSOCKET_ERROR,
                                      SOUP_WEBSOCKET_CLOSE_PROTOCOL_ERROR,
@@ -465,6 +851,9 @@ soup_websocket_extension_deflate_process_incoming_message (SoupWebsocketExtensio
                 return NULL;
         }
 
+        if (fin)
+                inflater_release (&priv->inflater, FALSE);
+
         g_byte_array_set_size (buffer, bytes_written);
 
         return g_byte_array_free_to_bytes (buffer);
@@ -485,4 +874,90 @@ soup_websocket_extension_deflate_class_init (SoupWebsocketExtensionDeflateClass
         extension_class->process_incoming_message = soup_websocket_extension_deflate_process_incoming_message;
 
         object_class->finalize = soup_websocket_extension_deflate_finalize;
+        object_class->get_property = soup_websocket_extension_deflate_get_property;
+        object_class->set_property = soup_websocket_extension_deflate_set_property;
+
+        /**
+         * SoupWebsocketExtensionDeflate:compression-threshold:
+         *
+         * Minimum size in bytes of an outgoing message to be compressed.
+         *
+         * Smaller messages are sent uncompressed, since the compression
+         * overhead is usually bigger than the saved bytes.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_COMPRESSION_THRESHOLD] =
+                g_param_spec_uint ("compression-threshold",
+                                   "Compression threshold",
+                                   "Minimum size of a message to be compressed",
+                                   0,
+                                   G_MAXUINT,
+                                   0,
+                                   G_PARAM_READWRITE |
+                                   G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupWebsocketExtensionDeflate:compression-level:
+         *
+         * The zlib compression level used for outgoing messages, from 0
+         * (no compression) to 9 (best compression), or -1 for the zlib
+         * default.
+         *
+         * Changes only apply to compression contexts created afterwards.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_COMPRESSION_LEVEL] =
+                g_param_spec_int ("compression-level",
+                                  "Compression level",
+                                  "The zlib compression level",
+                                  -1,
+                                  9,
+                                  DEFAULT_COMPRESSION_LEVEL,
+                                  G_PARAM_READWRITE |
+                                  G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupWebsocketExtensionDeflate:mem-level:
+         *
+         * The amount of memory zlib uses for the compression state, from
+         * 1 (minimum memory, slower) to 9 (maximum memory, faster).
+         *
+         * Changes only apply to compression contexts created afterwards.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_MEM_LEVEL] =
+                g_param_spec_int ("mem-level",
+                                  "Memory level",
+                                  "The zlib memory level",
+                                  1,
+                                  9,
+                                  DEFAULT_MEM_LEVEL,
+                                  G_PARAM_READWRITE |
+                                  G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupWebsocketExtensionDeflate:max-window-bits:
+         *
+         * The maximum LZ77 window size, as a base-2 logarithm, used to
+         * compress outgoing messages. The negotiated window is used when
+         * it's smaller.
+         *
+         * Changes only apply to compression contexts created afterwards.
+         *
+         * Since: 3.4
+         */
+        properties[PROP_MAX_WINDOW_BITS] =
+                g_param_spec_int ("max-window-bits",
+                                  "Maximum window bits",
+                                  "The maximum compression window bits",
+                                  9,
+                                  15,
+                                  DEFAULT_MAX_WINDOW_BITS,
+                                  G_PARAM_READWRITE |
+                                  G_PARAM_STATIC_STRINGS);
+
+        g_object_class_install_properties (object_class, LAST_PROPERTY, properties);
 }
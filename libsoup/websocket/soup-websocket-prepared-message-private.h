@@ -0,0 +1,29 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-websocket-prepared-message-private.h
+ *
+ * Copyright (C) 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-websocket-prepared-message.h"
+#include "soup-websocket-extension-deflate-private.h"
+
+G_BEGIN_DECLS
+
+#define SOUP_WEBSOCKET_FRAME_HEADER_MAX_LENGTH 14
+
+gsize   soup_websocket_frame_header_set_length     (guint8                           *header,
+                                                    gsize                             length);
+
+gboolean soup_websocket_utf8_validate              (const char                       *str,
+                                                    gsize                             max_len);
+
+GBytes *soup_websocket_prepared_message_get_frame  (SoupWebsocketPreparedMessage     *message,
+                                                    const SoupWebsocketDeflateParams *params,
+                                                    guint8                           *header,
+                                                    gsize                            *header_len,
+                                                    GError                          **error);
+
+G_END_DECLS
@@ -0,0 +1,296 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-websocket-prepared-message.c
+ *
+ * Copyright (C) 2026 The libsoup authors
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "soup-websocket-prepared-message-private.h"
+#include "soup-websocket-extension-deflate-private.h"
+
+/**
+ * SoupWebsocketPreparedMessage:
+ *
+ * A WebSocket message framed once to be sent to many connections.
+ *
+ * Sending the same message to many [class@WebsocketConnection]s with
+ * [method@WebsocketConnection.send_message] frames, and when
+ * permessage-deflate is in use compresses, the message once per connection.
+ * A #SoupWebsocketPreparedMessage caches the framed message for every
+ * negotiated configuration that allows it (no extensions, or
+ * permessage-deflate without context takeover), so that
+ * [method@WebsocketConnection.send_prepared_message] only needs to take a
+ * reference to the cached frame.
+ *
+ * Client connections, and connections with context takeover compression,
+ * can't share frames and send the message as usual.
+ *
+ * Since: 3.4
+ */
+
+typedef struct {
+        SoupWebsocketDeflateParams params;
+        guint8 header[SOUP_WEBSOCKET_FRAME_HEADER_MAX_LENGTH];
+        gsize header_len;
+        GBytes *payload;
+} PreparedFrame;
+
+struct _SoupWebsocketPreparedMessage {
+        SoupWebsocketDataType type;
+        GBytes *data;
+
+        GMutex mutex;
+        PreparedFrame uncompressed;
+        /* One per deflate configuration the message was sent with */
+        GArray *compressed;
+};
+
+G_DEFINE_BOXED_TYPE (SoupWebsocketPreparedMessage, soup_websocket_prepared_message, soup_websocket_prepared_message_ref, soup_websocket_prepared_message_unref)
+
+/**
+ * soup_websocket_prepared_message_new:
+ * @type: the type of message contents
+ * @message: the message data as #GBytes
+ *
+ * Creates a new #SoupWebsocketPreparedMessage to send @message to
+ * multiple connections.
+ *
+ * If @type is %SOUP_WEBSOCKET_DATA_TEXT, @message must be valid UTF-8.
+ *
+ * Returns: (transfer full): a new #SoupWebsocketPreparedMessage
+ *
+ * Since: 3.4
+ */
+SoupWebsocketPreparedMessage *
+soup_websocket_prepared_message_new (SoupWebsocketDataType type,
+                                     GBytes               *message)
+{
+        SoupWebsocketPreparedMessage *prepared;
+
+        g_return_val_if_fail (type == SOUP_WEBSOCKET_DATA_TEXT || type == SOUP_WEBSOCKET_DATA_BINARY, NULL);
+        g_return_val_if_fail (message != NULL, NULL);
+        g_return_val_if_fail (type != SOUP_WEBSOCKET_DATA_TEXT ||
+                              soup_websocket_utf8_validate (g_bytes_get_data (message, NULL), g_bytes_get_size (message)), NULL);
+
+        prepared = g_atomic_rc_box_new0 (SoupWebsocketPreparedMessage);
+        prepared->type = type;
+        prepared->data = g_bytes_ref (message);
+        g_mutex_init (&prepared->mutex);
+
+        return prepared;
+}
+
+/**
+ * soup_websocket_prepared_message_ref:
+ * @message: a #SoupWebsocketPreparedMessage
+ *
+ * Increases the reference count of @message by one.
+ *
+ * Returns: (transfer full): the passed in #SoupWebsocketPreparedMessage
+ *
+ * Since: 3.4
+ */
+SoupWebsocketPreparedMessage *
+soup_websocket_prepared_message_ref (SoupWebsocketPreparedMessage *message)
+{
+        g_return_val_if_fail (message != NULL, NULL);
+
+        g_atomic_rc_box_acquire (message);
+
+        return message;
+}
+
+static void
+prepared_frame_clear (PreparedFrame *frame)
+{
+        g_clear_pointer (&frame->payload, g_bytes_unref);
+}
+
+static void
+soup_websocket_prepared_message_destroy (SoupWebsocketPreparedMessage *message)
+{
+        prepared_frame_clear (&message->uncompressed);
+        g_clear_pointer (&message->compressed, g_array_unref);
+        g_mutex_clear (&message->mutex);
+        g_bytes_unref (message->data);
+}
+
+/**
+ * soup_websocket_prepared_message_unref:
+ * @message: a #SoupWebsocketPreparedMessage
+ *
+ * Decreases the reference count of @message by one.
+ *
+ * When the reference count reaches zero, the resources allocated by
+ * @message are freed.
+ *
+ * Since: 3.4
+ */
+void
+soup_websocket_prepared_message_unref (SoupWebsocketPreparedMessage *message)
+{
+        g_return_if_fail (message != NULL);
+
+        g_atomic_rc_box_release_full (message, (GDestroyNotify)soup_websocket_prepared_message_destroy);
+}
+
+/**
+ * soup_websocket_prepared_message_get_data_type:
+ * @message: a #SoupWebsocketPreparedMessage
+ *
+ * Gets the type of the contents of @message.
+ *
+ * Returns: a #SoupWebsocketDataType
+ *
+ * Since: 3.4
+ */
+SoupWebsocketDataType
+soup_websocket_prepared_message_get_data_type (SoupWebsocketPreparedMessage *message)
+{
+        g_return_val_if_fail (message != NULL, SOUP_WEBSOCKET_DATA_BINARY);
+
+        return message->type;
+}
+
+/**
+ * soup_websocket_prepared_message_get_data:
+ * @message: a #SoupWebsocketPreparedMessage
+ *
+ * Gets the uncompressed contents of @message.
+ *
+ * Returns: (transfer none): the message data
+ *
+ * Since: 3.4
+ */
+GBytes *
+soup_websocket_prepared_message_get_data (SoupWebsocketPreparedMessage *message)
+{
+        g_return_val_if_fail (message != NULL, NULL);
+
+        return message->data;
+}
+
+/* Sets the payload length in @header and returns the header length, without mask */
+gsize
+soup_websocket_frame_header_set_length (guint8 *header,
+                                        gsize   length)
+{
+        if (length < 126) {
+                header[1] = (0xFF & length); /* mask | 7-bit-len */
+                return 2;
+        }
+
+        if (length < 65536) {
+                header[1] = 126; /* mask | 16-bit-len */
+                header[2] = (length >> 8) & 0xFF;
+                header[3] = (length >> 0) & 0xFF;
+                return 4;
+        }
+
+        header[1] = 127; /* mask | 64-bit-len */
+#if GLIB_SIZEOF_SIZE_T > 4
+        header[2] = (length >> 56) & 0xFF;
+        header[3] = (length >> 48) & 0xFF;
+        header[4] = (length >> 40) & 0xFF;
+        header[5] = (length >> 32) & 0xFF;
+#else
+        header[2] = header[3] = header[4] = header[5] = 0;
+#endif
+        header[6] = (length >> 24) & 0xFF;
+        header[7] = (length >> 16) & 0xFF;
+        header[8] = (length >> 8) & 0xFF;
+        header[9] = (length >> 0) & 0xFF;
+        return 10;
+}
+
+static PreparedFrame *
+lookup_frame (SoupWebsocketPreparedMessage     *message,
+              const SoupWebsocketDeflateParams *params)
+{
+        PreparedFrame *frame;
+        guint i;
+
+        if (!params->window_bits)
+                return &message->uncompressed;
+
+        if (!message->compressed) {
+                message->compressed = g_array_new (FALSE, TRUE, sizeof (PreparedFrame));
+                g_array_set_clear_func (message->compressed, (GDestroyNotify)prepared_frame_clear);
+        }
+
+        for (i = 0; i < message->compressed->len; i++) {
+                frame = &g_array_index (message->compressed, PreparedFrame, i);
+                if (frame->params.window_bits == params->window_bits &&
+                    frame->params.compression_level == params->compression_level &&
+                    frame->params.mem_level == params->mem_level)
+                        return frame;
+        }
+
+        g_array_set_size (message->compressed, message->compressed->len + 1);
+        frame = &g_array_index (message->compressed, PreparedFrame, message->compressed->len - 1);
+        frame->params = *params;
+
+        return frame;
+}
+
+/*
+ * soup_websocket_prepared_message_get_frame:
+ * @message: a #SoupWebsocketPreparedMessage
+ * @params: the permessage-deflate parameters, with window bits 0 for no compression
+ * @header: return location for the frame header
+ * @header_len: (out): return location for the frame header length
+ * @error: return location for a #GError
+ *
+ * Gets the unmasked frame of @message for the given configuration, framing
+ * and compressing it the first time it's requested.
+ *
+ * Returns: (transfer full): the frame payload, or %NULL in case of error
+ */
+GBytes *
+soup_websocket_prepared_message_get_frame (SoupWebsocketPreparedMessage     *message,
+                                           const SoupWebsocketDeflateParams *params,
+                                           guint8                           *header,
+                                           gsize                            *header_len,
+                                           GError                          **error)
+{
+        PreparedFrame *frame;
+        GBytes *payload;
+
+        g_assert (params->window_bits == 0 || (params->window_bits >= 9 && params->window_bits <= 15));
+
+        g_mutex_lock (&message->mutex);
+        frame = lookup_frame (message, params);
+        if (!frame->payload) {
+                frame->header[0] = 0x80 | message->type;
+
+                /* Empty messages are never compressed */
+                if (params->window_bits && g_bytes_get_size (message->data) > 0) {
+                        payload = soup_websocket_extension_deflate_compress (message->data, params, error);
+                        if (!payload) {
+                                g_mutex_unlock (&message->mutex);
+                                return NULL;
+                        }
+
+                        /* Mark the frame as compressed using reserved bit 1 (0x40) */
+                        frame->header[0] |= 0x40;
+                } else {
+                        payload = g_bytes_ref (message->data);
+                }
+
+                frame->header_len = soup_websocket_frame_header_set_length (frame->header, g_bytes_get_size (payload));
+                frame->payload = payload;
+        }
+
+        memcpy (header, frame->header, frame->header_len);
+        *header_len = frame->header_len;
+        payload = g_bytes_ref (frame->payload);
+        g_mutex_unlock (&message->mutex);
+
+        return payload;
+}
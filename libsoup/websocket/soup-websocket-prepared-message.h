@@ -0,0 +1,39 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
+/*
+ * soup-websocket-prepared-message.h
+ *
+ * Copyright (C) 2026 The libsoup authors
+ */
+
+#pragma once
+
+#include "soup-types.h"
+#include "soup-websocket.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SoupWebsocketPreparedMessage SoupWebsocketPreparedMessage;
+
+SOUP_AVAILABLE_IN_3_4
+GType soup_websocket_prepared_message_get_type (void);
+#define SOUP_TYPE_WEBSOCKET_PREPARED_MESSAGE (soup_websocket_prepared_message_get_type ())
+
+SOUP_AVAILABLE_IN_3_4
+SoupWebsocketPreparedMessage *soup_websocket_prepared_message_new       (SoupWebsocketDataType         type,
+                                                                         GBytes                       *message);
+
+SOUP_AVAILABLE_IN_3_4
+SoupWebsocketPreparedMessage *soup_websocket_prepared_message_ref       (SoupWebsocketPreparedMessage *message);
+
+SOUP_AVAILABLE_IN_3_4
+void                          soup_websocket_prepared_message_unref     (SoupWebsocketPreparedMessage *message);
+
+SOUP_AVAILABLE_IN_3_4
+SoupWebsocketDataType         soup_websocket_prepared_message_get_data_type (SoupWebsocketPreparedMessage *message);
+
+SOUP_AVAILABLE_IN_3_4
+GBytes                       *soup_websocket_prepared_message_get_data  (SoupWebsocketPreparedMessage *message);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SoupWebsocketPreparedMessage, soup_websocket_prepared_message_unref)
+
+G_END_DECLS
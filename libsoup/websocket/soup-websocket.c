@@ -28,7 +28,7 @@
 #include "soup-headers.h"
 #include "soup-message-private.h"
 #include "soup-message-headers-private.h"
-#include "soup-server-message.h"
+#include "soup-server-message-private.h"
 #include "soup-websocket-extension.h"
 
 #define FIXED_DIGEST_LEN 20
@@ -517,6 +517,13 @@ process_extensions (const char  *extensions,
         return TRUE;
 }
 
+static gboolean
+server_message_is_extended_connect (SoupServerMessage *msg)
+{
+	return soup_server_message_get_http_version (msg) == SOUP_HTTP_2_0 &&
+		soup_server_message_get_method (msg) == SOUP_METHOD_CONNECT;
+}
+
 /**
  * soup_websocket_server_check_handshake:
  * @msg: #SoupServerMessage containing the client side of a WebSocket handshake
@@ -528,7 +535,8 @@ process_extensions (const char  *extensions,
  * @error: return location for a #GError
  *
  * Examines the method and request headers in @msg and determines
- * whether @msg contains a valid handshake request.
+ * whether @msg contains a valid handshake request. Over HTTP/2 this is
+ * an extended CONNECT request with the "websocket" protocol (RFC 8441).
  *
  * If @origin is non-%NULL, then only requests containing a matching
  * "Origin" header will be accepted. If @protocols is non-%NULL, then
@@ -562,22 +570,35 @@ soup_websocket_server_check_handshake (SoupServerMessage *msg,
 
 	g_return_val_if_fail (SOUP_IS_SERVER_MESSAGE (msg), FALSE);
 
-	if (soup_server_message_get_method (msg) != SOUP_METHOD_GET) {
-		g_set_error_literal (error,
-				     SOUP_WEBSOCKET_ERROR,
-				     SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET,
-				     _("WebSocket handshake expected"));
-		return FALSE;
-	}
-
 	request_headers = soup_server_message_get_request_headers (msg);
-	if (!soup_message_headers_header_equals_common (request_headers, SOUP_HEADER_UPGRADE, "websocket") ||
-	    !soup_message_headers_header_contains_common (request_headers, SOUP_HEADER_CONNECTION, "upgrade")) {
-		g_set_error_literal (error,
-				     SOUP_WEBSOCKET_ERROR,
-				     SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET,
-				     _("WebSocket handshake expected"));
-		return FALSE;
+	if (server_message_is_extended_connect (msg)) {
+		/* RFC 8441: the HTTP/2 handshake uses the :protocol
+		 * pseudo-header instead of Upgrade and there's no key.
+		 */
+		if (g_strcmp0 (soup_server_message_get_connect_protocol (msg), "websocket") != 0) {
+			g_set_error_literal (error,
+					     SOUP_WEBSOCKET_ERROR,
+					     SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET,
+					     _("WebSocket handshake expected"));
+			return FALSE;
+		}
+	} else {
+		if (soup_server_message_get_method (msg) != SOUP_METHOD_GET) {
+			g_set_error_literal (error,
+					     SOUP_WEBSOCKET_ERROR,
+					     SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET,
+					     _("WebSocket handshake expected"));
+			return FALSE;
+		}
+
+		if (!soup_message_headers_header_equals_common (request_headers, SOUP_HEADER_UPGRADE, "websocket") ||
+		    !soup_message_headers_header_contains_common (request_headers, SOUP_HEADER_CONNECTION, "upgrade")) {
+			g_set_error_literal (error,
+					     SOUP_WEBSOCKET_ERROR,
+					     SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET,
+					     _("WebSocket handshake expected"));
+			return FALSE;
+		}
 	}
 
 	if (!soup_message_headers_header_equals_common (request_headers, SOUP_HEADER_SEC_WEBSOCKET_VERSION, "13")) {
@@ -589,7 +610,7 @@ soup_websocket_server_check_handshake (SoupServerMessage *msg,
 	}
 
 	key = soup_message_headers_get_one_common (request_headers, SOUP_HEADER_SEC_WEBSOCKET_KEY);
-	if (key == NULL || !validate_key (key)) {
+	if (!server_message_is_extended_connect (msg) && (key == NULL || !validate_key (key))) {
 		g_set_error_literal (error,
 				     SOUP_WEBSOCKET_ERROR,
 				     SOUP_WEBSOCKET_ERROR_BAD_HANDSHAKE,
@@ -632,8 +653,9 @@ static void
 respond_handshake_forbidden (SoupServerMessage *msg)
 {
 	soup_server_message_set_status (msg, SOUP_STATUS_FORBIDDEN, NULL);
-	soup_message_headers_append_common (soup_server_message_get_response_headers (msg),
-                                            SOUP_HEADER_CONNECTION, "close");
+	if (soup_server_message_get_http_version (msg) != SOUP_HTTP_2_0)
+		soup_message_headers_append_common (soup_server_message_get_response_headers (msg),
+						    SOUP_HEADER_CONNECTION, "close");
 	soup_server_message_set_response (msg, "text/html", SOUP_MEMORY_COPY,
 					  RESPONSE_FORBIDDEN, strlen (RESPONSE_FORBIDDEN));
 }
@@ -649,8 +671,9 @@ respond_handshake_bad (SoupServerMessage *msg,
 
 	text = g_strdup_printf (RESPONSE_BAD, why);
 	soup_server_message_set_status (msg, SOUP_STATUS_BAD_REQUEST, NULL);
-	soup_message_headers_append_common (soup_server_message_get_response_headers (msg),
-                                            SOUP_HEADER_CONNECTION, "close");
+	if (soup_server_message_get_http_version (msg) != SOUP_HTTP_2_0)
+		soup_message_headers_append_common (soup_server_message_get_response_headers (msg),
+						    SOUP_HEADER_CONNECTION, "close");
 	soup_server_message_set_response (msg, "text/html", SOUP_MEMORY_TAKE,
 					  text, strlen (text));
 }
@@ -668,7 +691,8 @@ respond_handshake_bad (SoupServerMessage *msg,
  *
  * Examines the method and request headers in @msg and (assuming @msg
  * contains a valid handshake request), fills in the handshake
- * response.
+ * response. Over HTTP/2 the response is a "200 OK" to the extended
+ * CONNECT request instead of "101 Switching Protocols".
  *
  * If @expected_origin is non-%NULL, then only requests containing a matching
  * "Origin" header will be accepted. If @protocols is non-%NULL, then
@@ -714,16 +738,20 @@ soup_websocket_server_process_handshake (SoupServerMessage *msg,
 		return FALSE;
 	}
 
-	soup_server_message_set_status (msg, SOUP_STATUS_SWITCHING_PROTOCOLS, NULL);
 	response_headers = soup_server_message_get_response_headers (msg);
-	soup_message_headers_replace_common (response_headers, SOUP_HEADER_UPGRADE, "websocket");
-	soup_message_headers_append_common (response_headers, SOUP_HEADER_CONNECTION, "Upgrade");
-
 	request_headers = soup_server_message_get_request_headers (msg);
-	key = soup_message_headers_get_one_common (request_headers, SOUP_HEADER_SEC_WEBSOCKET_KEY);
-	accept_key = compute_accept_key (key);
-	soup_message_headers_append_common (response_headers, SOUP_HEADER_SEC_WEBSOCKET_ACCEPT, accept_key);
-	g_free (accept_key);
+	if (server_message_is_extended_connect (msg)) {
+		soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+	} else {
+		soup_server_message_set_status (msg, SOUP_STATUS_SWITCHING_PROTOCOLS, NULL);
+		soup_message_headers_replace_common (response_headers, SOUP_HEADER_UPGRADE, "websocket");
+		soup_message_headers_append_common (response_headers, SOUP_HEADER_CONNECTION, "Upgrade");
+
+		key = soup_message_headers_get_one_common (request_headers, SOUP_HEADER_SEC_WEBSOCKET_KEY);
+		accept_key = compute_accept_key (key);
+		soup_message_headers_append_common (response_headers, SOUP_HEADER_SEC_WEBSOCKET_ACCEPT, accept_key);
+		g_free (accept_key);
+	}
 
 	choose_subprotocol (msg, (const char **) protocols, &chosen_protocol);
 	if (chosen_protocol)
@@ -809,11 +837,15 @@ soup_websocket_client_verify_handshake (SoupMessage *msg,
 	const char *protocol, *request_protocols, *extensions, *accept_key;
 	char *expected_accept_key;
 	gboolean key_ok;
+	gboolean extended_connect;
 
 	g_return_val_if_fail (SOUP_IS_MESSAGE (msg), FALSE);
 	g_return_val_if_fail (accepted_extensions == NULL || *accepted_extensions == NULL, FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+	extended_connect = soup_message_get_http_version (msg) == SOUP_HTTP_2_0 &&
+		soup_message_get_connect_protocol (msg) != NULL;
+
 	if (soup_message_get_status (msg) == SOUP_STATUS_BAD_REQUEST) {
 		g_set_error_literal (error,
 				     SOUP_WEBSOCKET_ERROR,
@@ -822,7 +854,15 @@ soup_websocket_client_verify_handshake (SoupMessage *msg,
 		return FALSE;
 	}
 
-	if (soup_message_get_status (msg) != SOUP_STATUS_SWITCHING_PROTOCOLS) {
+	if (extended_connect) {
+		if (!SOUP_STATUS_IS_SUCCESSFUL (soup_message_get_status (msg))) {
+			g_set_error_literal (error,
+					     SOUP_WEBSOCKET_ERROR,
+					     SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET,
+					     _("Server ignored WebSocket handshake"));
+			return FALSE;
+		}
+	} else if (soup_message_get_status (msg) != SOUP_STATUS_SWITCHING_PROTOCOLS) {
 		g_set_error_literal (error,
 				     SOUP_WEBSOCKET_ERROR,
 				     SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET,
@@ -830,8 +870,9 @@ soup_websocket_client_verify_handshake (SoupMessage *msg,
 		return FALSE;
 	}
 
-	if (!soup_message_headers_header_equals_common (soup_message_get_response_headers (msg), SOUP_HEADER_UPGRADE, "websocket") ||
-	    !soup_message_headers_header_contains_common (soup_message_get_response_headers (msg), SOUP_HEADER_CONNECTION, "upgrade")) {
+	if (!extended_connect &&
+	    (!soup_message_headers_header_equals_common (soup_message_get_response_headers (msg), SOUP_HEADER_UPGRADE, "websocket") ||
+	     !soup_message_headers_header_contains_common (soup_message_get_response_headers (msg), SOUP_HEADER_CONNECTION, "upgrade"))) {
 		g_set_error_literal (error,
 				     SOUP_WEBSOCKET_ERROR,
 				     SOUP_WEBSOCKET_ERROR_NOT_WEBSOCKET,
@@ -858,6 +899,10 @@ soup_websocket_client_verify_handshake (SoupMessage *msg,
 			return FALSE;
 	}
 
+	/* There's no key exchange with extended CONNECT */
+	if (extended_connect)
+		return TRUE;
+
 	accept_key = soup_message_headers_get_one_common (soup_message_get_response_headers (msg), SOUP_HEADER_SEC_WEBSOCKET_ACCEPT);
 	expected_accept_key = compute_accept_key (soup_message_headers_get_one_common (soup_message_get_request_headers (msg), SOUP_HEADER_SEC_WEBSOCKET_KEY));
 	key_ok = (accept_key && expected_accept_key &&
@@ -5,10 +5,39 @@
  */
 
 #include "test-utils.h"
+#include "soup-content-decoder-stream.h"
 
 static SoupServer *server;
 static GUri *base_uri;
 
+static GBytes *
+gzip_encode (GBytes *bytes)
+{
+	GConverter *compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+	GByteArray *encoded = g_byte_array_new ();
+	const guint8 *in_buf;
+	gsize in_len;
+	GConverterResult result;
+
+	in_buf = g_bytes_get_data (bytes, &in_len);
+	do {
+		guint8 out_buf[4096];
+		gsize bytes_read, bytes_written;
+
+		result = g_converter_convert (compressor, in_buf, in_len, out_buf, sizeof out_buf,
+					      G_CONVERTER_INPUT_AT_END,
+					      &bytes_read, &bytes_written, NULL);
+		g_assert_cmpint (result, !=, G_CONVERTER_ERROR);
+		g_byte_array_append (encoded, out_buf, bytes_written);
+		in_buf += bytes_read;
+		in_len -= bytes_read;
+	} while (result != G_CONVERTER_FINISHED);
+
+	g_object_unref (compressor);
+
+	return g_byte_array_free_to_bytes (encoded);
+}
+
 static void
 server_callback (SoupServer        *server,
 		 SoupServerMessage *msg,
@@ -70,6 +99,16 @@ server_callback (SoupServer        *server,
 							     "Content-Encoding",
 							     encoding);
 			}
+
+			if (response && soup_header_contains (options, "double-encode")) {
+				GBytes *encoded = gzip_encode (response);
+
+				g_bytes_unref (response);
+				response = encoded;
+				soup_message_headers_append (response_headers,
+							     "Content-Encoding",
+							     "gzip");
+			}
 			g_free (resource);
 		}
 	}
@@ -262,6 +301,37 @@ do_coding_test_gzip_bad_server (CodingTestData *data, gconstpointer test_data)
 	g_bytes_unref (body);
 }
 
+static void
+do_coding_test_gzip_chained (CodingTestData *data, gconstpointer test_data)
+{
+	GInputStream *stream;
+	GByteArray *body;
+	GBytes *body_bytes;
+	GError *error = NULL;
+	gssize nread;
+
+	soup_message_headers_append (soup_message_get_request_headers (data->msg),
+				     "X-Test-Options", "double-encode");
+	stream = soup_session_send (data->session, data->msg, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (soup_message_headers_get_list (soup_message_get_response_headers (data->msg), "Content-Encoding"), ==, "gzip, gzip");
+
+	/* Read in tiny chunks to exercise the decoder buffering */
+	body = g_byte_array_new ();
+	do {
+		guint8 buffer[7];
+
+		nread = g_input_stream_read (stream, buffer, sizeof (buffer), NULL, &error);
+		g_assert_no_error (error);
+		g_byte_array_append (body, buffer, nread);
+	} while (nread > 0);
+	g_object_unref (stream);
+
+	body_bytes = g_byte_array_free_to_bytes (body);
+	g_assert_true (g_bytes_equal (body_bytes, data->response));
+	g_bytes_unref (body_bytes);
+}
+
 static void
 do_coding_test_deflate (CodingTestData *data, gconstpointer test_data)
 {
@@ -343,6 +413,117 @@ do_coding_msg_empty_test (CodingTestData *data, gconstpointer test_data)
 	g_bytes_unref (body);
 }
 
+/* A converter that only writes whole blocks of BLOCK_SIZE bytes, like
+ * decoders that can't write less than one decoded unit.
+ */
+#define BLOCK_SIZE 16
+
+typedef struct {
+	GObject parent_instance;
+} BlockConverter;
+
+typedef struct {
+	GObjectClass parent_class;
+} BlockConverterClass;
+
+GType block_converter_get_type (void);
+static void block_converter_iface_init (GConverterIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (BlockConverter, block_converter, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER, block_converter_iface_init))
+
+static GConverterResult
+block_converter_convert (GConverter      *converter,
+			 const void      *inbuf,
+			 gsize            inbuf_size,
+			 void            *outbuf,
+			 gsize            outbuf_size,
+			 GConverterFlags  flags,
+			 gsize           *bytes_read,
+			 gsize           *bytes_written,
+			 GError         **error)
+{
+	gsize size;
+
+	if (inbuf_size == 0 && (flags & G_CONVERTER_INPUT_AT_END)) {
+		*bytes_read = *bytes_written = 0;
+		return G_CONVERTER_FINISHED;
+	}
+
+	if (inbuf_size < BLOCK_SIZE && !(flags & G_CONVERTER_INPUT_AT_END)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "Need a whole block");
+		return G_CONVERTER_ERROR;
+	}
+
+	size = MIN (inbuf_size, BLOCK_SIZE);
+	if (outbuf_size < size) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "Need space for a whole block");
+		return G_CONVERTER_ERROR;
+	}
+
+	memcpy (outbuf, inbuf, size);
+	*bytes_read = *bytes_written = size;
+	return G_CONVERTER_CONVERTED;
+}
+
+static void
+block_converter_reset (GConverter *converter)
+{
+}
+
+static void
+block_converter_iface_init (GConverterIface *iface)
+{
+	iface->convert = block_converter_convert;
+	iface->reset = block_converter_reset;
+}
+
+static void
+block_converter_init (BlockConverter *converter)
+{
+}
+
+static void
+block_converter_class_init (BlockConverterClass *klass)
+{
+}
+
+static void
+do_coding_stream_small_reads_test (void)
+{
+	GInputStream *base_stream, *stream;
+	GSList *converters;
+	GByteArray *body;
+	GError *error = NULL;
+	char data[100];
+	gssize nread;
+	guint i;
+
+	for (i = 0; i < sizeof (data); i++)
+		data[i] = 'a' + i % 26;
+
+	base_stream = g_memory_input_stream_new_from_data (data, sizeof (data), NULL);
+	converters = g_slist_append (NULL, g_object_new (block_converter_get_type (), NULL));
+	stream = soup_content_decoder_stream_new (base_stream, converters);
+	g_slist_free_full (converters, g_object_unref);
+	g_object_unref (base_stream);
+
+	/* Reads smaller than a block are served from the decoder's buffer */
+	body = g_byte_array_new ();
+	do {
+		guint8 buffer[5];
+
+		nread = g_input_stream_read (stream, buffer, sizeof (buffer), NULL, &error);
+		g_assert_no_error (error);
+		g_assert_cmpint (nread, <=, sizeof (buffer));
+		g_byte_array_append (body, buffer, nread);
+	} while (nread > 0);
+	g_object_unref (stream);
+
+	g_assert_cmpmem (body->data, body->len, data, sizeof (data));
+	g_byte_array_unref (body);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -369,6 +550,9 @@ main (int argc, char **argv)
 	g_test_add ("/coding/message/gzip/bad-server", CodingTestData,
 		    GINT_TO_POINTER (CODING_TEST_DEFAULT),
 		    setup_coding_test, do_coding_test_gzip_bad_server, teardown_coding_test);
+	g_test_add ("/coding/message/gzip/chained", CodingTestData,
+		    GINT_TO_POINTER (CODING_TEST_DEFAULT),
+		    setup_coding_test, do_coding_test_gzip_chained, teardown_coding_test);
 	g_test_add ("/coding/message/deflate", CodingTestData,
 		    GINT_TO_POINTER (CODING_TEST_DEFAULT),
 		    setup_coding_test, do_coding_test_deflate, teardown_coding_test);
@@ -389,6 +573,8 @@ main (int argc, char **argv)
 		    GINT_TO_POINTER (CODING_TEST_EMPTY),
 		    setup_coding_test, do_coding_msg_empty_test, teardown_coding_test);
 
+	g_test_add_func ("/coding/stream/small-reads", do_coding_stream_small_reads_test);
+
 	ret = g_test_run ();
 
 	g_uri_unref (base_uri);
@@ -896,11 +896,15 @@ network_event (SoupMessage *msg, GSocketClientEvent event,
                         g_assert_cmpuint (soup_message_metrics_get_tls_start (metrics), >, 0);
                         g_assert_cmpuint (soup_message_metrics_get_tls_start (metrics), >=, soup_message_metrics_get_connect_start (metrics));
                         break;
+                case G_SOCKET_CLIENT_TLS_HANDSHAKED:
+                        g_assert_cmpuint (soup_message_metrics_get_tls_end (metrics), >, 0);
+                        g_assert_cmpuint (soup_message_metrics_get_tls_end (metrics), >=, soup_message_metrics_get_tls_start (metrics));
+                        break;
                 case G_SOCKET_CLIENT_COMPLETE:
                         g_assert_cmpuint (soup_message_metrics_get_connect_end (metrics), >, 0);
                         g_assert_cmpuint (soup_message_metrics_get_connect_end (metrics), >=, soup_message_metrics_get_connect_start (metrics));
                         if (soup_message_metrics_get_tls_start (metrics))
-                                g_assert_cmpuint (soup_message_metrics_get_connect_end (metrics), >=, soup_message_metrics_get_tls_start (metrics));
+                                g_assert_cmpuint (soup_message_metrics_get_connect_end (metrics), >=, soup_message_metrics_get_tls_end (metrics));
                         break;
                 default:
                         break;
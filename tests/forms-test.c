@@ -272,6 +272,237 @@ do_md5_test_libsoup (gconstpointer data)
 	g_free (md5);
 }
 
+static void
+do_md5_stream_test (gconstpointer data)
+{
+	const char *uri = data;
+	char *contents, *md5, *too_large_uri;
+	gsize length;
+	SoupMultipart *multipart;
+	GBytes *buffer;
+	SoupMessage *msg;
+	SoupSession *session;
+	GBytes *body;
+
+	md5 = get_md5_data (&contents, &length);
+	if (!md5)
+		return;
+
+	multipart = soup_multipart_new (SOUP_FORM_MIME_TYPE_MULTIPART);
+	buffer = g_bytes_new_take (contents, length);
+	soup_multipart_append_form_file (multipart, "file",
+					 MD5_TEST_FILE_BASENAME,
+					 MD5_TEST_FILE_MIME_TYPE,
+					 buffer);
+	g_bytes_unref (buffer);
+	soup_multipart_append_form_string (multipart, "fmt", "text");
+
+	msg = soup_message_new_from_multipart (uri, multipart);
+
+	session = soup_test_session_new (NULL);
+	body = soup_session_send_and_read (session, msg, NULL, NULL);
+
+	soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+	g_assert_cmpmem (md5, strlen (md5), g_bytes_get_data (body, NULL), g_bytes_get_size (body));
+
+	g_bytes_unref (body);
+	g_object_unref (msg);
+
+	/* A part over the size limit is rejected without reading it all */
+	too_large_uri = g_strdup_printf ("%s?max-part-size=16", uri);
+	msg = soup_message_new_from_multipart (too_large_uri, multipart);
+	g_free (too_large_uri);
+	body = soup_session_send_and_read (session, msg, NULL, NULL);
+	soup_test_assert_message_status (msg, SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE);
+	g_bytes_unref (body);
+	g_object_unref (msg);
+
+	soup_multipart_free (multipart);
+	soup_test_session_abort_unref (session);
+
+	g_free (md5);
+}
+
+static GBytes *
+build_form_data (const char *file_contents,
+		 char      **boundary)
+{
+	SoupMultipart *multipart;
+	SoupMessageHeaders *headers;
+	GHashTable *params;
+	GBytes *file, *body;
+
+	multipart = soup_multipart_new (SOUP_FORM_MIME_TYPE_MULTIPART);
+	soup_multipart_append_form_string (multipart, "name", "value");
+	file = g_bytes_new_static (file_contents, strlen (file_contents));
+	soup_multipart_append_form_file (multipart, "file", "upload.txt", "text/plain", file);
+	g_bytes_unref (file);
+	soup_multipart_append_form_string (multipart, "empty", "");
+
+	headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_REQUEST);
+	soup_multipart_to_message (multipart, headers, &body);
+	soup_multipart_free (multipart);
+
+	soup_message_headers_get_content_type (headers, &params);
+	*boundary = g_strdup (g_hash_table_lookup (params, "boundary"));
+	g_hash_table_destroy (params);
+	soup_message_headers_unref (headers);
+
+	return body;
+}
+
+static void
+part_started (SoupFormDataParser *parser,
+	      const char         *name,
+	      const char         *filename,
+	      SoupMessageHeaders *headers,
+	      GString            *parts)
+{
+	g_string_append_printf (parts, "[%s", name);
+}
+
+static void
+part_data (SoupFormDataParser *parser,
+	   GBytes             *chunk,
+	   GString            *parts)
+{
+	g_string_append_len (parts, g_bytes_get_data (chunk, NULL), g_bytes_get_size (chunk));
+}
+
+static void
+part_finished (SoupFormDataParser *parser,
+	       GString            *parts)
+{
+	g_string_append_c (parts, ']');
+}
+
+static gboolean
+feed_form_data (SoupFormDataParser *parser,
+		GBytes             *body,
+		gsize               body_size,
+		gsize               chunk_size,
+		GError            **error)
+{
+	gsize offset;
+
+	for (offset = 0; offset < body_size; offset += chunk_size) {
+		GBytes *chunk = g_bytes_new_from_bytes (body, offset, MIN (chunk_size, body_size - offset));
+		gboolean success = soup_form_data_parser_feed (parser, chunk, error);
+
+		g_bytes_unref (chunk);
+		if (!success)
+			return FALSE;
+	}
+
+	/* Files are written from a worker thread */
+	while (!soup_form_data_parser_finish (parser, error)) {
+		if (!g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_PENDING))
+			return FALSE;
+		g_clear_error (error);
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	return TRUE;
+}
+
+static void
+do_form_data_parser_test (void)
+{
+	const char *file_contents = "some\r\nfile\r\n-- contents";
+	gsize chunk_sizes[] = { 1, 7, 64, G_MAXSIZE };
+	SoupFormDataParser *parser;
+	GBytes *body;
+	char *boundary, *dir_path;
+	GFile *dir, *file;
+	const char *filename, *content_type;
+	char *contents;
+	GString *parts;
+	GError *error = NULL;
+	guint i;
+
+	body = build_form_data (file_contents, &boundary);
+	dir_path = g_dir_make_tmp ("soup-form-data-XXXXXX", &error);
+	g_assert_no_error (error);
+	dir = g_file_new_for_path (dir_path);
+
+	for (i = 0; i < G_N_ELEMENTS (chunk_sizes); i++) {
+		debug_printf (1, "  chunk size %" G_GSIZE_FORMAT "\n", chunk_sizes[i]);
+
+		parser = soup_form_data_parser_new (boundary);
+		soup_form_data_parser_set_upload_directory (parser, dir);
+		parts = g_string_new (NULL);
+		g_signal_connect (parser, "part-started", G_CALLBACK (part_started), parts);
+		g_signal_connect (parser, "part-data", G_CALLBACK (part_data), parts);
+		g_signal_connect (parser, "part-finished", G_CALLBACK (part_finished), parts);
+
+		feed_form_data (parser, body, g_bytes_get_size (body), chunk_sizes[i], &error);
+		g_assert_no_error (error);
+
+		g_assert_cmpstr (parts->str, ==, "[namevalue][filesome\r\nfile\r\n-- contents][empty]");
+		g_string_free (parts, TRUE);
+
+		g_assert_cmpuint (g_hash_table_size (soup_form_data_parser_get_fields (parser)), ==, 2);
+		g_assert_cmpstr (g_hash_table_lookup (soup_form_data_parser_get_fields (parser), "name"), ==, "value");
+		g_assert_cmpstr (g_hash_table_lookup (soup_form_data_parser_get_fields (parser), "empty"), ==, "");
+
+		file = soup_form_data_parser_get_file (parser, "file", &filename, &content_type);
+		g_assert_nonnull (file);
+		g_assert_cmpstr (filename, ==, "upload.txt");
+		g_assert_cmpstr (content_type, ==, "text/plain");
+		g_file_load_contents (file, NULL, &contents, NULL, NULL, &error);
+		g_assert_no_error (error);
+		g_assert_cmpstr (contents, ==, file_contents);
+		g_free (contents);
+
+		/* Uploaded files are removed with the parser */
+		g_object_ref (file);
+		g_object_unref (parser);
+		while (g_file_query_exists (file, NULL))
+			g_main_context_iteration (NULL, TRUE);
+		g_object_unref (file);
+	}
+
+	/* Parts larger than the limit are rejected */
+	parser = soup_form_data_parser_new (boundary);
+	soup_form_data_parser_set_max_part_size (parser, 8);
+	g_assert_false (feed_form_data (parser, body, g_bytes_get_size (body), 16, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE);
+	g_clear_error (&error);
+	g_assert_null (soup_form_data_parser_get_file (parser, "file", NULL, NULL));
+	g_object_unref (parser);
+
+	/* Regular fields have their own limit, which doesn't apply to files */
+	parser = soup_form_data_parser_new (boundary);
+	g_assert_cmpint (soup_form_data_parser_get_max_field_size (parser), >, 0);
+	soup_form_data_parser_set_max_field_size (parser, 4);
+	g_assert_false (feed_form_data (parser, body, g_bytes_get_size (body), 16, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE);
+	g_clear_error (&error);
+	g_assert_null (g_hash_table_lookup (soup_form_data_parser_get_fields (parser), "name"));
+	g_object_unref (parser);
+
+	parser = soup_form_data_parser_new (boundary);
+	soup_form_data_parser_set_max_field_size (parser, 5);
+	feed_form_data (parser, body, g_bytes_get_size (body), 16, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (g_hash_table_lookup (soup_form_data_parser_get_fields (parser), "name"), ==, "value");
+	g_object_unref (parser);
+
+	/* A truncated body is an error */
+	parser = soup_form_data_parser_new (boundary);
+	g_assert_false (feed_form_data (parser, body, g_bytes_get_size (body) - 4, 16, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT);
+	g_clear_error (&error);
+	g_object_unref (parser);
+
+	g_file_delete (dir, NULL, &error);
+	g_assert_no_error (error);
+	g_object_unref (dir);
+	g_free (dir_path);
+	g_free (boundary);
+	g_bytes_unref (body);
+}
+
 static void
 do_form_decode_test (void)
 {
@@ -461,6 +692,112 @@ md5_post_callback (SoupServer        *server,
 	g_hash_table_destroy (params);
 }
 
+typedef struct {
+	SoupFormDataParser *parser;
+	GChecksum *checksum;
+	gboolean in_file;
+} StreamUpload;
+
+static void
+stream_upload_free (StreamUpload *upload)
+{
+	g_object_unref (upload->parser);
+	g_checksum_free (upload->checksum);
+	g_free (upload);
+}
+
+static void
+stream_part_started (SoupFormDataParser *parser,
+		     const char         *name,
+		     const char         *filename,
+		     SoupMessageHeaders *headers,
+		     StreamUpload       *upload)
+{
+	upload->in_file = g_strcmp0 (name, "file") == 0;
+}
+
+static void
+stream_part_data (SoupFormDataParser *parser,
+		  GBytes             *chunk,
+		  StreamUpload       *upload)
+{
+	if (upload->in_file)
+		g_checksum_update (upload->checksum, g_bytes_get_data (chunk, NULL), g_bytes_get_size (chunk));
+}
+
+static void
+md5_stream_early_callback (SoupServer        *server,
+			   SoupServerMessage *msg,
+			   const char        *path,
+			   GHashTable        *query,
+			   gpointer           data)
+{
+	StreamUpload *upload;
+	SoupFormDataParser *parser;
+
+	parser = soup_form_data_parser_new_for_message (msg);
+	if (!parser)
+		return;
+
+	if (query && g_hash_table_contains (query, "max-part-size"))
+		soup_form_data_parser_set_max_part_size (parser, g_ascii_strtoll (g_hash_table_lookup (query, "max-part-size"), NULL, 10));
+	else {
+		GFile *dir = g_file_new_for_path (g_get_tmp_dir ());
+
+		soup_form_data_parser_set_upload_directory (parser, dir);
+		g_object_unref (dir);
+	}
+
+	upload = g_new0 (StreamUpload, 1);
+	upload->parser = parser;
+	upload->checksum = g_checksum_new (G_CHECKSUM_MD5);
+	g_signal_connect (parser, "part-started", G_CALLBACK (stream_part_started), upload);
+	g_signal_connect (parser, "part-data", G_CALLBACK (stream_part_data), upload);
+	g_object_set_data_full (G_OBJECT (msg), "upload", upload, (GDestroyNotify)stream_upload_free);
+}
+
+static void
+md5_stream_callback (SoupServer        *server,
+		     SoupServerMessage *msg,
+		     const char        *path,
+		     GHashTable        *query,
+		     gpointer           data)
+{
+	StreamUpload *upload;
+	const char *md5sum;
+	GFile *file;
+	char *contents, *file_md5sum;
+	gsize length;
+	GError *error = NULL;
+
+	upload = g_object_get_data (G_OBJECT (msg), "upload");
+	if (!upload || !soup_form_data_parser_finish (upload->parser, NULL)) {
+		soup_server_message_set_status (msg, SOUP_STATUS_BAD_REQUEST, NULL);
+		return;
+	}
+
+	/* The request body was not kept in memory */
+	g_assert_cmpint (soup_server_message_get_request_body (msg)->length, ==, 0);
+	g_assert_cmpstr (g_hash_table_lookup (soup_form_data_parser_get_fields (upload->parser), "fmt"), ==, "text");
+
+	md5sum = g_checksum_get_string (upload->checksum);
+
+	/* The file was completely written before the handler is called */
+	file = soup_form_data_parser_get_file (upload->parser, "file", NULL, NULL);
+	g_assert_nonnull (file);
+	g_file_load_contents (file, NULL, &contents, &length, NULL, &error);
+	g_assert_no_error (error);
+	file_md5sum = g_compute_checksum_for_data (G_CHECKSUM_MD5, (const guchar *)contents, length);
+	g_assert_cmpstr (file_md5sum, ==, md5sum);
+	g_free (file_md5sum);
+	g_free (contents);
+
+	soup_server_message_set_response (msg, "text/plain",
+					  SOUP_MEMORY_COPY,
+					  md5sum, strlen (md5sum));
+	soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+}
+
 static void
 md5_callback (SoupServer        *server,
 	      SoupServerMessage *msg,
@@ -504,6 +841,10 @@ main (int argc, char **argv)
 				 hello_callback, NULL, NULL);
 	soup_server_add_handler (server, "/md5",
 				 md5_callback, NULL, NULL);
+	soup_server_add_early_handler (server, "/md5-stream",
+				       md5_stream_early_callback, NULL, NULL);
+	soup_server_add_handler (server, "/md5-stream",
+				 md5_stream_callback, NULL, NULL);
 	base_uri = soup_test_server_get_uri (server, "http", NULL);
 
 	loop = g_main_loop_new (NULL, TRUE);
@@ -519,7 +860,12 @@ main (int argc, char **argv)
 		g_test_add_data_func_full ("/forms/md5/libsoup", g_uri_to_string (uri), do_md5_test_libsoup, g_free);
 		g_uri_unref (uri);
 
+		uri = g_uri_parse_relative (base_uri, "/md5-stream", SOUP_HTTP_URI_FLAGS, NULL);
+		g_test_add_data_func_full ("/forms/md5/stream", g_uri_to_string (uri), do_md5_stream_test, g_free);
+		g_uri_unref (uri);
+
 		g_test_add_func ("/forms/decode", do_form_decode_test);
+		g_test_add_func ("/forms/data-parser", do_form_data_parser_test);
 
 		ret = g_test_run ();
 	} else {
@@ -791,6 +791,9 @@ metrics_test_network_event_cb (SoupMessage       *msg,
                 g_assert_cmpuint (soup_message_metrics_get_tls_start (metrics), >, 0);
                 g_assert_cmpuint (soup_message_metrics_get_tls_start (metrics), >=, soup_message_metrics_get_connect_start (metrics));
                 break;
+        case G_SOCKET_CLIENT_TLS_HANDSHAKED:
+                g_assert_cmpuint (soup_message_metrics_get_tls_end (metrics), >=, soup_message_metrics_get_tls_start (metrics));
+                break;
         case G_SOCKET_CLIENT_COMPLETE:
                 g_assert_cmpuint (soup_message_metrics_get_connect_end (metrics), >, 0);
                 g_assert_cmpuint (soup_message_metrics_get_connect_end (metrics), >=, soup_message_metrics_get_connect_start (metrics));
@@ -1183,6 +1186,94 @@ do_connection_closed_test (Test *test, gconstpointer data)
         g_uri_unref (uri);
 }
 
+#ifdef HAVE_NGHTTP2_EXTENDED_CONNECT
+static void
+websocket_connect_ready (SoupSession              *session,
+                         GAsyncResult             *result,
+                         SoupWebsocketConnection **ws)
+{
+        GError *error = NULL;
+
+        *ws = soup_session_websocket_connect_finish (session, result, &error);
+        g_assert_no_error (error);
+}
+
+static void
+websocket_client_message (SoupWebsocketConnection *ws,
+                          SoupWebsocketDataType    type,
+                          GBytes                  *message,
+                          GBytes                 **received)
+{
+        g_assert_cmpint (type, ==, SOUP_WEBSOCKET_DATA_TEXT);
+        *received = g_bytes_ref (message);
+}
+
+static void
+do_websocket_test (Test *test, gconstpointer data)
+{
+        GUri *uri;
+        SoupMessage *msg;
+        SoupWebsocketConnection *ws = NULL;
+        GBytes *response;
+        GBytes *received = NULL;
+        GError *error = NULL;
+        guint32 connection_id;
+
+        /* Open the HTTP/2 connection first, the WebSocket must share it */
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, base_uri);
+        response = soup_test_session_async_send (test->session, msg, NULL, &error);
+        g_assert_no_error (error);
+        g_assert_cmpuint (soup_message_get_http_version (msg), ==, SOUP_HTTP_2_0);
+        connection_id = soup_message_get_connection_id (msg);
+        g_bytes_unref (response);
+        g_object_unref (msg);
+
+        uri = g_uri_parse_relative (base_uri, "/websocket", SOUP_HTTP_URI_FLAGS, NULL);
+        if (data) {
+                GUri *copy = soup_uri_copy (uri, SOUP_URI_SCHEME, data, SOUP_URI_NONE);
+
+                g_uri_unref (uri);
+                uri = copy;
+        }
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, uri);
+        soup_session_websocket_connect_async (test->session, msg, NULL, NULL,
+                                              G_PRIORITY_DEFAULT, NULL,
+                                              (GAsyncReadyCallback)websocket_connect_ready,
+                                              &ws);
+        while (!ws)
+                g_main_context_iteration (NULL, TRUE);
+
+        g_assert_cmpuint (soup_message_get_http_version (msg), ==, SOUP_HTTP_2_0);
+        g_assert_cmpuint (soup_message_get_status (msg), ==, SOUP_STATUS_OK);
+        g_assert_cmpuint (soup_message_get_connection_id (msg), ==, connection_id);
+        g_object_unref (msg);
+
+        g_signal_connect (ws, "message",
+                          G_CALLBACK (websocket_client_message), &received);
+        soup_websocket_connection_send_text (ws, "Hello over HTTP/2");
+        while (!received)
+                g_main_context_iteration (NULL, TRUE);
+        g_assert_cmpmem (g_bytes_get_data (received, NULL), g_bytes_get_size (received),
+                         "Hello over HTTP/2", strlen ("Hello over HTTP/2"));
+        g_bytes_unref (received);
+
+        /* Regular requests keep being multiplexed on the same connection */
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, base_uri);
+        response = soup_test_session_async_send (test->session, msg, NULL, &error);
+        g_assert_no_error (error);
+        g_assert_cmpstr (g_bytes_get_data (response, NULL), ==, "Hello world");
+        g_assert_cmpuint (soup_message_get_connection_id (msg), ==, connection_id);
+        g_bytes_unref (response);
+        g_object_unref (msg);
+
+        soup_websocket_connection_close (ws, SOUP_WEBSOCKET_CLOSE_NORMAL, NULL);
+        while (soup_websocket_connection_get_state (ws) != SOUP_WEBSOCKET_STATE_CLOSED)
+                g_main_context_iteration (NULL, TRUE);
+        g_object_unref (ws);
+        g_uri_unref (uri);
+}
+#endif
+
 static gboolean
 unpause_message (SoupServerMessage *msg)
 {
@@ -1305,6 +1396,34 @@ server_handler (SoupServer        *server,
         }
 }
 
+#ifdef HAVE_NGHTTP2_EXTENDED_CONNECT
+static void
+websocket_server_message (SoupWebsocketConnection *ws,
+                          SoupWebsocketDataType    type,
+                          GBytes                  *message,
+                          gpointer                 user_data)
+{
+        soup_websocket_connection_send_message (ws, type, message);
+}
+
+static void
+websocket_server_callback (SoupServer              *server,
+                           SoupServerMessage       *msg,
+                           const char              *path,
+                           SoupWebsocketConnection *ws,
+                           gpointer                 user_data)
+{
+        g_assert_cmpuint (soup_server_message_get_http_version (msg), ==, SOUP_HTTP_2_0);
+        /* wss:// is sent as https (RFC 8441 section 5) */
+        g_assert_cmpstr (g_uri_get_scheme (soup_server_message_get_uri (msg)), ==, "https");
+
+        g_signal_connect (ws, "message",
+                          G_CALLBACK (websocket_server_message), NULL);
+        g_signal_connect (g_object_ref (ws), "closed",
+                          G_CALLBACK (g_object_unref), NULL);
+}
+#endif
+
 static gboolean
 server_basic_auth_callback (SoupAuthDomain    *auth_domain,
                             SoupServerMessage *msg,
@@ -1339,6 +1458,10 @@ main (int argc, char **argv)
         g_object_unref (auth);
 
         soup_server_add_handler (server, NULL, server_handler, NULL, NULL);
+#ifdef HAVE_NGHTTP2_EXTENDED_CONNECT
+        soup_server_add_websocket_handler (server, "/websocket", NULL, NULL,
+                                           websocket_server_callback, NULL, NULL);
+#endif
         base_uri = soup_test_server_get_uri (server, "https", "127.0.0.1");
 
         g_test_add ("/http2/basic/async", Test, NULL,
@@ -1471,6 +1594,16 @@ main (int argc, char **argv)
                     setup_session,
                     do_connection_closed_test,
                     teardown_session);
+#ifdef HAVE_NGHTTP2_EXTENDED_CONNECT
+        g_test_add ("/http2/websocket", Test, NULL,
+                    setup_session,
+                    do_websocket_test,
+                    teardown_session);
+        g_test_add ("/http2/websocket/wss", Test, "wss",
+                    setup_session,
+                    do_websocket_test,
+                    teardown_session);
+#endif
 
 	ret = g_test_run ();
 
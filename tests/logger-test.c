@@ -463,6 +463,97 @@ do_logger_preconnect_test (void)
         soup_test_session_abort_unref (session);
 }
 
+static void
+structured_printer (SoupLogger         *logger,
+                    SoupLoggerLogLevel  level,
+                    char                direction,
+                    const char         *data,
+                    GPtrArray          *lines)
+{
+        g_ptr_array_add (lines, g_strdup_printf ("%c%s", direction, data));
+}
+
+static void
+do_logger_structured_test (void)
+{
+        SoupSession *session;
+        SoupLogger *logger;
+        SoupMessage *msg;
+        GPtrArray *lines;
+        char *host;
+        const char *other_hosts[] = { "example.invalid", ".example.com", NULL };
+        int i;
+
+        /* JSON lines, printed from the logger thread */
+        lines = g_ptr_array_new_with_free_func (g_free);
+        session = soup_test_session_new (NULL);
+        logger = soup_logger_new (SOUP_LOGGER_LOG_BODY);
+        soup_logger_set_printer (logger, (SoupLoggerPrinter)structured_printer, lines, NULL);
+        soup_logger_set_structured (logger, SOUP_LOGGER_FORMAT_JSON, 16);
+        soup_session_add_feature (session, SOUP_SESSION_FEATURE (logger));
+
+        msg = soup_message_new_from_uri ("GET", base_uri);
+        soup_test_session_send_message (session, msg);
+        g_object_unref (msg);
+
+        soup_logger_flush (logger);
+        g_assert_cmpuint (lines->len, ==, 2);
+        g_assert_true (g_str_has_prefix (lines->pdata[0], ">{\"type\":\"request\""));
+        g_assert_nonnull (strstr (lines->pdata[0], "\"method\":\"GET\""));
+        g_assert_nonnull (strstr (lines->pdata[0], "\"path\":\"/\""));
+        host = g_strdup_printf ("[\"Host\",\"%s:%d\"]", g_uri_get_host (base_uri), g_uri_get_port (base_uri));
+        g_assert_nonnull (strstr (lines->pdata[0], host));
+        g_free (host);
+        g_assert_true (g_str_has_prefix (lines->pdata[1], "<{\"type\":\"response\""));
+        g_assert_nonnull (strstr (lines->pdata[1], "\"status\":200"));
+        g_assert_nonnull (strstr (lines->pdata[1], "\"body\":\"Lorem ipsum"));
+        g_assert_cmpuint (soup_logger_get_dropped_records (logger), ==, 0);
+
+        g_object_unref (logger);
+        soup_test_session_abort_unref (session);
+        g_ptr_array_set_size (lines, 0);
+
+        /* Every other message is logged */
+        session = soup_test_session_new (NULL);
+        logger = soup_logger_new (SOUP_LOGGER_LOG_MINIMAL);
+        soup_logger_set_printer (logger, (SoupLoggerPrinter)structured_printer, lines, NULL);
+        soup_logger_set_structured (logger, SOUP_LOGGER_FORMAT_JSON, 16);
+        soup_logger_set_sample_rate (logger, 0.5);
+        soup_session_add_feature (session, SOUP_SESSION_FEATURE (logger));
+
+        for (i = 0; i < 4; i++) {
+                msg = soup_message_new_from_uri ("GET", base_uri);
+                soup_test_session_send_message (session, msg);
+                g_object_unref (msg);
+        }
+
+        soup_logger_flush (logger);
+        g_assert_cmpuint (lines->len, ==, 4);
+
+        g_object_unref (logger);
+        soup_test_session_abort_unref (session);
+        g_ptr_array_set_size (lines, 0);
+
+        /* Only messages to other hosts are logged */
+        session = soup_test_session_new (NULL);
+        logger = soup_logger_new (SOUP_LOGGER_LOG_MINIMAL);
+        soup_logger_set_printer (logger, (SoupLoggerPrinter)structured_printer, lines, NULL);
+        soup_logger_set_structured (logger, SOUP_LOGGER_FORMAT_TEXT, 16);
+        soup_logger_set_hosts (logger, other_hosts);
+        soup_session_add_feature (session, SOUP_SESSION_FEATURE (logger));
+
+        msg = soup_message_new_from_uri ("GET", base_uri);
+        soup_test_session_send_message (session, msg);
+        g_object_unref (msg);
+
+        soup_logger_flush (logger);
+        g_assert_cmpuint (lines->len, ==, 0);
+
+        g_object_unref (logger);
+        soup_test_session_abort_unref (session);
+        g_ptr_array_unref (lines);
+}
+
 static void
 server_callback (SoupServer        *server,
                  SoupServerMessage *msg,
@@ -499,6 +590,7 @@ main (int argc, char **argv)
         g_test_add_func ("/logger/filters", do_logger_filters_test);
         g_test_add_func ("/logger/cookies", do_logger_cookies_test);
         g_test_add_func ("/logger/preconnect", do_logger_preconnect_test);
+        g_test_add_func ("/logger/structured", do_logger_structured_test);
 
         ret = g_test_run ();
 
@@ -88,6 +88,56 @@ server_callback (SoupServer        *server,
 	soup_message_body_complete (response_body);
 }
 
+/* Sent in pieces that split the boundaries and the part headers */
+static const char *slow_pieces[] = {
+	"--cut-here\r\nContent-Ty",
+	"pe: text/plain\r\n",
+	"\r\nfirst part",
+	"\r\n--cut-here\r\n",
+	"Content-Type: text/plain\r\n\r\nsecond part\r\n--cut",
+	"-here--\r\n"
+};
+
+static gboolean
+slow_server_write_piece (gpointer user_data)
+{
+	SoupServerMessage *msg = user_data;
+	SoupMessageBody *response_body = soup_server_message_get_response_body (msg);
+	guint next_piece;
+
+	next_piece = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (msg), "next-piece"));
+	soup_message_body_append (response_body, SOUP_MEMORY_STATIC,
+				  slow_pieces[next_piece], strlen (slow_pieces[next_piece]));
+	next_piece++;
+	if (next_piece == G_N_ELEMENTS (slow_pieces))
+		soup_message_body_complete (response_body);
+	g_object_set_data (G_OBJECT (msg), "next-piece", GUINT_TO_POINTER (next_piece));
+	soup_server_message_unpause (msg);
+
+	return next_piece < G_N_ELEMENTS (slow_pieces) ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static void
+slow_server_callback (SoupServer        *server,
+		      SoupServerMessage *msg,
+		      const char        *path,
+		      GHashTable        *query,
+		      gpointer           data)
+{
+	SoupMessageHeaders *response_headers;
+
+	soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+	response_headers = soup_server_message_get_response_headers (msg);
+	soup_message_headers_append (response_headers,
+				     "Content-Type", "multipart/x-mixed-replace; boundary=cut-here");
+	soup_message_headers_set_encoding (response_headers, SOUP_ENCODING_CHUNKED);
+
+	soup_server_message_pause (msg);
+	g_timeout_add_full (G_PRIORITY_DEFAULT, 10, slow_server_write_piece,
+			    g_object_ref (msg), g_object_unref);
+}
+
 static void
 content_sniffed (SoupMessage *msg, char *content_type, GHashTable *params, int *sniffed_count)
 {
@@ -473,6 +523,103 @@ test_multipart (gconstpointer data)
 	loop = NULL;
 }
 
+typedef struct {
+	SoupMultipartInputStream *multipart;
+	GInputStream *part;
+	char buffer[64];
+	GPtrArray *parts;
+} SlowMultipartData;
+
+static void slow_multipart_next_part_cb (GObject *source, GAsyncResult *res, gpointer user_data);
+
+static void
+slow_multipart_read_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	SlowMultipartData *data = user_data;
+	gsize bytes_read;
+	GError *error = NULL;
+
+	g_input_stream_read_all_finish (G_INPUT_STREAM (source), res, &bytes_read, &error);
+	g_assert_no_error (error);
+	g_ptr_array_add (data->parts, g_strndup (data->buffer, bytes_read));
+	g_clear_object (&data->part);
+
+	soup_multipart_input_stream_next_part_async (data->multipart, G_PRIORITY_DEFAULT, NULL,
+						     slow_multipart_next_part_cb, data);
+}
+
+static void
+slow_multipart_next_part_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	SlowMultipartData *data = user_data;
+	SoupMessageHeaders *headers;
+	GError *error = NULL;
+
+	data->part = soup_multipart_input_stream_next_part_finish (data->multipart, res, &error);
+	g_assert_no_error (error);
+	if (!data->part) {
+		g_main_loop_quit (loop);
+		return;
+	}
+
+	headers = soup_multipart_input_stream_get_headers (data->multipart);
+	g_assert_nonnull (headers);
+	g_assert_cmpstr (soup_message_headers_get_content_type (headers, NULL), ==, "text/plain");
+
+	g_input_stream_read_all_async (data->part, data->buffer, sizeof (data->buffer),
+				       G_PRIORITY_DEFAULT, NULL,
+				       slow_multipart_read_cb, data);
+}
+
+static void
+slow_multipart_send_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	SlowMultipartData *data = user_data;
+	GInputStream *in;
+	GError *error = NULL;
+
+	in = soup_session_send_finish (SOUP_SESSION (source), res, &error);
+	g_assert_no_error (error);
+
+	data->multipart = soup_multipart_input_stream_new (soup_session_get_async_result_message (SOUP_SESSION (source), res), in);
+	g_object_unref (in);
+
+	soup_multipart_input_stream_next_part_async (data->multipart, G_PRIORITY_DEFAULT, NULL,
+						     slow_multipart_next_part_cb, data);
+}
+
+/* Part boundaries and headers arriving in several pieces must be
+ * picked up as they arrive by next_part_async().
+ */
+static void
+test_multipart_slow (void)
+{
+	SlowMultipartData data = { NULL, };
+	SoupMessage *msg;
+	GUri *uri;
+
+	uri = g_uri_parse_relative (base_uri, "/slow", SOUP_HTTP_URI_FLAGS, NULL);
+	msg = soup_message_new_from_uri ("GET", uri);
+	/* The sniffer would wait for the whole response */
+	soup_message_disable_feature (msg, SOUP_TYPE_CONTENT_SNIFFER);
+
+	data.parts = g_ptr_array_new_with_free_func (g_free);
+	loop = g_main_loop_new (NULL, TRUE);
+	soup_session_send_async (session, msg, G_PRIORITY_DEFAULT, NULL, slow_multipart_send_cb, &data);
+	g_main_loop_run (loop);
+
+	g_assert_cmpuint (data.parts->len, ==, 2);
+	g_assert_cmpstr (data.parts->pdata[0], ==, "first part");
+	g_assert_cmpstr (data.parts->pdata[1], ==, "second part");
+
+	g_ptr_array_unref (data.parts);
+	g_object_unref (data.multipart);
+	g_object_unref (msg);
+	g_uri_unref (uri);
+	g_main_loop_unref (loop);
+	loop = NULL;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -485,6 +632,7 @@ main (int argc, char **argv)
 
 	server = soup_test_server_new (SOUP_TEST_SERVER_DEFAULT);
 	soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+	soup_server_add_handler (server, "/slow", slow_server_callback, NULL, NULL);
 	base_uri = soup_test_server_get_uri (server, "http", NULL);
 	base_uri_string = g_uri_to_string (base_uri);
 
@@ -500,6 +648,7 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/multipart/sync", GINT_TO_POINTER (SYNC_MULTIPART), test_multipart);
 	g_test_add_data_func ("/multipart/async", GINT_TO_POINTER (ASYNC_MULTIPART), test_multipart);
 	g_test_add_data_func ("/multipart/async-small-reads", GINT_TO_POINTER (ASYNC_MULTIPART_SMALL_READS), test_multipart);
+	g_test_add_func ("/multipart/async-slow", test_multipart_slow);
 
 	ret = g_test_run ();
 
@@ -354,9 +354,22 @@ server_handler (SoupServer        *server,
 		GHashTable        *query,
 		gpointer           user_data)
 {
+	SoupMessageBody *response_body = soup_server_message_get_response_body (msg);
+	gsize full_response_length = g_bytes_get_size (full_response);
+	gsize offset = 0, chunk_size = 1;
+
 	soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
-	soup_message_body_append_bytes (soup_server_message_get_response_body (msg),
-					full_response);
+
+	/* Use chunks of growing sizes, so that ranges span several of them */
+	while (offset < full_response_length) {
+		GBytes *chunk;
+
+		chunk_size = MIN (chunk_size * 7, full_response_length - offset);
+		chunk = g_bytes_new_from_bytes (full_response, offset, chunk_size);
+		soup_message_body_append_bytes (response_body, chunk);
+		g_bytes_unref (chunk);
+		offset += chunk_size;
+	}
 }
 
 static void
@@ -381,6 +394,30 @@ do_libsoup_range_test (void)
 	soup_test_session_abort_unref (session);
 }
 
+static void
+do_libsoup_http2_range_test (void)
+{
+	SoupSession *session;
+	SoupServer *server;
+	GUri *base_uri;
+	char *base_uri_str;
+
+	SOUP_TEST_SKIP_IF_NO_TLS;
+
+	session = soup_test_session_new (NULL);
+
+	server = soup_test_server_new (SOUP_TEST_SERVER_HTTP2);
+	soup_server_add_handler (server, NULL, server_handler, NULL, NULL);
+	base_uri = soup_test_server_get_uri (server, "https", NULL);
+	base_uri_str = g_uri_to_string (base_uri);
+	do_range_test (session, base_uri_str, TRUE, TRUE);
+	g_uri_unref (base_uri);
+	g_free (base_uri_str);
+	soup_test_server_quit_unref (server);
+
+	soup_test_session_abort_unref (session);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -394,6 +431,7 @@ main (int argc, char **argv)
 
 	g_test_add_func ("/ranges/apache", do_apache_range_test);
 	g_test_add_func ("/ranges/libsoup", do_libsoup_range_test);
+	g_test_add_func ("/ranges/libsoup/http2", do_libsoup_http2_range_test);
 
 	ret = g_test_run ();
 
@@ -7,9 +7,11 @@
 #include "soup-message-private.h"
 #include "soup-uri-utils-private.h"
 #include "soup-server-private.h"
+#include "soup-server-message-private.h"
 #include "soup-misc.h"
 
 #include <gio/gnetworking.h>
+#include <glib/gstdio.h>
 
 typedef struct {
 	SoupServer *server;
@@ -433,6 +435,50 @@ do_multi_port_test (ServerData *sd, gconstpointer test_data)
 	do_multi_test (sd, uri1, uri2);
 }
 
+static void
+do_reuse_port_test (ServerData *sd, gconstpointer test_data)
+{
+	SoupSession *session;
+	SoupMessage *msg;
+	GSList *uris;
+	GUri *uri;
+	GBytes *body;
+	guint port;
+	GError *error = NULL;
+	int i;
+
+	sd->server = soup_test_server_new (SOUP_TEST_SERVER_NO_DEFAULT_LISTENER);
+	server_add_handler (sd, NULL, server_callback, NULL, NULL);
+
+	soup_server_listen_local (sd->server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY | SOUP_SERVER_LISTEN_REUSE_PORT, &error);
+	g_assert_no_error (error);
+	uris = soup_server_get_uris (sd->server);
+	uri = g_uri_ref (uris->data);
+	g_slist_free_full (uris, (GDestroyNotify)g_uri_unref);
+	port = g_uri_get_port (uri);
+
+	/* A second listener can share the port only if it asks for it */
+	g_assert_false (soup_server_listen_local (sd->server, port, SOUP_SERVER_LISTEN_IPV4_ONLY, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE);
+	g_clear_error (&error);
+
+	soup_server_listen_local (sd->server, port, SOUP_SERVER_LISTEN_IPV4_ONLY | SOUP_SERVER_LISTEN_REUSE_PORT, &error);
+	g_assert_no_error (error);
+
+	session = soup_test_session_new (NULL);
+	for (i = 0; i < 10; i++) {
+		msg = soup_message_new_from_uri ("GET", uri);
+		soup_message_add_flags (msg, SOUP_MESSAGE_NEW_CONNECTION);
+		body = soup_test_session_async_send (session, msg, NULL, NULL);
+		soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+		g_bytes_unref (body);
+		g_object_unref (msg);
+	}
+	soup_test_session_abort_unref (session);
+
+	g_uri_unref (uri);
+}
+
 static void
 do_multi_scheme_test (ServerData *sd, gconstpointer test_data)
 {
@@ -1355,6 +1401,697 @@ do_idle_connection_closed_test (ServerData *sd, gconstpointer test_data)
                 g_main_context_iteration (NULL, FALSE);
 }
 
+static GBytes *compress_body;
+
+static void
+compress_wrote_chunk (SoupServerMessage *msg,
+                      GBytes            *rest)
+{
+        g_signal_handlers_disconnect_by_func (msg, compress_wrote_chunk, rest);
+        soup_message_body_append_bytes (soup_server_message_get_response_body (msg), rest);
+}
+
+static void
+compress_server_callback (SoupServer        *server,
+                          SoupServerMessage *msg,
+                          const char        *path,
+                          GHashTable        *query,
+                          gpointer           data)
+{
+        SoupMessageHeaders *response_headers = soup_server_message_get_response_headers (msg);
+        SoupMessageBody *response_body = soup_server_message_get_response_body (msg);
+
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+
+        if (!strcmp (path, "/compress/small")) {
+                soup_server_message_set_response (msg, "text/plain",
+                                                  SOUP_MEMORY_STATIC, "small", 5);
+        } else if (!strcmp (path, "/compress/image")) {
+                soup_message_headers_set_content_type (response_headers, "image/png", NULL);
+                soup_message_body_append_bytes (response_body, compress_body);
+        } else if (!strcmp (path, "/compress/chunked")) {
+                gsize size = g_bytes_get_size (compress_body);
+                GBytes *half;
+
+                soup_message_headers_set_content_type (response_headers, "text/plain", NULL);
+                soup_message_headers_set_encoding (response_headers, SOUP_ENCODING_CHUNKED);
+                half = g_bytes_new_from_bytes (compress_body, 0, size / 2);
+                soup_message_body_append_bytes (response_body, half);
+                g_bytes_unref (half);
+                half = g_bytes_new_from_bytes (compress_body, size / 2, size - size / 2);
+                soup_message_body_append_bytes (response_body, half);
+                g_bytes_unref (half);
+                soup_message_body_complete (response_body);
+        } else if (!strcmp (path, "/compress/streamed")) {
+                gsize size = g_bytes_get_size (compress_body);
+                GBytes *half;
+
+                /* The rest of the declared length is appended once the
+                 * first half has been written.
+                 */
+                soup_message_headers_set_content_type (response_headers, "text/plain", NULL);
+                soup_message_headers_set_content_length (response_headers, size);
+                soup_message_body_set_accumulate (response_body, FALSE);
+                half = g_bytes_new_from_bytes (compress_body, 0, size / 2);
+                soup_message_body_append_bytes (response_body, half);
+                g_bytes_unref (half);
+                half = g_bytes_new_from_bytes (compress_body, size / 2, size - size / 2);
+                g_signal_connect_data (msg, "wrote-chunk",
+                                       G_CALLBACK (compress_wrote_chunk), half,
+                                       (GClosureNotify)g_bytes_unref, 0);
+        } else {
+                soup_message_headers_set_content_type (response_headers, "text/plain", NULL);
+                soup_message_headers_replace (response_headers, "ETag", "\"compress\"");
+                soup_message_body_append_bytes (response_body, compress_body);
+        }
+}
+
+static SoupMessage *
+do_compress_request (SoupSession *session,
+                     GUri        *base_uri,
+                     const char  *path,
+                     const char  *accept_encoding,
+                     const char  *expected_encoding,
+                     GBytes      *expected_body)
+{
+        SoupMessage *msg;
+        GUri *uri;
+        GBytes *body;
+
+        uri = g_uri_parse_relative (base_uri, path, SOUP_HTTP_URI_FLAGS, NULL);
+        msg = soup_message_new_from_uri ("GET", uri);
+        if (accept_encoding)
+                soup_message_headers_replace (soup_message_get_request_headers (msg), "Accept-Encoding", accept_encoding);
+        body = soup_test_session_async_send (session, msg, NULL, NULL);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_assert_cmpstr (soup_message_headers_get_one (soup_message_get_response_headers (msg), "Content-Encoding"), ==, expected_encoding);
+        g_assert_true (g_bytes_equal (body, expected_body));
+
+        g_bytes_unref (body);
+        g_uri_unref (uri);
+
+        return msg;
+}
+
+static void
+do_content_encoder_test (ServerData *sd, gconstpointer test_data)
+{
+        SoupContentEncoder *encoder;
+        SoupSession *session;
+        SoupMessage *msg;
+        SoupMessageHeaders *response_headers;
+        GString *text;
+        GBytes *small;
+        goffset length;
+
+        text = g_string_new (NULL);
+        while (text->len < 64 * 1024)
+                g_string_append_printf (text, "Line %u of a compressible response body\n", (guint)text->len);
+        compress_body = g_string_free_to_bytes (text);
+
+        encoder = soup_content_encoder_new ();
+        soup_server_set_content_encoder (sd->server, encoder);
+        g_assert_true (soup_server_get_content_encoder (sd->server) == encoder);
+        g_object_unref (encoder);
+
+        server_add_handler (sd, "/compress", compress_server_callback, NULL, NULL);
+
+        session = soup_test_session_new (NULL);
+
+        /* Complete bodies are compressed once and served from the cache */
+        msg = do_compress_request (session, sd->base_uri, "/compress/static", NULL, "gzip", compress_body);
+        response_headers = soup_message_get_response_headers (msg);
+        g_assert_true (soup_message_headers_header_contains (response_headers, "Vary", "Accept-Encoding"));
+        length = soup_message_headers_get_content_length (response_headers);
+        g_assert_cmpint (length, >, 0);
+        g_assert_cmpint (length, <, g_bytes_get_size (compress_body));
+        g_assert_cmpstr (soup_message_headers_get_one (response_headers, "ETag"), ==, "W/\"compress\"");
+        g_object_unref (msg);
+
+        msg = do_compress_request (session, sd->base_uri, "/compress/static", NULL, "gzip", compress_body);
+        g_assert_cmpint (soup_message_headers_get_content_length (soup_message_get_response_headers (msg)), ==, length);
+        g_object_unref (msg);
+
+        /* Streamed bodies are compressed as they are written */
+        msg = do_compress_request (session, sd->base_uri, "/compress/chunked", NULL, "gzip", compress_body);
+        g_assert_cmpint (soup_message_headers_get_encoding (soup_message_get_response_headers (msg)), ==, SOUP_ENCODING_CHUNKED);
+        g_object_unref (msg);
+
+        msg = do_compress_request (session, sd->base_uri, "/compress/streamed", NULL, "gzip", compress_body);
+        g_assert_cmpint (soup_message_headers_get_encoding (soup_message_get_response_headers (msg)), ==, SOUP_ENCODING_CHUNKED);
+        g_object_unref (msg);
+
+        /* The coding with the highest quality value wins, whatever the server prefers */
+        msg = do_compress_request (session, sd->base_uri, "/compress/static", "gzip;q=0.5, deflate", "deflate", compress_body);
+        g_object_unref (msg);
+
+        msg = do_compress_request (session, sd->base_uri, "/compress/static", "deflate;q=0.5, gzip;q=0.5", "gzip", compress_body);
+        g_object_unref (msg);
+
+        msg = do_compress_request (session, sd->base_uri, "/compress/static", "*;q=0.5, gzip;q=0, deflate", "deflate", compress_body);
+        g_object_unref (msg);
+
+        /* Small bodies and already compressed types are left alone */
+        small = g_bytes_new_static ("small", 5);
+        msg = do_compress_request (session, sd->base_uri, "/compress/small", NULL, NULL, small);
+        g_object_unref (msg);
+        g_bytes_unref (small);
+
+        msg = do_compress_request (session, sd->base_uri, "/compress/image", NULL, NULL, compress_body);
+        g_object_unref (msg);
+
+        soup_test_session_abort_unref (session);
+        g_clear_pointer (&compress_body, g_bytes_unref);
+}
+
+static void
+do_content_encoder_chunks_test (void)
+{
+        SoupServerMessage *msg;
+        SoupMessageBody *body;
+        GBytes *chunk;
+        gconstpointer data;
+        gpointer stolen;
+        gsize size;
+
+        msg = g_object_new (SOUP_TYPE_SERVER_MESSAGE, NULL);
+        body = soup_server_message_get_response_body (msg);
+        soup_message_body_append (body, SOUP_MEMORY_STATIC, "compressed", 10);
+        soup_message_body_complete (body);
+        soup_server_message_set_response_encoder (msg,
+                                                  G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, 6)),
+                                                  -1);
+
+        body = soup_server_message_get_write_body (msg);
+        chunk = soup_message_body_get_chunk (body, 0);
+        g_assert_nonnull (chunk);
+        data = g_bytes_get_data (chunk, &size);
+        g_assert_cmpuint (size, >, 0);
+        soup_message_body_wrote_chunk (body, chunk);
+
+        /* Once written, the encoded chunk is only referenced here, so
+         * its data can be taken without copying it.
+         */
+        stolen = g_bytes_unref_to_data (chunk, &size);
+        g_assert_true (stolen == data);
+        g_free (stolen);
+
+        g_object_unref (msg);
+}
+
+#ifdef G_OS_UNIX
+static gboolean
+has_request_body_tmp_files (void)
+{
+        GDir *dir;
+        const char *name;
+        gboolean found = FALSE;
+
+        dir = g_dir_open (g_get_tmp_dir (), 0, NULL);
+        if (!dir)
+                return FALSE;
+
+        while (!found && (name = g_dir_read_name (dir)))
+                found = g_str_has_prefix (name, "libsoup-request-body-");
+        g_dir_close (dir);
+
+        return found;
+}
+#endif
+
+static GBytes *
+read_request_body (SoupServerMessage *msg)
+{
+        GInputStream *istream;
+        GOutputStream *ostream;
+        GBytes *body;
+        GError *error = NULL;
+
+        istream = soup_server_message_get_request_body_stream (msg, &error);
+        g_assert_no_error (error);
+        ostream = g_memory_output_stream_new_resizable ();
+        g_output_stream_splice (ostream, istream,
+                                G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                NULL, &error);
+        g_assert_no_error (error);
+        body = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream));
+        g_object_unref (ostream);
+        g_object_unref (istream);
+
+        return body;
+}
+
+static void
+upload_server_callback (SoupServer        *server,
+                        SoupServerMessage *msg,
+                        const char        *path,
+                        GHashTable        *query,
+                        gpointer           data)
+{
+        GBytes *body, *body2;
+        gboolean spilled;
+
+        spilled = soup_server_message_get_request_body (msg)->length == 0 &&
+                soup_message_headers_get_content_length (soup_server_message_get_request_headers (msg)) > 0;
+#ifdef G_OS_UNIX
+        /* The temporary file is unlinked right after being created */
+        g_assert_false (has_request_body_tmp_files ());
+#endif
+
+        /* Every stream reads the body from the start */
+        body = read_request_body (msg);
+        body2 = read_request_body (msg);
+        g_assert_true (g_bytes_equal (body, body2));
+        g_bytes_unref (body2);
+
+        soup_message_headers_append (soup_server_message_get_response_headers (msg),
+                                     "X-Spilled", spilled ? "yes" : "no");
+        soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+        soup_message_body_append_bytes (soup_server_message_get_response_body (msg), body);
+        g_bytes_unref (body);
+}
+
+static void
+do_upload_request (SoupSession *session,
+                   GUri        *base_uri,
+                   GBytes      *request_body,
+                   const char  *expected_spilled)
+{
+        SoupMessage *msg;
+        GUri *uri;
+        GBytes *body;
+
+        uri = g_uri_parse_relative (base_uri, "/upload", SOUP_HTTP_URI_FLAGS, NULL);
+        msg = soup_message_new_from_uri ("PUT", uri);
+        soup_message_set_request_body_from_bytes (msg, "application/octet-stream", request_body);
+        body = soup_test_session_async_send (session, msg, NULL, NULL);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_assert_cmpstr (soup_message_headers_get_one (soup_message_get_response_headers (msg), "X-Spilled"), ==, expected_spilled);
+        g_assert_true (g_bytes_equal (body, request_body));
+
+        g_bytes_unref (body);
+        g_object_unref (msg);
+        g_uri_unref (uri);
+}
+
+static void
+do_request_body_spill_test (ServerData *sd, gconstpointer test_data)
+{
+        SoupSession *session;
+        GBytes *small, *large;
+        guchar *data;
+        gsize i;
+
+        small = g_bytes_new_static ("small request body", 18);
+        data = g_malloc (300 * 1024);
+        for (i = 0; i < 300 * 1024; i++)
+                data[i] = i % 251;
+        large = g_bytes_new_take (data, 300 * 1024);
+
+        server_add_handler (sd, "/upload", upload_server_callback, NULL, NULL);
+        session = soup_test_session_new (NULL);
+
+        /* Bodies are kept in memory by default */
+        do_upload_request (session, sd->base_uri, large, "no");
+
+        soup_server_set_request_body_spill_threshold (sd->server, 64 * 1024);
+        g_assert_cmpint (soup_server_get_request_body_spill_threshold (sd->server), ==, 64 * 1024);
+        do_upload_request (session, sd->base_uri, small, "no");
+        do_upload_request (session, sd->base_uri, large, "yes");
+
+        soup_test_session_abort_unref (session);
+
+        g_bytes_unref (small);
+        g_bytes_unref (large);
+}
+
+static void
+do_admission_control_test (ServerData *sd, gconstpointer test_data)
+{
+        SoupSession *session, *session2;
+        SoupMessage *msg;
+        GBytes *body;
+        GInputStream *input;
+        GOutputStream *output;
+        GIOStream *stream;
+        GSocketAddress *addr;
+        GError *error = NULL;
+        int i;
+
+        session = soup_test_session_new (NULL);
+
+        /* Per-client token bucket: two requests, then 503 */
+        soup_server_set_client_limits (sd->server, 0, 0.001, 2);
+        soup_server_set_retry_after (sd->server, 5);
+        for (i = 0; i < 3; i++) {
+                msg = soup_message_new_from_uri ("GET", sd->base_uri);
+                body = soup_test_session_async_send (session, msg, NULL, NULL);
+                if (i < 2) {
+                        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+                } else {
+                        soup_test_assert_message_status (msg, SOUP_STATUS_SERVICE_UNAVAILABLE);
+                        g_assert_cmpstr (soup_message_headers_get_one (soup_message_get_response_headers (msg), "Retry-After"), ==, "5");
+                        g_assert_cmpstr (soup_message_headers_get_one (soup_message_get_response_headers (msg), "X-Handled-By"), ==, NULL);
+                }
+                g_bytes_unref (body);
+                g_object_unref (msg);
+        }
+        g_assert_cmpuint (soup_server_get_counter (sd->server, SOUP_SERVER_COUNTER_REQUESTS_ACCEPTED), ==, 2);
+        g_assert_cmpuint (soup_server_get_counter (sd->server, SOUP_SERVER_COUNTER_REQUESTS_REJECTED), ==, 1);
+        soup_server_set_client_limits (sd->server, 0, 0, 0);
+
+        /* Keep one connection open and check a second one is refused */
+        msg = soup_message_new_from_uri ("GET", sd->base_uri);
+        body = soup_test_session_async_send (session, msg, NULL, NULL);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        soup_server_set_max_connections (sd->server, 1);
+        g_assert_cmpuint (soup_server_get_max_connections (sd->server), ==, 1);
+
+        session2 = soup_test_session_new (NULL);
+        msg = soup_message_new_from_uri ("GET", sd->base_uri);
+        body = soup_test_session_async_send (session2, msg, NULL, &error);
+        g_assert_nonnull (error);
+        g_clear_error (&error);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+        g_assert_cmpuint (soup_server_get_counter (sd->server, SOUP_SERVER_COUNTER_CONNECTIONS_REJECTED), ==, 1);
+
+        /* Streams passed to the server directly are refused too */
+        input = g_memory_input_stream_new ();
+        output = g_memory_output_stream_new_resizable ();
+        stream = g_test_io_stream_new (input, output);
+        addr = g_inet_socket_address_new_from_string ("127.0.0.1", 0);
+        g_assert_false (soup_server_accept_iostream (sd->server, stream, addr, addr, &error));
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_REFUSED);
+        g_clear_error (&error);
+        g_assert_true (g_io_stream_is_closed (stream));
+        g_assert_cmpuint (soup_server_get_counter (sd->server, SOUP_SERVER_COUNTER_CONNECTIONS_REJECTED), ==, 2);
+        g_object_unref (addr);
+        g_object_unref (stream);
+        g_object_unref (input);
+        g_object_unref (output);
+
+        soup_test_session_abort_unref (session2);
+        soup_test_session_abort_unref (session);
+}
+
+static void
+do_tls_handshake_threads_test (ServerData *sd, gconstpointer test_data)
+{
+        SoupSession *session;
+        SoupMessage *msg;
+        GBytes *body;
+        int i;
+
+        if (!tls_available) {
+                g_test_skip ("TLS is not available");
+                return;
+        }
+
+        soup_server_set_tls_handshake_threads (sd->server, 2);
+        g_assert_cmpuint (soup_server_get_tls_handshake_threads (sd->server), ==, 2);
+
+        session = soup_test_session_new (NULL);
+        for (i = 0; i < 3; i++) {
+                msg = soup_message_new_from_uri ("GET", sd->ssl_base_uri);
+                soup_message_add_flags (msg, SOUP_MESSAGE_NEW_CONNECTION);
+                body = soup_test_session_async_send (session, msg, NULL, NULL);
+                soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+                g_bytes_unref (body);
+                g_object_unref (msg);
+        }
+        soup_test_session_abort_unref (session);
+
+        g_assert_cmpuint (soup_server_get_counter (sd->server, SOUP_SERVER_COUNTER_TLS_HANDSHAKES_COMPLETED), ==, 3);
+        g_assert_cmpuint (soup_server_get_counter (sd->server, SOUP_SERVER_COUNTER_TLS_HANDSHAKES_PENDING), ==, 0);
+        g_assert_cmpuint (soup_server_get_counter (sd->server, SOUP_SERVER_COUNTER_TLS_HANDSHAKE_TIME), >, 0);
+}
+
+static SoupMessage *
+do_static_request (SoupSession *session,
+                   GUri        *base_uri,
+                   const char  *path,
+                   const char  *header,
+                   const char  *value,
+                   GBytes     **body)
+{
+        SoupMessage *msg;
+        GUri *uri;
+
+        uri = g_uri_parse_relative (base_uri, path, SOUP_HTTP_URI_FLAGS, NULL);
+        msg = soup_message_new_from_uri ("GET", uri);
+        g_uri_unref (uri);
+        soup_message_add_flags (msg, SOUP_MESSAGE_NO_REDIRECT);
+        if (header)
+                soup_message_headers_replace (soup_message_get_request_headers (msg), header, value);
+
+        *body = soup_test_session_async_send (session, msg, NULL, NULL);
+
+        return msg;
+}
+
+static void
+do_static_handler_test (ServerData *sd, gconstpointer test_data)
+{
+        SoupSession *session;
+        SoupMessage *msg;
+        SoupMessageHeaders *headers;
+        GBytes *body;
+        GUri *uri;
+        char *root_dir, *filename, *etag, *large;
+        FILE *fp;
+
+        root_dir = g_dir_make_tmp ("soup-static-XXXXXX", NULL);
+        g_assert_nonnull (root_dir);
+        filename = g_build_filename (root_dir, "hello.txt", NULL);
+        g_assert_true (g_file_set_contents (filename, "Hello, world", -1, NULL));
+        g_free (filename);
+        filename = g_build_filename (root_dir, ".hidden", NULL);
+        g_assert_true (g_file_set_contents (filename, "secret", -1, NULL));
+        g_free (filename);
+        filename = g_build_filename (root_dir, "sub", NULL);
+        g_assert_cmpint (g_mkdir (filename, 0700), ==, 0);
+        g_free (filename);
+        filename = g_build_filename (root_dir, "sub", "index.html", NULL);
+        g_assert_true (g_file_set_contents (filename, "<html></html>", -1, NULL));
+        g_free (filename);
+        large = g_malloc (256 * 1024);
+        memset (large, 'x', 256 * 1024);
+        memcpy (large + 200 * 1024, "middle", 6);
+        filename = g_build_filename (root_dir, "large.bin", NULL);
+        g_assert_true (g_file_set_contents (filename, large, 256 * 1024, NULL));
+        g_free (filename);
+
+        soup_server_add_static_handler (sd->server, "/static", root_dir, SOUP_SERVER_STATIC_INDEX);
+        sd->handlers = g_slist_prepend (sd->handlers, g_strdup ("/static"));
+        session = soup_test_session_new (NULL);
+
+        msg = do_static_request (session, sd->base_uri, "/static/hello.txt", NULL, NULL, &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_assert_cmpmem ("Hello, world", sizeof ("Hello, world") - 1, g_bytes_get_data (body, NULL), g_bytes_get_size (body));
+        headers = soup_message_get_response_headers (msg);
+        g_assert_cmpstr (soup_message_headers_get_content_type (headers, NULL), ==, "text/plain");
+        g_assert_cmpstr (soup_message_headers_get_one (headers, "Accept-Ranges"), ==, "bytes");
+        g_assert_nonnull (soup_message_headers_get_one (headers, "Last-Modified"));
+        etag = g_strdup (soup_message_headers_get_one (headers, "ETag"));
+        g_assert_nonnull (etag);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        msg = do_static_request (session, sd->base_uri, "/static/hello.txt", "If-None-Match", etag, &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_NOT_MODIFIED);
+        g_assert_cmpuint (g_bytes_get_size (body), ==, 0);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        msg = do_static_request (session, sd->base_uri, "/static/hello.txt", "Range", "bytes=7-11", &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_PARTIAL_CONTENT);
+        g_assert_cmpmem ("world", sizeof ("world") - 1, g_bytes_get_data (body, NULL), g_bytes_get_size (body));
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        /* A Range with an outdated If-Range gets the whole file */
+        uri = g_uri_parse_relative (sd->base_uri, "/static/hello.txt", SOUP_HTTP_URI_FLAGS, NULL);
+        msg = soup_message_new_from_uri ("GET", uri);
+        g_uri_unref (uri);
+        soup_message_headers_replace (soup_message_get_request_headers (msg), "Range", "bytes=7-11");
+        soup_message_headers_replace (soup_message_get_request_headers (msg), "If-Range", "\"outdated\"");
+        body = soup_test_session_async_send (session, msg, NULL, NULL);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_assert_cmpmem ("Hello, world", sizeof ("Hello, world") - 1, g_bytes_get_data (body, NULL), g_bytes_get_size (body));
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        msg = do_static_request (session, sd->base_uri, "/static/sub", NULL, NULL, &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_MOVED_PERMANENTLY);
+        g_assert_cmpstr (soup_message_headers_get_one (soup_message_get_response_headers (msg), "Location"), ==, "/static/sub/");
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        msg = do_static_request (session, sd->base_uri, "/static/sub/", NULL, NULL, &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_assert_cmpmem ("<html></html>", sizeof ("<html></html>") - 1, g_bytes_get_data (body, NULL), g_bytes_get_size (body));
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        msg = do_static_request (session, sd->base_uri, "/static/.hidden", NULL, NULL, &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_NOT_FOUND);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        msg = do_static_request (session, sd->base_uri, "/static/missing.txt", NULL, NULL, &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_NOT_FOUND);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        /* Large files are streamed, from the offset of a single range */
+        msg = do_static_request (session, sd->base_uri, "/static/large.bin", NULL, NULL, &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_assert_cmpmem (large, 256 * 1024, g_bytes_get_data (body, NULL), g_bytes_get_size (body));
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        msg = do_static_request (session, sd->base_uri, "/static/large.bin", "Range", "bytes=204800-204805", &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_PARTIAL_CONTENT);
+        g_assert_cmpmem ("middle", sizeof ("middle") - 1, g_bytes_get_data (body, NULL), g_bytes_get_size (body));
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        /* Several ranges get the whole file */
+        msg = do_static_request (session, sd->base_uri, "/static/large.bin", "Range", "bytes=0-9,204800-204805", &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_assert_cmpmem (large, 256 * 1024, g_bytes_get_data (body, NULL), g_bytes_get_size (body));
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        msg = do_static_request (session, sd->base_uri, "/static/large.bin", "Range", "bytes=300000-", &body);
+        soup_test_assert_message_status (msg, SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        /* Truncating a file in place while it's cached doesn't crash the server */
+        filename = g_build_filename (root_dir, "large.bin", NULL);
+        fp = g_fopen (filename, "w");
+        g_assert_nonnull (fp);
+        fclose (fp);
+        g_free (filename);
+
+        msg = do_static_request (session, sd->base_uri, "/static/large.bin", NULL, NULL, &body);
+        if (soup_message_get_status (msg) == SOUP_STATUS_OK)
+                g_assert_cmpuint (g_bytes_get_size (body), ==, 0);
+        else
+                soup_test_assert_message_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        soup_test_session_abort_unref (session);
+        g_free (etag);
+        g_free (large);
+
+        filename = g_build_filename (root_dir, "sub", "index.html", NULL);
+        g_remove (filename);
+        g_free (filename);
+        filename = g_build_filename (root_dir, "sub", NULL);
+        g_rmdir (filename);
+        g_free (filename);
+        filename = g_build_filename (root_dir, ".hidden", NULL);
+        g_remove (filename);
+        g_free (filename);
+        filename = g_build_filename (root_dir, "hello.txt", NULL);
+        g_remove (filename);
+        g_free (filename);
+        filename = g_build_filename (root_dir, "large.bin", NULL);
+        g_remove (filename);
+        g_free (filename);
+        g_rmdir (root_dir);
+        g_free (root_dir);
+}
+
+typedef struct {
+        GMutex mutex;
+        GCond cond;
+        SoupServerMessageMetrics *metrics;
+} MetricsData;
+
+static void
+metrics_request_finished (SoupServer        *server,
+                          SoupServerMessage *msg,
+                          MetricsData       *data)
+{
+        g_mutex_lock (&data->mutex);
+        data->metrics = soup_server_message_metrics_copy (soup_server_message_get_metrics (msg));
+        g_cond_signal (&data->cond);
+        g_mutex_unlock (&data->mutex);
+}
+
+static void
+do_message_metrics_test (ServerData *sd, gconstpointer test_data)
+{
+        SoupSession *session;
+        SoupMessage *msg;
+        GBytes *body, *request_body;
+        MetricsData data = { 0 };
+        SoupServerMessageMetrics *metrics;
+        char *openmetrics;
+
+        g_mutex_init (&data.mutex);
+        g_cond_init (&data.cond);
+        g_signal_connect (sd->server, "request-finished",
+                          G_CALLBACK (metrics_request_finished), &data);
+
+        session = soup_test_session_new (NULL);
+        request_body = g_bytes_new_static ("metrics request body", 20);
+        msg = soup_message_new_from_uri ("POST", sd->base_uri);
+        soup_message_set_request_body_from_bytes (msg, "text/plain", request_body);
+        body = soup_test_session_async_send (session, msg, NULL, NULL);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+        g_bytes_unref (request_body);
+
+        g_mutex_lock (&data.mutex);
+        while (!data.metrics)
+                g_cond_wait (&data.cond, &data.mutex);
+        g_mutex_unlock (&data.mutex);
+        g_signal_handlers_disconnect_by_data (sd->server, &data);
+        metrics = data.metrics;
+
+        g_assert_cmpuint (soup_server_message_metrics_get_connection_start (metrics), >, 0);
+        g_assert_cmpuint (soup_server_message_metrics_get_request_start (metrics), >=, soup_server_message_metrics_get_connection_start (metrics));
+        g_assert_cmpuint (soup_server_message_metrics_get_request_headers_end (metrics), >=, soup_server_message_metrics_get_request_start (metrics));
+        g_assert_cmpuint (soup_server_message_metrics_get_request_end (metrics), >=, soup_server_message_metrics_get_request_headers_end (metrics));
+        g_assert_cmpuint (soup_server_message_metrics_get_response_start (metrics), >=, soup_server_message_metrics_get_request_end (metrics));
+        g_assert_cmpuint (soup_server_message_metrics_get_response_end (metrics), >=, soup_server_message_metrics_get_response_start (metrics));
+        g_assert_cmpuint (soup_server_message_metrics_get_request_header_bytes_received (metrics), >, 0);
+        g_assert_cmpuint (soup_server_message_metrics_get_request_body_bytes_received (metrics), ==, 20);
+        g_assert_cmpuint (soup_server_message_metrics_get_response_header_bytes_sent (metrics), >, 0);
+        g_assert_cmpuint (soup_server_message_metrics_get_response_body_bytes_sent (metrics), ==, 5);
+
+        g_assert_cmpuint (soup_server_get_metrics_count (sd->server, SOUP_SERVER_METRICS_PHASE_TOTAL), ==, 1);
+        g_assert_cmpuint (soup_server_get_metrics_count (sd->server, SOUP_SERVER_METRICS_PHASE_HANDLER), ==, 1);
+        g_assert_cmpuint (soup_server_get_metrics_percentile (sd->server, SOUP_SERVER_METRICS_PHASE_TOTAL, 50), >=,
+                          soup_server_message_metrics_get_response_end (metrics) - soup_server_message_metrics_get_request_start (metrics));
+
+        openmetrics = soup_server_get_openmetrics (sd->server);
+        g_assert_nonnull (strstr (openmetrics, "# TYPE soup_server_request_duration_seconds summary\n"));
+        g_assert_nonnull (strstr (openmetrics, "soup_server_request_duration_seconds_count 1\n"));
+        g_assert_nonnull (strstr (openmetrics, "soup_server_connections_accepted_total 1\n"));
+        g_assert_nonnull (strstr (openmetrics, "# TYPE soup_server_connections_active gauge\n"));
+        g_assert_true (g_str_has_suffix (openmetrics, "# EOF\n"));
+        g_free (openmetrics);
+
+        soup_server_reset_metrics (sd->server);
+        g_assert_cmpuint (soup_server_get_metrics_count (sd->server, SOUP_SERVER_METRICS_PHASE_TOTAL), ==, 0);
+
+        soup_server_message_metrics_free (metrics);
+        g_mutex_clear (&data.mutex);
+        g_cond_clear (&data.cond);
+        soup_test_session_abort_unref (session);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1378,6 +2115,8 @@ main (int argc, char **argv)
 		    NULL, do_multi_scheme_test, server_teardown);
 	g_test_add ("/server/multi/family", ServerData, NULL,
 		    NULL, do_multi_family_test, server_teardown);
+	g_test_add ("/server/multi/reuse-port", ServerData, NULL,
+		    NULL, do_reuse_port_test, server_teardown);
 	g_test_add_func ("/server/import/gsocket", do_gsocket_import_test);
 	g_test_add_func ("/server/import/fd", do_fd_import_test);
 	g_test_add_func ("/server/accept/iostream", do_iostream_accept_test);
@@ -1395,6 +2134,19 @@ main (int argc, char **argv)
 		    server_setup_nohandler, do_early_multi_test, server_teardown);
 	g_test_add ("/server/steal/CONNECT", ServerData, NULL,
 		    server_setup, do_steal_connect_test, server_teardown);
+        g_test_add_func ("/server/content-encoder/chunks", do_content_encoder_chunks_test);
+        g_test_add ("/server/content-encoder", ServerData, NULL,
+                    server_setup, do_content_encoder_test, server_teardown);
+        g_test_add ("/server/request-body-spill", ServerData, NULL,
+                    server_setup, do_request_body_spill_test, server_teardown);
+        g_test_add ("/server/admission-control", ServerData, NULL,
+                    server_setup, do_admission_control_test, server_teardown);
+        g_test_add ("/server/tls-handshake-threads", ServerData, NULL,
+                    server_setup, do_tls_handshake_threads_test, server_teardown);
+        g_test_add ("/server/static-handler", ServerData, NULL,
+                    server_setup_nohandler, do_static_handler_test, server_teardown);
+        g_test_add ("/server/message-metrics", ServerData, NULL,
+                    server_setup, do_message_metrics_test, server_teardown);
 
 	ret = g_test_run ();
 
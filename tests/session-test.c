@@ -465,6 +465,129 @@ do_queue_order_test (void)
 	soup_test_session_abort_unref (session);
 }
 
+static void
+do_stats_test (void)
+{
+	SoupSession *session;
+	SoupSessionStats *stats;
+	SoupSessionStatsSnapshot *snapshot, *other;
+	SoupMessage *msg;
+	GUri *uri;
+	GBytes *body;
+	char **origins, *origin, *expected, *exposition;
+	int i;
+
+	session = soup_test_session_new (NULL);
+	stats = soup_session_stats_new ();
+	soup_session_add_feature (session, SOUP_SESSION_FEATURE (stats));
+
+	uri = g_uri_parse_relative (base_uri, "/index.txt", SOUP_HTTP_URI_FLAGS, NULL);
+	for (i = 0; i < 3; i++) {
+		msg = soup_message_new_from_uri ("GET", uri);
+		body = soup_test_session_async_send (session, msg, NULL, NULL);
+		soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+		g_bytes_unref (body);
+		g_object_unref (msg);
+	}
+	g_uri_unref (uri);
+
+	snapshot = soup_session_stats_get_snapshot (stats);
+	origins = soup_session_stats_snapshot_get_origins (snapshot);
+	g_assert_cmpuint (g_strv_length (origins), ==, 1);
+	origin = g_strdup_printf ("http://%s:%d", g_uri_get_host (base_uri), g_uri_get_port (base_uri));
+	g_assert_cmpstr (origins[0], ==, origin);
+	g_strfreev (origins);
+
+	g_assert_cmpuint (soup_session_stats_snapshot_get_count (snapshot, origin, SOUP_SESSION_STATS_PHASE_TOTAL), ==, 3);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_count (snapshot, origin, SOUP_SESSION_STATS_PHASE_TTFB), ==, 3);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_count (snapshot, origin, SOUP_SESSION_STATS_PHASE_CONNECT), >=, 1);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_count (snapshot, origin, SOUP_SESSION_STATS_PHASE_TLS), ==, 0);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_count (snapshot, "http://example.com", SOUP_SESSION_STATS_PHASE_TOTAL), ==, 0);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_count (snapshot, NULL, SOUP_SESSION_STATS_PHASE_TOTAL), ==, 3);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_percentile (snapshot, origin, SOUP_SESSION_STATS_PHASE_TOTAL, 50), >, 0);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_percentile (snapshot, origin, SOUP_SESSION_STATS_PHASE_TOTAL, 50), <=,
+			  soup_session_stats_snapshot_get_percentile (snapshot, origin, SOUP_SESSION_STATS_PHASE_TOTAL, 99.9));
+
+	exposition = soup_session_stats_snapshot_to_openmetrics (snapshot);
+	expected = g_strdup_printf ("soup_session_request_duration_seconds_count{origin=\"%s\"} 3\n", origin);
+	g_assert_nonnull (strstr (exposition, "# TYPE soup_session_request_duration_seconds summary\n"));
+	g_assert_nonnull (strstr (exposition, expected));
+	g_assert_true (g_str_has_suffix (exposition, "# EOF\n"));
+	g_free (expected);
+	g_free (exposition);
+
+	other = soup_session_stats_get_snapshot (stats);
+	soup_session_stats_snapshot_merge (snapshot, other);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_count (snapshot, origin, SOUP_SESSION_STATS_PHASE_TOTAL), ==, 6);
+	soup_session_stats_snapshot_unref (other);
+	soup_session_stats_snapshot_unref (snapshot);
+
+	soup_session_stats_reset (stats);
+	snapshot = soup_session_stats_get_snapshot (stats);
+	g_assert_cmpuint (soup_session_stats_snapshot_get_count (snapshot, origin, SOUP_SESSION_STATS_PHASE_TOTAL), ==, 0);
+	soup_session_stats_snapshot_unref (snapshot);
+
+	g_free (origin);
+	g_object_unref (stats);
+	soup_test_session_abort_unref (session);
+}
+
+static void
+do_flight_recorder_test (void)
+{
+	SoupSession *session;
+	SoupFlightRecorder *recorder;
+	SoupMessage *msg;
+	GUri *uri;
+	GBytes *body;
+	char *json, *expected;
+	const char *p;
+	int i, n;
+
+	session = soup_test_session_new (NULL);
+	recorder = soup_flight_recorder_new (2, 256);
+	g_assert_cmpuint (soup_flight_recorder_get_max_exchanges (recorder), ==, 2);
+	g_assert_cmpuint (soup_flight_recorder_get_max_header_bytes (recorder), ==, 256);
+	soup_session_add_feature (session, SOUP_SESSION_FEATURE (recorder));
+
+	json = soup_flight_recorder_to_json (recorder);
+	g_assert_cmpstr (json, ==, "[]\n");
+	g_free (json);
+
+	uri = g_uri_parse_relative (base_uri, "/index.txt?secret=1", SOUP_HTTP_URI_FLAGS, NULL);
+	for (i = 0; i < 3; i++) {
+		msg = soup_message_new_from_uri ("GET", uri);
+		soup_message_headers_append (soup_message_get_request_headers (msg), "Authorization", "Basic c2VjcmV0");
+		body = soup_test_session_async_send (session, msg, NULL, NULL);
+		soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+		g_bytes_unref (body);
+		g_object_unref (msg);
+	}
+	g_uri_unref (uri);
+
+	json = soup_flight_recorder_to_json (recorder);
+	g_assert_true (g_str_has_prefix (json, "[\n{"));
+	g_assert_true (g_str_has_suffix (json, "}\n]\n"));
+	for (p = json, n = 0; (p = strstr (p, "\"status\":200")); p++, n++)
+		;
+	g_assert_cmpint (n, ==, 2);
+	expected = g_strdup_printf ("\"uri\":\"http://%s:%d/index.txt\"", g_uri_get_host (base_uri), g_uri_get_port (base_uri));
+	g_assert_nonnull (strstr (json, expected));
+	g_assert_nonnull (strstr (json, "[\"Authorization\",\"[redacted]\"]"));
+	g_assert_null (strstr (json, "secret"));
+	g_assert_null (strstr (json, "c2VjcmV0"));
+	g_free (expected);
+	g_free (json);
+
+	soup_flight_recorder_clear (recorder);
+	json = soup_flight_recorder_to_json (recorder);
+	g_assert_cmpstr (json, ==, "[]\n");
+	g_free (json);
+
+	g_object_unref (recorder);
+	soup_test_session_abort_unref (session);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -485,6 +608,8 @@ main (int argc, char **argv)
 	g_test_add_func ("/session/property", do_property_tests);
 	g_test_add_func ("/session/features", do_features_test);
 	g_test_add_func ("/session/queue-order", do_queue_order_test);
+	g_test_add_func ("/session/stats", do_stats_test);
+	g_test_add_func ("/session/flight-recorder", do_flight_recorder_test);
 
 	ret = g_test_run ();
 
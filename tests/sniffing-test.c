@@ -342,6 +342,113 @@ test_disabled (gconstpointer data)
 	g_uri_unref (uri);
 }
 
+#define BENCHMARK_ITERATIONS 20000
+
+/* Parses a libFuzzer dictionary entry: a quoted string with \xNN escapes */
+static GBytes *
+parse_dict_entry (const char *line)
+{
+        GByteArray *entry;
+        const char *p;
+
+        p = strchr (line, '"');
+        if (!p)
+                return NULL;
+
+        entry = g_byte_array_new ();
+        for (p++; *p && *p != '"'; p++) {
+                guint8 c = *p;
+
+                if (*p == '\\' && p[1] == 'x' && g_ascii_isxdigit (p[2]) && g_ascii_isxdigit (p[3])) {
+                        c = g_ascii_xdigit_value (p[2]) << 4 | g_ascii_xdigit_value (p[3]);
+                        p += 3;
+                } else if (*p == '\\' && p[1]) {
+                        c = *++p;
+                }
+                g_byte_array_append (entry, &c, 1);
+        }
+
+        return g_byte_array_free_to_bytes (entry);
+}
+
+static void
+do_sniffing_benchmark (void)
+{
+        static const char *content_types[] = {
+                NULL, "text/plain", "text/html", "image/png", "video/mp4"
+        };
+        SoupContentSniffer *sniffer;
+        GPtrArray *inputs;
+        char *dict_path, *contents, **lines;
+        GError *error = NULL;
+        guint i, j, k, n_sniffed = 0;
+        double elapsed;
+
+        dict_path = g_build_filename (g_test_get_dir (G_TEST_DIST), "..", "fuzzing", "fuzz_content_sniffer.dict", NULL);
+        if (!g_file_get_contents (dict_path, &contents, NULL, &error)) {
+                g_test_skip (error->message);
+                g_error_free (error);
+                g_free (dict_path);
+                return;
+        }
+        g_free (dict_path);
+
+        /* Each dictionary entry on its own and at the start of a
+         * resource long enough to fill the sniffing window.
+         */
+        inputs = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+        lines = g_strsplit (contents, "\n", -1);
+        for (i = 0; lines[i]; i++) {
+                GBytes *entry;
+                GString *padded;
+
+                if (lines[i][0] == '#')
+                        continue;
+
+                entry = parse_dict_entry (lines[i]);
+                if (!entry)
+                        continue;
+
+                padded = g_string_new_len (g_bytes_get_data (entry, NULL), g_bytes_get_size (entry));
+                while (padded->len < 1024)
+                        g_string_append (padded, " lorem ipsum dolor sit amet\r\n");
+                g_ptr_array_add (inputs, entry);
+                g_ptr_array_add (inputs, g_string_free_to_bytes (padded));
+        }
+        g_strfreev (lines);
+        g_free (contents);
+        g_assert_cmpuint (inputs->len, >, 0);
+
+        sniffer = soup_content_sniffer_new ();
+        g_test_timer_start ();
+        for (i = 0; i < G_N_ELEMENTS (content_types); i++) {
+                SoupMessage *msg = soup_message_new ("GET", "http://example.org");
+
+                if (content_types[i])
+                        soup_message_headers_set_content_type (soup_message_get_response_headers (msg), content_types[i], NULL);
+
+                for (j = 0; j < BENCHMARK_ITERATIONS; j++) {
+                        for (k = 0; k < inputs->len; k++) {
+                                char *sniffed_type;
+
+                                sniffed_type = soup_content_sniffer_sniff (sniffer, msg, inputs->pdata[k], NULL);
+                                g_assert_nonnull (sniffed_type);
+                                g_free (sniffed_type);
+                                n_sniffed++;
+                        }
+                }
+                g_object_unref (msg);
+        }
+        elapsed = g_test_timer_elapsed ();
+
+        g_test_maximized_result (n_sniffed / elapsed,
+                                 "sniffed %u resources at %.0f per second",
+                                 n_sniffed, n_sniffed / elapsed);
+
+        g_object_unref (sniffer);
+        g_ptr_array_unref (inputs);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -517,6 +624,9 @@ main (int argc, char **argv)
 			      "/text_or_binary/home.gif",
 			      test_disabled);
 
+        if (g_test_perf ())
+                g_test_add_func ("/sniffing/benchmark", do_sniffing_benchmark);
+
 	ret = g_test_run ();
 
 	g_uri_unref (base_uri);
@@ -4,6 +4,7 @@
 #include "soup-message-private.h"
 #include "soup-connection.h"
 #include "soup-uri-utils-private.h"
+#include "soup-timer-wheel.h"
 
 static gboolean slow_https;
 
@@ -205,6 +206,89 @@ server_handler (SoupServer        *server,
 	}
 }
 
+typedef struct {
+        GString *fired;
+        SoupTimer *timers[4];
+        guint ticks;
+} TimerWheelTest;
+
+static void
+timer_a_fired (gpointer user_data)
+{
+        TimerWheelTest *test = user_data;
+
+        g_string_append_c (test->fired, 'a');
+
+        /* Timers can be cancelled and rearmed from a callback */
+        soup_timer_cancel (test->timers[3]);
+}
+
+static void
+timer_b_fired (gpointer user_data)
+{
+        TimerWheelTest *test = user_data;
+
+        g_string_append_c (test->fired, 'b');
+        if (++test->ticks < 3)
+                soup_timer_arm (test->timers[1], 5);
+}
+
+static void
+timer_c_fired (gpointer user_data)
+{
+        TimerWheelTest *test = user_data;
+
+        g_string_append_c (test->fired, 'c');
+}
+
+static void
+timer_d_fired (gpointer user_data)
+{
+        TimerWheelTest *test = user_data;
+
+        g_string_append_c (test->fired, 'd');
+}
+
+static void
+do_timer_wheel_test (void)
+{
+        TimerWheelTest test = { NULL, };
+        SoupTimer *far;
+        guint i;
+
+        test.fired = g_string_new (NULL);
+        test.timers[0] = soup_timer_new (NULL, timer_a_fired, &test);
+        test.timers[1] = soup_timer_new (NULL, timer_b_fired, &test);
+        test.timers[2] = soup_timer_new (NULL, timer_c_fired, &test);
+        test.timers[3] = soup_timer_new (NULL, timer_d_fired, &test);
+        far = soup_timer_new (NULL, timer_d_fired, &test);
+
+        soup_timer_arm (test.timers[0], 200);
+        soup_timer_arm (test.timers[1], 1);
+        soup_timer_arm (test.timers[2], 1000);
+        soup_timer_arm (test.timers[3], 300);
+        g_assert_true (soup_timer_is_armed (test.timers[2]));
+
+        /* Rearming replaces the previous expiration */
+        soup_timer_arm (test.timers[2], 400);
+
+        /* Timers beyond the range of the wheel */
+        soup_timer_arm (far, G_GUINT64_CONSTANT (30) * 24 * 60 * 60 * 1000);
+
+        while (soup_timer_is_armed (test.timers[1]) || soup_timer_is_armed (test.timers[2]))
+                g_main_context_iteration (NULL, TRUE);
+
+        g_assert_cmpstr (test.fired->str, ==, "bbbac");
+        g_assert_false (soup_timer_is_armed (test.timers[0]));
+        g_assert_false (soup_timer_is_armed (test.timers[3]));
+        g_assert_true (soup_timer_is_armed (far));
+
+        for (i = 0; i < G_N_ELEMENTS (test.timers); i++)
+                soup_timer_free (test.timers[i]);
+        soup_timer_free (far);
+        g_string_free (test.fired, TRUE);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -247,6 +331,7 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/timeout/http/sync", uri, do_sync_timeout_tests);
 	g_test_add_data_func ("/timeout/https/async", https_uri, do_async_timeout_tests);
 	g_test_add_data_func ("/timeout/https/sync", https_uri, do_sync_timeout_tests);
+	g_test_add_func ("/timeout/timer-wheel", do_timer_wheel_test);
 
 	ret = g_test_run ();
 
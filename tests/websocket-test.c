@@ -39,6 +39,7 @@ typedef struct {
 	GIOStream *raw_server;
 
 	gboolean enable_extensions;
+	gboolean no_context_takeover;
 	gboolean disable_deflate_in_message;
 
 	GList *initial_cookies;
@@ -101,6 +102,25 @@ setup_listener (Test *test)
 	g_assert_no_error (error);
 }
 
+static SoupWebsocketExtension *
+create_deflate_extension (Test *test,
+			  SoupWebsocketConnectionType type)
+{
+	SoupWebsocketExtension *extension;
+	GHashTable *params = NULL;
+
+	if (test->no_context_takeover) {
+		params = g_hash_table_new (g_str_hash, g_str_equal);
+		g_hash_table_insert (params, "server_no_context_takeover", NULL);
+	}
+
+	extension = g_object_new (SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE, NULL);
+	g_assert_true (soup_websocket_extension_configure (extension, type, params, NULL));
+	g_clear_pointer (&params, g_hash_table_unref);
+
+	return extension;
+}
+
 static void
 direct_connection_complete (GObject *object,
 			    GAsyncResult *result,
@@ -118,13 +138,8 @@ direct_connection_complete (GObject *object,
 
 	uri = g_uri_parse ("http://127.0.0.1/", SOUP_HTTP_URI_FLAGS, NULL);
 	if (test->enable_extensions) {
-		SoupWebsocketExtension *extension;
-
-		extension = g_object_new (SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE, NULL);
-		g_assert_true (soup_websocket_extension_configure (extension,
-								   SOUP_WEBSOCKET_CONNECTION_CLIENT,
-								   NULL, NULL));
-		extensions = g_list_prepend (extensions, extension);
+		extensions = g_list_prepend (extensions,
+					     create_deflate_extension (test, SOUP_WEBSOCKET_CONNECTION_CLIENT));
 	}
 	test->client = soup_websocket_connection_new (G_IO_STREAM (conn), uri,
 						      SOUP_WEBSOCKET_CONNECTION_CLIENT,
@@ -158,13 +173,8 @@ got_connection (GSocket *listener,
 	else {
 		uri = g_uri_parse ("http://127.0.0.1/", SOUP_HTTP_URI_FLAGS, NULL);
 		if (test->enable_extensions) {
-			SoupWebsocketExtension *extension;
-
-			extension = g_object_new (SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE, NULL);
-			g_assert_true (soup_websocket_extension_configure (extension,
-									   SOUP_WEBSOCKET_CONNECTION_SERVER,
-									   NULL, NULL));
-			extensions = g_list_prepend (extensions, extension);
+			extensions = g_list_prepend (extensions,
+						     create_deflate_extension (test, SOUP_WEBSOCKET_CONNECTION_SERVER));
 		}
 		test->server = soup_websocket_connection_new (G_IO_STREAM (conn), uri,
 							      SOUP_WEBSOCKET_CONNECTION_SERVER,
@@ -210,6 +220,14 @@ setup_direct_connection_with_extensions (Test *test,
 	setup_direct_connection (test, data);
 }
 
+static void
+setup_direct_connection_with_no_context_takeover (Test *test,
+						  gconstpointer data)
+{
+	test->no_context_takeover = TRUE;
+	setup_direct_connection_with_extensions (test, data);
+}
+
 static void
 setup_half_direct_connection (Test *test,
 			      gconstpointer data)
@@ -537,6 +555,111 @@ test_send_server_to_client (Test *test,
         g_clear_pointer (&received, g_bytes_unref);
 }
 
+static void
+on_binary_message_append (SoupWebsocketConnection *ws,
+			  SoupWebsocketDataType type,
+			  GBytes *message,
+			  gpointer user_data)
+{
+	GPtrArray *received = user_data;
+
+	g_assert_cmpint (type, ==, SOUP_WEBSOCKET_DATA_BINARY);
+	g_ptr_array_add (received, g_bytes_ref (message));
+}
+
+static void
+test_send_bytes (Test *test,
+		 gconstpointer data)
+{
+	GPtrArray *sent;
+	GPtrArray *received;
+	guint i;
+
+	sent = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	received = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	g_signal_connect (test->client, "message", G_CALLBACK (on_binary_message_append), received);
+	g_signal_connect (test->server, "message", G_CALLBACK (on_binary_message_append), received);
+
+	/* Queue several frames of different sizes so they are flushed together */
+	for (i = 0; i < 8; i++) {
+		gsize size = i % 2 ? 70 * 1000 : 100 + i;
+
+		g_ptr_array_add (sent, g_bytes_new_take (g_strnfill (size, 'a' + i), size));
+	}
+
+	for (i = 0; i < sent->len; i++)
+		soup_websocket_connection_send_bytes (test->server, SOUP_WEBSOCKET_DATA_BINARY, g_bytes_ref (sent->pdata[i]));
+	WAIT_UNTIL (received->len == sent->len);
+	for (i = 0; i < sent->len; i++)
+		g_assert_true (g_bytes_equal (sent->pdata[i], received->pdata[i]));
+	g_ptr_array_set_size (received, 0);
+
+	for (i = 0; i < sent->len; i++)
+		soup_websocket_connection_send_bytes (test->client, SOUP_WEBSOCKET_DATA_BINARY, g_bytes_ref (sent->pdata[i]));
+	WAIT_UNTIL (received->len == sent->len);
+	for (i = 0; i < sent->len; i++)
+		g_assert_true (g_bytes_equal (sent->pdata[i], received->pdata[i]));
+
+	g_ptr_array_unref (sent);
+	g_ptr_array_unref (received);
+}
+
+static void
+test_send_prepared_message (Test *test,
+			    gconstpointer data)
+{
+	SoupWebsocketPreparedMessage *prepared;
+	GBytes *sent;
+	GBytes *received = NULL;
+	guint i;
+
+	sent = g_bytes_new_take (g_strnfill (10 * 1000, '!'), 10 * 1000);
+	prepared = soup_websocket_prepared_message_new (SOUP_WEBSOCKET_DATA_TEXT, sent);
+	g_assert_cmpint (soup_websocket_prepared_message_get_data_type (prepared), ==, SOUP_WEBSOCKET_DATA_TEXT);
+	g_assert_true (soup_websocket_prepared_message_get_data (prepared) == sent);
+
+	/* The same prepared message can be sent multiple times */
+	g_signal_connect (test->client, "message", G_CALLBACK (on_text_message), &received);
+	for (i = 0; i < 3; i++) {
+		soup_websocket_connection_send_prepared_message (test->server, prepared);
+		WAIT_UNTIL (received != NULL);
+		g_assert_true (g_bytes_equal (sent, received));
+		g_clear_pointer (&received, g_bytes_unref);
+	}
+
+	/* Client connections send it as a normal message */
+	g_signal_connect (test->server, "message", G_CALLBACK (on_text_message), &received);
+	soup_websocket_connection_send_prepared_message (test->client, prepared);
+	WAIT_UNTIL (received != NULL);
+	g_assert_true (g_bytes_equal (sent, received));
+	g_clear_pointer (&received, g_bytes_unref);
+
+	soup_websocket_prepared_message_unref (prepared);
+	g_bytes_unref (sent);
+}
+
+static void
+test_prepared_message_invalid_utf8 (void)
+{
+	SoupWebsocketPreparedMessage *prepared;
+	GBytes *bytes;
+
+	bytes = g_bytes_new_static ("\xff\xfe", 2);
+
+	g_test_expect_message ("libsoup", G_LOG_LEVEL_CRITICAL,
+			       "*soup_websocket_prepared_message_new*assertion*failed*");
+	prepared = soup_websocket_prepared_message_new (SOUP_WEBSOCKET_DATA_TEXT, bytes);
+	g_test_assert_expected_messages ();
+	g_assert_null (prepared);
+
+	/* Binary messages can contain anything */
+	prepared = soup_websocket_prepared_message_new (SOUP_WEBSOCKET_DATA_BINARY, bytes);
+	g_assert_nonnull (prepared);
+	soup_websocket_prepared_message_unref (prepared);
+
+	g_bytes_unref (bytes);
+}
+
 static void
 test_send_big_packets (Test *test,
                        gconstpointer data)
@@ -1418,6 +1541,113 @@ test_receive_fragmented (Test *test,
 	WAIT_UNTIL (soup_websocket_connection_get_state (test->client) == SOUP_WEBSOCKET_STATE_CLOSED);
 }
 
+static void
+on_message_chunk (SoupWebsocketConnection *ws,
+		  SoupWebsocketDataType type,
+		  GBytes *chunk,
+		  gboolean is_last,
+		  gpointer user_data)
+{
+	GPtrArray *chunks = user_data;
+
+	g_assert_cmpint (type, ==, SOUP_WEBSOCKET_DATA_TEXT);
+	g_ptr_array_add (chunks, g_bytes_ref (chunk));
+	if (is_last)
+		g_ptr_array_add (chunks, NULL);
+}
+
+static void
+test_receive_fragmented_streaming (Test *test,
+				   gconstpointer data)
+{
+	GThread *thread;
+	GPtrArray *chunks;
+	const char *expected[] = { "one ", "two ", "three" };
+	guint i;
+
+	chunks = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	soup_websocket_connection_set_stream_messages (test->client, TRUE);
+	g_assert_true (soup_websocket_connection_get_stream_messages (test->client));
+
+	thread = g_thread_new ("fragment-thread",
+			       test->enable_extensions ?
+			       send_compressed_fragments_server_thread :
+			       send_fragments_server_thread,
+			       test);
+
+	g_signal_connect (test->client, "error", G_CALLBACK (on_error_not_reached), NULL);
+	g_signal_connect (test->client, "message-chunk", G_CALLBACK (on_message_chunk), chunks);
+
+	WAIT_UNTIL (chunks->len > 0 && chunks->pdata[chunks->len - 1] == NULL);
+	g_assert_cmpuint (chunks->len, ==, G_N_ELEMENTS (expected) + 1);
+	for (i = 0; i < G_N_ELEMENTS (expected); i++) {
+		GBytes *expect = g_bytes_new_static (expected[i], strlen (expected[i]));
+
+		g_assert_true (g_bytes_equal (expect, chunks->pdata[i]));
+		g_bytes_unref (expect);
+	}
+	g_ptr_array_unref (chunks);
+
+	g_thread_join (thread);
+
+	WAIT_UNTIL (soup_websocket_connection_get_state (test->client) == SOUP_WEBSOCKET_STATE_CLOSED);
+}
+
+static gpointer
+send_split_utf8_fragments_server_thread (gpointer user_data)
+{
+	Test *test = user_data;
+	gsize written;
+	/* U+00F1 U+20AC split in the middle of both sequences */
+	const char fragments[] = "\x01\x01""\xc3"         /* !fin | opcode */
+		"\x00\x02""\xb1\xe2"   /* !fin | no opcode */
+		"\x80\x02""\x82\xac";  /* fin  | no opcode */
+	GError *error = NULL;
+
+	g_output_stream_write_all (g_io_stream_get_output_stream (test->raw_server),
+				   fragments, sizeof (fragments) -1, &written, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (written, ==, sizeof (fragments) - 1);
+	g_io_stream_close (test->raw_server, NULL, &error);
+	g_assert_no_error (error);
+
+	return NULL;
+}
+
+static void
+test_receive_split_utf8_streaming (Test *test,
+				   gconstpointer data)
+{
+	GThread *thread;
+	GPtrArray *chunks;
+	GByteArray *message;
+	guint i;
+
+	chunks = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	soup_websocket_connection_set_stream_messages (test->client, TRUE);
+
+	thread = g_thread_new ("fragment-thread", send_split_utf8_fragments_server_thread, test);
+
+	g_signal_connect (test->client, "error", G_CALLBACK (on_error_not_reached), NULL);
+	g_signal_connect (test->client, "message-chunk", G_CALLBACK (on_message_chunk), chunks);
+
+	WAIT_UNTIL (chunks->len > 0 && chunks->pdata[chunks->len - 1] == NULL);
+	message = g_byte_array_new ();
+	for (i = 0; i < chunks->len - 1; i++) {
+		gsize len;
+		gconstpointer chunk = g_bytes_get_data (chunks->pdata[i], &len);
+
+		g_byte_array_append (message, chunk, len);
+	}
+	g_assert_cmpmem (message->data, message->len, "\xc3\xb1\xe2\x82\xac", 5);
+	g_byte_array_unref (message);
+	g_ptr_array_unref (chunks);
+
+	g_thread_join (thread);
+
+	WAIT_UNTIL (soup_websocket_connection_get_state (test->client) == SOUP_WEBSOCKET_STATE_CLOSED);
+}
+
 typedef struct {
 	Test *test;
 	const char *header;
@@ -1853,6 +2083,80 @@ test_deflate_negotiate_direct (Test *test,
 	g_ptr_array_unref (supported_extensions);
 }
 
+static void
+test_deflate_compression_tuning (Test *test,
+                                 gconstpointer data)
+{
+	GList *extensions;
+	SoupWebsocketExtension *extension;
+	guint8 header[2] = { 0x82, 0x00 };
+	guint8 small[16] = { 0, };
+	guint8 large[1024] = { 0, };
+	GBytes *payload;
+	GBytes *received = NULL;
+	int level;
+	GError *error = NULL;
+
+	/* Use a standalone extension, so that the connection's
+	 * compression context is not modified.
+	 */
+	extension = create_deflate_extension (test, SOUP_WEBSOCKET_CONNECTION_SERVER);
+
+	g_object_get (extension, "compression-level", &level, NULL);
+	g_assert_cmpint (level, ==, -1);
+
+	g_object_set (extension,
+		      "compression-threshold", 128,
+		      "compression-level", 1,
+		      "mem-level", 1,
+		      "max-window-bits", 9,
+		      NULL);
+
+	/* Messages below the threshold are not compressed */
+	payload = soup_websocket_extension_process_outgoing_message (extension, header,
+								     g_bytes_new_static (small, sizeof (small)),
+								     &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (header[0] & 0x40, ==, 0);
+	g_assert_cmpuint (g_bytes_get_size (payload), ==, sizeof (small));
+	g_bytes_unref (payload);
+
+	payload = soup_websocket_extension_process_outgoing_message (extension, header,
+								     g_bytes_new_static (large, sizeof (large)),
+								     &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (header[0] & 0x40, ==, 0x40);
+	g_assert_cmpuint (g_bytes_get_size (payload), <, sizeof (large));
+	g_bytes_unref (payload);
+	g_object_unref (extension);
+
+	/* The peer inflates both kinds of messages */
+	extensions = soup_websocket_connection_get_extensions (test->server);
+	g_assert_cmpuint (g_list_length (extensions), ==, 1);
+	g_object_set (extensions->data,
+		      "compression-threshold", 128,
+		      "compression-level", 1,
+		      "mem-level", 1,
+		      "max-window-bits", 9,
+		      NULL);
+
+	g_signal_connect (test->client, "message", G_CALLBACK (on_binary_message), &received);
+
+	payload = g_bytes_new_static (small, sizeof (small));
+	soup_websocket_connection_send_message (test->server, SOUP_WEBSOCKET_DATA_BINARY, payload);
+	WAIT_UNTIL (received != NULL);
+	g_assert_true (g_bytes_equal (payload, received));
+	g_clear_pointer (&received, g_bytes_unref);
+	g_bytes_unref (payload);
+
+	payload = g_bytes_new_static (large, sizeof (large));
+	soup_websocket_connection_send_message (test->server, SOUP_WEBSOCKET_DATA_BINARY, payload);
+	WAIT_UNTIL (received != NULL);
+	g_assert_true (g_bytes_equal (payload, received));
+	g_clear_pointer (&received, g_bytes_unref);
+	g_bytes_unref (payload);
+}
+
 static void
 test_deflate_disabled_in_message_direct (Test *test,
 					 gconstpointer unused)
@@ -2127,6 +2431,26 @@ main (int argc,
 		    test_send_server_to_client,
 		    teardown_soup_connection);
 
+	g_test_add ("/websocket/direct/send-bytes", Test, NULL,
+		    setup_direct_connection,
+		    test_send_bytes,
+		    teardown_direct_connection);
+	g_test_add ("/websocket/soup/send-bytes", Test, NULL,
+		    setup_soup_connection,
+		    test_send_bytes,
+		    teardown_soup_connection);
+
+	g_test_add ("/websocket/direct/send-prepared-message", Test, NULL,
+		    setup_direct_connection,
+		    test_send_prepared_message,
+		    teardown_direct_connection);
+	g_test_add ("/websocket/soup/send-prepared-message", Test, NULL,
+		    setup_soup_connection,
+		    test_send_prepared_message,
+		    teardown_soup_connection);
+	g_test_add_func ("/websocket/prepared-message-invalid-utf8",
+			 test_prepared_message_invalid_utf8);
+
 	g_test_add ("/websocket/direct/send-big-packets", Test, NULL,
 		    setup_direct_connection,
 		    test_send_big_packets,
@@ -2228,6 +2552,19 @@ main (int argc,
 		    test_receive_fragmented,
 		    teardown_direct_connection);
 
+	g_test_add ("/websocket/direct/receive-fragmented-streaming", Test, NULL,
+		    setup_half_direct_connection,
+		    test_receive_fragmented_streaming,
+		    teardown_direct_connection);
+	g_test_add ("/websocket/direct/deflate-receive-fragmented-streaming", Test, NULL,
+		    setup_half_direct_connection_with_extensions,
+		    test_receive_fragmented_streaming,
+		    teardown_direct_connection);
+	g_test_add ("/websocket/direct/receive-split-utf8-streaming", Test, NULL,
+		    setup_half_direct_connection,
+		    test_receive_split_utf8_streaming,
+		    teardown_direct_connection);
+
 	g_test_add ("/websocket/direct/receive-invalid-encode-length-16", Test, NULL,
 		    setup_half_direct_connection,
 		    test_receive_invalid_encode_length_16,
@@ -2286,6 +2623,27 @@ main (int argc,
 		    test_send_server_to_client,
 		    teardown_soup_connection);
 
+	g_test_add ("/websocket/direct/deflate-send-prepared-message", Test, NULL,
+		    setup_direct_connection_with_extensions,
+		    test_send_prepared_message,
+		    teardown_direct_connection);
+	g_test_add ("/websocket/soup/deflate-send-prepared-message", Test, NULL,
+		    setup_soup_connection_with_extensions,
+		    test_send_prepared_message,
+		    teardown_soup_connection);
+	g_test_add ("/websocket/direct/deflate-no-context-takeover-send-prepared-message", Test, NULL,
+		    setup_direct_connection_with_no_context_takeover,
+		    test_send_prepared_message,
+		    teardown_direct_connection);
+	g_test_add ("/websocket/direct/deflate-compression-tuning", Test, NULL,
+		    setup_direct_connection_with_extensions,
+		    test_deflate_compression_tuning,
+		    teardown_direct_connection);
+	g_test_add ("/websocket/direct/deflate-no-context-takeover-compression-tuning", Test, NULL,
+		    setup_direct_connection_with_no_context_takeover,
+		    test_deflate_compression_tuning,
+		    teardown_direct_connection);
+
 	g_test_add ("/websocket/direct/deflate-send-big-packets", Test, NULL,
 		    setup_direct_connection_with_extensions,
 		    test_send_big_packets,
@@ -0,0 +1,351 @@
+/* zstd-decompressor-test.c
+ *
+ * Copyright 2026 The libsoup authors
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "test-utils.h"
+#include "soup-zstd-decompressor.h"
+#ifdef WITH_BROTLI
+#include "soup-brotli-decompressor.h"
+#endif
+
+static GBytes *
+load_data (const char *directory,
+           const char *name)
+{
+        char *filename = g_build_filename (g_test_get_dir (G_TEST_DIST), directory, name, NULL);
+        char *contents;
+        gsize length;
+
+        g_assert_true (g_file_get_contents (filename, &contents, &length, NULL));
+        g_free (filename);
+
+        return g_bytes_new_take (contents, length);
+}
+
+static GByteArray *
+decode_all (GConverter  *converter,
+            GBytes      *input,
+            gsize        out_buf_size,
+            GError     **error)
+{
+        GByteArray *out_bytes = g_byte_array_new ();
+        guint8 *out_buf = g_malloc (out_buf_size);
+        const guint8 *in_buf;
+        gsize length;
+        GConverterResult result;
+
+        in_buf = g_bytes_get_data (input, &length);
+
+        do {
+                gsize bytes_read, bytes_written;
+
+                result = g_converter_convert (converter, in_buf, length, out_buf, out_buf_size,
+                                              G_CONVERTER_INPUT_AT_END,
+                                              &bytes_read, &bytes_written, error);
+                g_byte_array_append (out_bytes, out_buf, bytes_written);
+                in_buf += bytes_read;
+                length -= bytes_read;
+        } while (result == G_CONVERTER_CONVERTED);
+
+        g_free (out_buf);
+
+        if (result == G_CONVERTER_ERROR) {
+                g_byte_array_free (out_bytes, TRUE);
+                return NULL;
+        }
+
+        g_assert_cmpint (result, ==, G_CONVERTER_FINISHED);
+        g_assert_cmpuint (length, ==, 0);
+
+        return out_bytes;
+}
+
+static void
+assert_decoded (GByteArray *out_bytes,
+                GBytes     *expected)
+{
+        g_assert_nonnull (out_bytes);
+        g_assert_cmpmem (out_bytes->data, out_bytes->len,
+                         g_bytes_get_data (expected, NULL), g_bytes_get_size (expected));
+}
+
+static void
+test_zstd (void)
+{
+        SoupZstdDecompressor *dec = soup_zstd_decompressor_new (NULL);
+        GBytes *compressed = load_data ("zstd-data", "compressed.zst");
+        GBytes *uncompressed = load_data ("zstd-data", "uncompressed.txt");
+        GByteArray *out_bytes;
+        GError *error = NULL;
+
+        /* This is stupidly small just to simulate common usage of converting in chunks */
+        out_bytes = decode_all (G_CONVERTER (dec), compressed, 16, &error);
+        g_assert_no_error (error);
+        assert_decoded (out_bytes, uncompressed);
+
+        g_byte_array_free (out_bytes, TRUE);
+        g_bytes_unref (compressed);
+        g_bytes_unref (uncompressed);
+        g_object_unref (dec);
+}
+
+static void
+test_zstd_corrupt (void)
+{
+        SoupZstdDecompressor *dec = soup_zstd_decompressor_new (NULL);
+        GBytes *compressed = load_data ("zstd-data", "corrupt.zst");
+        GByteArray *out_bytes;
+        GError *error = NULL;
+
+        out_bytes = decode_all (G_CONVERTER (dec), compressed, 4096, &error);
+        g_assert_null (out_bytes);
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+
+        g_error_free (error);
+        g_bytes_unref (compressed);
+        g_object_unref (dec);
+}
+
+static void
+test_zstd_not_compressed (void)
+{
+        SoupZstdDecompressor *dec = soup_zstd_decompressor_new (NULL);
+        GBytes *uncompressed = load_data ("zstd-data", "uncompressed.txt");
+        GByteArray *out_bytes;
+        GError *error = NULL;
+
+        /* SoupConverterWrapper relies on this error to pass the data through */
+        out_bytes = decode_all (G_CONVERTER (dec), uncompressed, 4096, &error);
+        g_assert_null (out_bytes);
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+
+        g_error_free (error);
+        g_bytes_unref (uncompressed);
+        g_object_unref (dec);
+}
+
+static void
+test_zstd_multiple_frames (void)
+{
+        SoupZstdDecompressor *dec = soup_zstd_decompressor_new (NULL);
+        GBytes *compressed = load_data ("zstd-data", "compressed.zst");
+        GBytes *uncompressed = load_data ("zstd-data", "uncompressed.txt");
+        GByteArray *input = g_byte_array_new ();
+        GByteArray *expected = g_byte_array_new ();
+        GBytes *input_bytes, *expected_bytes;
+        GByteArray *out_bytes;
+        GError *error = NULL;
+
+        g_byte_array_append (input, g_bytes_get_data (compressed, NULL), g_bytes_get_size (compressed));
+        g_byte_array_append (input, g_bytes_get_data (compressed, NULL), g_bytes_get_size (compressed));
+        input_bytes = g_byte_array_free_to_bytes (input);
+        g_byte_array_append (expected, g_bytes_get_data (uncompressed, NULL), g_bytes_get_size (uncompressed));
+        g_byte_array_append (expected, g_bytes_get_data (uncompressed, NULL), g_bytes_get_size (uncompressed));
+        expected_bytes = g_byte_array_free_to_bytes (expected);
+
+        out_bytes = decode_all (G_CONVERTER (dec), input_bytes, 4096, &error);
+        g_assert_no_error (error);
+        assert_decoded (out_bytes, expected_bytes);
+
+        g_byte_array_free (out_bytes, TRUE);
+        g_bytes_unref (input_bytes);
+        g_bytes_unref (expected_bytes);
+        g_bytes_unref (compressed);
+        g_bytes_unref (uncompressed);
+        g_object_unref (dec);
+}
+
+static void
+test_zstd_dictionary (void)
+{
+        GBytes *dictionary = load_data ("zstd-data", "dictionary");
+        GBytes *compressed = load_data ("zstd-data", "compressed-dictionary.zst");
+        GBytes *uncompressed = load_data ("zstd-data", "uncompressed.txt");
+        SoupZstdDecompressor *dec;
+        GByteArray *out_bytes;
+        GError *error = NULL;
+
+        dec = soup_zstd_decompressor_new (NULL);
+        out_bytes = decode_all (G_CONVERTER (dec), compressed, 4096, &error);
+        g_assert_null (out_bytes);
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+        g_clear_error (&error);
+        g_object_unref (dec);
+
+        dec = soup_zstd_decompressor_new (dictionary);
+        out_bytes = decode_all (G_CONVERTER (dec), compressed, 4096, &error);
+        g_assert_no_error (error);
+        assert_decoded (out_bytes, uncompressed);
+        g_byte_array_free (out_bytes, TRUE);
+
+        /* The dictionary is kept across resets */
+        g_converter_reset (G_CONVERTER (dec));
+        out_bytes = decode_all (G_CONVERTER (dec), compressed, 4096, &error);
+        g_assert_no_error (error);
+        assert_decoded (out_bytes, uncompressed);
+        g_byte_array_free (out_bytes, TRUE);
+        g_object_unref (dec);
+
+        g_bytes_unref (dictionary);
+        g_bytes_unref (compressed);
+        g_bytes_unref (uncompressed);
+}
+
+static void
+test_zstd_reset (void)
+{
+        SoupZstdDecompressor *dec = soup_zstd_decompressor_new (NULL);
+        char *compressed_filename = g_build_filename (g_test_get_dir (G_TEST_DIST), "zstd-data", "compressed.zst", NULL);
+        char *contents;
+        gsize length, in_len;
+        char *in_buf;
+        GConverterResult result;
+        int iterations = 0;
+
+        g_assert_true (g_file_get_contents (compressed_filename, &contents, &length, NULL));
+        in_buf = contents;
+        in_len = length;
+
+        do {
+                GError *error = NULL;
+                guint8 out_buf[16];
+                gsize bytes_read, bytes_written;
+                result = g_converter_convert (G_CONVERTER (dec), in_buf, in_len, out_buf, sizeof out_buf,
+                                              G_CONVERTER_INPUT_AT_END,
+                                              &bytes_read, &bytes_written, &error);
+
+                /* Just randomly reset in the middle and ensure everything keeps working */
+                if (iterations == 6) {
+                        g_converter_reset (G_CONVERTER (dec));
+                        in_buf = contents;
+                        in_len = length;
+                        bytes_read = 0;
+                }
+
+                g_assert_no_error (error);
+                g_assert_cmpint (result, !=, G_CONVERTER_ERROR);
+                in_buf += bytes_read;
+                in_len -= bytes_read;
+                ++iterations;
+        } while (result == G_CONVERTER_CONVERTED);
+
+        g_assert_cmpint (result, ==, G_CONVERTER_FINISHED);
+
+        g_object_unref (dec);
+        g_free (compressed_filename);
+        g_free (contents);
+}
+
+/* Decode throughput of the codings SoupContentDecoder supports, all
+ * compressing the same corpus. Only run in perf mode (-m perf).
+ */
+#define BENCHMARK_DECODED_SIZE (64 * 1024 * 1024)
+
+static void
+benchmark_one (const char *name,
+               GConverter *converter,
+               GBytes     *compressed,
+               GBytes     *uncompressed)
+{
+        gsize decoded = 0;
+        double elapsed;
+
+        g_test_timer_start ();
+        while (decoded < BENCHMARK_DECODED_SIZE) {
+                GByteArray *out_bytes;
+                GError *error = NULL;
+
+                out_bytes = decode_all (converter, compressed, 64 * 1024, &error);
+                g_assert_no_error (error);
+                g_assert_cmpuint (out_bytes->len, ==, g_bytes_get_size (uncompressed));
+                decoded += out_bytes->len;
+                g_byte_array_free (out_bytes, TRUE);
+                g_converter_reset (converter);
+        }
+        elapsed = g_test_timer_elapsed ();
+
+        g_test_maximized_result (decoded / elapsed / (1024 * 1024),
+                                 "%s: decoded %" G_GSIZE_FORMAT " bytes (ratio %.2f) at %.1f MB/s",
+                                 name, decoded,
+                                 (double)g_bytes_get_size (uncompressed) / g_bytes_get_size (compressed),
+                                 decoded / elapsed / (1024 * 1024));
+}
+
+static GBytes *
+gzip_compress (GBytes *uncompressed)
+{
+        GConverter *compressor = (GConverter *)g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, 9);
+        GByteArray *out_bytes = decode_all (compressor, uncompressed, 4096, NULL);
+
+        g_object_unref (compressor);
+
+        return g_byte_array_free_to_bytes (out_bytes);
+}
+
+static void
+test_zstd_benchmark (void)
+{
+        GBytes *uncompressed = load_data ("zstd-data", "uncompressed.txt");
+        GBytes *compressed;
+        GConverter *converter;
+
+        compressed = gzip_compress (uncompressed);
+        converter = (GConverter *)g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+        benchmark_one ("gzip", converter, compressed, uncompressed);
+        g_object_unref (converter);
+        g_bytes_unref (compressed);
+
+#ifdef WITH_BROTLI
+        /* brotli-data/compressed.br is the same corpus */
+        compressed = load_data ("brotli-data", "compressed.br");
+        converter = (GConverter *)soup_brotli_decompressor_new ();
+        benchmark_one ("br", converter, compressed, uncompressed);
+        g_object_unref (converter);
+        g_bytes_unref (compressed);
+#endif
+
+        compressed = load_data ("zstd-data", "compressed.zst");
+        converter = (GConverter *)soup_zstd_decompressor_new (NULL);
+        benchmark_one ("zstd", converter, compressed, uncompressed);
+        g_object_unref (converter);
+        g_bytes_unref (compressed);
+
+        g_bytes_unref (uncompressed);
+}
+
+int
+main (int argc, char **argv)
+{
+	int ret;
+
+	test_init (argc, argv, NULL);
+
+        g_test_add_func ("/zstd/basic", test_zstd);
+        g_test_add_func ("/zstd/corrupt", test_zstd_corrupt);
+        g_test_add_func ("/zstd/not-compressed", test_zstd_not_compressed);
+        g_test_add_func ("/zstd/multiple-frames", test_zstd_multiple_frames);
+        g_test_add_func ("/zstd/dictionary", test_zstd_dictionary);
+        g_test_add_func ("/zstd/reset", test_zstd_reset);
+        if (g_test_perf ())
+                g_test_add_func ("/zstd/benchmark", test_zstd_benchmark);
+
+	ret = g_test_run ();
+	test_cleanup ();
+	return ret;
+}